@@ -53,27 +53,55 @@
 
 /* TAKE CARE: Tokens != Labels */
 
-/* Tokens used by the RDF world */
-static const char* const librdf_concept_tokens[LIBRDF_CONCEPT_LAST+1]={
+#define LIBRDF_CONCEPT_MS_NS "http://www.w3.org/1999/02/22-rdf-syntax-ns#"
+#define LIBRDF_CONCEPT_S_NS "http://www.w3.org/2000/01/rdf-schema#"
+
+/* Token plus the full URI string built at compile time */
+typedef struct {
+  const char* token;
+  const char* uri_string;
+  size_t uri_string_len;
+} librdf_concept_info;
+
+#define LIBRDF_CONCEPT_MS(token) \
+  { token, LIBRDF_CONCEPT_MS_NS token, sizeof(LIBRDF_CONCEPT_MS_NS token) - 1 }
+#define LIBRDF_CONCEPT_S(token) \
+  { token, LIBRDF_CONCEPT_S_NS token, sizeof(LIBRDF_CONCEPT_S_NS token) - 1 }
+
+/* Concepts used by the RDF world, indexed by #librdf_concepts_index */
+static const librdf_concept_info librdf_concepts[LIBRDF_CONCEPT_LAST+1]={
   /* RDF M&S */
-  "Alt", "Bag", "Property", "Seq", "Statement", "object", "predicate", "subject", "type", "value", "li",
-  "RDF", "Description",
-  "aboutEach", "aboutEachPrefix",
+  LIBRDF_CONCEPT_MS("Alt"), LIBRDF_CONCEPT_MS("Bag"),
+  LIBRDF_CONCEPT_MS("Property"), LIBRDF_CONCEPT_MS("Seq"),
+  LIBRDF_CONCEPT_MS("Statement"), LIBRDF_CONCEPT_MS("object"),
+  LIBRDF_CONCEPT_MS("predicate"), LIBRDF_CONCEPT_MS("subject"),
+  LIBRDF_CONCEPT_MS("type"), LIBRDF_CONCEPT_MS("value"),
+  LIBRDF_CONCEPT_MS("li"),
+  LIBRDF_CONCEPT_MS("RDF"), LIBRDF_CONCEPT_MS("Description"),
+  LIBRDF_CONCEPT_MS("aboutEach"), LIBRDF_CONCEPT_MS("aboutEachPrefix"),
   /* all new in RDF/XML revised */
-  "nodeID",
-  "List", "first", "rest", "nil", 
-  "XMLLiteral",
+  LIBRDF_CONCEPT_MS("nodeID"),
+  LIBRDF_CONCEPT_MS("List"), LIBRDF_CONCEPT_MS("first"),
+  LIBRDF_CONCEPT_MS("rest"), LIBRDF_CONCEPT_MS("nil"), 
+  LIBRDF_CONCEPT_MS("XMLLiteral"),
 
   /* RDF S */
-  "Class", "ConstraintProperty", "ConstraintResource", "Container", "ContainerMembershipProperty", "Literal", "Resource", "comment", "domain", "isDefinedBy", "label", "range", "seeAlso", "subClassOf", "subPropertyOf",
+  LIBRDF_CONCEPT_S("Class"), LIBRDF_CONCEPT_S("ConstraintProperty"),
+  LIBRDF_CONCEPT_S("ConstraintResource"), LIBRDF_CONCEPT_S("Container"),
+  LIBRDF_CONCEPT_S("ContainerMembershipProperty"),
+  LIBRDF_CONCEPT_S("Literal"), LIBRDF_CONCEPT_S("Resource"),
+  LIBRDF_CONCEPT_S("comment"), LIBRDF_CONCEPT_S("domain"),
+  LIBRDF_CONCEPT_S("isDefinedBy"), LIBRDF_CONCEPT_S("label"),
+  LIBRDF_CONCEPT_S("range"), LIBRDF_CONCEPT_S("seeAlso"),
+  LIBRDF_CONCEPT_S("subClassOf"), LIBRDF_CONCEPT_S("subPropertyOf"),
 
   /* RDF 1.1 */
-  "HTML", "langString"
+  LIBRDF_CONCEPT_MS("HTML"), LIBRDF_CONCEPT_MS("langString")
 };
 
 
-static const unsigned char * const librdf_concept_ms_namespace=(const unsigned char *)"http://www.w3.org/1999/02/22-rdf-syntax-ns#";
-static const unsigned char * const librdf_concept_schema_namespace=(const unsigned char *)"http://www.w3.org/2000/01/rdf-schema#";
+static const unsigned char * const librdf_concept_ms_namespace=(const unsigned char *)LIBRDF_CONCEPT_MS_NS;
+static const unsigned char * const librdf_concept_schema_namespace=(const unsigned char *)LIBRDF_CONCEPT_S_NS;
 
 /**
  * librdf_init_concepts:
@@ -81,12 +109,14 @@ static const unsigned char * const librdf_concept_schema_namespace=(const unsign
  *
  * INTERNAL - Initialise the concepts module.
  * 
+ * Only the namespace URIs are created here.  The concept nodes and
+ * URIs are made from the static table the first time each one is
+ * asked for, so opening a world does not pay for concepts that are
+ * never used.
  **/
 void
 librdf_init_concepts(librdf_world *world)
 {
-  int i;
-
   /* Create the Unique URI objects */
   world->concept_ms_namespace_uri = librdf_new_uri(world, librdf_concept_ms_namespace);
   world->concept_schema_namespace_uri = librdf_new_uri(world, librdf_concept_schema_namespace);
@@ -103,21 +133,63 @@ librdf_init_concepts(librdf_world *world)
                                            sizeof(librdf_node*));
   if(!world->concept_uris || !world->concept_resources)
     LIBRDF_FATAL1(world, LIBRDF_FROM_CONCEPTS, "Out of memory creating node/uri arrays");
+}
 
-  /* Create the M&S and Schema resource nodes */
-  for (i = 0; i <= LIBRDF_CONCEPT_LAST; i++) {
-    librdf_uri* ns_uri = (LIBRDF_CONCEPT_FIRST_S_ID <= i &&
-                          i <= LIBRDF_CONCEPT_LAST_S_ID) ?
-      world->concept_schema_namespace_uri : world->concept_ms_namespace_uri;
-    const unsigned char * token = (const unsigned char *)librdf_concept_tokens[i];
 
-    world->concept_resources[i] = librdf_new_node_from_uri_local_name(world, ns_uri, token);
-    if(!world->concept_resources[i])
-      LIBRDF_FATAL1(world, LIBRDF_FROM_CONCEPTS, "Failed to create Node from URI\n");
+/*
+ * librdf_concept_get_resource:
+ * @world: redland world object
+ * @idx: concept index
+ *
+ * INTERNAL - Get the node for a concept, creating it on first use
+ *
+ * Worlds made by librdf_new_world_from_world() share the concepts
+ * of their template world.
+ *
+ * Return value: shared #librdf_node or NULL on failure
+ */
+static librdf_node*
+librdf_concept_get_resource(librdf_world *world, int idx)
+{
+  librdf_node* node;
+
+  librdf_world_open(world);
+
+  if(world->template_world)
+    world = world->template_world;
 
-    /* keep shared copy of URI from node */
-    world->concept_uris[i] = librdf_node_get_uri(world->concept_resources[i]);
+  node = world->concept_resources[idx];
+  if(node)
+    return node;
+
+#ifdef WITH_THREADS
+  pthread_mutex_lock(world->mutex);
+#endif
+
+  /* check again now locked */
+  node = world->concept_resources[idx];
+  if(!node) {
+    const librdf_concept_info* info = &librdf_concepts[idx];
+
+    node = librdf_new_node_from_counted_uri_string(world,
+             (const unsigned char*)info->uri_string, info->uri_string_len);
+    if(node) {
+      /* keep shared copy of URI from node */
+      world->concept_uris[idx] = librdf_node_get_uri(node);
+      world->concept_resources[idx] = node;
+    }
   }
+
+#ifdef WITH_THREADS
+  pthread_mutex_unlock(world->mutex);
+#endif
+
+  if(!node)
+    librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_CONCEPTS, NULL,
+               "Failed to create Node from URI %s",
+               librdf_concepts[idx].uri_string);
+
+  return node;
 }
 
 
@@ -179,14 +251,17 @@ librdf_get_concept_by_name(librdf_world *world, int is_ms,
   for (i=0; i < LIBRDF_CONCEPT_LAST; i++) {
     int this_is_ms = !(LIBRDF_CONCEPT_FIRST_S_ID <= i && 
                        i <= LIBRDF_CONCEPT_LAST_S_ID);
+    librdf_node* node;
+
     if(this_is_ms != is_ms)
       continue;
 
-    if(!strcmp(librdf_concept_tokens[i], name)) {
+    if(!strcmp(librdf_concepts[i].token, name)) {
+      node = librdf_concept_get_resource(world, i);
       if(uri_p)
-        *uri_p=world->concept_uris[i];
+        *uri_p = node ? librdf_node_get_uri(node) : NULL;
       if(node_p)
-        *node_p=world->concept_resources[i];
+        *node_p = node;
     }
   }
 }
@@ -205,12 +280,10 @@ librdf_node*
 librdf_get_concept_resource_by_index(librdf_world *world,
                                      librdf_concepts_index idx)
 {
-  librdf_world_open(world);
-
   if ((int)idx < 0 || idx > LIBRDF_CONCEPT_LAST)
     return NULL;
 
-  return world->concept_resources[idx];
+  return librdf_concept_get_resource(world, (int)idx);
 }
 
 
@@ -227,12 +300,13 @@ librdf_uri*
 librdf_get_concept_uri_by_index(librdf_world *world,
                                 librdf_concepts_index idx)
 {
-  librdf_world_open(world);
+  librdf_node* node;
 
   if ((int)idx < 0 || idx > LIBRDF_CONCEPT_LAST)
     return NULL;
 
-  return world->concept_uris[idx];
+  node = librdf_concept_get_resource(world, (int)idx);
+  return node ? librdf_node_get_uri(node) : NULL;
 }
 
 
@@ -327,6 +401,19 @@ main(int argc, char *argv[])
     exit(1);
   }
 
+  if(librdf_get_concept_resource_by_index(world, LIBRDF_CONCEPT_LAST) != node) {
+    fprintf(stderr, "%s: Got a different node for the last concept\n", program);
+    exit(1);
+  }
+
+  uri = NULL;
+  node = NULL;
+  librdf_get_concept_by_name(world, 0, "subClassOf", &uri, &node);
+  if(!uri || !node || node != LIBRDF_S_subClassOf(world)) {
+    fprintf(stderr, "%s: Got no concept for rdfs:subClassOf by name\n", program);
+    exit(1);
+  }
+
   librdf_free_world(world);
 
   /* keep gcc -Wall happy */
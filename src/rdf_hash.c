@@ -565,6 +565,9 @@ librdf_hash_open(librdf_hash* hash, const char *identifier,
   int status;
 
   if(identifier) {
+    /* a cloned hash already has one */
+    if(hash->identifier)
+      LIBRDF_FREE(char*, hash->identifier);
     hash->identifier = LIBRDF_MALLOC(char*, strlen(identifier) + 1);
     if(!hash->identifier)
       return 1;
@@ -1877,6 +1880,423 @@ librdf_hash_interpret_template(const unsigned char* template_string,
 int main(int argc, char *argv[]);
 
 
+/* Test a key/value pair of strings and report a mismatch */
+static int
+hash_test_check(const char *program, const char *label, librdf_hash *h,
+                const char *key, const char *value, int expected)
+{
+  librdf_hash_datum hd_key, hd_value; /* on stack */
+  int found;
+
+  hd_key.data=(char*)key;
+  hd_key.size=strlen(key);
+  hd_value.data=(char*)value;
+  hd_value.size=strlen(value);
+  found=(librdf_hash_exists(h, &hd_key, &hd_value) > 0);
+  if(found != expected) {
+    fprintf(stderr, "%s: %s hash %s %s=%s\n", program, label,
+            found ? "unexpectedly has" : "is missing", key, value);
+    return 1;
+  }
+
+  return 0;
+}
+
+
+static int
+hash_test_delete(librdf_hash *h, const char *key, const char *value)
+{
+  librdf_hash_datum hd_key, hd_value; /* on stack */
+
+  hd_key.data=(char*)key;
+  hd_key.size=strlen(key);
+  hd_value.data=(char*)value;
+  hd_value.size=strlen(value);
+  return librdf_hash_delete(h, &hd_key, &hd_value);
+}
+
+
+static int
+hash_test_values_count(const char *program, const char *label,
+                       librdf_hash *h, int expected)
+{
+  int count=librdf_hash_values_count(h);
+
+  if(count != expected) {
+    fprintf(stderr, "%s: %s hash has %d values, expected %d\n",
+            program, label, count, expected);
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/* Change a memory hash and its copy-on-write clone independently,
+ * with more values for one key than the value index threshold, then
+ * clone enough times to need the layers flattening
+ */
+static int
+hash_test_clone_changes(librdf_world *world, const char *program)
+{
+  librdf_hash *h, *ch, *next;
+  char value[16];
+  int i;
+  int status=0;
+
+  fprintf(stdout, "%s: Testing changes to a cloned memory hash\n", program);
+
+  h=librdf_new_hash(world, "memory");
+  if(!h || librdf_hash_open(h, NULL, 0644, 1, 1, NULL)) {
+    fprintf(stderr, "%s: Failed to create memory hash\n", program);
+    if(h)
+      librdf_free_hash(h);
+    return 1;
+  }
+
+  for(i=0; i < 40; i++) {
+    sprintf(value, "v%d", i);
+    librdf_hash_put_strings(h, "k", value);
+  }
+  librdf_hash_put_strings(h, "other", "x");
+
+  ch=librdf_new_hash_from_hash(h);
+  if(!ch) {
+    fprintf(stderr, "%s: Failed to clone memory hash\n", program);
+    librdf_free_hash(h);
+    return 1;
+  }
+
+  hash_test_delete(h, "k", "v5");
+  librdf_hash_put_strings(h, "k", "v40");
+  hash_test_delete(ch, "k", "v6");
+  librdf_hash_put_strings(ch, "k", "v41");
+  hash_test_delete(ch, "other", "x");
+
+  status|=hash_test_check(program, "original", h, "k", "v5", 0);
+  status|=hash_test_check(program, "original", h, "k", "v6", 1);
+  status|=hash_test_check(program, "original", h, "k", "v40", 1);
+  status|=hash_test_check(program, "original", h, "k", "v41", 0);
+  status|=hash_test_check(program, "original", h, "other", "x", 1);
+  status|=hash_test_values_count(program, "original", h, 41);
+
+  status|=hash_test_check(program, "cloned", ch, "k", "v5", 1);
+  status|=hash_test_check(program, "cloned", ch, "k", "v6", 0);
+  status|=hash_test_check(program, "cloned", ch, "k", "v40", 0);
+  status|=hash_test_check(program, "cloned", ch, "k", "v41", 1);
+  status|=hash_test_check(program, "cloned", ch, "other", "x", 0);
+  status|=hash_test_values_count(program, "cloned", ch, 40);
+
+  librdf_free_hash(h);
+
+  /* each clone of a changed hash adds a layer until they are flattened */
+  for(i=0; i < 8; i++) {
+    next=librdf_new_hash_from_hash(ch);
+    if(!next) {
+      fprintf(stderr, "%s: Failed to clone memory hash\n", program);
+      status=1;
+      break;
+    }
+    librdf_free_hash(ch);
+    ch=next;
+    sprintf(value, "layer%d", i);
+    librdf_hash_put_strings(ch, "k", value);
+  }
+
+  status|=hash_test_check(program, "recloned", ch, "k", "v41", 1);
+  status|=hash_test_check(program, "recloned", ch, "k", "v6", 0);
+  status|=hash_test_check(program, "recloned", ch, "k", "layer0", 1);
+  status|=hash_test_check(program, "recloned", ch, "k", "layer7", 1);
+  status|=hash_test_values_count(program, "recloned", ch, 40 + i);
+
+  librdf_free_hash(ch);
+
+  return status;
+}
+
+
+
+/* Replace every key of a memory hash while iterating over it, growing
+ * the hash meanwhile, and check each original key is seen once
+ */
+static int
+hash_test_replace_while_iterating(librdf_world *world, const char *program)
+{
+#define HASH_TEST_REPLACE_KEYS 48
+  librdf_hash *h;
+  librdf_hash_datum *key, *value;
+  librdf_iterator *iterator;
+  int seen[HASH_TEST_REPLACE_KEYS];
+  char string[16];
+  char new_key[16];
+  int replaced=0;
+  int i;
+  int status=0;
+
+  fprintf(stdout, "%s: Testing replacing memory hash keys while iterating\n",
+          program);
+
+  h=librdf_new_hash(world, "memory");
+  if(!h || librdf_hash_open(h, NULL, 0644, 1, 1, NULL)) {
+    fprintf(stderr, "%s: Failed to create memory hash\n", program);
+    if(h)
+      librdf_free_hash(h);
+    return 1;
+  }
+
+  for(i=0; i < HASH_TEST_REPLACE_KEYS; i++) {
+    sprintf(string, "old%d", i);
+    librdf_hash_put_strings(h, string, "x");
+    seen[i]=0;
+  }
+
+  key=librdf_new_hash_datum(world, NULL, 0);
+  value=librdf_new_hash_datum(world, NULL, 0);
+
+  /* the added keys make the hash grow while the cursor is open */
+  iterator=librdf_hash_get_all(h, key, value);
+  while(iterator && !librdf_iterator_end(iterator)) {
+    librdf_hash_datum* k=(librdf_hash_datum*)librdf_iterator_get_key(iterator);
+
+    if(k->size < sizeof(string) && !strncmp((char*)k->data, "old", 3)) {
+      memcpy(string, k->data, k->size);
+      string[k->size]='\0';
+      i=atoi(string + 3);
+      if(i >= 0 && i < HASH_TEST_REPLACE_KEYS)
+        seen[i]++;
+
+      /* add first so the first replacement grows the hash */
+      sprintf(new_key, "new%d", replaced++);
+      librdf_hash_put_strings(h, new_key, "x");
+      hash_test_delete(h, string, "x");
+    }
+    librdf_iterator_next(iterator);
+  }
+  if(iterator)
+    librdf_free_iterator(iterator);
+
+  librdf_free_hash_datum(value);
+  librdf_free_hash_datum(key);
+
+  for(i=0; i < HASH_TEST_REPLACE_KEYS; i++) {
+    if(seen[i] != 1) {
+      fprintf(stderr, "%s: key old%d returned %d times, expected once\n",
+              program, i, seen[i]);
+      status=1;
+    }
+  }
+  status|=hash_test_values_count(program, "replaced", h,
+                                 HASH_TEST_REPLACE_KEYS);
+  status|=hash_test_check(program, "replaced", h, "old0", "x", 0);
+  status|=hash_test_check(program, "replaced", h, "new47", "x", 1);
+
+  librdf_free_hash(h);
+
+  return status;
+}
+
+
+/* Clone and sync a layered memory hash while a cursor is open on it
+ * and check the cursor still returns every pair once
+ */
+static int
+hash_test_clone_with_cursor(librdf_world *world, const char *program)
+{
+#define HASH_TEST_CURSOR_NAME "rdf_hash_test_cursor"
+  librdf_hash *h, *ch0, *ch=NULL;
+  librdf_hash *options;
+  librdf_hash_datum *key, *value;
+  librdf_iterator *iterator;
+  char string[16];
+  int count;
+  int i;
+  int status=0;
+
+  fprintf(stdout, "%s: Testing cloning and syncing a memory hash being read\n",
+          program);
+
+  options=librdf_new_hash(world, NULL);
+  if(!options)
+    return 1;
+  librdf_hash_from_string(options, "snapshot='yes'");
+
+  h=librdf_new_hash(world, "memory");
+  if(!h || librdf_hash_open(h, HASH_TEST_CURSOR_NAME, 0644, 1, 1, options)) {
+    fprintf(stderr, "%s: Failed to open memory hash snapshot\n", program);
+    if(h)
+      librdf_free_hash(h);
+    librdf_free_hash(options);
+    return 1;
+  }
+  librdf_free_hash(options);
+
+  for(i=0; i < 20; i++) {
+    sprintf(string, "k%d", i);
+    librdf_hash_put_strings(h, string, "x");
+  }
+
+  /* the original now sits on a base layer with a change over it */
+  ch0=librdf_new_hash_from_hash(h);
+  librdf_hash_put_strings(h, "k20", "x");
+
+  key=librdf_new_hash_datum(world, NULL, 0);
+  value=librdf_new_hash_datum(world, NULL, 0);
+
+  iterator=librdf_hash_get_all(h, key, value);
+  for(count=0; iterator && !librdf_iterator_end(iterator);
+      librdf_iterator_next(iterator)) {
+    if(++count != 5)
+      continue;
+
+    ch=librdf_new_hash_from_hash(h);
+    if(!ch) {
+      fprintf(stderr, "%s: Failed to clone memory hash being read\n", program);
+      status=1;
+    } else {
+      status|=hash_test_check(program, "cloned while read", ch, "k0", "x", 1);
+      status|=hash_test_check(program, "cloned while read", ch, "k20", "x", 1);
+      status|=hash_test_values_count(program, "cloned while read", ch, 21);
+    }
+
+    if(!librdf_hash_sync(h)) {
+      fprintf(stderr, "%s: memory hash layers were flattened while being read\n",
+              program);
+      status=1;
+    }
+  }
+  if(iterator)
+    librdf_free_iterator(iterator);
+
+  librdf_free_hash_datum(value);
+  librdf_free_hash_datum(key);
+
+  if(count != 21) {
+    fprintf(stderr, "%s: cursor returned %d pairs, expected 21\n",
+            program, count);
+    status=1;
+  }
+
+  if(librdf_hash_sync(h)) {
+    fprintf(stderr, "%s: Failed to sync memory hash after reading\n", program);
+    status=1;
+  }
+
+  if(ch)
+    librdf_free_hash(ch);
+  if(ch0)
+    librdf_free_hash(ch0);
+  librdf_free_hash(h);
+  remove(HASH_TEST_CURSOR_NAME ".snapshot");
+
+  return status;
+}
+
+
+/* Write a memory hash snapshot, reopen it read-only and writable,
+ * check the contents and delete every pair while iterating
+ */
+static int
+hash_test_snapshot(librdf_world *world, const char *program)
+{
+#define HASH_TEST_SNAPSHOT_NAME "rdf_hash_test_snapshot"
+  librdf_hash *h;
+  librdf_hash *options;
+  librdf_hash_datum *key, *value;
+  librdf_iterator *iterator;
+  char string[16];
+  int pass;
+  int count;
+  int i;
+  int status=0;
+
+  fprintf(stdout, "%s: Testing memory hash snapshots\n", program);
+
+  options=librdf_new_hash(world, NULL);
+  if(!options)
+    return 1;
+  librdf_hash_from_string(options, "snapshot='yes'");
+
+  /* write, reopen read-only then reopen writable */
+  for(pass=0; pass < 3; pass++) {
+    h=librdf_new_hash(world, "memory");
+    if(!h || librdf_hash_open(h, HASH_TEST_SNAPSHOT_NAME, 0644,
+                              (pass != 1), (pass == 0), options)) {
+      fprintf(stderr, "%s: Failed to open memory hash snapshot\n", program);
+      if(h)
+        librdf_free_hash(h);
+      status=1;
+      break;
+    }
+
+    if(!pass) {
+      for(i=0; i < 40; i++) {
+        char number[8];
+
+        sprintf(string, "k%d", i % 10);
+        sprintf(number, "%d", i);
+        librdf_hash_put_strings(h, string, number);
+        sprintf(string, "v%d", i);
+        librdf_hash_put_strings(h, "k0", string);
+      }
+      /* written on close */
+      librdf_free_hash(h);
+      continue;
+    }
+
+    status|=hash_test_values_count(program, "snapshot", h, 80);
+    status|=hash_test_check(program, "snapshot", h, "k3", "3", 1);
+    status|=hash_test_check(program, "snapshot", h, "k3", "4", 0);
+    status|=hash_test_check(program, "snapshot", h, "k0", "v39", 1);
+
+    key=librdf_new_hash_datum(world, NULL, 0);
+    value=librdf_new_hash_datum(world, NULL, 0);
+
+    /* deleting is refused while reading a read-only snapshot */
+    count=0;
+    iterator=librdf_hash_get_all(h, key, value);
+    while(iterator && !librdf_iterator_end(iterator)) {
+      librdf_hash_datum* k=(librdf_hash_datum*)librdf_iterator_get_key(iterator);
+      librdf_hash_datum* v=(librdf_hash_datum*)librdf_iterator_get_value(iterator);
+      librdf_hash_datum k_copy, v_copy; /* on stack */
+      char key_string[16];
+      char value_string[16];
+
+      if(k->size < sizeof(key_string) && v->size < sizeof(value_string)) {
+        memcpy(key_string, k->data, k->size);
+        memcpy(value_string, v->data, v->size);
+        k_copy.data=key_string;
+        k_copy.size=k->size;
+        v_copy.data=value_string;
+        v_copy.size=v->size;
+        if(!librdf_hash_delete(h, &k_copy, &v_copy))
+          count++;
+      }
+      librdf_iterator_next(iterator);
+    }
+    if(iterator)
+      librdf_free_iterator(iterator);
+
+    librdf_free_hash_datum(value);
+    librdf_free_hash_datum(key);
+
+    if(count != (pass == 1 ? 0 : 80)) {
+      fprintf(stderr, "%s: deleted %d snapshot pairs while iterating, expected %d\n",
+              program, count, (pass == 1 ? 0 : 80));
+      status=1;
+    }
+    status|=hash_test_values_count(program, "snapshot", h,
+                                   (pass == 1 ? 80 : 0));
+
+    librdf_free_hash(h);
+  }
+
+  librdf_free_hash(options);
+  remove(HASH_TEST_SNAPSHOT_NAME ".snapshot");
+
+  return status;
+}
+
+
 int
 main(int argc, char *argv[]) 
 {
@@ -2003,6 +2423,18 @@ main(int argc, char *argv[])
     fprintf(stdout, "%s: Freeing hash\n", program);
     librdf_free_hash(h);
   }
+  if(hash_test_clone_changes(world, program))
+    return(1);
+
+  if(hash_test_replace_while_iterating(world, program))
+    return(1);
+
+  if(hash_test_snapshot(world, program))
+    return(1);
+
+  if(hash_test_clone_with_cursor(world, program))
+    return(1);
+
   fprintf(stdout, "%s: Getting default hash factory\n", program);
   h2=librdf_new_hash(world, NULL);
   if(!h2) {
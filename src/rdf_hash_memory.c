@@ -39,6 +39,22 @@
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
 #endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <sys/mman.h>
+#define LIBRDF_HASH_MEMORY_USE_MMAP 1
+#endif
 
 #include <redland.h>
 #include <rdf_types.h>
@@ -48,6 +64,7 @@
 struct librdf_hash_memory_node_value_s
 {
   struct librdf_hash_memory_node_value_s* next;
+  struct librdf_hash_memory_node_value_s* prev;
   void *value;
   size_t value_len;
 };
@@ -62,14 +79,22 @@ struct librdf_hash_memory_node_s
   u32 hash_key;
   librdf_hash_memory_node_value *values;
   int values_count;
+  /* Open addressed table of the values (linear probing) once there
+   * are librdf_hash_value_index_threshold or more, else NULL.
+   * value_index_capacity is a power of 2.
+   */
+  librdf_hash_memory_node_value **value_index;
+  int value_index_capacity;
 };
 typedef struct librdf_hash_memory_node_s librdf_hash_memory_node;
 
 
-typedef struct
+typedef struct librdf_hash_memory_context_s
 {
-  /* the hash object */
+  /* the hash object, NULL for a frozen base or deleted pairs */
   librdf_hash* hash;
+  /* world of the hash, kept in every layer for logging */
+  librdf_world* world;
   /* An array pointing to a list of nodes (buckets) */
   librdf_hash_memory_node** nodes;
   /* this many buckets used */
@@ -81,14 +106,113 @@ typedef struct
   /* total array size */
   int capacity;
 
+  /* While growing, the previous array whose buckets are still being
+   * moved into nodes a few at a time, or NULL.  Keys live in exactly
+   * one of the two arrays so lookups check both.
+   */
+  librdf_hash_memory_node** old_nodes;
+  int old_capacity;
+  /* next bucket of old_nodes to move */
+  int rehash_bucket;
+  /* cursors open on the hash.  Their positions index the old array
+   * followed by the current one, so no buckets are moved while there
+   * are any.
+   */
+  int cursors;
+
   /* array load factor expressed out of 1000.
    * Always true: (size/capacity * 1000) < load_factor,
    * or in the code: size * 1000 < load_factor * capacity
    */
   int load_factor;
+
+  /* Snapshot file support, when opened with an identifier and the
+   * boolean option 'snapshot'.  The hash is written to the snapshot
+   * file on sync or close if it changed.
+   */
+  char *snapshot_name;
+  int is_writable;
+  int dirty;
+
+  /* Snapshot image opened read-only and used directly for lookups
+   * until the first change loads it into nodes, or NULL.
+   */
+  unsigned char *image;
+  size_t image_size;
+  int image_mapped;
+
+  /* Copy-on-write clones.  base is the frozen contents shared with
+   * the hash this was cloned from, or NULL; nodes then hold only the
+   * key/value pairs added since and deleted the pairs of base that
+   * were deleted since.  values counts all the visible pairs.
+   */
+  struct librdf_hash_memory_context_s* base;
+  struct librdf_hash_memory_context_s* deleted;
+  /* hashes sharing this one as their base */
+  int usage;
 } librdf_hash_memory_context;
 
 
+typedef struct librdf_hash_memory_cursor_context_s {
+  librdf_hash_memory_context* hash;
+  int current_bucket;
+  librdf_hash_memory_node* current_node;
+  librdf_hash_memory_node_value *current_value;
+  /* when reading a snapshot image: record offset (or 0) and value */
+  size_t image_record;
+  u32 image_value;
+  /* when the hash has a base: a cursor over the base, which is read
+   * first (in_nodes 0) before the nodes, and a copy of the key from
+   * LIBRDF_HASH_CURSOR_SET for moving on to the nodes
+   */
+  struct librdf_hash_memory_cursor_context_s* base_cursor;
+  int in_nodes;
+  librdf_hash_datum set_key;
+  /* counted in the hash cursors by librdf_hash_memory_cursor_init() */
+  int is_counted;
+} librdf_hash_memory_cursor_context;
+
+
+/*
+ * Snapshot image layout, all in the byte order of the writer:
+ *   librdf_hash_memory_snapshot_header
+ *   u64 offsets[capacity + 1]; the records of bucket b are in
+ *     [offsets[b], offsets[b+1]) so all records are in
+ *     [offsets[0], offsets[capacity])
+ *   records, each 8-byte aligned:
+ *     u32 record_len, hash_key, key_len, values_count
+ *     key, padded to 4 bytes
+ *     u32 value_offsets[values_count] from the record start, in
+ *       value order (length then bytes) for binary search
+ *     values, each a u32 value_len then value padded to 4 bytes
+ */
+typedef struct
+{
+  char magic[8];
+  u32 version;
+  /* LIBRDF_HASH_MEMORY_SNAPSHOT_BYTE_ORDER as written */
+  u32 byte_order;
+  /* buckets; power of 2 */
+  u32 capacity;
+  u32 keys;
+  u32 values;
+  u32 reserved;
+} librdf_hash_memory_snapshot_header;
+
+#define LIBRDF_HASH_MEMORY_SNAPSHOT_MAGIC "RDFHSNAP"
+#define LIBRDF_HASH_MEMORY_SNAPSHOT_VERSION 1
+#define LIBRDF_HASH_MEMORY_SNAPSHOT_BYTE_ORDER 0x01020304
+
+#define LIBRDF_HASH_MEMORY_SNAPSHOT_RECORD_HEADER_SIZE (4 * sizeof(u32))
+
+#define LIBRDF_HASH_MEMORY_ALIGN(n, a) (((n) + (a) - 1) & ~((size_t)(a) - 1))
+
+#define LIBRDF_HASH_MEMORY_SNAPSHOT_HEADER(image) \
+  ((const librdf_hash_memory_snapshot_header*)(image))
+#define LIBRDF_HASH_MEMORY_SNAPSHOT_OFFSETS(image) \
+  ((const u64*)((image) + sizeof(librdf_hash_memory_snapshot_header)))
+
+
 
 /* default load_factor out of 1000 */
 static const int librdf_hash_default_load_factor=750;
@@ -96,15 +220,53 @@ static const int librdf_hash_default_load_factor=750;
 /* starting capacity - MUST BE POWER OF 2 */
 static const int librdf_hash_initial_capacity=8;
 
+/* buckets of the old array moved per put or delete while growing.
+ * Growth doubles the capacity at the load factor so the old array is
+ * always emptied before the next growth is needed.
+ */
+static const int librdf_hash_rehash_step=4;
+
+/* values for a key at which they are also indexed by value so that
+ * checking or deleting one key/value pair does not walk the list
+ */
+static const int librdf_hash_value_index_threshold=32;
+
+/* frozen bases under a hash at which a clone first flattens it so
+ * lookups do not walk an ever longer chain of layers
+ */
+static const int librdf_hash_max_layers=4;
+
 
 /* prototypes for local functions */
 static librdf_hash_memory_node* librdf_hash_memory_find_node(librdf_hash_memory_context* hash, void *key, size_t key_len, int *bucket, librdf_hash_memory_node** prev);
 static void librdf_free_hash_memory_node(librdf_hash_memory_node* node);
 static int librdf_hash_memory_expand_size(librdf_hash_memory_context* hash);
+static void librdf_hash_memory_rehash_step(librdf_hash_memory_context* hash, int buckets);
+static librdf_hash_memory_node_value* librdf_hash_memory_find_value(librdf_hash_memory_node* node, void *value, size_t value_len);
+static void librdf_hash_memory_value_index_add(librdf_hash_memory_node* node, librdf_hash_memory_node_value* vnode);
+static void librdf_hash_memory_value_index_remove(librdf_hash_memory_node* node, librdf_hash_memory_node_value* vnode);
+
+static int librdf_hash_memory_snapshot_check(librdf_hash_memory_context* hash);
+static int librdf_hash_memory_snapshot_open(librdf_hash_memory_context* hash);
+static void librdf_hash_memory_snapshot_release(librdf_hash_memory_context* hash);
+static int librdf_hash_memory_snapshot_load(librdf_hash_memory_context* hash);
+static int librdf_hash_memory_snapshot_write(librdf_hash_memory_context* hash);
+static size_t librdf_hash_memory_snapshot_find(librdf_hash_memory_context* hash, void *key, size_t key_len);
+static int librdf_hash_memory_snapshot_exists(librdf_hash_memory_context* hash, size_t record, void *value, size_t value_len);
+
+static librdf_hash_memory_context* librdf_hash_memory_new_table(librdf_world* world);
+static void librdf_hash_memory_free_table(librdf_hash_memory_context* hash);
+static int librdf_hash_memory_is_deleted(librdf_hash_memory_context* hash, void *key, size_t key_len, void *value, size_t value_len);
+static int librdf_hash_memory_live_count(librdf_hash_memory_context* hash, void *key, size_t key_len);
+static int librdf_hash_memory_exists_pair(librdf_hash_memory_context* hash, void *key, size_t key_len, void *value, size_t value_len);
+static int librdf_hash_memory_delete_base_value(librdf_hash_memory_context* hash, librdf_hash_datum *key, librdf_hash_datum *value);
+static int librdf_hash_memory_delete_base_key(librdf_hash_memory_context* hash, librdf_hash_datum *key);
+static int librdf_hash_memory_flatten(librdf_hash_memory_context* hash);
 
 /* Implementing the hash cursor */
 static int librdf_hash_memory_cursor_init(void *cursor_context, void *hash_context);
 static int librdf_hash_memory_cursor_get(void* context, librdf_hash_datum* key, librdf_hash_datum* value, unsigned int flags);
+static int librdf_hash_memory_cursor_get_nodes(void* context, librdf_hash_datum* key, librdf_hash_datum* value, unsigned int flags);
 static void librdf_hash_memory_cursor_finish(void* context);
 
 
@@ -119,6 +281,7 @@ static int librdf_hash_memory_close(void* context);
 static int librdf_hash_memory_clone(librdf_hash* new_hash, void *new_context, char *new_identifier, void* old_context);
 static int librdf_hash_memory_values_count(void *context);
 static int librdf_hash_memory_put(void* context, librdf_hash_datum *key, librdf_hash_datum *data);
+static int librdf_hash_memory_put_node(librdf_hash_memory_context* hash, librdf_hash_datum *key, librdf_hash_datum *value);
 static int librdf_hash_memory_exists(void* context, librdf_hash_datum *key, librdf_hash_datum *value);
 static int librdf_hash_memory_delete_key(void* context, librdf_hash_datum *key);
 static int librdf_hash_memory_delete_key_value(void* context, librdf_hash_datum *key, librdf_hash_datum *value);
@@ -162,6 +325,28 @@ static void librdf_hash_memory_register_factory(librdf_hash_factory *factory);
 /* helper functions */
 
 
+/**
+ * librdf_hash_memory_bucket:
+ * @hash: the memory hash context
+ * @bucket: bucket index
+ *
+ * Get the list head for a bucket index.
+ *
+ * Bucket indexes cover the old array being moved (if any) followed
+ * by the current array, 0 to old_capacity+capacity-1.
+ *
+ * Return value: pointer to the bucket list head
+ **/
+static librdf_hash_memory_node**
+librdf_hash_memory_bucket(librdf_hash_memory_context* hash, int bucket)
+{
+  if(bucket < hash->old_capacity)
+    return &hash->old_nodes[bucket];
+
+  return &hash->nodes[bucket - hash->old_capacity];
+}
+
+
 /**
  * librdf_hash_memory_find_node:
  * @hash: the memory hash context
@@ -175,8 +360,9 @@ static void librdf_hash_memory_register_factory(librdf_hash_factory *factory);
  * If value is not NULL and value_len is non 0, the value will also be
  * compared in the search.
  *
- * If user_bucket is not NULL, the bucket used will be returned.  if
- * prev is no NULL, the previous node in the list will be returned.
+ * If user_bucket is not NULL, the bucket used will be returned as
+ * an index for librdf_hash_memory_bucket().  if prev is no NULL, the
+ * previous node in the list will be returned.
  * 
  * Return value: #librdf_hash_memory_node of content or NULL on failure
  **/
@@ -196,13 +382,30 @@ librdf_hash_memory_find_node(librdf_hash_memory_context* hash,
   
   ONE_AT_A_TIME_HASH(hash_key, key, key_len);
 
+  /* while growing, the key may not have been moved yet */
+  if(hash->old_nodes) {
+    bucket=hash_key & (hash->old_capacity - 1);
+
+    if(prev)
+      *prev=NULL;
+    for(node=hash->old_nodes[bucket]; node; node=node->next) {
+      if(key_len == node->key_len && !memcmp(key, node->key, key_len)) {
+        if(user_bucket)
+          *user_bucket=bucket;
+        return node;
+      }
+      if(prev)
+        *prev=node;
+    }
+  }
+
   if(prev)
     *prev=NULL;
 
   /* find slot in table */
   bucket=hash_key & (hash->capacity - 1);
   if(user_bucket)
-    *user_bucket=bucket;
+    *user_bucket=hash->old_capacity + bucket;
 
   /* check if there is a list present */ 
   node=hash->nodes[bucket];
@@ -239,20 +442,204 @@ librdf_free_hash_memory_node(librdf_hash_memory_node* node)
       LIBRDF_FREE(librdf_hash_memory_node_value, vnode);
     }
   }
+  if(node->value_index)
+    LIBRDF_FREE(librdf_hash_memory_node_value_index, node->value_index);
   LIBRDF_FREE(librdf_hash_memory_node, node);
 }
 
 
+/*
+ * librdf_hash_memory_value_index_build - Create the value index for a key
+ * @node: key node
+ * @capacity: table size, power of 2
+ *
+ * Adds all the values of the key.  If there is no memory, the key
+ * is left without an index and the list is searched instead.
+ */
+static void
+librdf_hash_memory_value_index_build(librdf_hash_memory_node* node,
+                                     int capacity)
+{
+  librdf_hash_memory_node_value *vnode;
+
+  if(node->value_index)
+    LIBRDF_FREE(librdf_hash_memory_node_value_index, node->value_index);
+  node->value_index_capacity=0;
+
+  node->value_index = LIBRDF_CALLOC(librdf_hash_memory_node_value**,
+                                    capacity,
+                                    sizeof(librdf_hash_memory_node_value*));
+  if(!node->value_index)
+    return;
+  node->value_index_capacity=capacity;
+
+  for(vnode=node->values; vnode; vnode=vnode->next) {
+    u32 slot;
+
+    ONE_AT_A_TIME_HASH(slot, vnode->value, vnode->value_len);
+    slot &= (capacity - 1);
+    while(node->value_index[slot])
+      slot=(slot + 1) & (capacity - 1);
+    node->value_index[slot]=vnode;
+  }
+}
+
+
+/*
+ * librdf_hash_memory_value_index_add - Add a new value to a key's index
+ * @node: key node
+ * @vnode: value node already in the node's values list
+ *
+ * Creates the index when the key reaches the threshold and doubles it
+ * to keep it at most half full.
+ */
+static void
+librdf_hash_memory_value_index_add(librdf_hash_memory_node* node,
+                                   librdf_hash_memory_node_value* vnode)
+{
+  int capacity;
+  u32 slot;
+
+  if(!node->value_index) {
+    if(node->values_count < librdf_hash_value_index_threshold)
+      return;
+
+    /* values_count already includes vnode */
+    for(capacity=4; capacity < node->values_count * 2; capacity <<= 1)
+      ;
+    librdf_hash_memory_value_index_build(node, capacity << 1);
+    return;
+  }
+
+  if(node->values_count * 2 > node->value_index_capacity) {
+    librdf_hash_memory_value_index_build(node,
+                                         node->value_index_capacity << 1);
+    return;
+  }
+
+  capacity=node->value_index_capacity;
+  ONE_AT_A_TIME_HASH(slot, vnode->value, vnode->value_len);
+  slot &= (capacity - 1);
+  while(node->value_index[slot])
+    slot=(slot + 1) & (capacity - 1);
+  node->value_index[slot]=vnode;
+}
+
+
+/*
+ * librdf_hash_memory_value_index_remove - Remove a value from a key's index
+ * @node: key node
+ * @vnode: value node to remove
+ *
+ * Later entries of the probe run are shifted back into the hole so
+ * lookups never need deleted markers.
+ */
+static void
+librdf_hash_memory_value_index_remove(librdf_hash_memory_node* node,
+                                      librdf_hash_memory_node_value* vnode)
+{
+  u32 mask;
+  u32 hole, slot;
+
+  if(!node->value_index)
+    return;
+
+  mask=(u32)node->value_index_capacity - 1;
+
+  ONE_AT_A_TIME_HASH(hole, vnode->value, vnode->value_len);
+  hole &= mask;
+  while(node->value_index[hole] != vnode) {
+    if(!node->value_index[hole])
+      /* not indexed */
+      return;
+    hole=(hole + 1) & mask;
+  }
+
+  for(slot=(hole + 1) & mask; node->value_index[slot];
+      slot=(slot + 1) & mask) {
+    librdf_hash_memory_node_value *moving=node->value_index[slot];
+    u32 home;
+
+    ONE_AT_A_TIME_HASH(home, moving->value, moving->value_len);
+    home &= mask;
+
+    /* can move if home is not cyclically within (hole, slot] */
+    if(((slot - home) & mask) >= ((slot - hole) & mask)) {
+      node->value_index[hole]=moving;
+      hole=slot;
+    }
+  }
+  node->value_index[hole]=NULL;
+}
+
+
+/*
+ * librdf_hash_memory_find_value - Find a value of a key
+ * @node: key node
+ * @value: value data
+ * @value_len: value length
+ *
+ * Return value: value node or NULL if not found
+ */
+static librdf_hash_memory_node_value*
+librdf_hash_memory_find_value(librdf_hash_memory_node* node,
+                              void *value, size_t value_len)
+{
+  librdf_hash_memory_node_value *vnode;
+
+  if(node->value_index) {
+    u32 mask=(u32)node->value_index_capacity - 1;
+    u32 slot;
+
+    ONE_AT_A_TIME_HASH(slot, value, value_len);
+    for(slot &= mask; (vnode=node->value_index[slot]);
+        slot=(slot + 1) & mask) {
+      if(value_len == vnode->value_len &&
+         !memcmp(value, vnode->value, value_len))
+        return vnode;
+    }
+    return NULL;
+  }
+
+  /* search for value in list of values */
+  for(vnode=node->values; vnode; vnode=vnode->next) {
+    if(value_len == vnode->value_len && 
+       !memcmp(value, vnode->value, value_len))
+      break;
+  }
+
+  return vnode;
+}
+
+
+/*
+ * librdf_hash_memory_expand_size - Grow the hash if the load factor is reached
+ * @hash: the memory hash context
+ *
+ * Does not move any keys; the current array becomes the old array and
+ * librdf_hash_memory_rehash_step() moves its buckets over later.
+ *
+ * Return value: non 0 on failure
+ */
 static int
 librdf_hash_memory_expand_size(librdf_hash_memory_context* hash) {
   int required_capacity=0;
   librdf_hash_memory_node **new_nodes;
-  int i;
 
   if (hash->capacity) {
     /* big enough */
     if((1000 * hash->keys) < (hash->load_factor * hash->capacity))
       return 0;
+
+    /* previous growth not yet finished (only if the load factor was
+     * changed or cursors held it up) so finish it now, or stay over
+     * the load factor until the cursors are finished */
+    if(hash->old_nodes) {
+      if(hash->cursors)
+        return 0;
+      librdf_hash_memory_rehash_step(hash, hash->old_capacity);
+    }
+
     /* grow hash (keeping it a power of two) */
     required_capacity=hash->capacity << 1;
   } else {
@@ -268,45 +655,948 @@ librdf_hash_memory_expand_size(librdf_hash_memory_context* hash) {
 
 
   /* it is a new hash empty hash - we are done */
-  if(!hash->size) {
+  if(!hash->keys) {
+    if(hash->nodes)
+      LIBRDF_FREE(librdf_hash_memory_nodes, hash->nodes);
     hash->capacity=required_capacity;
     hash->nodes=new_nodes;
     return 0;
-  }
-  
-
-  for(i=0; i<hash->capacity; i++) {
-    librdf_hash_memory_node *node=hash->nodes[i];
-      
-    /* walk all attached nodes */
-    while(node) {
-      librdf_hash_memory_node *next;
-      int bucket;
+  }
+  
+  /* keep the current table to move from and attach new one */
+  hash->old_nodes=hash->nodes;
+  hash->old_capacity=hash->capacity;
+  hash->rehash_bucket=0;
+
+  hash->capacity=required_capacity;
+  hash->nodes=new_nodes;
+
+  return 0;
+}
+
+
+/*
+ * librdf_hash_memory_rehash_step - Move some old buckets into the new array
+ * @hash: the memory hash context
+ * @buckets: maximum number of old buckets to move
+ *
+ * Frees the old array once the last bucket has been moved.  Does
+ * nothing while cursors are open.
+ */
+static void
+librdf_hash_memory_rehash_step(librdf_hash_memory_context* hash, int buckets)
+{
+  if(!hash->old_nodes || hash->cursors)
+    return;
+
+  while(buckets-- > 0 && hash->rehash_bucket < hash->old_capacity) {
+    librdf_hash_memory_node *node=hash->old_nodes[hash->rehash_bucket];
+
+    if(node) {
+      hash->old_nodes[hash->rehash_bucket]=NULL;
+      hash->size--;
+    }
+
+    /* walk all attached nodes */
+    while(node) {
+      librdf_hash_memory_node *next;
+      int bucket;
+
+      next=node->next;
+      /* find slot in new table */
+      bucket=node->hash_key & (hash->capacity - 1);
+      if(!hash->nodes[bucket])
+        hash->size++;
+      node->next=hash->nodes[bucket];
+      hash->nodes[bucket]=node;
+
+      node=next;
+    }
+
+    hash->rehash_bucket++;
+  }
+
+  if(hash->rehash_bucket >= hash->old_capacity) {
+    /* now free old table */
+    LIBRDF_FREE(librdf_hash_memory_nodes, hash->old_nodes);
+    hash->old_nodes=NULL;
+    hash->old_capacity=0;
+    hash->rehash_bucket=0;
+  }
+}
+
+
+
+/*
+ * librdf_hash_memory_snapshot_value - Get a value of a snapshot record
+ * @hash: the memory hash context
+ * @record: record offset in the image
+ * @index: value index
+ * @value_len_p: pointer to store the value length
+ *
+ * Return value: pointer to the value in the image
+ */
+static void*
+librdf_hash_memory_snapshot_value(librdf_hash_memory_context* hash,
+                                  size_t record, u32 index,
+                                  size_t *value_len_p)
+{
+  const u32* header=(const u32*)(hash->image + record);
+  const u32* value_offsets;
+  const unsigned char* p;
+
+  value_offsets=(const u32*)(hash->image + record +
+                             LIBRDF_HASH_MEMORY_SNAPSHOT_RECORD_HEADER_SIZE +
+                             LIBRDF_HASH_MEMORY_ALIGN(header[2], 4));
+  p=hash->image + record + value_offsets[index];
+  *value_len_p=*(const u32*)p;
+
+  return (void*)(p + sizeof(u32));
+}
+
+
+static int
+librdf_hash_memory_compare_value(const void *a, size_t a_len,
+                                 const void *b, size_t b_len)
+{
+  if(a_len != b_len)
+    return (a_len < b_len) ? -1 : 1;
+  return memcmp(a, b, a_len);
+}
+
+
+/*
+ * librdf_hash_memory_snapshot_find - Find the snapshot record for a key
+ * @hash: the memory hash context
+ * @key: key data
+ * @key_len: key length
+ *
+ * Return value: record offset in the image or 0 if not found
+ */
+static size_t
+librdf_hash_memory_snapshot_find(librdf_hash_memory_context* hash,
+                                 void *key, size_t key_len)
+{
+  const u64* offsets=LIBRDF_HASH_MEMORY_SNAPSHOT_OFFSETS(hash->image);
+  u32 capacity=LIBRDF_HASH_MEMORY_SNAPSHOT_HEADER(hash->image)->capacity;
+  u32 hash_key;
+  u32 bucket;
+  size_t record;
+
+  ONE_AT_A_TIME_HASH(hash_key, key, key_len);
+  bucket=hash_key & (capacity - 1);
+
+  for(record=(size_t)offsets[bucket]; record < (size_t)offsets[bucket + 1];
+      record+=((const u32*)(hash->image + record))[0]) {
+    const u32* header=(const u32*)(hash->image + record);
+
+    if(header[1] == hash_key && header[2] == key_len &&
+       !memcmp(hash->image + record +
+               LIBRDF_HASH_MEMORY_SNAPSHOT_RECORD_HEADER_SIZE, key, key_len))
+      return record;
+  }
+
+  return 0;
+}
+
+
+/*
+ * librdf_hash_memory_snapshot_exists - Check a snapshot record for a value
+ * @hash: the memory hash context
+ * @record: record offset in the image
+ * @value: value data
+ * @value_len: value length
+ *
+ * Return value: non 0 if the value is present
+ */
+static int
+librdf_hash_memory_snapshot_exists(librdf_hash_memory_context* hash,
+                                   size_t record,
+                                   void *value, size_t value_len)
+{
+  u32 low=0;
+  u32 high=((const u32*)(hash->image + record))[3];
+
+  /* binary search of the sorted values */
+  while(low < high) {
+    u32 mid=low + (high - low) / 2;
+    size_t mid_len;
+    void *mid_value;
+    int cmp;
+
+    mid_value=librdf_hash_memory_snapshot_value(hash, record, mid, &mid_len);
+    cmp=librdf_hash_memory_compare_value(value, value_len,
+                                         mid_value, mid_len);
+    if(!cmp)
+      return 1;
+    if(cmp < 0)
+      high=mid;
+    else
+      low=mid + 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * librdf_hash_memory_snapshot_check - Check the snapshot image is well formed
+ * @hash: the memory hash context with an image whose header was checked
+ *
+ * Checks every bucket, record, key and value lies inside the image so
+ * lookups can trust the offsets and lengths in it.
+ *
+ * Return value: non 0 if the image is not valid
+ */
+static int
+librdf_hash_memory_snapshot_check(librdf_hash_memory_context* hash)
+{
+  const librdf_hash_memory_snapshot_header* header;
+  const u64* offsets;
+  size_t start;
+  size_t record;
+  u32 keys=0;
+  u32 values=0;
+  u32 b;
+
+  header=LIBRDF_HASH_MEMORY_SNAPSHOT_HEADER(hash->image);
+  offsets=LIBRDF_HASH_MEMORY_SNAPSHOT_OFFSETS(hash->image);
+
+  /* the offsets array itself, avoiding overflow with a bad capacity */
+  if(header->capacity >
+     (hash->image_size - sizeof(*header)) / sizeof(u64) - 1)
+    return 1;
+  start=sizeof(*header) + (header->capacity + 1) * sizeof(u64);
+
+  if(offsets[0] != start || offsets[header->capacity] > hash->image_size)
+    return 1;
+
+  /* the records of each bucket run exactly to the start of the next */
+  record=start;
+  for(b=0; b < header->capacity; b++) {
+    if(offsets[b + 1] < offsets[b])
+      return 1;
+
+    while(record < (size_t)offsets[b + 1]) {
+      const u32* rheader=(const u32*)(hash->image + record);
+      size_t record_len;
+      size_t values_start;
+      u32 i;
+
+      if((size_t)offsets[b + 1] - record <
+         LIBRDF_HASH_MEMORY_SNAPSHOT_RECORD_HEADER_SIZE)
+        return 1;
+      record_len=rheader[0];
+      if(record_len < LIBRDF_HASH_MEMORY_SNAPSHOT_RECORD_HEADER_SIZE ||
+         (record_len & 7) ||
+         record_len > (size_t)offsets[b + 1] - record ||
+         (rheader[1] & (header->capacity - 1)) != b)
+        return 1;
+
+      /* key then the value offsets */
+      if(rheader[2] > record_len ||
+         rheader[3] > record_len / sizeof(u32))
+        return 1;
+      values_start=LIBRDF_HASH_MEMORY_SNAPSHOT_RECORD_HEADER_SIZE +
+        LIBRDF_HASH_MEMORY_ALIGN((size_t)rheader[2], 4);
+      if(values_start + rheader[3] * sizeof(u32) > record_len)
+        return 1;
+
+      for(i=0; i < rheader[3]; i++) {
+        const u32* value_offsets=(const u32*)(hash->image + record +
+                                              values_start);
+        size_t offset=value_offsets[i];
+
+        if((offset & 3) || offset > record_len - sizeof(u32) ||
+           *(const u32*)(hash->image + record + offset) >
+           record_len - sizeof(u32) - offset)
+          return 1;
+      }
+
+      keys++;
+      values+=rheader[3];
+      record+=record_len;
+    }
+
+    if(record != (size_t)offsets[b + 1])
+      return 1;
+  }
+
+  return keys != header->keys || values != header->values;
+}
+
+
+/*
+ * librdf_hash_memory_snapshot_open - Open the snapshot image if present
+ * @hash: the memory hash context
+ *
+ * Maps the snapshot file read-only (or reads it where mmap is not
+ * available) and checks the header.  A missing file is not an error.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_hash_memory_snapshot_open(librdf_hash_memory_context* hash)
+{
+  librdf_world* world=hash->world;
+  const librdf_hash_memory_snapshot_header* header;
+  struct stat sb;
+  int fd;
+
+  fd=open(hash->snapshot_name, O_RDONLY);
+  if(fd < 0) {
+    if(errno == ENOENT)
+      return 0;
+    librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_HASH, NULL,
+               "failed to open hash snapshot '%s' - %s",
+               hash->snapshot_name, strerror(errno));
+    return 1;
+  }
+
+  if(fstat(fd, &sb) < 0 ||
+     (size_t)sb.st_size < sizeof(librdf_hash_memory_snapshot_header)) {
+    librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_HASH, NULL,
+               "hash snapshot '%s' is too short", hash->snapshot_name);
+    close(fd);
+    return 1;
+  }
+
+  hash->image_size=(size_t)sb.st_size;
+#ifdef LIBRDF_HASH_MEMORY_USE_MMAP
+  hash->image=(unsigned char*)mmap(NULL, hash->image_size, PROT_READ,
+                                   MAP_SHARED, fd, 0);
+  if(hash->image == (unsigned char*)MAP_FAILED)
+    hash->image=NULL;
+  else
+    hash->image_mapped=1;
+#else
+  hash->image = LIBRDF_MALLOC(unsigned char*, hash->image_size);
+  if(hash->image &&
+     read(fd, hash->image, hash->image_size) != (ssize_t)hash->image_size) {
+    LIBRDF_FREE(char*, hash->image);
+    hash->image=NULL;
+  }
+#endif
+  close(fd);
+
+  if(!hash->image) {
+    librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_HASH, NULL,
+               "failed to read hash snapshot '%s' - %s",
+               hash->snapshot_name, strerror(errno));
+    return 1;
+  }
+
+  header=LIBRDF_HASH_MEMORY_SNAPSHOT_HEADER(hash->image);
+  if(memcmp(header->magic, LIBRDF_HASH_MEMORY_SNAPSHOT_MAGIC, 8) ||
+     header->version != LIBRDF_HASH_MEMORY_SNAPSHOT_VERSION ||
+     header->byte_order != LIBRDF_HASH_MEMORY_SNAPSHOT_BYTE_ORDER ||
+     !header->capacity || (header->capacity & (header->capacity - 1)) ||
+     hash->image_size < sizeof(*header) + 2 * sizeof(u64) ||
+     librdf_hash_memory_snapshot_check(hash)) {
+    librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_HASH, NULL,
+               "hash snapshot '%s' is not a valid snapshot for this system",
+               hash->snapshot_name);
+    librdf_hash_memory_snapshot_release(hash);
+    return 1;
+  }
+
+  hash->keys=(int)header->keys;
+  hash->values=(int)header->values;
+
+  return 0;
+}
+
+
+static void
+librdf_hash_memory_snapshot_release(librdf_hash_memory_context* hash)
+{
+  if(!hash->image)
+    return;
+
+#ifdef LIBRDF_HASH_MEMORY_USE_MMAP
+  if(hash->image_mapped)
+    munmap(hash->image, hash->image_size);
+  else
+#endif
+    LIBRDF_FREE(char*, hash->image);
+
+  hash->image=NULL;
+  hash->image_size=0;
+  hash->image_mapped=0;
+}
+
+
+/*
+ * librdf_hash_memory_snapshot_load - Load the snapshot image into nodes
+ * @hash: the memory hash context
+ *
+ * Done when a hash is opened writable from a snapshot and before the
+ * first change to one opened read-only.  Keys and values returned by
+ * cursors point into the image, so that fails while any are open.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_hash_memory_snapshot_load(librdf_hash_memory_context* hash)
+{
+  const u64* offsets;
+  u32 capacity;
+  size_t record;
+  int status=0;
+
+  if(!hash->image)
+    return 0;
+
+  if(hash->cursors) {
+    librdf_log(hash->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_HASH, NULL,
+               "cannot change hash snapshot '%s' opened read-only while it is being read",
+               hash->snapshot_name);
+    return 1;
+  }
+
+  offsets=LIBRDF_HASH_MEMORY_SNAPSHOT_OFFSETS(hash->image);
+  capacity=LIBRDF_HASH_MEMORY_SNAPSHOT_HEADER(hash->image)->capacity;
+
+  hash->keys=0;
+  hash->values=0;
+
+  for(record=(size_t)offsets[0]; record < (size_t)offsets[capacity];
+      record+=((const u32*)(hash->image + record))[0]) {
+    const u32* header=(const u32*)(hash->image + record);
+    librdf_hash_datum key, value;
+    u32 i;
+
+    key.data=hash->image + record +
+      LIBRDF_HASH_MEMORY_SNAPSHOT_RECORD_HEADER_SIZE;
+    key.size=header[2];
+
+    for(i=0; i < header[3]; i++) {
+      value.data=librdf_hash_memory_snapshot_value(hash, record, i,
+                                                   &value.size);
+      status=librdf_hash_memory_put_node(hash, &key, &value);
+      if(status)
+        break;
+    }
+    if(status)
+      break;
+  }
+
+  librdf_hash_memory_snapshot_release(hash);
+
+  return status;
+}
+
+
+static int
+librdf_hash_memory_compare_value_nodes(const void *a, const void *b)
+{
+  const librdf_hash_memory_node_value* va=*(librdf_hash_memory_node_value* const*)a;
+  const librdf_hash_memory_node_value* vb=*(librdf_hash_memory_node_value* const*)b;
+
+  return librdf_hash_memory_compare_value(va->value, va->value_len,
+                                          vb->value, vb->value_len);
+}
+
+
+static size_t
+librdf_hash_memory_snapshot_record_size(librdf_hash_memory_node* node)
+{
+  librdf_hash_memory_node_value *vnode;
+  size_t size;
+
+  size=LIBRDF_HASH_MEMORY_SNAPSHOT_RECORD_HEADER_SIZE +
+    LIBRDF_HASH_MEMORY_ALIGN(node->key_len, 4) +
+    node->values_count * sizeof(u32);
+  for(vnode=node->values; vnode; vnode=vnode->next)
+    size+=sizeof(u32) + LIBRDF_HASH_MEMORY_ALIGN(vnode->value_len, 4);
+
+  return LIBRDF_HASH_MEMORY_ALIGN(size, 8);
+}
+
+
+/*
+ * librdf_hash_memory_snapshot_write - Write the hash to the snapshot file
+ * @hash: the memory hash context
+ *
+ * Writes to the snapshot name with ".new" appended and renames it
+ * over the old snapshot so readers mapping it are not disturbed.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_hash_memory_snapshot_write(librdf_hash_memory_context* hash)
+{
+  librdf_world* world=hash->world;
+  librdf_hash_memory_snapshot_header header;
+  librdf_hash_memory_node **nodes=NULL;
+  librdf_hash_memory_node_value **vnodes=NULL;
+  u64 *offsets=NULL;
+  unsigned char *buffer=NULL;
+  size_t buffer_size=0;
+  int vnodes_size=0;
+  u32 capacity;
+  size_t name_len;
+  char *new_name=NULL;
+  FILE *fh=NULL;
+  int i, k;
+  u32 b;
+  u64 offset;
+  int status=1;
+
+  /* same load factor as the live hash */
+  for(capacity=librdf_hash_initial_capacity;
+      (1000 * (size_t)hash->keys) >= ((size_t)hash->load_factor * capacity);
+      capacity <<= 1)
+    ;
+
+  /* order the nodes by snapshot bucket */
+  offsets = LIBRDF_CALLOC(u64*, capacity + 1, sizeof(u64));
+  nodes = LIBRDF_CALLOC(librdf_hash_memory_node**, hash->keys + 1,
+                        sizeof(librdf_hash_memory_node*));
+  if(!offsets || !nodes)
+    goto tidy;
+
+  for(i=0; i < hash->old_capacity + hash->capacity; i++) {
+    librdf_hash_memory_node* node;
+
+    for(node=*librdf_hash_memory_bucket(hash, i); node; node=node->next)
+      offsets[(node->hash_key & (capacity - 1)) + 1]++;
+  }
+  for(b=0; b < capacity; b++)
+    offsets[b + 1]+=offsets[b];
+  for(i=0; i < hash->old_capacity + hash->capacity; i++) {
+    librdf_hash_memory_node* node;
+
+    for(node=*librdf_hash_memory_bucket(hash, i); node; node=node->next)
+      nodes[offsets[node->hash_key & (capacity - 1)]++]=node;
+  }
+
+  /* offsets[b] is now the end of bucket b; turn into file offsets */
+  offset=sizeof(header) + (capacity + 1) * sizeof(u64);
+  for(k=0, b=0; b < capacity; b++) {
+    u64 end=offsets[b];
+
+    offsets[b]=offset;
+    for(; k < (int)end; k++)
+      offset+=librdf_hash_memory_snapshot_record_size(nodes[k]);
+  }
+  offsets[capacity]=offset;
+
+  name_len=strlen(hash->snapshot_name);
+  new_name = LIBRDF_MALLOC(char*, name_len + 5);
+  if(!new_name)
+    goto tidy;
+  strcpy(new_name, hash->snapshot_name);
+  strcpy(new_name + name_len, ".new");
+
+  fh=fopen(new_name, "wb");
+  if(!fh) {
+    librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_HASH, NULL,
+               "failed to open hash snapshot '%s' for writing - %s",
+               new_name, strerror(errno));
+    goto tidy;
+  }
+
+  memset(&header, '\0', sizeof(header));
+  memcpy(header.magic, LIBRDF_HASH_MEMORY_SNAPSHOT_MAGIC, 8);
+  header.version=LIBRDF_HASH_MEMORY_SNAPSHOT_VERSION;
+  header.byte_order=LIBRDF_HASH_MEMORY_SNAPSHOT_BYTE_ORDER;
+  header.capacity=capacity;
+  header.keys=(u32)hash->keys;
+  header.values=(u32)hash->values;
+
+  if(fwrite(&header, sizeof(header), 1, fh) != 1 ||
+     fwrite(offsets, sizeof(u64), capacity + 1, fh) != capacity + 1)
+    goto write_failed;
+
+  for(k=0; k < hash->keys; k++) {
+    librdf_hash_memory_node* node=nodes[k];
+    librdf_hash_memory_node_value *vnode;
+    size_t size=librdf_hash_memory_snapshot_record_size(node);
+    u32* record;
+    u32* value_offsets;
+    size_t p;
+    int v;
+
+    if(size > buffer_size) {
+      if(buffer)
+        LIBRDF_FREE(char*, buffer);
+      buffer = LIBRDF_MALLOC(unsigned char*, size);
+      if(!buffer)
+        goto tidy;
+      buffer_size=size;
+    }
+    memset(buffer, '\0', size);
+
+    if(node->values_count > vnodes_size) {
+      if(vnodes)
+        LIBRDF_FREE(librdf_hash_memory_node_value, vnodes);
+      vnodes = LIBRDF_MALLOC(librdf_hash_memory_node_value**,
+                             node->values_count * sizeof(librdf_hash_memory_node_value*));
+      if(!vnodes)
+        goto tidy;
+      vnodes_size=node->values_count;
+    }
+
+    for(v=0, vnode=node->values; vnode; vnode=vnode->next)
+      vnodes[v++]=vnode;
+    qsort(vnodes, (size_t)v, sizeof(librdf_hash_memory_node_value*),
+          librdf_hash_memory_compare_value_nodes);
+
+    record=(u32*)buffer;
+    record[0]=(u32)size;
+    record[1]=node->hash_key;
+    record[2]=(u32)node->key_len;
+    record[3]=(u32)v;
+    p=LIBRDF_HASH_MEMORY_SNAPSHOT_RECORD_HEADER_SIZE;
+    memcpy(buffer + p, node->key, node->key_len);
+    p+=LIBRDF_HASH_MEMORY_ALIGN(node->key_len, 4);
+
+    value_offsets=(u32*)(buffer + p);
+    p+=v * sizeof(u32);
+    for(i=0; i < v; i++) {
+      value_offsets[i]=(u32)p;
+      *(u32*)(buffer + p)=(u32)vnodes[i]->value_len;
+      memcpy(buffer + p + sizeof(u32), vnodes[i]->value,
+             vnodes[i]->value_len);
+      p+=sizeof(u32) + LIBRDF_HASH_MEMORY_ALIGN(vnodes[i]->value_len, 4);
+    }
+
+    if(fwrite(buffer, 1, size, fh) != size)
+      goto write_failed;
+  }
+
+  if(fclose(fh)) {
+    fh=NULL;
+    goto write_failed;
+  }
+  fh=NULL;
+
+  if(rename(new_name, hash->snapshot_name) < 0) {
+    librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_HASH, NULL,
+               "rename of '%s' to '%s' failed - %s",
+               new_name, hash->snapshot_name, strerror(errno));
+    goto tidy;
+  }
+
+  status=0;
+  goto tidy;
+
+  write_failed:
+  librdf_log(world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_HASH, NULL,
+             "failed to write hash snapshot '%s' - %s",
+             new_name, strerror(errno));
+
+  tidy:
+  if(fh)
+    fclose(fh);
+  if(status && new_name)
+    remove(new_name);
+  if(new_name)
+    LIBRDF_FREE(char*, new_name);
+  if(buffer)
+    LIBRDF_FREE(char*, buffer);
+  if(vnodes)
+    LIBRDF_FREE(librdf_hash_memory_node_value, vnodes);
+  if(nodes)
+    LIBRDF_FREE(librdf_hash_memory_nodes, nodes);
+  if(offsets)
+    LIBRDF_FREE(u64, offsets);
+
+  return status;
+}
+
+
+
+/* functions implementing hash api */
+
+
+/*
+ * librdf_hash_memory_new_table - Create a memory hash context with no librdf_hash
+ * @world: redland world object
+ *
+ * Used for the frozen bases and deleted pairs of copy-on-write clones.
+ *
+ * Return value: new context or NULL on failure
+ */
+static librdf_hash_memory_context*
+librdf_hash_memory_new_table(librdf_world* world)
+{
+  librdf_hash_memory_context* hash;
+
+  hash = LIBRDF_CALLOC(librdf_hash_memory_context*, 1, sizeof(*hash));
+  if(!hash)
+    return NULL;
+
+  hash->world=world;
+  hash->load_factor=librdf_hash_default_load_factor;
+  if(librdf_hash_memory_expand_size(hash)) {
+    LIBRDF_FREE(librdf_hash_memory_context, hash);
+    return NULL;
+  }
+
+  return hash;
+}
+
+
+/*
+ * librdf_hash_memory_free_table - Free a context from librdf_hash_memory_new_table()
+ * @hash: memory hash context
+ */
+static void
+librdf_hash_memory_free_table(librdf_hash_memory_context* hash)
+{
+  librdf_hash_memory_destroy(hash);
+  LIBRDF_FREE(librdf_hash_memory_context, hash);
+}
+
+
+/*
+ * librdf_hash_memory_is_deleted - Test if a key/value pair of the base was deleted
+ * @hash: memory hash context
+ * @key: key
+ * @key_len: key length
+ * @value: value
+ * @value_len: value length
+ *
+ * Return value: non 0 if the pair was deleted in this hash
+ */
+static int
+librdf_hash_memory_is_deleted(librdf_hash_memory_context* hash,
+                              void *key, size_t key_len,
+                              void *value, size_t value_len)
+{
+  librdf_hash_memory_node* node;
+
+  if(!hash->deleted)
+    return 0;
+
+  node=librdf_hash_memory_find_node(hash->deleted, key, key_len, NULL, NULL);
+  return node && librdf_hash_memory_find_value(node, value, value_len);
+}
+
+
+/*
+ * librdf_hash_memory_live_count - Count the visible values of a key
+ * @hash: memory hash context
+ * @key: key
+ * @key_len: key length
+ *
+ * Return value: number of values
+ */
+static int
+librdf_hash_memory_live_count(librdf_hash_memory_context* hash,
+                              void *key, size_t key_len)
+{
+  librdf_hash_memory_node* node;
+  int count=0;
+
+  if(hash->image) {
+    size_t record=librdf_hash_memory_snapshot_find(hash, key, key_len);
+
+    if(record)
+      count=(int)((const u32*)(hash->image + record))[3];
+    return count;
+  }
+
+  node=librdf_hash_memory_find_node(hash, key, key_len, NULL, NULL);
+  if(node)
+    count=node->values_count;
+
+  if(hash->base) {
+    count+=librdf_hash_memory_live_count(hash->base, key, key_len);
+
+    if(hash->deleted) {
+      node=librdf_hash_memory_find_node(hash->deleted, key, key_len,
+                                        NULL, NULL);
+      if(node)
+        count-=node->values_count;
+    }
+  }
+
+  return count;
+}
+
+
+/*
+ * librdf_hash_memory_exists_pair - Test if a key or key/value pair is visible
+ * @hash: memory hash context
+ * @key: key
+ * @key_len: key length
+ * @value: value or NULL for any
+ * @value_len: value length
+ *
+ * Return value: non 0 if it exists
+ */
+static int
+librdf_hash_memory_exists_pair(librdf_hash_memory_context* hash,
+                               void *key, size_t key_len,
+                               void *value, size_t value_len)
+{
+  librdf_hash_memory_node* node;
+
+  if(!value)
+    return librdf_hash_memory_live_count(hash, key, key_len) > 0;
+
+  if(hash->image) {
+    size_t record=librdf_hash_memory_snapshot_find(hash, key, key_len);
+
+    return record &&
+      librdf_hash_memory_snapshot_exists(hash, record, value, value_len);
+  }
+
+  node=librdf_hash_memory_find_node(hash, key, key_len, NULL, NULL);
+  if(node && librdf_hash_memory_find_value(node, value, value_len))
+    return 1;
+
+  return hash->base &&
+    !librdf_hash_memory_is_deleted(hash, key, key_len, value, value_len) &&
+    librdf_hash_memory_exists_pair(hash->base, key, key_len, value, value_len);
+}
+
+
+/*
+ * librdf_hash_memory_delete_base_value - Delete a key/value pair of the base
+ * @hash: memory hash context
+ * @key: key
+ * @value: value
+ *
+ * Return value: non 0 on failure or if the base has no such pair
+ */
+static int
+librdf_hash_memory_delete_base_value(librdf_hash_memory_context* hash,
+                                     librdf_hash_datum *key,
+                                     librdf_hash_datum *value)
+{
+  if(!hash->base ||
+     librdf_hash_memory_is_deleted(hash, key->data, key->size,
+                                   value->data, value->size) ||
+     !librdf_hash_memory_exists_pair(hash->base, key->data, key->size,
+                                     value->data, value->size))
+    return 1;
+
+  if(!hash->deleted && !(hash->deleted=librdf_hash_memory_new_table(hash->world)))
+    return 1;
+
+  if(librdf_hash_memory_put_node(hash->deleted, key, value))
+    return 1;
+
+  hash->values--;
+  hash->dirty=1;
+  return 0;
+}
+
+
+/*
+ * librdf_hash_memory_delete_base_key - Delete all values of a key in the base
+ * @hash: memory hash context
+ * @key: key
+ *
+ * Return value: number of pairs deleted
+ */
+static int
+librdf_hash_memory_delete_base_key(librdf_hash_memory_context* hash,
+                                   librdf_hash_datum *key)
+{
+  librdf_hash_memory_cursor_context cursor;
+  librdf_hash_datum k, v;
+  int count=0;
+  int status;
+
+  if(!hash->base)
+    return 0;
+
+  memset(&cursor, '\0', sizeof(cursor));
+  cursor.hash=hash->base;
+
+  k.data=key->data;
+  k.size=key->size;
+  for(status=librdf_hash_memory_cursor_get(&cursor, &k, &v,
+                                           LIBRDF_HASH_CURSOR_SET);
+      !status;
+      status=librdf_hash_memory_cursor_get(&cursor, &k, &v,
+                                           LIBRDF_HASH_CURSOR_NEXT_VALUE))
+    if(!librdf_hash_memory_delete_base_value(hash, key, &v))
+      count++;
+
+  librdf_hash_memory_cursor_finish(&cursor);
+
+  return count;
+}
+
+
+/*
+ * librdf_hash_memory_flatten - Copy the visible pairs into the nodes alone
+ * @hash: memory hash context
+ *
+ * Afterwards the hash no longer shares a base.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_hash_memory_flatten(librdf_hash_memory_context* hash)
+{
+  librdf_hash_memory_context* flat;
+  librdf_hash_memory_context old;
+  librdf_hash_memory_cursor_context cursor;
+  librdf_hash_datum k, v;
+  int status;
+  int rc=0;
+
+  if(!hash->base)
+    return 0;
 
-      next=node->next;
-      /* find slot in new table */
-      bucket=node->hash_key & (required_capacity - 1);
-      node->next=new_nodes[bucket];
-      new_nodes[bucket]=node;
+  flat=librdf_hash_memory_new_table(hash->world);
+  if(!flat)
+    return 1;
 
-      node=next;
+  memset(&cursor, '\0', sizeof(cursor));
+  cursor.hash=hash;
+
+  k.data=NULL;
+  for(status=librdf_hash_memory_cursor_get(&cursor, &k, &v,
+                                           LIBRDF_HASH_CURSOR_FIRST);
+      !status;
+      status=librdf_hash_memory_cursor_get(&cursor, &k, &v,
+                                           LIBRDF_HASH_CURSOR_NEXT)) {
+    if(librdf_hash_memory_put_node(flat, &k, &v)) {
+      rc=1;
+      break;
     }
+    k.data=NULL;
   }
 
-  /* now free old table */
-  LIBRDF_FREE(librdf_hash_memory_nodes, hash->nodes);
+  librdf_hash_memory_cursor_finish(&cursor);
 
-  /* attach new one */
-  hash->capacity=required_capacity;
-  hash->nodes=new_nodes;
+  if(rc) {
+    librdf_hash_memory_free_table(flat);
+    return 1;
+  }
+
+  /* swap the copied nodes in and free the layers they replace */
+  old=*hash;
+  hash->nodes=flat->nodes;
+  hash->size=flat->size;
+  hash->keys=flat->keys;
+  hash->capacity=flat->capacity;
+  hash->old_nodes=flat->old_nodes;
+  hash->old_capacity=flat->old_capacity;
+  hash->rehash_bucket=flat->rehash_bucket;
+  hash->base=NULL;
+  hash->deleted=NULL;
+
+  flat->nodes=old.nodes;
+  flat->capacity=old.capacity;
+  flat->old_nodes=old.old_nodes;
+  flat->old_capacity=old.old_capacity;
+  flat->base=old.base;
+  flat->deleted=old.deleted;
+  librdf_hash_memory_free_table(flat);
 
   return 0;
 }
 
 
-
-/* functions implementing hash api */
-
 /**
  * librdf_hash_memory_create:
  * @hash: #librdf_hash hash
@@ -322,6 +1612,7 @@ librdf_hash_memory_create(librdf_hash* hash, void* context)
   librdf_hash_memory_context* hcontext=(librdf_hash_memory_context*)context;
 
   hcontext->hash=hash;
+  hcontext->world=hash->world;
   hcontext->load_factor=librdf_hash_default_load_factor;
   return librdf_hash_memory_expand_size(hcontext);
 }
@@ -343,8 +1634,8 @@ librdf_hash_memory_destroy(void* context)
   if(hcontext->nodes) {
     int i;
   
-    for(i=0; i<hcontext->capacity; i++) {
-      librdf_hash_memory_node *node=hcontext->nodes[i];
+    for(i=0; i < hcontext->old_capacity + hcontext->capacity; i++) {
+      librdf_hash_memory_node *node=*librdf_hash_memory_bucket(hcontext, i);
       
       /* this entry is used */
       if(node) {
@@ -360,6 +1651,21 @@ librdf_hash_memory_destroy(void* context)
     LIBRDF_FREE(librdf_hash_memory_nodes, hcontext->nodes);
   }
 
+  if(hcontext->old_nodes)
+    LIBRDF_FREE(librdf_hash_memory_nodes, hcontext->old_nodes);
+
+  librdf_hash_memory_snapshot_release(hcontext);
+
+  if(hcontext->snapshot_name)
+    LIBRDF_FREE(char*, hcontext->snapshot_name);
+
+  if(hcontext->deleted)
+    librdf_hash_memory_free_table(hcontext->deleted);
+
+  /* the last hash sharing a base frees it */
+  if(hcontext->base && !--hcontext->base->usage)
+    librdf_hash_memory_free_table(hcontext->base);
+
   return 0;
 }
 
@@ -367,14 +1673,21 @@ librdf_hash_memory_destroy(void* context)
 /**
  * librdf_hash_memory_open:
  * @context: memory hash context
- * @identifier: identifier - not used
+ * @identifier: identifier - snapshot file name prefix or NULL
  * @mode: access mode - not used
- * @is_writable: is hash writable? - not used
- * @is_new: is hash new? - not used
- * @options: #librdf_hash of options - not used
+ * @is_writable: is hash writable?
+ * @is_new: is hash new?
+ * @options: #librdf_hash of options
  *
  * Open memory hash with given parameters.
  * 
+ * If boolean option <literal>snapshot</literal> is set and there is
+ * an identifier, the hash is kept in file identifier".snapshot".  An
+ * existing snapshot (ignored if @is_new) is mapped read-only.  When
+ * @is_writable it is loaded into memory at once and written back on
+ * sync or close; otherwise it is used for lookups directly and only
+ * loaded on the first change, which fails while cursors are open.
+ *
  * Return value: non 0 on failure
  **/
 static int
@@ -382,7 +1695,36 @@ librdf_hash_memory_open(void* context, const char *identifier,
                         int mode, int is_writable, int is_new,
                         librdf_hash* options) 
 {
-  /* NOP */
+  librdf_hash_memory_context* hash=(librdf_hash_memory_context*)context;
+  size_t len;
+
+  if(!identifier || !options ||
+     librdf_hash_get_as_boolean(options, "snapshot") <= 0)
+    return 0;
+
+  /* identifier".snapshot\0" */
+  len=strlen(identifier);
+  hash->snapshot_name = LIBRDF_MALLOC(char*, len + 10);
+  if(!hash->snapshot_name)
+    return 1;
+  strcpy(hash->snapshot_name, identifier);
+  strcpy(hash->snapshot_name + len, ".snapshot");
+
+  hash->is_writable=is_writable;
+
+  if(is_new || hash->values || hash->base) {
+    /* write the contents, if any from a clone, on sync */
+    hash->dirty=1;
+    return 0;
+  }
+
+  if(librdf_hash_memory_snapshot_open(hash))
+    return 1;
+
+  /* changes would otherwise unmap the image under open cursors */
+  if(is_writable)
+    return librdf_hash_memory_snapshot_load(hash);
+
   return 0;
 }
 
@@ -393,13 +1735,14 @@ librdf_hash_memory_open(void* context, const char *identifier,
  *
  * Close the hash.
  * 
+ * Writes the snapshot if there is one and the hash changed.
+ *
  * Return value: non 0 on failure
  **/
 static int
 librdf_hash_memory_close(void* context) 
 {
-  /* NOP */
-  return 0;
+  return librdf_hash_memory_sync(context);
 }
 
 
@@ -409,42 +1752,96 @@ librdf_hash_memory_clone(librdf_hash *hash, void* context, char *new_identifer,
 {
   librdf_hash_memory_context* hcontext=(librdf_hash_memory_context*)context;
   librdf_hash_memory_context* old_hcontext=(librdf_hash_memory_context*)old_context;
+  librdf_hash_memory_context* base;
   librdf_hash_datum *key, *value;
   librdf_iterator *iterator;
   int status=0;
   
   /* copy data fields that might change */
   hcontext->hash=hash;
+  hcontext->world=hash->world;
   hcontext->load_factor=old_hcontext->load_factor;
 
   /* Don't need to deal with new_identifier - not used for memory hashes */
 
-  /* Use higher level functions to iterator this data
-   * on the other hand, maybe this is a good idea since that
-   * code is tested and works
-   */
+  if(old_hcontext->image || old_hcontext->cursors) {
+    /* A snapshot image is only lent by the file and open cursors walk
+     * the nodes that would move into a base; copy the pairs.
+     *
+     * Use higher level functions to iterator this data
+     * on the other hand, maybe this is a good idea since that
+     * code is tested and works
+     */
+
+    key=librdf_new_hash_datum(hash->world, NULL, 0);
+    value=librdf_new_hash_datum(hash->world, NULL, 0);
+
+    iterator=librdf_hash_get_all(old_hcontext->hash, key, value);
+    while(!librdf_iterator_end(iterator)) {
+      librdf_hash_datum* k= (librdf_hash_datum*)librdf_iterator_get_key(iterator);
+      librdf_hash_datum* v= (librdf_hash_datum*)librdf_iterator_get_value(iterator);
+
+      if(librdf_hash_memory_put(hcontext, k, v)) {
+        status=1;
+        break;
+      }
+      librdf_iterator_next(iterator);
+    }
+    if(iterator)
+      librdf_free_iterator(iterator);
 
-  key=librdf_new_hash_datum(hash->world, NULL, 0);
-  value=librdf_new_hash_datum(hash->world, NULL, 0);
+    librdf_free_hash_datum(value);
+    librdf_free_hash_datum(key);
 
-  iterator=librdf_hash_get_all(old_hcontext->hash, key, value);
-  while(!librdf_iterator_end(iterator)) {
-    librdf_hash_datum* k= (librdf_hash_datum*)librdf_iterator_get_key(iterator);
-    librdf_hash_datum* v= (librdf_hash_datum*)librdf_iterator_get_value(iterator);
+    return status;
+  }
 
-    if(librdf_hash_memory_put(hcontext, k, v)) {
-      status=1;
-      break;
-    }
-    librdf_iterator_next(iterator);
+  /* Copy-on-write: both hashes share the old contents, frozen, as
+   * their base and record their own changes on top of it.  An old
+   * hash with no changes since it was itself cloned already has one.
+   */
+  if(old_hcontext->base && !old_hcontext->keys && !old_hcontext->deleted)
+    base=old_hcontext->base;
+  else {
+    int depth=0;
+
+    /* keep the chain of layers short */
+    for(base=old_hcontext->base; base; base=base->base)
+      depth++;
+    if(depth >= librdf_hash_max_layers &&
+       librdf_hash_memory_flatten(old_hcontext))
+      return 1;
+
+    base = LIBRDF_CALLOC(librdf_hash_memory_context*, 1, sizeof(*base));
+    if(!base)
+      return 1;
+
+    /* move the contents (and any base of them) into the frozen base */
+    *base=*old_hcontext;
+    base->hash=NULL;
+    base->snapshot_name=NULL;
+    base->cursors=0;
+    base->usage=1;
+
+    old_hcontext->nodes=NULL;
+    old_hcontext->size=0;
+    old_hcontext->keys=0;
+    old_hcontext->capacity=0;
+    old_hcontext->old_nodes=NULL;
+    old_hcontext->old_capacity=0;
+    old_hcontext->rehash_bucket=0;
+    old_hcontext->base=base;
+    old_hcontext->deleted=NULL;
+
+    /* on failure the nodes array is allocated on the next put */
+    librdf_hash_memory_expand_size(old_hcontext);
   }
-  if(iterator)
-    librdf_free_iterator(iterator);
 
-  librdf_free_hash_datum(value);
-  librdf_free_hash_datum(key);
+  base->usage++;
+  hcontext->base=base;
+  hcontext->values=old_hcontext->values;
 
-  return status;
+  return librdf_hash_memory_expand_size(hcontext);
 }
 
 
@@ -466,15 +1863,6 @@ librdf_hash_memory_values_count(void *context)
 
 
 
-typedef struct {
-  librdf_hash_memory_context* hash;
-  int current_bucket;
-  librdf_hash_memory_node* current_node;
-  librdf_hash_memory_node_value *current_value;
-} librdf_hash_memory_cursor_context;
-
-
-
 /**
  * librdf_hash_memory_cursor_init:
  * @cursor_context: hash cursor context
@@ -490,23 +1878,118 @@ librdf_hash_memory_cursor_init(void *cursor_context, void *hash_context)
   librdf_hash_memory_cursor_context *cursor=(librdf_hash_memory_cursor_context*)cursor_context;
 
   cursor->hash = (librdf_hash_memory_context*)hash_context;
+  cursor->hash->cursors++;
+  cursor->is_counted=1;
   return 0;
 }
 
 
-/**
- * librdf_hash_memory_cursor_get:
+/*
+ * librdf_hash_memory_snapshot_cursor_get - Cursor get over a snapshot image
+ * @cursor: memory hash cursor context
+ * @key: pointer to key to use
+ * @value: pointer to value to use
+ * @flags: flags
+ *
+ * As librdf_hash_memory_cursor_get() but walking the image records,
+ * which are contiguous so no buckets need visiting.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_hash_memory_snapshot_cursor_get(librdf_hash_memory_cursor_context* cursor,
+                                       librdf_hash_datum *key,
+                                       librdf_hash_datum *value,
+                                       unsigned int flags)
+{
+  librdf_hash_memory_context* hash=cursor->hash;
+  const u64* offsets=LIBRDF_HASH_MEMORY_SNAPSHOT_OFFSETS(hash->image);
+  u32 capacity=LIBRDF_HASH_MEMORY_SNAPSHOT_HEADER(hash->image)->capacity;
+  const u32* record;
+
+  /* Move to start of hash if necessary  */
+  if(flags == LIBRDF_HASH_CURSOR_FIRST) {
+    cursor->image_record=0;
+    if(offsets[0] < offsets[capacity])
+      cursor->image_record=(size_t)offsets[0];
+    cursor->image_value=0;
+  }
+
+  /* If still have no current record, try to find it from the key */
+  if(!cursor->image_record && key && key->data) {
+    cursor->image_record=librdf_hash_memory_snapshot_find(hash, key->data,
+                                                          key->size);
+    cursor->image_value=0;
+  }
+
+  /* If still have no record, failed */
+  if(!cursor->image_record)
+    return 1;
+
+  record=(const u32*)(hash->image + cursor->image_record);
+
+  switch(flags) {
+    case LIBRDF_HASH_CURSOR_SET:
+
+      /* FALLTHROUGH */
+    case LIBRDF_HASH_CURSOR_NEXT_VALUE:
+      /* If want values and have reached end of values, end */
+      if(cursor->image_value >= record[3])
+        return 1;
+
+      value->data=librdf_hash_memory_snapshot_value(hash, cursor->image_record,
+                                                    cursor->image_value++,
+                                                    &value->size);
+      break;
+
+    case LIBRDF_HASH_CURSOR_FIRST:
+    case LIBRDF_HASH_CURSOR_NEXT:
+      /* get key */
+      key->data=hash->image + cursor->image_record +
+        LIBRDF_HASH_MEMORY_SNAPSHOT_RECORD_HEADER_SIZE;
+      key->size=record[2];
+
+      /* if want values, walk through them */
+      if(value) {
+        value->data=librdf_hash_memory_snapshot_value(hash,
+                                                      cursor->image_record,
+                                                      cursor->image_value++,
+                                                      &value->size);
+        if(cursor->image_value < record[3])
+          break;
+      }
+
+      /* move on to next record */
+      cursor->image_record+=record[0];
+      if(cursor->image_record >= (size_t)offsets[capacity])
+        cursor->image_record=0;
+      cursor->image_value=0;
+      break;
+
+    default:
+      librdf_log(hash->world,
+                 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_HASH, NULL,
+                 "Unknown hash method flag %d", flags);
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * librdf_hash_memory_cursor_get_nodes - Cursor get over the hash nodes alone
  * @context: memory hash cursor context
  * @key: pointer to key to use
  * @value: pointer to value to use
  * @flags: flags
  *
- * Retrieve a hash value for the given key.
+ * Retrieve a hash value for the given key, ignoring any base.
  * 
  * Return value: non 0 on failure
- **/
+ */
 static int
-librdf_hash_memory_cursor_get(void* context, 
+librdf_hash_memory_cursor_get_nodes(void* context, 
                               librdf_hash_datum *key,
                               librdf_hash_datum *value,
                               unsigned int flags)
@@ -515,6 +1998,8 @@ librdf_hash_memory_cursor_get(void* context,
   librdf_hash_memory_node_value *vnode=NULL;
   librdf_hash_memory_node *node;
   
+  if(cursor->hash->image)
+    return librdf_hash_memory_snapshot_cursor_get(cursor, key, value, flags);
 
   /* First step, make sure cursor->current_node points to a valid node,
      if possible */
@@ -527,8 +2012,8 @@ librdf_hash_memory_cursor_get(void* context,
     /* find first used bucket (with keys) */
     cursor->current_bucket=0;
 
-    for(i=0; i< cursor->hash->capacity; i++)
-      if((cursor->current_node=cursor->hash->nodes[i])) {
+    for(i=0; i< cursor->hash->old_capacity + cursor->hash->capacity; i++)
+      if((cursor->current_node=*librdf_hash_memory_bucket(cursor->hash, i))) {
         cursor->current_bucket=i;
         break;
       }
@@ -568,12 +2053,13 @@ librdf_hash_memory_cursor_get(void* context,
     case LIBRDF_HASH_CURSOR_FIRST:
     case LIBRDF_HASH_CURSOR_NEXT:
       /* If have reached last bucket, end */
-      if(cursor->current_bucket >= cursor->hash->capacity)
+      if(cursor->current_bucket >=
+         cursor->hash->old_capacity + cursor->hash->capacity)
         return 1;
       
       break;
     default:
-      librdf_log(cursor->hash->hash->world,
+      librdf_log(cursor->hash->world,
                  0, LIBRDF_LOG_ERROR, LIBRDF_FROM_HASH, NULL,
                  "Unknown hash method flag %d", flags);
       return 1;
@@ -628,8 +2114,9 @@ librdf_hash_memory_cursor_get(void* context,
         int i;
         
         /* end of list - move to next used bucket */
-        for(i=cursor->current_bucket+1; i< cursor->hash->capacity; i++)
-          if((node=cursor->hash->nodes[i])) {
+        for(i=cursor->current_bucket+1;
+            i< cursor->hash->old_capacity + cursor->hash->capacity; i++)
+          if((node=*librdf_hash_memory_bucket(cursor->hash, i))) {
             cursor->current_bucket=i;
             break;
           }
@@ -641,7 +2128,7 @@ librdf_hash_memory_cursor_get(void* context,
       
       break;
     default:
-      librdf_log(cursor->hash->hash->world,
+      librdf_log(cursor->hash->world,
                  0, LIBRDF_LOG_ERROR, LIBRDF_FROM_HASH, NULL,
                  "Unknown hash method flag %d", flags);
       return 1;
@@ -652,6 +2139,148 @@ librdf_hash_memory_cursor_get(void* context,
 }
 
 
+/*
+ * librdf_hash_memory_base_key_visible - Test if a base key has visible values
+ * @hash: memory hash context with a base
+ * @key: key
+ *
+ * Return value: non 0 if some values of the key in the base are not deleted
+ */
+static int
+librdf_hash_memory_base_key_visible(librdf_hash_memory_context* hash,
+                                    librdf_hash_datum *key)
+{
+  int count;
+  librdf_hash_memory_node* node;
+
+  count=librdf_hash_memory_live_count(hash->base, key->data, key->size);
+  if(count && hash->deleted) {
+    node=librdf_hash_memory_find_node(hash->deleted, key->data, key->size,
+                                      NULL, NULL);
+    if(node)
+      count-=node->values_count;
+  }
+
+  return count > 0;
+}
+
+
+/**
+ * librdf_hash_memory_cursor_get:
+ * @context: memory hash cursor context
+ * @key: pointer to key to use
+ * @value: pointer to value to use
+ * @flags: flags
+ *
+ * Retrieve a hash value for the given key.
+ *
+ * A hash with a base returns the pairs of the base that were not
+ * deleted followed by those of its nodes.  When returning keys alone,
+ * a key is returned from the base if any of its values there are
+ * visible and from the nodes otherwise.
+ * 
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_hash_memory_cursor_get(void* context, 
+                              librdf_hash_datum *key,
+                              librdf_hash_datum *value,
+                              unsigned int flags)
+{
+  librdf_hash_memory_cursor_context *cursor=(librdf_hash_memory_cursor_context*)context;
+  librdf_hash_memory_context* hash=cursor->hash;
+  librdf_hash_memory_cursor_context *base_cursor;
+  int status;
+
+  if(!hash->base)
+    return librdf_hash_memory_cursor_get_nodes(cursor, key, value, flags);
+
+  if(!cursor->base_cursor) {
+    cursor->base_cursor = LIBRDF_CALLOC(librdf_hash_memory_cursor_context*, 1,
+                                        sizeof(*base_cursor));
+    if(!cursor->base_cursor)
+      return 1;
+    cursor->base_cursor->hash=hash->base;
+  }
+  base_cursor=cursor->base_cursor;
+
+  switch(flags) {
+    case LIBRDF_HASH_CURSOR_FIRST:
+      cursor->in_nodes=0;
+      cursor->current_node=NULL;
+
+      /* FALLTHROUGH */
+    case LIBRDF_HASH_CURSOR_NEXT:
+      if(!cursor->in_nodes) {
+        status=librdf_hash_memory_cursor_get(base_cursor, key, value, flags);
+        while(!status &&
+              (value ? librdf_hash_memory_is_deleted(hash,
+                                                     key->data, key->size,
+                                                     value->data, value->size)
+                     : !librdf_hash_memory_base_key_visible(hash, key))) {
+          key->data=NULL;
+          status=librdf_hash_memory_cursor_get(base_cursor, key, value,
+                                               LIBRDF_HASH_CURSOR_NEXT);
+        }
+        if(!status)
+          return 0;
+
+        cursor->in_nodes=1;
+        flags=LIBRDF_HASH_CURSOR_FIRST;
+      }
+
+      status=librdf_hash_memory_cursor_get_nodes(cursor, key, value, flags);
+      /* keys alone: skip those already returned from the base */
+      while(!status && !value &&
+            librdf_hash_memory_base_key_visible(hash, key)) {
+        key->data=NULL;
+        status=librdf_hash_memory_cursor_get_nodes(cursor, key, value,
+                                                   LIBRDF_HASH_CURSOR_NEXT);
+      }
+      return status;
+
+    case LIBRDF_HASH_CURSOR_SET:
+      if(cursor->set_key.data)
+        LIBRDF_FREE(char*, cursor->set_key.data);
+      cursor->set_key.data = LIBRDF_MALLOC(void*, key->size ? key->size : 1);
+      if(!cursor->set_key.data)
+        return 1;
+      memcpy(cursor->set_key.data, key->data, key->size);
+      cursor->set_key.size=key->size;
+      cursor->in_nodes=0;
+      cursor->current_node=NULL;
+
+      /* FALLTHROUGH */
+    case LIBRDF_HASH_CURSOR_NEXT_VALUE:
+      if(!cursor->in_nodes) {
+        status=librdf_hash_memory_cursor_get(base_cursor, &cursor->set_key,
+                                             value, flags);
+        while(!status &&
+              librdf_hash_memory_is_deleted(hash, cursor->set_key.data,
+                                            cursor->set_key.size,
+                                            value->data, value->size))
+          status=librdf_hash_memory_cursor_get(base_cursor, &cursor->set_key,
+                                               value,
+                                               LIBRDF_HASH_CURSOR_NEXT_VALUE);
+        if(!status)
+          return 0;
+
+        cursor->in_nodes=1;
+        flags=LIBRDF_HASH_CURSOR_SET;
+      }
+
+      return librdf_hash_memory_cursor_get_nodes(cursor, &cursor->set_key,
+                                                 value, flags);
+
+    default:
+      librdf_log(hash->world,
+                 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_HASH, NULL,
+                 "Unknown hash method flag %d", flags);
+      return 1;
+  }
+}
+
+
 /**
  * librdf_hash_memory_cursor_finished:
  * @context: hash memory get iterator context
@@ -662,8 +2291,18 @@ librdf_hash_memory_cursor_get(void* context,
 static void
 librdf_hash_memory_cursor_finish(void* context)
 {
-/* librdf_hash_memory_cursor_context *cursor=(librdf_hash_memory_cursor_context*)context; */
+  librdf_hash_memory_cursor_context *cursor=(librdf_hash_memory_cursor_context*)context;
+
+  if(cursor->is_counted)
+    cursor->hash->cursors--;
+
+  if(cursor->base_cursor) {
+    librdf_hash_memory_cursor_finish(cursor->base_cursor);
+    LIBRDF_FREE(librdf_hash_memory_cursor_context, cursor->base_cursor);
+  }
 
+  if(cursor->set_key.data)
+    LIBRDF_FREE(char*, cursor->set_key.data);
 }
 
 
@@ -682,6 +2321,36 @@ librdf_hash_memory_put(void* context, librdf_hash_datum *key,
 		       librdf_hash_datum *value) 
 {
   librdf_hash_memory_context* hash=(librdf_hash_memory_context*)context;
+
+  if(hash->image && librdf_hash_memory_snapshot_load(hash))
+    return 1;
+  hash->dirty=1;
+
+  /* adding back a deleted pair of the base */
+  if(librdf_hash_memory_is_deleted(hash, key->data, key->size,
+                                   value->data, value->size)) {
+    if(librdf_hash_memory_delete_key_value(hash->deleted, key, value))
+      return 1;
+    hash->values++;
+    return 0;
+  }
+
+  return librdf_hash_memory_put_node(hash, key, value);
+}
+
+
+/*
+ * librdf_hash_memory_put_node - Store a key/value pair in the hash nodes
+ * @hash: memory hash context
+ * @key: pointer to key to store
+ * @value: pointer to value to store
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_hash_memory_put_node(librdf_hash_memory_context* hash,
+                            librdf_hash_datum *key, librdf_hash_datum *value)
+{
   librdf_hash_memory_node *node;
   librdf_hash_memory_node_value *vnode;
   u32 hash_key;
@@ -693,6 +2362,8 @@ librdf_hash_memory_put(void* context, librdf_hash_datum *key,
   /* ensure there is enough space in the hash */
   if (librdf_hash_memory_expand_size(hash))
     return 1;
+
+  librdf_hash_memory_rehash_step(hash, librdf_hash_rehash_step);
   
   /* find node for key */
   node=librdf_hash_memory_find_node(hash,
@@ -754,6 +2425,8 @@ librdf_hash_memory_put(void* context, librdf_hash_datum *key,
 
   /* put new value node in list */
   vnode->next=node->values;
+  if(node->values)
+    node->values->prev=vnode;
   node->values=vnode;
 
   /* note that in counter */
@@ -764,6 +2437,8 @@ librdf_hash_memory_put(void* context, librdf_hash_datum *key,
   vnode->value=new_value;
   vnode->value_len=value->size;
 
+  librdf_hash_memory_value_index_add(node, vnode);
+
 
   /* now update buckets and hash counts */
   if(is_new_node) {
@@ -799,28 +2474,10 @@ librdf_hash_memory_exists(void* context,
                           librdf_hash_datum *key, librdf_hash_datum *value)
 {
   librdf_hash_memory_context* hash=(librdf_hash_memory_context*)context;
-  librdf_hash_memory_node* node;
-  librdf_hash_memory_node_value *vnode;
-  
-  node=librdf_hash_memory_find_node(hash,
-				    (char*)key->data, key->size,
-				    NULL, NULL);
-  /* key not found */
-  if(!node)
-    return 0;
-  
-  /* no value wanted */
-  if(!value)
-    return 1;
-
-  /* search for value in list of values */
-  for(vnode=node->values; vnode; vnode=vnode->next) {
-    if(value->size == vnode->value_len && 
-       !memcmp(value->data, vnode->value, value->size))
-      break;
-  }
 
-  return (vnode != NULL);
+  return librdf_hash_memory_exists_pair(hash, key->data, key->size,
+                                        value ? value->data : NULL,
+                                        value ? value->size : 0);
 }
 
 
@@ -841,37 +2498,39 @@ librdf_hash_memory_delete_key_value(void* context, librdf_hash_datum *key,
 {
   librdf_hash_memory_context* hash=(librdf_hash_memory_context*)context;
   librdf_hash_memory_node *node, *prev, *next;
-  librdf_hash_memory_node_value *vnode, *vprev;
+  librdf_hash_memory_node_value *vnode;
   int bucket;
   
+  if(hash->image && librdf_hash_memory_snapshot_load(hash))
+    return 1;
+
+  librdf_hash_memory_rehash_step(hash, librdf_hash_rehash_step);
+
   node=librdf_hash_memory_find_node(hash, 
 				    (char*)key->data, key->size,
 				    &bucket, &prev);
-  /* key not found anywhere */
+  /* key not found in the nodes; maybe in the base */
   if(!node)
-    return 1;
+    return librdf_hash_memory_delete_base_value(hash, key, value);
 
-  /* search for value in list of values */
-  vnode=node->values;
-  vprev=NULL;
-  while(vnode) {
-    if(value->size == vnode->value_len && 
-       !memcmp(value->data, vnode->value, value->size))
-      break;
-    vprev=vnode;
-    vnode=vnode->next;
-  }
+  vnode=librdf_hash_memory_find_value(node, value->data, value->size);
 
-  /* key/value combination not found */
+  /* key/value combination not found in the nodes; maybe in the base */
   if(!vnode)
-    return 1;
+    return librdf_hash_memory_delete_base_value(hash, key, value);
+
+  librdf_hash_memory_value_index_remove(node, vnode);
+  hash->dirty=1;
 
   /* found - delete it from list */
-  if(!vprev) {
+  if(!vnode->prev) {
     /* at start of list so delete from there */
     node->values=vnode->next;
   } else
-    vprev->next=vnode->next;
+    vnode->prev->next=vnode->next;
+  if(vnode->next)
+    vnode->next->prev=vnode->prev;
+  node->values_count--;
 
   /* free value and value node */
   if(vnode->value)
@@ -891,7 +2550,7 @@ librdf_hash_memory_delete_key_value(void* context, librdf_hash_datum *key,
 
   if(!prev) {
     /* is at start of list, so delete from there */
-    if(!(hash->nodes[bucket]=node->next))
+    if(!(*librdf_hash_memory_bucket(hash, bucket)=node->next))
       /* hash bucket occupancy is one less if bucket is now empty */
       hash->size--;
     next=NULL;
@@ -941,18 +2600,28 @@ librdf_hash_memory_delete_key(void* context, librdf_hash_datum *key)
   librdf_hash_memory_context* hash=(librdf_hash_memory_context*)context;
   librdf_hash_memory_node *node, *prev;
   int bucket;
+  int deleted;
   
+  if(hash->image && librdf_hash_memory_snapshot_load(hash))
+    return 1;
+
+  librdf_hash_memory_rehash_step(hash, librdf_hash_rehash_step);
+
+  deleted=librdf_hash_memory_delete_base_key(hash, key);
+
   node=librdf_hash_memory_find_node(hash, 
 				    (char*)key->data, key->size,
 				    &bucket, &prev);
-  /* not found anywhere */
+  /* not found in the nodes */
   if(!node)
-    return 1;
+    return !deleted;
+
+  hash->dirty=1;
 
   /* search list from here */
   if(!prev) {
     /* is at start of list, so delete from there */
-    if(!(hash->nodes[bucket]=node->next))
+    if(!(*librdf_hash_memory_bucket(hash, bucket)=node->next))
       /* hash bucket occupancy is one less if bucket is now empty */
       hash->size--;
   } else
@@ -974,14 +2643,36 @@ librdf_hash_memory_delete_key(void* context, librdf_hash_datum *key)
  *
  * Flush the hash to disk.
  * 
- * Not used
+ * Writes the snapshot file if the hash has one, is writable and has
+ * changed.  A clone still sharing layers cannot be written while
+ * cursors are open on it.
  * 
- * Return value: 0
+ * Return value: non 0 on failure
  **/
 static int
 librdf_hash_memory_sync(void* context) 
 {
-  /* Not applicable */
+  librdf_hash_memory_context* hash=(librdf_hash_memory_context*)context;
+
+  if(!hash->snapshot_name || !hash->is_writable || !hash->dirty)
+    return 0;
+
+  /* flattening frees the layers that open cursors are walking */
+  if(hash->base && hash->cursors) {
+    librdf_log(hash->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_HASH, NULL,
+               "cannot write hash snapshot '%s' while it is being read",
+               hash->snapshot_name);
+    return 1;
+  }
+
+  /* the image holds every pair itself */
+  if(librdf_hash_memory_flatten(hash))
+    return 1;
+
+  if(librdf_hash_memory_snapshot_write(hash))
+    return 1;
+
+  hash->dirty=0;
   return 0;
 }
 
@@ -178,6 +178,126 @@ librdf_new_world(void)
 }
 
 
+/**
+ * librdf_new_world_from_world:
+ * @old_world: template redland world object
+ *
+ * Copy constructor - create a new world sharing a template world's set up.
+ *
+ * The new world is created already opened and shares, rather than
+ * builds again, the registered factories, the raptor and rasqal
+ * library instances and the RDF concepts of @old_world, which is
+ * opened here if it has not been already.  This makes it a cheap way
+ * to get a fresh world per request or per forked child process from a
+ * template world prepared once at startup.
+ *
+ * Blank node identifiers are generated from the template so they stay
+ * unique across all its worlds, and log messages from raptor and
+ * rasqal are reported through the template world's handlers.
+ * The template world must not be freed before any world made from
+ * it and, like any world, shared worlds must not be used by several
+ * threads at once.
+ *
+ * Returns: a new #librdf_world or NULL on failure
+ */
+librdf_world*
+librdf_new_world_from_world(librdf_world* old_world)
+{
+  librdf_world *world;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(old_world, librdf_world, NULL);
+
+  librdf_world_open(old_world);
+
+  /* always share from the original template */
+  if(old_world->template_world)
+    old_world = old_world->template_world;
+
+  world = LIBRDF_CALLOC(librdf_world*, 1, sizeof(*world));
+  if(!world)
+    return NULL;
+
+  world->template_world = old_world;
+
+  world->error_user_data = old_world->error_user_data;
+  world->error_handler = old_world->error_handler;
+  world->warning_user_data = old_world->warning_user_data;
+  world->warning_handler = old_world->warning_handler;
+  world->log_user_data = old_world->log_user_data;
+  world->log_handler = old_world->log_handler;
+
+  world->digest_factory_name = old_world->digest_factory_name;
+  world->digest_factory = old_world->digest_factory;
+  world->hash_load_factor = old_world->hash_load_factor;
+
+  /* shared registrations and library instances */
+  world->models = old_world->models;
+  world->storages = old_world->storages;
+  world->parsers = old_world->parsers;
+  world->serializers = old_world->serializers;
+  world->query_factories = old_world->query_factories;
+  world->digests = old_world->digests;
+  world->hashes = old_world->hashes;
+  world->storage_modules = old_world->storage_modules;
+  world->storage_module_stubs = old_world->storage_module_stubs;
+
+  world->concept_ms_namespace_uri = old_world->concept_ms_namespace_uri;
+  world->concept_schema_namespace_uri = old_world->concept_schema_namespace_uri;
+  world->xsd_namespace_uri = old_world->xsd_namespace_uri;
+
+  world->raptor_world_ptr = old_world->raptor_world_ptr;
+  world->raptor_world_allocated_here = 0;
+  world->rasqal_world_ptr = old_world->rasqal_world_ptr;
+  world->rasqal_world_allocated_here = 0;
+
+  /* state private to this world */
+  librdf_world_init_mutex(world);
+
+  world->opened = 1;
+
+  /* No bnode_hash: the raptor generate id handler is shared so blank
+   * node ids are mapped in the template world's hash.
+   */
+
+  return world;
+}
+
+
+/*
+ * librdf_world_release_template:
+ * @world: redland world object made by librdf_new_world_from_world()
+ *
+ * INTERNAL - Forget everything shared with the template world
+ *
+ * After this, the module terminate functions only free what @world
+ * owns itself.
+ */
+static void
+librdf_world_release_template(librdf_world *world)
+{
+  world->digest_factory = NULL;
+
+  world->models = NULL;
+  world->storages = NULL;
+  world->parsers = NULL;
+  world->serializers = NULL;
+  world->query_factories = NULL;
+  world->digests = NULL;
+  world->hashes = NULL;
+  world->storage_modules = NULL;
+  world->storage_module_stubs = NULL;
+
+  world->concept_ms_namespace_uri = NULL;
+  world->concept_schema_namespace_uri = NULL;
+  world->xsd_namespace_uri = NULL;
+
+  world->raptor_world_ptr = NULL;
+  world->rasqal_world_ptr = NULL;
+
+  world->template_world = NULL;
+}
+
+
 /**
  * librdf_free_world:
  * @world: redland world object
@@ -190,6 +310,12 @@ librdf_free_world(librdf_world *world)
   if(!world)
     return;
   
+  /* Closes any trace output before anything else goes */
+  librdf_finish_trace(world);
+
+  if(world->template_world)
+    librdf_world_release_template(world);
+
   librdf_finish_serializer(world);
   librdf_finish_parser(world);
 
@@ -210,6 +336,8 @@ librdf_free_world(librdf_world *world)
 
   librdf_finish_digest(world);
 
+  librdf_finish_metrics(world);
+
 #ifdef WITH_THREADS
 
   if(world->hash_datums_mutex) {
@@ -451,13 +579,52 @@ librdf_world_set_digest(librdf_world* world, const char *name)
  * 
  * Get the value of a world feature.
  *
+ * The generated ID features of a world made by
+ * librdf_new_world_from_world() are those of its template world.
+ *
  * Return value: new #librdf_node feature value or NULL if no such feature
  * exists or the value is empty.
  **/
 librdf_node*
 librdf_world_get_feature(librdf_world* world, librdf_uri *feature) 
 {
-  return NULL; /* none retrievable */
+  librdf_uri* genid_base;
+  librdf_uri* genid_counter;
+  unsigned long value = 0;
+  int found = 1;
+  char buffer[24];
+
+  /* the template world owns the generated ID state */
+  if(world->template_world)
+    world = world->template_world;
+
+  genid_counter = librdf_new_uri(world,
+                                 (const unsigned char*)LIBRDF_WORLD_FEATURE_GENID_COUNTER);
+  genid_base = librdf_new_uri(world,
+                              (const unsigned char*)LIBRDF_WORLD_FEATURE_GENID_BASE);
+
+#ifdef WITH_THREADS
+  pthread_mutex_lock(world->mutex);
+#endif
+  if(librdf_uri_equals(feature, genid_base))
+    value = world->genid_base;
+  else if(librdf_uri_equals(feature, genid_counter))
+    value = world->genid_counter;
+  else
+    found = 0;
+#ifdef WITH_THREADS
+  pthread_mutex_unlock(world->mutex);
+#endif
+
+  librdf_free_uri(genid_base);
+  librdf_free_uri(genid_counter);
+
+  if(!found)
+    return NULL;
+
+  sprintf(buffer, "%lu", value);
+  return librdf_new_node_from_literal(world, (const unsigned char*)buffer,
+                                      NULL, 0);
 }
 
 
@@ -469,6 +636,10 @@ librdf_world_get_feature(librdf_world* world, librdf_uri *feature)
  *
  * Set the value of a world feature.
  * 
+ * The generated ID features of a world made by
+ * librdf_new_world_from_world() are set on its template world, which
+ * makes the IDs for all of the worlds sharing it.
+ *
  * Return value: non 0 on failure (negative if no such feature)
  **/
 int
@@ -479,13 +650,17 @@ librdf_world_set_feature(librdf_world* world, librdf_uri* feature,
   librdf_uri* genid_counter;
   int rc= -1;
 
+  /* the template world owns the generated ID state */
+  if(world->template_world)
+    world = world->template_world;
+
   genid_counter = librdf_new_uri(world,
                                  (const unsigned char*)LIBRDF_WORLD_FEATURE_GENID_COUNTER);
   genid_base = librdf_new_uri(world,
                               (const unsigned char*)LIBRDF_WORLD_FEATURE_GENID_BASE);
 
   if(librdf_uri_equals(feature, genid_base)) {
-    if(!librdf_node_is_resource(value))
+    if(!librdf_node_is_literal(value))
       rc=1;
     else {
       long lid = atol((const char*)librdf_node_get_literal_value(value));
@@ -496,13 +671,15 @@ librdf_world_set_feature(librdf_world* world, librdf_uri* feature,
       pthread_mutex_lock(world->mutex);
 #endif
       world->genid_base = LIBRDF_GOOD_CAST(unsigned long, lid);
+      /* format the ID prefix again with the new base */
+      world->genid_prefix_pid = 0;
 #ifdef WITH_THREADS
       pthread_mutex_unlock(world->mutex);
 #endif
       rc = 0;
     }
   } else if(librdf_uri_equals(feature, genid_counter)) {
-    if(!librdf_node_is_resource(value))
+    if(!librdf_node_is_literal(value))
       rc = 1;
     else {
       long lid = atol((const char*)librdf_node_get_literal_value(value));
@@ -527,49 +704,101 @@ librdf_world_set_feature(librdf_world* world, librdf_uri* feature,
 }
 
 
-/* Internal */
-unsigned char*
-librdf_world_get_genid(librdf_world* world)
+/* Write decimal @value at @buffer returning the number of digits */
+static size_t
+librdf_world_format_ulong(unsigned char* buffer, unsigned long value)
 {
-  unsigned long id, tmpid, counter, tmpcounter, pid, tmppid;
+  unsigned char digits[20];
+  size_t length = 0;
+  size_t i;
+
+  do {
+    digits[length++] = LIBRDF_GOOD_CAST(unsigned char, '0' + (value % 10));
+    value /= 10;
+  } while(value);
+
+  for(i = 0; i < length; i++)
+    buffer[i] = digits[length - 1 - i];
+
+  return length;
+}
+
+
+/**
+ * librdf_world_format_genid:
+ * @world: redland world object
+ * @buffer: buffer of at least LIBRDF_GENID_MAX_LEN bytes
+ *
+ * INTERNAL - Generate a new blank node identifier into a buffer.
+ *
+ * The identifier is "r" then the ID base, the process ID and a unique
+ * counter separated by "r".  Only the counter is formatted for each
+ * identifier; the rest is kept in the world.
+ *
+ * Return value: length of the identifier written to @buffer
+ **/
+size_t
+librdf_world_format_genid(librdf_world* world, unsigned char* buffer)
+{
+  unsigned long counter, pid;
   size_t length;
-  unsigned char *buffer;
 
-  /* This is read-only and thread safe */
-  tmpid = (id = world->genid_base);
+  /* share the template's counter so IDs stay unique across its worlds */
+  if(world->template_world)
+    world = world->template_world;
+
+  /* Add the process ID to the seed to differentiate between
+   * simultaneously executed child processes.
+   */
+  pid = LIBRDF_GOOD_CAST(unsigned long, getpid());
+  if(!pid)
+    pid = 1;
 
 #ifdef WITH_THREADS
   pthread_mutex_lock(world->mutex);
 #endif
-  tmpcounter = (counter = world->genid_counter++);
+  counter = world->genid_counter++;
+
+  if(world->genid_prefix_pid != pid) {
+    unsigned char* p = world->genid_prefix;
+
+    *p++ = 'r';
+    p += librdf_world_format_ulong(p, world->genid_base);
+    *p++ = 'r';
+    p += librdf_world_format_ulong(p, pid);
+    *p++ = 'r';
+    world->genid_prefix_len = LIBRDF_GOOD_CAST(size_t, p - world->genid_prefix);
+    world->genid_prefix_pid = pid;
+  }
+
+  length = world->genid_prefix_len;
+  memcpy(buffer, world->genid_prefix, length);
 #ifdef WITH_THREADS
   pthread_mutex_unlock(world->mutex);
 #endif
 
-  /* Add the process ID to the seed to differentiate between
-   * simultaneously executed child processes.
-   */
-  pid = LIBRDF_GOOD_CAST(unsigned long, getpid());
-  if(!pid)
-    pid = 1;
-  tmppid = pid;
+  length += librdf_world_format_ulong(buffer + length, counter);
+  buffer[length] = '\0';
 
+  return length;
+}
 
-  /* min length 1 + "r" + min length 1 + "r" + min length 1 + "r" \0 */
-  length = 7;
 
-  while(tmpid /= 10)
-    length++;
-  while(tmpcounter /= 10)
-    length++;
-  while(tmppid /= 10)
-    length++;
-  
-  buffer = LIBRDF_MALLOC(unsigned char*, length);
+/* Internal */
+unsigned char*
+librdf_world_get_genid(librdf_world* world)
+{
+  unsigned char id[LIBRDF_GENID_MAX_LEN];
+  unsigned char *buffer;
+  size_t length;
+
+  length = librdf_world_format_genid(world, id);
+
+  buffer = LIBRDF_MALLOC(unsigned char*, length + 1);
   if(!buffer)
     return NULL;
 
-  sprintf((char*)buffer, "r%lur%lur%lu", id, pid, counter);
+  memcpy(buffer, id, length + 1);
   return buffer;
 }
 
@@ -724,8 +953,12 @@ int
 main(int argc, char *argv[]) 
 {
   librdf_world *world;
+  librdf_world *new_world;
   rasqal_world *rasqal_world;
   unsigned char* id;
+  unsigned char* id2;
+  librdf_uri* feature;
+  librdf_node* node;
   const char *program=librdf_basename((const char*)argv[0]);
 
   /* Minimal setup-cleanup test without opening the world */
@@ -777,11 +1010,107 @@ main(int argc, char *argv[])
     return 1;
   }
   fprintf(stdout, "%s: New identifier is: '%s'\n", program, id);
+
+  id2 = librdf_world_get_genid(world);
+  if(!id2 || !strcmp((const char*)id, (const char*)id2)) {
+    fprintf(stderr, "%s: second identifier '%s' is not different from '%s'\n",
+            program, id2 ? (const char*)id2 : "(null)", id);
+    return 1;
+  }
   LIBRDF_FREE(char*, id);
+  LIBRDF_FREE(char*, id2);
 
   fprintf(stdout, "%s: Deleting world\n", program);
   librdf_free_world(world);
 
+
+  /* Test making a world from a template world */
+  fprintf(stdout, "%s: Creating template world\n", program);
+  world = librdf_new_world();
+  if(!world) {
+    fprintf(stderr, "%s: librdf_new_world failed\n", program);
+    return 1;
+  }
+  librdf_world_open(world);
+
+  fprintf(stdout, "%s: Creating world from template world\n", program);
+  new_world = librdf_new_world_from_world(world);
+  if(!new_world) {
+    fprintf(stderr, "%s: librdf_new_world_from_world failed\n", program);
+    return 1;
+  }
+
+  if(librdf_world_get_raptor(new_world) != librdf_world_get_raptor(world)) {
+    fprintf(stderr, "%s: world from template world has a different raptor_world\n", program);
+    return 1;
+  }
+
+  if(LIBRDF_MS_type(new_world) != LIBRDF_MS_type(world)) {
+    fprintf(stderr, "%s: world from template world has a different rdf:type node\n", program);
+    return 1;
+  }
+
+  if(new_world->bnode_hash) {
+    fprintf(stderr, "%s: world from template world has its own bnode map\n", program);
+    return 1;
+  }
+
+  id = librdf_world_get_genid(world);
+  id2 = librdf_world_get_genid(new_world);
+  if(!id || !id2 || !strcmp((const char*)id, (const char*)id2)) {
+    fprintf(stderr, "%s: worlds sharing a template made identifiers '%s' and '%s'\n",
+            program, id ? (const char*)id : "(null)",
+            id2 ? (const char*)id2 : "(null)");
+    return 1;
+  }
+  LIBRDF_FREE(char*, id);
+  LIBRDF_FREE(char*, id2);
+
+  fprintf(stdout, "%s: Setting genid-base on world from template world\n", program);
+  feature = librdf_new_uri(new_world,
+                           (const unsigned char*)LIBRDF_WORLD_FEATURE_GENID_BASE);
+  node = librdf_new_node_from_literal(new_world, (const unsigned char*)"42",
+                                      NULL, 0);
+  if(!feature || !node || librdf_world_set_feature(new_world, feature, node)) {
+    fprintf(stderr, "%s: setting genid-base on world from template world failed\n",
+            program);
+    return 1;
+  }
+  librdf_free_node(node);
+
+  node = librdf_world_get_feature(world, feature);
+  if(!node || strcmp((const char*)librdf_node_get_literal_value(node), "42")) {
+    fprintf(stderr, "%s: template world genid-base was not set\n", program);
+    return 1;
+  }
+  librdf_free_node(node);
+  librdf_free_uri(feature);
+
+  id = librdf_world_get_genid(new_world);
+  id2 = librdf_world_get_genid(world);
+  if(!id || !id2 || strncmp((const char*)id, "r42r", 4) ||
+     strncmp((const char*)id2, "r42r", 4) ||
+     !strcmp((const char*)id, (const char*)id2)) {
+    fprintf(stderr, "%s: genid-base 42 made identifiers '%s' and '%s'\n",
+            program, id ? (const char*)id : "(null)",
+            id2 ? (const char*)id2 : "(null)");
+    return 1;
+  }
+  LIBRDF_FREE(char*, id);
+  LIBRDF_FREE(char*, id2);
+
+  fprintf(stdout, "%s: Deleting world from template world\n", program);
+  librdf_free_world(new_world);
+
+  /* template must still work */
+  if(!LIBRDF_MS_Seq(world)) {
+    fprintf(stderr, "%s: template world lost concepts\n", program);
+    return 1;
+  }
+
+  fprintf(stdout, "%s: Deleting template world\n", program);
+  librdf_free_world(world);
+
   /* keep gcc -Wall happy */
   return(0);
 }
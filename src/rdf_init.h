@@ -48,6 +48,8 @@ extern "C" {
 REDLAND_API
 librdf_world* librdf_new_world(void);
 REDLAND_API
+librdf_world* librdf_new_world_from_world(librdf_world* old_world);
+REDLAND_API
 void librdf_free_world(librdf_world *world);
 REDLAND_API
 void librdf_world_open(librdf_world *world);
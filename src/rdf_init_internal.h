@@ -30,6 +30,9 @@
 extern "C" {
 #endif
 
+/* Longest generated ID: "r" and an unsigned long three times + NUL */
+#define LIBRDF_GENID_MAX_LEN (3 * (1 + 20) + 1)
+
 #ifdef WITH_THREADS
 #include <pthread.h>
 #endif
@@ -101,6 +104,13 @@ struct librdf_world_s
   /* Unique counter from there */
   unsigned long genid_counter;
 
+  /* "r<base>r<pid>r" start of generated IDs, formatted once and
+   * again only when the base or the process ID changes (0 if unset)
+   */
+  unsigned char genid_prefix[LIBRDF_GENID_MAX_LEN];
+  size_t genid_prefix_len;
+  unsigned long genid_prefix_pid;
+
 #ifdef WITH_THREADS
   /* mutex so we can lock around this when we need to */
   pthread_mutex_t* mutex;
@@ -129,6 +139,11 @@ struct librdf_world_s
    */
   raptor_sequence* storage_modules;
 
+  /* Sequence of storage modules found but not yet loaded
+   * Used with --enable-modular / MODULAR_LIBRDF
+   */
+  raptor_sequence* storage_module_stubs;
+
   /* If libtdl has been opened with lt_dlinit()
    * Used with --enable-modular / MODULAR_LIBRDF
    */
@@ -153,6 +168,25 @@ struct librdf_world_s
   /* bnode id (raptor => internal) map during parsing */
   librdf_hash *bnode_hash;
 
+  /* table of recently made short literal nodes shared by the literal
+   * constructors (or NULL) - see rdf_node.c
+   */
+  librdf_node** shared_literals;
+
+  /* operation metrics, recorded once librdf_world_get_metrics() has
+   * been called (or NULL) - see rdf_metrics.c
+   */
+  librdf_metrics* metrics;
+
+  /* trace span handlers (trace_enabled is set when there are any)
+   * and any Chrome trace writer - see rdf_trace.c
+   */
+  int trace_enabled;
+  librdf_trace_handler trace_begin_handler;
+  librdf_trace_handler trace_end_handler;
+  void* trace_user_data;
+  librdf_trace_chrome* trace_chrome;
+
   librdf_raptor_init_handler raptor_init_handler;
   void* raptor_init_handler_user_data;
 
@@ -160,9 +194,15 @@ struct librdf_world_s
   void* rasqal_init_handler_user_data;
 
   librdf_uri* xsd_namespace_uri;
+
+  /* World this one shares factories, library instances and concepts
+   * with or NULL.  Set by librdf_new_world_from_world()
+   */
+  librdf_world* template_world;
 };
 
 unsigned char* librdf_world_get_genid(librdf_world* world);
+size_t librdf_world_format_genid(librdf_world* world, unsigned char* buffer);
 
 
 #ifdef __cplusplus
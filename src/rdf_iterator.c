@@ -32,6 +32,7 @@
 #endif
 
 #include <stdio.h>
+#include <string.h>
 
 #include <redland.h>
 
@@ -89,17 +90,6 @@ librdf_new_iterator(librdf_world *world,
 }
 
 
-/* helper function for deleting list map */
-static void
-librdf_iterator_free_iterator_map(void *list_data, void *user_data) 
-{
-  librdf_iterator_map* map=(librdf_iterator_map*)list_data;
-  if(map->free_context)
-    map->free_context(map->context);
-  LIBRDF_FREE(librdf_iterator_map, map);
-}
-
-  
 
 /**
  * librdf_free_iterator:
@@ -117,10 +107,16 @@ librdf_free_iterator(librdf_iterator* iterator)
   if(iterator->finished_method)
     iterator->finished_method(iterator->context);
 
-  if(iterator->map_list) {
-    librdf_list_foreach(iterator->map_list,
-                        librdf_iterator_free_iterator_map, NULL);
-    librdf_free_list(iterator->map_list);
+  if(iterator->maps) {
+    int i;
+
+    for(i=0; i < iterator->maps_count; i++) {
+      librdf_iterator_map *map=&iterator->maps[i];
+      if(map->free_context)
+        map->free_context(map->context);
+    }
+    if(iterator->maps != iterator->inline_maps)
+      LIBRDF_FREE(librdf_iterator_map, iterator->maps);
   }
   
   LIBRDF_FREE(librdf_iterator, iterator);
@@ -150,32 +146,18 @@ librdf_iterator_update_current_element(librdf_iterator* iterator)
   
   /* find next element subject to map */
   while(!iterator->is_end_method(iterator->context)) {
-    librdf_iterator* map_iterator; /* Iterator over iterator->map_list librdf_list */
+    int i;
+
     element=iterator->get_method(iterator->context, 
                                  LIBRDF_ITERATOR_GET_METHOD_GET_OBJECT);
     if(!element)
       break;
 
-    if(!iterator->map_list || !librdf_list_size(iterator->map_list))
-      break;
-    
-    map_iterator=librdf_list_get_iterator(iterator->map_list);
-    if(!map_iterator)
-      break;
-    
-    while(!librdf_iterator_end(map_iterator)) {
-      librdf_iterator_map *map=(librdf_iterator_map*)librdf_iterator_get_object(map_iterator);
-      if(!map)
-        break;
-      
-      /* apply the map to the element  */
+    /* apply the maps to the element in order */
+    for(i=0; element && i < iterator->maps_count; i++) {
+      librdf_iterator_map *map=&iterator->maps[i];
       element=map->fn(iterator, map->context, element);
-      if(!element)
-        break;
-
-      librdf_iterator_next(map_iterator);
     }
-    librdf_free_iterator(map_iterator);
     
 
     /* found something, return it */
@@ -390,24 +372,27 @@ librdf_iterator_add_map(librdf_iterator* iterator,
 {
   librdf_iterator_map *map;
   
-  if(!iterator->map_list) {
-    iterator->map_list=librdf_new_list(iterator->world);
-    if(!iterator->map_list)
+  if(!iterator->maps) {
+    iterator->maps=iterator->inline_maps;
+    iterator->maps_size=LIBRDF_ITERATOR_INLINE_MAPS;
+  } else if(iterator->maps_count == iterator->maps_size) {
+    librdf_iterator_map *maps;
+
+    maps = LIBRDF_MALLOC(librdf_iterator_map*,
+                         2 * iterator->maps_size * sizeof(*maps));
+    if(!maps)
       return 1;
+    memcpy(maps, iterator->maps, iterator->maps_count * sizeof(*maps));
+    if(iterator->maps != iterator->inline_maps)
+      LIBRDF_FREE(librdf_iterator_map, iterator->maps);
+    iterator->maps=maps;
+    iterator->maps_size *= 2;
   }
 
-  map = LIBRDF_CALLOC(librdf_iterator_map*, 1, sizeof(*map));
-  if(!map)
-    return 1;
-
+  map=&iterator->maps[iterator->maps_count++];
   map->fn=map_function;
   map->free_context=free_context;
   map->context=map_context;
-
-  if(librdf_list_add(iterator->map_list, map)) {
-    LIBRDF_FREE(librdf_iterator_map, map);
-    return 1;
-  }
   
   return 0;
 }
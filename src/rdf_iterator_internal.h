@@ -31,7 +31,10 @@
 extern "C" {
 #endif
 
-/* used in map_list below */
+/* Maps held in the object itself before an array is allocated */
+#define LIBRDF_ITERATOR_INLINE_MAPS 2
+
+/* used in maps below */
 typedef struct {
   void *context; /* context to pass on to map */
   librdf_iterator_map_handler fn;
@@ -47,7 +50,12 @@ struct librdf_iterator_s {
 
   /* Used when mapping */
   void *current;            /* stores current element */
-  librdf_list *map_list; /* non-empty means there is a list of maps */
+  /* maps_count maps to apply in order, in inline_maps until more
+   * than fit there are added */
+  librdf_iterator_map *maps;
+  int maps_count;
+  int maps_size;
+  librdf_iterator_map inline_maps[LIBRDF_ITERATOR_INLINE_MAPS];
   
   int (*is_end_method)(void*);
   int (*next_method)(void*);
@@ -0,0 +1,979 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rdf_metrics.c - RDF operation counters and latency histograms
+ *
+ * Copyright (C) 2004-2008, David Beckett http://www.dajobe.org/
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <rdf_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rdf_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef WITH_THREADS
+#include <pthread.h>
+#endif
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+/* for clock_gettime and gettimeofday */
+#if TIME_WITH_SYS_TIME
+#include <sys/time.h>
+#include <time.h>
+#else
+#if HAVE_SYS_TIME_H
+#include <sys/time.h>
+#else
+#include <time.h>
+#endif
+#endif
+
+#include <redland.h>
+
+
+#ifndef STANDALONE
+
+/* Name and pattern labels of each librdf_metrics_operation */
+static const char * const librdf_metrics_operation_names[LIBRDF_METRICS_LAST+1][2] = {
+  { "add", NULL },
+  { "remove", NULL },
+  { "contains", NULL },
+  { "find", "???" },
+  { "find", "??o" },
+  { "find", "?p?" },
+  { "find", "?po" },
+  { "find", "s??" },
+  { "find", "s?o" },
+  { "find", "sp?" },
+  { "find", "spo" },
+  { "sync", NULL },
+  { "transaction_commit", NULL }
+};
+
+static const char * const librdf_metrics_query_phase_names[LIBRDF_METRICS_QUERY_LAST+1] = {
+  "prepare", "execute"
+};
+
+
+static void
+librdf_metrics_lock(librdf_metrics* metrics)
+{
+#ifdef WITH_THREADS
+  pthread_mutex_lock(metrics->mutex);
+#endif
+}
+
+
+static void
+librdf_metrics_unlock(librdf_metrics* metrics)
+{
+#ifdef WITH_THREADS
+  pthread_mutex_unlock(metrics->mutex);
+#endif
+}
+
+
+/**
+ * librdf_world_get_metrics:
+ * @world: redland world object
+ *
+ * Get the operation metrics of a world.
+ *
+ * Nothing is recorded until this is first called, after which every
+ * storage operation, parse and query execution in the world is
+ * counted and timed.  The metrics are owned by the world and freed
+ * with it.
+ *
+ * Return value: #librdf_metrics object or NULL on failure
+ **/
+librdf_metrics*
+librdf_world_get_metrics(librdf_world* world)
+{
+  librdf_metrics* metrics;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, librdf_world, NULL);
+
+#ifdef WITH_THREADS
+  pthread_mutex_lock(world->mutex);
+#endif
+
+  metrics = world->metrics;
+  if(!metrics) {
+    metrics = LIBRDF_CALLOC(librdf_metrics*, 1, sizeof(*metrics));
+    if(metrics) {
+      metrics->world = world;
+#ifdef WITH_THREADS
+      metrics->mutex = (pthread_mutex_t *) SYSTEM_MALLOC(sizeof(pthread_mutex_t));
+      pthread_mutex_init(metrics->mutex, NULL);
+#endif
+      world->metrics = metrics;
+    }
+  }
+
+#ifdef WITH_THREADS
+  pthread_mutex_unlock(world->mutex);
+#endif
+
+  return metrics;
+}
+
+
+/**
+ * librdf_finish_metrics:
+ * @world: redland world object
+ *
+ * INTERNAL - Free the operation metrics of a world.
+ *
+ **/
+void
+librdf_finish_metrics(librdf_world* world)
+{
+  librdf_metrics* metrics = world->metrics;
+  librdf_metrics_storage* record;
+
+  if(!metrics)
+    return;
+
+  while((record = metrics->storages)) {
+    metrics->storages = record->next;
+    LIBRDF_FREE(char*, record->name);
+    LIBRDF_FREE(librdf_metrics_storage, record);
+  }
+
+#ifdef WITH_THREADS
+  pthread_mutex_destroy(metrics->mutex);
+  SYSTEM_FREE(metrics->mutex);
+#endif
+
+  LIBRDF_FREE(librdf_metrics, metrics);
+  world->metrics = NULL;
+}
+
+
+/**
+ * librdf_metrics_now:
+ *
+ * INTERNAL - Get a time in seconds for measuring intervals.
+ *
+ * Uses a monotonic clock where there is one.
+ *
+ * Return value: time in seconds
+ **/
+double
+librdf_metrics_now(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+  struct timespec ts;
+
+  if(!clock_gettime(CLOCK_MONOTONIC, &ts))
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+#endif
+#ifdef HAVE_GETTIMEOFDAY
+  {
+    struct timeval tv;
+
+    if(!gettimeofday(&tv, NULL))
+      return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+  }
+#endif
+
+  return (double)time(NULL);
+}
+
+
+/*
+ * librdf_metrics_histogram_add - Add one time to a histogram
+ * @histogram: histogram
+ * @seconds: time taken
+ */
+static void
+librdf_metrics_histogram_add(librdf_metrics_histogram* histogram,
+                             double seconds)
+{
+  double limit = 256.0 / 1000000000.0;
+  int i;
+
+  if(seconds < 0.0)
+    seconds = 0.0;
+
+  for(i = 0; i < LIBRDF_METRICS_BUCKETS - 1 && seconds > limit; i++)
+    limit *= 2.0;
+
+  histogram->count++;
+  histogram->seconds += seconds;
+  histogram->buckets[i]++;
+}
+
+
+/*
+ * librdf_metrics_histogram_merge - Add the times of one histogram to another
+ * @histogram: histogram to add to
+ * @other: histogram to add
+ */
+static void
+librdf_metrics_histogram_merge(librdf_metrics_histogram* histogram,
+                               librdf_metrics_histogram* other)
+{
+  int i;
+
+  histogram->count += other->count;
+  histogram->seconds += other->seconds;
+  for(i = 0; i < LIBRDF_METRICS_BUCKETS; i++)
+    histogram->buckets[i] += other->buckets[i];
+}
+
+
+/**
+ * librdf_metrics_storage_record:
+ * @storage: storage the operation was done on
+ * @operation: the operation
+ * @start: time the operation started from LIBRDF_METRICS_START()
+ *
+ * INTERNAL - Record the time a storage operation took.
+ *
+ **/
+void
+librdf_metrics_storage_record(librdf_storage* storage,
+                              librdf_metrics_operation operation,
+                              double start)
+{
+  librdf_metrics* metrics = storage->world->metrics;
+  librdf_metrics_storage* record;
+  double seconds;
+
+  if(start <= 0.0 || !metrics)
+    return;
+
+  seconds = librdf_metrics_now() - start;
+
+  librdf_metrics_lock(metrics);
+
+  record = storage->metrics;
+  if(!record) {
+    const char* name = storage->factory->name;
+    librdf_metrics_storage** last;
+
+    record = LIBRDF_CALLOC(librdf_metrics_storage*, 1, sizeof(*record));
+    if(record) {
+      record->name = LIBRDF_MALLOC(char*, strlen(name) + 1);
+      if(!record->name) {
+        LIBRDF_FREE(librdf_metrics_storage, record);
+        record = NULL;
+      }
+    }
+    if(!record) {
+      librdf_metrics_unlock(metrics);
+      return;
+    }
+    strcpy(record->name, name);
+    record->id = ++metrics->storage_id;
+
+    for(last = &metrics->storages; *last; last = &(*last)->next)
+      ;
+    *last = record;
+
+    storage->metrics = record;
+  }
+
+  librdf_metrics_histogram_add(&record->operations[operation], seconds);
+
+  librdf_metrics_unlock(metrics);
+}
+
+
+/**
+ * librdf_metrics_find_operation:
+ * @statement: partial statement to find or NULL
+ *
+ * INTERNAL - Get the find operation for the parts of a statement bound.
+ *
+ * Return value: find #librdf_metrics_operation
+ **/
+librdf_metrics_operation
+librdf_metrics_find_operation(librdf_statement* statement)
+{
+  int shape = 0;
+
+  if(statement) {
+    if(statement->subject)
+      shape += 4;
+    if(statement->predicate)
+      shape += 2;
+    if(statement->object)
+      shape += 1;
+  }
+
+  return (librdf_metrics_operation)(LIBRDF_METRICS_FIND + shape);
+}
+
+
+/**
+ * librdf_metrics_operation_name:
+ * @operation: storage operation
+ * @pattern_p: pointer to store the find pattern such as "s??" or NULL
+ *
+ * INTERNAL - Get the name of a storage operation.
+ *
+ * Return value: operation name shared with the metrics labels
+ **/
+const char*
+librdf_metrics_operation_name(librdf_metrics_operation operation,
+                              const char** pattern_p)
+{
+  if(pattern_p)
+    *pattern_p = librdf_metrics_operation_names[operation][1];
+
+  return librdf_metrics_operation_names[operation][0];
+}
+
+
+/**
+ * librdf_metrics_query_phase_name:
+ * @phase: query execution phase
+ *
+ * INTERNAL - Get the name of a query execution phase.
+ *
+ * Return value: phase name shared with the metrics labels
+ **/
+const char*
+librdf_metrics_query_phase_name(librdf_metrics_query_phase phase)
+{
+  return librdf_metrics_query_phase_names[phase];
+}
+
+
+/**
+ * librdf_metrics_storage_finished:
+ * @storage: storage being freed
+ *
+ * INTERNAL - Keep the metrics of a storage after it is freed.
+ *
+ * The operations recorded are added to the record with id 0 for the
+ * storage factory, so the totals do not go backwards and the records
+ * do not grow with every storage made.
+ *
+ **/
+void
+librdf_metrics_storage_finished(librdf_storage* storage)
+{
+  librdf_metrics* metrics = storage->world->metrics;
+  librdf_metrics_storage* record = storage->metrics;
+  librdf_metrics_storage* freed = NULL;
+  librdf_metrics_storage** prev = NULL;
+  librdf_metrics_storage** p;
+
+  if(!metrics || !record)
+    return;
+
+  librdf_metrics_lock(metrics);
+
+  for(p = &metrics->storages; *p; p = &(*p)->next) {
+    if(*p == record)
+      prev = p;
+    else if(!(*p)->id && !strcmp((*p)->name, record->name))
+      freed = *p;
+  }
+
+  if(!freed) {
+    /* this becomes the record of freed storages of the factory */
+    record->id = 0;
+  } else {
+    int i;
+
+    for(i = 0; i <= LIBRDF_METRICS_LAST; i++)
+      librdf_metrics_histogram_merge(&freed->operations[i],
+                                     &record->operations[i]);
+    if(prev)
+      *prev = record->next;
+    LIBRDF_FREE(char*, record->name);
+    LIBRDF_FREE(librdf_metrics_storage, record);
+  }
+
+  librdf_metrics_unlock(metrics);
+
+  storage->metrics = NULL;
+}
+
+
+/**
+ * librdf_metrics_parse_record:
+ * @world: redland world object
+ * @statements: number of statements parsed
+ * @start: time the parse started from LIBRDF_METRICS_START()
+ *
+ * INTERNAL - Record the statements a parse returned and the time taken.
+ *
+ **/
+void
+librdf_metrics_parse_record(librdf_world* world, unsigned long statements,
+                            double start)
+{
+  librdf_metrics* metrics = world->metrics;
+  double seconds;
+
+  if(start <= 0.0 || !metrics)
+    return;
+
+  seconds = librdf_metrics_now() - start;
+
+  librdf_metrics_lock(metrics);
+  metrics->parsed_statements += statements;
+  librdf_metrics_histogram_add(&metrics->parse, seconds);
+  librdf_metrics_unlock(metrics);
+}
+
+
+/**
+ * librdf_metrics_query_record:
+ * @world: redland world object
+ * @phase: query execution phase
+ * @start: time the phase started from LIBRDF_METRICS_START()
+ *
+ * INTERNAL - Record the time a query execution phase took.
+ *
+ **/
+void
+librdf_metrics_query_record(librdf_world* world,
+                            librdf_metrics_query_phase phase, double start)
+{
+  librdf_metrics* metrics = world->metrics;
+  double seconds;
+
+  if(start <= 0.0 || !metrics)
+    return;
+
+  seconds = librdf_metrics_now() - start;
+
+  librdf_metrics_lock(metrics);
+  librdf_metrics_histogram_add(&metrics->query[phase], seconds);
+  librdf_metrics_unlock(metrics);
+}
+
+
+/**
+ * librdf_metrics_get_storage_count:
+ * @metrics: #librdf_metrics object
+ * @storage: #librdf_storage object
+ * @operation: storage operation
+ *
+ * Get the number of times an operation was done on a storage.
+ *
+ * Return value: operation count
+ **/
+unsigned long
+librdf_metrics_get_storage_count(librdf_metrics* metrics,
+                                 librdf_storage* storage,
+                                 librdf_metrics_operation operation)
+{
+  unsigned long count = 0;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(metrics, librdf_metrics, 0);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 0);
+
+  if(operation > LIBRDF_METRICS_LAST)
+    return 0;
+
+  librdf_metrics_lock(metrics);
+  if(storage->metrics)
+    count = storage->metrics->operations[operation].count;
+  librdf_metrics_unlock(metrics);
+
+  return count;
+}
+
+
+/**
+ * librdf_metrics_get_storage_seconds:
+ * @metrics: #librdf_metrics object
+ * @storage: #librdf_storage object
+ * @operation: storage operation
+ *
+ * Get the total time an operation on a storage has taken.
+ *
+ * Return value: time in seconds
+ **/
+double
+librdf_metrics_get_storage_seconds(librdf_metrics* metrics,
+                                   librdf_storage* storage,
+                                   librdf_metrics_operation operation)
+{
+  double seconds = 0.0;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(metrics, librdf_metrics, 0.0);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 0.0);
+
+  if(operation > LIBRDF_METRICS_LAST)
+    return 0.0;
+
+  librdf_metrics_lock(metrics);
+  if(storage->metrics)
+    seconds = storage->metrics->operations[operation].seconds;
+  librdf_metrics_unlock(metrics);
+
+  return seconds;
+}
+
+
+/**
+ * librdf_metrics_get_parsed_statements:
+ * @metrics: #librdf_metrics object
+ *
+ * Get the number of statements returned by parsers.
+ *
+ * Return value: statement count
+ **/
+unsigned long
+librdf_metrics_get_parsed_statements(librdf_metrics* metrics)
+{
+  unsigned long count;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(metrics, librdf_metrics, 0);
+
+  librdf_metrics_lock(metrics);
+  count = metrics->parsed_statements;
+  librdf_metrics_unlock(metrics);
+
+  return count;
+}
+
+
+/**
+ * librdf_metrics_get_parse_seconds:
+ * @metrics: #librdf_metrics object
+ *
+ * Get the total time spent parsing.
+ *
+ * A parse is timed from the start until the statement stream is
+ * freed, so statements per second can be found with
+ * librdf_metrics_get_parsed_statements().
+ *
+ * Return value: time in seconds
+ **/
+double
+librdf_metrics_get_parse_seconds(librdf_metrics* metrics)
+{
+  double seconds;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(metrics, librdf_metrics, 0.0);
+
+  librdf_metrics_lock(metrics);
+  seconds = metrics->parse.seconds;
+  librdf_metrics_unlock(metrics);
+
+  return seconds;
+}
+
+
+/**
+ * librdf_metrics_get_query_count:
+ * @metrics: #librdf_metrics object
+ * @phase: query execution phase
+ *
+ * Get the number of times a query execution phase was run.
+ *
+ * Return value: phase count
+ **/
+unsigned long
+librdf_metrics_get_query_count(librdf_metrics* metrics,
+                               librdf_metrics_query_phase phase)
+{
+  unsigned long count;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(metrics, librdf_metrics, 0);
+
+  if(phase > LIBRDF_METRICS_QUERY_LAST)
+    return 0;
+
+  librdf_metrics_lock(metrics);
+  count = metrics->query[phase].count;
+  librdf_metrics_unlock(metrics);
+
+  return count;
+}
+
+
+/**
+ * librdf_metrics_get_query_seconds:
+ * @metrics: #librdf_metrics object
+ * @phase: query execution phase
+ *
+ * Get the total time a query execution phase has taken.
+ *
+ * Return value: time in seconds
+ **/
+double
+librdf_metrics_get_query_seconds(librdf_metrics* metrics,
+                                 librdf_metrics_query_phase phase)
+{
+  double seconds;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(metrics, librdf_metrics, 0.0);
+
+  if(phase > LIBRDF_METRICS_QUERY_LAST)
+    return 0.0;
+
+  librdf_metrics_lock(metrics);
+  seconds = metrics->query[phase].seconds;
+  librdf_metrics_unlock(metrics);
+
+  return seconds;
+}
+
+
+/**
+ * librdf_metrics_reset:
+ * @metrics: #librdf_metrics object
+ *
+ * Set all the counts and times recorded back to zero.
+ *
+ **/
+void
+librdf_metrics_reset(librdf_metrics* metrics)
+{
+  librdf_metrics_storage* record;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN(metrics, librdf_metrics);
+
+  librdf_metrics_lock(metrics);
+
+  for(record = metrics->storages; record; record = record->next)
+    memset(record->operations, '\0', sizeof(record->operations));
+
+  metrics->parsed_statements = 0;
+  memset(&metrics->parse, '\0', sizeof(metrics->parse));
+  memset(metrics->query, '\0', sizeof(metrics->query));
+
+  librdf_metrics_unlock(metrics);
+}
+
+
+/*
+ * librdf_metrics_write_histogram - Write a histogram in Prometheus text format
+ * @iostr: iostream to write to
+ * @name: metric name
+ * @labels: labels separated by commas or NULL
+ * @histogram: histogram
+ */
+static void
+librdf_metrics_write_histogram(raptor_iostream* iostr, const char* name,
+                               const char* labels,
+                               librdf_metrics_histogram* histogram)
+{
+  static const char * const suffixes[3] = { "_bucket", "_sum", "_count" };
+  char number[64];
+  unsigned long cumulative = 0;
+  double limit = 256.0 / 1000000000.0;
+  int i;
+
+  for(i = 0; i < LIBRDF_METRICS_BUCKETS + 2; i++) {
+    int suffix = (i < LIBRDF_METRICS_BUCKETS) ? 0 : i - LIBRDF_METRICS_BUCKETS + 1;
+
+    raptor_iostream_string_write(name, iostr);
+    raptor_iostream_string_write(suffixes[suffix], iostr);
+    raptor_iostream_write_byte('{', iostr);
+    if(labels)
+      raptor_iostream_string_write(labels, iostr);
+
+    if(!suffix) {
+      cumulative += histogram->buckets[i];
+      if(labels)
+        raptor_iostream_write_byte(',', iostr);
+      /* the last bucket counts everything */
+      if(i == LIBRDF_METRICS_BUCKETS - 1)
+        raptor_iostream_string_write("le=\"+Inf\"} ", iostr);
+      else {
+        sprintf(number, "le=\"%.9g\"} ", limit);
+        raptor_iostream_string_write(number, iostr);
+      }
+      limit *= 2.0;
+      sprintf(number, "%lu\n", cumulative);
+    } else {
+      raptor_iostream_string_write("} ", iostr);
+      if(suffix == 1)
+        sprintf(number, "%.9g\n", histogram->seconds);
+      else
+        sprintf(number, "%lu\n", histogram->count);
+    }
+    raptor_iostream_string_write(number, iostr);
+  }
+}
+
+
+/*
+ * librdf_metrics_write_family - Write the help and type of a Prometheus metric
+ * @iostr: iostream to write to
+ * @name: metric name
+ * @type: metric type
+ * @help: help text
+ */
+static void
+librdf_metrics_write_family(raptor_iostream* iostr, const char* name,
+                            const char* type, const char* help)
+{
+  raptor_iostream_string_write("# HELP ", iostr);
+  raptor_iostream_string_write(name, iostr);
+  raptor_iostream_write_byte(' ', iostr);
+  raptor_iostream_string_write(help, iostr);
+  raptor_iostream_string_write("\n# TYPE ", iostr);
+  raptor_iostream_string_write(name, iostr);
+  raptor_iostream_write_byte(' ', iostr);
+  raptor_iostream_string_write(type, iostr);
+  raptor_iostream_write_byte('\n', iostr);
+}
+
+
+/**
+ * librdf_metrics_write_prometheus:
+ * @metrics: #librdf_metrics object
+ * @iostr: iostream to write to
+ *
+ * Write the metrics in the Prometheus text exposition format.
+ *
+ * Storage operations are written as the histogram
+ * librdf_storage_operation_seconds labelled with the storage factory
+ * name, the instance number (0 for storages already freed), the
+ * operation and for finds the pattern such as "s?o".  Parsing is
+ * written as librdf_parser_statements_total and the histogram
+ * librdf_parser_seconds and query execution as the histogram
+ * librdf_query_phase_seconds labelled with the phase.  Histograms
+ * with nothing recorded are left out.
+ *
+ * Return value: non 0 on failure
+ **/
+int
+librdf_metrics_write_prometheus(librdf_metrics* metrics,
+                                raptor_iostream* iostr)
+{
+  librdf_metrics_storage* record;
+  char labels[256];
+  int i;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(metrics, librdf_metrics, 1);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(iostr, raptor_iostream, 1);
+
+  librdf_metrics_lock(metrics);
+
+  librdf_metrics_write_family(iostr, "librdf_storage_operation_seconds",
+                              "histogram",
+                              "Time taken by storage operations");
+  for(record = metrics->storages; record; record = record->next) {
+    char instance[32];
+
+    /* id 0 is the record of freed storages of the factory */
+    sprintf(instance, "%d", record->id);
+
+    for(i = 0; i <= LIBRDF_METRICS_LAST; i++) {
+      const char* const * names = librdf_metrics_operation_names[i];
+
+      if(!record->operations[i].count)
+        continue;
+
+      /* storage factory names are short identifiers */
+      if(names[1])
+        sprintf(labels,
+                "storage=\"%.64s\",instance=\"%s\",operation=\"%s\",pattern=\"%s\"",
+                record->name, instance, names[0], names[1]);
+      else
+        sprintf(labels, "storage=\"%.64s\",instance=\"%s\",operation=\"%s\"",
+                record->name, instance, names[0]);
+      librdf_metrics_write_histogram(iostr, "librdf_storage_operation_seconds",
+                                     labels, &record->operations[i]);
+    }
+  }
+
+  librdf_metrics_write_family(iostr, "librdf_parser_statements_total",
+                              "counter", "Statements returned by parsers");
+  sprintf(labels, "librdf_parser_statements_total %lu\n",
+          metrics->parsed_statements);
+  raptor_iostream_string_write(labels, iostr);
+
+  librdf_metrics_write_family(iostr, "librdf_parser_seconds", "histogram",
+                              "Time taken by parses");
+  if(metrics->parse.count)
+    librdf_metrics_write_histogram(iostr, "librdf_parser_seconds", NULL,
+                                   &metrics->parse);
+
+  librdf_metrics_write_family(iostr, "librdf_query_phase_seconds",
+                              "histogram",
+                              "Time taken by query execution phases");
+  for(i = 0; i <= LIBRDF_METRICS_QUERY_LAST; i++) {
+    if(!metrics->query[i].count)
+      continue;
+
+    sprintf(labels, "phase=\"%s\"", librdf_metrics_query_phase_names[i]);
+    librdf_metrics_write_histogram(iostr, "librdf_query_phase_seconds",
+                                   labels, &metrics->query[i]);
+  }
+
+  librdf_metrics_unlock(metrics);
+
+  return 0;
+}
+
+#endif
+
+
+
+/* TEST CODE */
+
+
+#ifdef STANDALONE
+
+/* one more prototype */
+int main(int argc, char *argv[]);
+
+
+int
+main(int argc, char *argv[])
+{
+  librdf_world *world;
+  librdf_storage *storage;
+  librdf_storage *copy;
+  librdf_model *model;
+  librdf_metrics *metrics;
+  librdf_statement *statement;
+  librdf_stream *stream;
+  raptor_iostream *iostr;
+  unsigned char *string = NULL;
+  size_t string_len = 0;
+  const char *program = librdf_basename((const char*)argv[0]);
+  const char *expected = "librdf_storage_operation_seconds_count{storage=\"hashes\",instance=\"1\",operation=\"find\",pattern=\"s??\"} 1\n";
+  const char *expected_add = "librdf_storage_operation_seconds_count{storage=\"hashes\",instance=\"2\",operation=\"add\"} 1\n";
+  int i;
+  int rc = 0;
+
+  world = librdf_new_world();
+  librdf_world_open(world);
+
+  fprintf(stdout, "%s: Getting world metrics\n", program);
+  metrics = librdf_world_get_metrics(world);
+  if(!metrics || librdf_world_get_metrics(world) != metrics) {
+    fprintf(stderr, "%s: Failed to get world metrics\n", program);
+    return 1;
+  }
+
+  storage = librdf_new_storage(world, "hashes", NULL, "hash-type='memory'");
+  model = librdf_new_model(world, storage, NULL);
+  if(!storage || !model) {
+    fprintf(stderr, "%s: Failed to create model\n", program);
+    return 1;
+  }
+
+  fprintf(stdout, "%s: Adding statements\n", program);
+  for(i = 0; i < 3; i++) {
+    char object[16];
+
+    sprintf(object, "%d", i);
+    statement = librdf_new_statement_from_nodes(world,
+      librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/s"),
+      librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/p"),
+      librdf_new_node_from_literal(world, (const unsigned char*)object, NULL, 0));
+    librdf_model_add_statement(model, statement);
+    librdf_free_statement(statement);
+  }
+
+  fprintf(stdout, "%s: Finding (S, ?, ?)\n", program);
+  statement = librdf_new_statement_from_nodes(world,
+    librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/s"),
+    NULL, NULL);
+  stream = librdf_model_find_statements(model, statement);
+  librdf_free_stream(stream);
+  librdf_free_statement(statement);
+
+  if(librdf_metrics_get_storage_count(metrics, storage, LIBRDF_METRICS_ADD) != 3) {
+    fprintf(stderr, "%s: Expected 3 adds, got %lu\n", program,
+            librdf_metrics_get_storage_count(metrics, storage, LIBRDF_METRICS_ADD));
+    rc = 1;
+  }
+  if(librdf_metrics_get_storage_count(metrics, storage, LIBRDF_METRICS_FIND_S) != 1) {
+    fprintf(stderr, "%s: Expected 1 (S, ?, ?) find, got %lu\n", program,
+            librdf_metrics_get_storage_count(metrics, storage, LIBRDF_METRICS_FIND_S));
+    rc = 1;
+  }
+
+  fprintf(stdout, "%s: Writing metrics\n", program);
+  iostr = raptor_new_iostream_to_string(world->raptor_world_ptr,
+                                        (void**)&string, &string_len, malloc);
+  librdf_metrics_write_prometheus(metrics, iostr);
+  raptor_free_iostream(iostr);
+  if(!string || !strstr((const char*)string, expected)) {
+    fprintf(stderr, "%s: Metrics did not contain %s", program, expected);
+    rc = 1;
+  }
+  if(string)
+    free(string);
+
+  fprintf(stdout, "%s: Resetting metrics\n", program);
+  librdf_metrics_reset(metrics);
+  if(librdf_metrics_get_storage_count(metrics, storage, LIBRDF_METRICS_ADD)) {
+    fprintf(stderr, "%s: Metrics were not reset\n", program);
+    rc = 1;
+  }
+
+  fprintf(stdout, "%s: Adding a batch of statements\n", program);
+  copy = librdf_new_storage(world, "hashes", NULL, "hash-type='memory'");
+  stream = librdf_storage_serialise(storage);
+  if(!copy || !stream || librdf_storage_add_statements(copy, stream)) {
+    fprintf(stderr, "%s: Failed to add a batch of statements\n", program);
+    return 1;
+  }
+  librdf_free_stream(stream);
+
+  if(librdf_metrics_get_storage_count(metrics, copy, LIBRDF_METRICS_ADD) != 1) {
+    fprintf(stderr, "%s: Expected 1 batched add, got %lu\n", program,
+            librdf_metrics_get_storage_count(metrics, copy, LIBRDF_METRICS_ADD));
+    rc = 1;
+  }
+  if(librdf_metrics_get_storage_count(metrics, storage, LIBRDF_METRICS_FIND) != 1) {
+    fprintf(stderr, "%s: Expected 1 serialise, got %lu\n", program,
+            librdf_metrics_get_storage_count(metrics, storage, LIBRDF_METRICS_FIND));
+    rc = 1;
+  }
+
+  iostr = raptor_new_iostream_to_string(world->raptor_world_ptr,
+                                        (void**)&string, &string_len, malloc);
+  librdf_metrics_write_prometheus(metrics, iostr);
+  raptor_free_iostream(iostr);
+  if(!string || !strstr((const char*)string, expected_add)) {
+    fprintf(stderr, "%s: Metrics did not contain %s", program, expected_add);
+    rc = 1;
+  }
+  if(string) {
+    free(string);
+    string = NULL;
+  }
+
+  librdf_free_storage(copy);
+
+  librdf_free_model(model);
+  librdf_free_storage(storage);
+
+  librdf_free_world(world);
+
+  return rc;
+}
+
+#endif
@@ -0,0 +1,121 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rdf_metrics.h - RDF operation metrics interfaces
+ *
+ * Copyright (C) 2004-2008, David Beckett http://www.dajobe.org/
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+
+#ifndef LIBRDF_METRICS_H
+#define LIBRDF_METRICS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <raptor2.h>
+
+/**
+ * librdf_metrics_operation:
+ * @LIBRDF_METRICS_ADD: Add a statement.
+ * @LIBRDF_METRICS_REMOVE: Remove a statement.
+ * @LIBRDF_METRICS_CONTAINS: Check for a statement.
+ * @LIBRDF_METRICS_FIND: Find statements matching (?, ?, ?).
+ * @LIBRDF_METRICS_FIND_O: Find statements matching (?, ?, O).
+ * @LIBRDF_METRICS_FIND_P: Find statements matching (?, P, ?).
+ * @LIBRDF_METRICS_FIND_PO: Find statements matching (?, P, O).
+ * @LIBRDF_METRICS_FIND_S: Find statements matching (S, ?, ?).
+ * @LIBRDF_METRICS_FIND_SO: Find statements matching (S, ?, O).
+ * @LIBRDF_METRICS_FIND_SP: Find statements matching (S, P, ?).
+ * @LIBRDF_METRICS_FIND_SPO: Find statements matching (S, P, O).
+ * @LIBRDF_METRICS_SYNC: Synchronise the storage.
+ * @LIBRDF_METRICS_TRANSACTION_COMMIT: Commit a transaction.
+ * @LIBRDF_METRICS_LAST: Internal, never used.
+ *
+ * Storage operations counted and timed by #librdf_metrics.
+ *
+ * The find operations are in the order of the parts bound so
+ * LIBRDF_METRICS_FIND plus 4 if the subject is bound, 2 if the
+ * predicate is bound and 1 if the object is bound gives the operation
+ * for a pattern.  Finds are timed until the stream is returned.
+ */
+typedef enum {
+  LIBRDF_METRICS_ADD,
+  LIBRDF_METRICS_REMOVE,
+  LIBRDF_METRICS_CONTAINS,
+  LIBRDF_METRICS_FIND,
+  LIBRDF_METRICS_FIND_O,
+  LIBRDF_METRICS_FIND_P,
+  LIBRDF_METRICS_FIND_PO,
+  LIBRDF_METRICS_FIND_S,
+  LIBRDF_METRICS_FIND_SO,
+  LIBRDF_METRICS_FIND_SP,
+  LIBRDF_METRICS_FIND_SPO,
+  LIBRDF_METRICS_SYNC,
+  LIBRDF_METRICS_TRANSACTION_COMMIT,
+  LIBRDF_METRICS_LAST = LIBRDF_METRICS_TRANSACTION_COMMIT
+} librdf_metrics_operation;
+
+/**
+ * librdf_metrics_query_phase:
+ * @LIBRDF_METRICS_QUERY_PREPARE: Parse and prepare a query.
+ * @LIBRDF_METRICS_QUERY_EXECUTE: Execute a prepared query until the results are returned.
+ * @LIBRDF_METRICS_QUERY_LAST: Internal, never used.
+ *
+ * Query execution phases timed by #librdf_metrics.
+ */
+typedef enum {
+  LIBRDF_METRICS_QUERY_PREPARE,
+  LIBRDF_METRICS_QUERY_EXECUTE,
+  LIBRDF_METRICS_QUERY_LAST = LIBRDF_METRICS_QUERY_EXECUTE
+} librdf_metrics_query_phase;
+
+
+#ifdef LIBRDF_INTERNAL
+#include <rdf_metrics_internal.h>
+#endif
+
+
+/* class methods */
+REDLAND_API
+librdf_metrics* librdf_world_get_metrics(librdf_world* world);
+
+/* methods */
+REDLAND_API
+unsigned long librdf_metrics_get_storage_count(librdf_metrics* metrics, librdf_storage* storage, librdf_metrics_operation operation);
+REDLAND_API
+double librdf_metrics_get_storage_seconds(librdf_metrics* metrics, librdf_storage* storage, librdf_metrics_operation operation);
+REDLAND_API
+unsigned long librdf_metrics_get_parsed_statements(librdf_metrics* metrics);
+REDLAND_API
+double librdf_metrics_get_parse_seconds(librdf_metrics* metrics);
+REDLAND_API
+unsigned long librdf_metrics_get_query_count(librdf_metrics* metrics, librdf_metrics_query_phase phase);
+REDLAND_API
+double librdf_metrics_get_query_seconds(librdf_metrics* metrics, librdf_metrics_query_phase phase);
+REDLAND_API
+void librdf_metrics_reset(librdf_metrics* metrics);
+REDLAND_API
+int librdf_metrics_write_prometheus(librdf_metrics* metrics, raptor_iostream* iostr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
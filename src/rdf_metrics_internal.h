@@ -0,0 +1,93 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rdf_metrics_internal.h - Internal RDF operation metrics definitions
+ *
+ * Copyright (C) 2004-2008, David Beckett http://www.dajobe.org/
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+
+#ifndef LIBRDF_METRICS_INTERNAL_H
+#define LIBRDF_METRICS_INTERNAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Histogram buckets: bucket i counts times up to 2^(i+8) nanoseconds
+ * (256ns up to about 34s) and the last one counts anything longer.
+ */
+#define LIBRDF_METRICS_BUCKETS 28
+
+typedef struct {
+  unsigned long count;
+  double seconds;
+  unsigned long buckets[LIBRDF_METRICS_BUCKETS];
+} librdf_metrics_histogram;
+
+
+typedef struct librdf_metrics_storage_s librdf_metrics_storage;
+
+/* Operation histograms of one storage instance.  When the storage is
+ * freed they are added to the record of the same factory with id 0.
+ */
+struct librdf_metrics_storage_s {
+  librdf_metrics_storage* next;
+  char* name;
+  int id;
+  librdf_metrics_histogram operations[LIBRDF_METRICS_LAST+1];
+};
+
+
+struct librdf_metrics_s {
+  librdf_world* world;
+
+#ifdef WITH_THREADS
+  pthread_mutex_t* mutex;
+#endif
+
+  /* storage records in order of creation and the last id given */
+  librdf_metrics_storage* storages;
+  int storage_id;
+
+  unsigned long parsed_statements;
+  librdf_metrics_histogram parse;
+
+  librdf_metrics_histogram query[LIBRDF_METRICS_QUERY_LAST+1];
+};
+
+
+/* Start time of an operation or 0.0 if nothing is being recorded */
+#define LIBRDF_METRICS_START(world) ((world)->metrics ? librdf_metrics_now() : 0.0)
+
+void librdf_finish_metrics(librdf_world* world);
+
+double librdf_metrics_now(void);
+void librdf_metrics_storage_record(librdf_storage* storage, librdf_metrics_operation operation, double start);
+librdf_metrics_operation librdf_metrics_find_operation(librdf_statement* statement);
+const char* librdf_metrics_operation_name(librdf_metrics_operation operation, const char** pattern_p);
+const char* librdf_metrics_query_phase_name(librdf_metrics_query_phase phase);
+void librdf_metrics_storage_finished(librdf_storage* storage);
+void librdf_metrics_parse_record(librdf_world* world, unsigned long statements, double start);
+void librdf_metrics_query_record(librdf_world* world, librdf_metrics_query_phase phase, double start);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -53,6 +53,7 @@ librdf_init_model(librdf_world *world)
 {
   /* Always have model storage - must always be the default model */
   librdf_init_model_storage(world);
+  librdf_init_model_overlay(world);
 }
 
 
@@ -1666,6 +1667,77 @@ librdf_model_find_statements_with_options(librdf_model* model,
 }
 
 
+/**
+ * librdf_model_find_statements_in_range:
+ * @model: #librdf_model object
+ * @predicate: #librdf_node predicate
+ * @min: #librdf_node lowest literal value or NULL
+ * @max: #librdf_node highest literal value or NULL
+ *
+ * Search the model for statements with a literal value in a range.
+ * 
+ * Returns the statements with predicate @predicate and a typed
+ * literal object with a value between @min and @max inclusive.
+ * Values of the XSD numeric datatypes compare as numbers, whatever
+ * their datatype, and xsd:dateTime and xsd:date values compare as
+ * instants (UTC when no timezone is given).  At least one bound must
+ * be given and both must be of one of those two kinds.
+ *
+ * Storages with a value index such as the trees storage with option
+ * <literal>index-values</literal> answer this with a range scan,
+ * otherwise all statements with the predicate are checked.
+ * 
+ * Return value:  #librdf_stream of matching statements (may be empty) or NULL on failure
+ **/
+librdf_stream*
+librdf_model_find_statements_in_range(librdf_model* model,
+                                      librdf_node* predicate,
+                                      librdf_node* min, librdf_node* max) 
+{
+  librdf_node_value_range* range;
+  librdf_statement* statement;
+  librdf_stream* stream;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(model, librdf_model, NULL);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(predicate, librdf_node, NULL);
+
+  if(model->factory->find_statements_in_range)
+    return model->factory->find_statements_in_range(model, predicate, min, max);
+
+  range=librdf_new_node_value_range(min, max);
+  if(!range) {
+    librdf_log(model->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_MODEL, NULL,
+               "Range bounds are not comparable literal values");
+    return NULL;
+  }
+
+  statement=librdf_new_statement(model->world);
+  if(!statement) {
+    librdf_free_node_value_range(range);
+    return NULL;
+  }
+  librdf_statement_set_predicate(statement, librdf_new_node_from_node(predicate));
+
+  stream=librdf_model_find_statements(model, statement);
+  librdf_free_statement(statement);
+  if(!stream) {
+    librdf_free_node_value_range(range);
+    return NULL;
+  }
+
+  if(librdf_stream_add_map(stream, 
+                           &librdf_stream_value_range_map,
+                           (librdf_stream_map_free_context_handler)&librdf_free_node_value_range,
+                           (void*)range)) {
+    /* error - stream_add_map failed and freed the range */
+    librdf_free_stream(stream);
+    stream=NULL;
+  }
+
+  return stream;
+}
+
+
 /**
  * librdf_model_load:
  * @model: #librdf_model object
@@ -1928,6 +2000,7 @@ int main(int argc, char *argv[]);
 "</rdf:RDF>"
 
 int test_model_cloning(char const *program, librdf_world *);
+int test_model_overlay(char const *program, librdf_world *);
 int test_model(librdf_world *world, const char *program,
     const char *storage_type, const char *storage_name, const char* storage_options);
 
@@ -1951,6 +2024,11 @@ main(int argc, char *argv[])
     goto tidy;
   }
 
+  if(test_model_overlay(program, world)) {
+    status = 1;
+    goto tidy;
+  }
+
   /* Get storage configuration */
   storage_type=getenv("REDLAND_TEST_STORAGE_TYPE");
   storage_name=getenv("REDLAND_TEST_STORAGE_NAME");
@@ -2462,5 +2540,147 @@ test_model_cloning(char const *program, librdf_world *world)
   return status;
 }
 
-#endif
 
+/* Check the size of a model and whether it contains statement i */
+static int
+test_model_overlay_check(char const *program, librdf_world *world,
+                         const char *label, librdf_model *model,
+                         int expected_size, librdf_statement **statements,
+                         int i, int expected_contains)
+{
+  librdf_statement *statement;
+  librdf_stream *stream;
+  int size;
+  int contains;
+  int count;
+  int status = 0;
+
+  size = librdf_model_size(model);
+  if(size != expected_size) {
+    fprintf(stderr, "%s: %s model has %d statements, expected %d\n",
+            program, label, size, expected_size);
+    status = 1;
+  }
+
+  statement = librdf_new_statement_from_nodes(world, NULL,
+    librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/p"),
+    NULL);
+  stream = librdf_model_find_statements(model, statement);
+  librdf_free_statement(statement);
+  for(count = 0; stream && !librdf_stream_end(stream); librdf_stream_next(stream))
+    count++;
+  if(stream)
+    librdf_free_stream(stream);
+  if(count != expected_size) {
+    fprintf(stderr, "%s: %s model find returned %d statements, expected %d\n",
+            program, label, count, expected_size);
+    status = 1;
+  }
+
+  contains = (librdf_model_contains_statement(model, statements[i]) > 0);
+  if(contains != expected_contains) {
+    fprintf(stderr, "%s: %s model %s statement %d\n", program, label,
+            contains ? "unexpectedly contains" : "does not contain", i);
+    status = 1;
+  }
+
+  return status;
+}
+
+
+int
+test_model_overlay(char const *program, librdf_world *world)
+{
+  librdf_storage *base_storage;
+  librdf_storage *storage = NULL;
+  librdf_model *base;
+  librdf_model *model = NULL;
+  librdf_model *clone = NULL;
+  librdf_statement *statements[5];
+  int i;
+  int status = 0;
+
+  fprintf(stderr, "%s: Testing overlay model\n", program);
+
+  base_storage = librdf_new_storage(world, "memory", NULL, NULL);
+  base = base_storage ? librdf_new_model(world, base_storage, NULL) : NULL;
+  if(!base) {
+    fprintf(stderr, "%s: Failed to create base model\n", program);
+    if(base_storage)
+      librdf_free_storage(base_storage);
+    return 1;
+  }
+
+  for(i = 0; i < 5; i++) {
+    char subject[32];
+
+    sprintf(subject, "http://example.org/s%d", i);
+    statements[i] = librdf_new_statement_from_nodes(world,
+      librdf_new_node_from_uri_string(world, (const unsigned char*)subject),
+      librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/p"),
+      librdf_new_node_from_literal(world, (const unsigned char*)"value", NULL, 0));
+  }
+
+  for(i = 0; i < 3; i++)
+    librdf_model_add_statement(base, statements[i]);
+
+  storage = librdf_new_storage(world, "memory", NULL, NULL);
+  if(storage)
+    model = librdf_new_model_overlay(world, base, storage, NULL);
+  if(!model) {
+    fprintf(stderr, "%s: Failed to create overlay model\n", program);
+    status = 1;
+    goto tidy;
+  }
+
+  /* hide base statement 1, add 3 and add base statement 0 again */
+  librdf_model_remove_statement(model, statements[1]);
+  librdf_model_add_statement(model, statements[3]);
+  librdf_model_add_statement(model, statements[0]);
+
+  status |= test_model_overlay_check(program, world, "overlay", model, 3,
+                                      statements, 1, 0);
+  status |= test_model_overlay_check(program, world, "overlay", model, 3,
+                                      statements, 3, 1);
+  /* the base is never changed */
+  status |= test_model_overlay_check(program, world, "base", base, 3,
+                                      statements, 1, 1);
+  status |= test_model_overlay_check(program, world, "base", base, 3,
+                                      statements, 3, 0);
+
+  /* the clone copies the changes and then goes its own way */
+  clone = librdf_new_model_from_model(model);
+  if(!clone) {
+    fprintf(stderr, "%s: Failed to clone overlay model\n", program);
+    status = 1;
+    goto tidy;
+  }
+  status |= test_model_overlay_check(program, world, "cloned overlay", clone, 3,
+                                      statements, 3, 1);
+
+  librdf_model_add_statement(clone, statements[4]);
+  librdf_model_remove_statement(model, statements[3]);
+
+  status |= test_model_overlay_check(program, world, "cloned overlay", clone, 4,
+                                      statements, 3, 1);
+  status |= test_model_overlay_check(program, world, "cloned overlay", clone, 4,
+                                      statements, 1, 0);
+  status |= test_model_overlay_check(program, world, "overlay", model, 2,
+                                      statements, 4, 0);
+
+  tidy:
+  if(clone)
+    librdf_free_model(clone);
+  if(model)
+    librdf_free_model(model);
+  if(storage)
+    librdf_free_storage(storage);
+  librdf_free_model(base);
+  librdf_free_storage(base_storage);
+  for(i = 0; i < 5; i++)
+    librdf_free_statement(statements[i]);
+
+  return status;
+}
+
+#endif
@@ -58,6 +58,10 @@ librdf_model* librdf_new_model_with_options(librdf_world *world, librdf_storage
 REDLAND_API
 librdf_model* librdf_new_model_from_model(librdf_model* model);
 
+/* Create a new Model layering changes over an existing Model */
+REDLAND_API
+librdf_model* librdf_new_model_overlay(librdf_world *world, librdf_model* base, librdf_storage *storage, librdf_hash* options);
+
 /* destructor */
 REDLAND_API
 void librdf_free_model(librdf_model *model);
@@ -119,6 +123,8 @@ librdf_stream* librdf_model_find_statements(librdf_model* model, librdf_statemen
 REDLAND_API
 librdf_stream* librdf_model_find_statements_with_options(librdf_model* model, librdf_statement* statement, librdf_node* context_node, librdf_hash* options);
 REDLAND_API
+librdf_stream* librdf_model_find_statements_in_range(librdf_model* model, librdf_node* predicate, librdf_node* min, librdf_node* max);
+REDLAND_API
 librdf_iterator* librdf_model_get_sources(librdf_model *model, librdf_node *arc, librdf_node *target);
 REDLAND_API
 librdf_iterator* librdf_model_get_arcs(librdf_model *model, librdf_node *source, librdf_node *target);
@@ -171,6 +171,11 @@ struct librdf_model_factory_s {
   int (*transaction_rollback)(librdf_model* model);
   void* (*transaction_get_handle)(librdf_model* model);
 
+  /* search for statements with a predicate and a literal object
+   * value in a range - OPTIONAL (rdf_model will do it using
+   * find_statements if missing)
+   */
+  librdf_stream* (*find_statements_in_range)(librdf_model* model, librdf_node* predicate, librdf_node* min, librdf_node* max);
 };
 
 /* module init */
@@ -187,8 +192,10 @@ void librdf_model_add_reference(librdf_model *model);
 void librdf_model_remove_reference(librdf_model *model);
 
 
-/* model storage factory initialise (the only model factory at present) */
+/* model storage factory initialise (the default model factory) */
 void librdf_init_model_storage(librdf_world *world);
+/* model overlay factory initialise */
+void librdf_init_model_overlay(librdf_world *world);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,987 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rdf_model_overlay.c - RDF Model layering changes over a read-only model
+ *
+ * Copyright (C) 2003-2008, David Beckett http://www.dajobe.org/
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <rdf_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rdf_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h> /* for exit()  */
+#endif
+
+#include <redland.h>
+
+
+/*
+ * The overlay model answers from a base model that it never changes
+ * plus two small storages: the statements added over the base and
+ * the tombstones of base statements removed.  A statement is only
+ * ever in one of them:
+ *   added   - not in the base
+ *   removed - in the base
+ * so the overlay contents are (base - removed) + added.
+ */
+typedef struct
+{
+  /* read-only model layered over; may itself be an overlay */
+  librdf_model *base;
+  /* statements added */
+  librdf_storage *added;
+  /* tombstones of base statements removed */
+  librdf_storage *removed;
+} librdf_model_overlay_context;
+
+
+static void
+librdf_model_overlay_init(void) {
+
+}
+
+
+static void
+librdf_model_overlay_terminate(void) {
+
+}
+
+
+/**
+ * librdf_model_overlay_create:
+ * @model: #librdf_model to initialise
+ * @storage: #librdf_storage storage for the statements added
+ * @options: #librdf_hash of options to use
+ *
+ * Constructor - Create a new overlay #librdf_model.
+ *
+ * The base model must already be set in the context by
+ * librdf_new_model_overlay().  Options are presently not used.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_model_overlay_create(librdf_model *model, librdf_storage *storage,
+                            librdf_hash* options)
+{
+  librdf_model_overlay_context *context=(librdf_model_overlay_context *)model->context;
+
+  if(!storage || !context->base)
+    return 1;
+
+  context->removed=librdf_new_storage(model->world, "hashes", NULL,
+                                      "hash-type='memory'");
+  if(!context->removed)
+    return 1;
+
+  if(librdf_storage_open(context->removed, model)) {
+    librdf_free_storage(context->removed);
+    context->removed=NULL;
+    return 1;
+  }
+
+  if(librdf_storage_open(storage, model))
+    return 1;
+
+  context->added=storage;
+
+  librdf_storage_add_reference(storage);
+
+  return 0;
+}
+
+
+/**
+ * librdf_model_overlay_clone:
+ * @old_model: the existing #librdf_model
+ *
+ * Copy constructor - create a new librdf_model from an existing one.
+ *
+ * The new overlay shares the base model and starts with copies of
+ * the added statements and tombstones.  The added statements storage
+ * is cloned where its factory can and otherwise copied into a new
+ * memory hashes storage; when the clone starts empty, as all but
+ * memory hashes storages do, the statements are copied in with a
+ * stream.
+ *
+ * Return value: a new #librdf_model or NULL on failure
+ **/
+static librdf_model*
+librdf_model_overlay_clone(librdf_model* old_model)
+{
+  librdf_model_overlay_context *old_context=(librdf_model_overlay_context *)old_model->context;
+  librdf_model_overlay_context *new_context;
+  librdf_storage *new_storage;
+  librdf_storage *removed;
+  librdf_model *new_model;
+  int old_size;
+
+  if(old_context->added->factory->clone)
+    new_storage=librdf_new_storage_from_storage(old_context->added);
+  else
+    new_storage=librdf_new_storage(old_model->world, "hashes", NULL,
+                                   "hash-type='memory'");
+  if(!new_storage)
+    return NULL;
+
+  new_model=librdf_new_model_overlay(old_model->world, old_context->base,
+                                     new_storage, NULL);
+  /* the model has a reference if it was made */
+  librdf_free_storage(new_storage);
+  if(!new_model)
+    return NULL;
+
+  removed=librdf_new_storage_from_storage(old_context->removed);
+  if(!removed || librdf_storage_open(removed, new_model)) {
+    if(removed)
+      librdf_free_storage(removed);
+    librdf_free_model(new_model);
+    return NULL;
+  }
+
+  new_context=(librdf_model_overlay_context *)new_model->context;
+  librdf_storage_close(new_context->removed);
+  librdf_free_storage(new_context->removed);
+  new_context->removed=removed;
+
+  old_size=librdf_storage_size(old_context->added);
+  if(old_size && !librdf_storage_size(new_context->added)) {
+    librdf_stream *stream;
+    int rc;
+
+    stream=librdf_storage_serialise(old_context->added);
+    if(!stream) {
+      librdf_free_model(new_model);
+      return NULL;
+    }
+    rc=librdf_storage_add_statements(new_context->added, stream);
+    librdf_free_stream(stream);
+    if(rc) {
+      librdf_free_model(new_model);
+      return NULL;
+    }
+  }
+
+  return new_model;
+}
+
+
+/**
+ * librdf_model_overlay_destroy:
+ * @model: #librdf_model model to destroy
+ *
+ * Destructor - Destroy a #librdf_model object.
+ *
+ **/
+static void
+librdf_model_overlay_destroy(librdf_model *model)
+{
+  librdf_model_overlay_context *context=(librdf_model_overlay_context *)model->context;
+
+  if(context->added) {
+    librdf_storage_close(context->added);
+    librdf_storage_remove_reference(context->added);
+  }
+
+  if(context->removed) {
+    librdf_storage_close(context->removed);
+    librdf_free_storage(context->removed);
+  }
+
+  if(context->base)
+    librdf_free_model(context->base);
+}
+
+
+/**
+ * librdf_model_overlay_size:
+ * @model: #librdf_model object
+ *
+ * Get the number of statements in the model.
+ *
+ * Return value: the number of statements or <0 if it cannot be counted
+ **/
+static int
+librdf_model_overlay_size(librdf_model* model)
+{
+  librdf_model_overlay_context *context=(librdf_model_overlay_context *)model->context;
+  int base_size;
+  int added_size;
+  int removed_size;
+
+  base_size=librdf_model_size(context->base);
+  added_size=librdf_storage_size(context->added);
+  removed_size=librdf_storage_size(context->removed);
+  if(base_size < 0 || added_size < 0 || removed_size < 0)
+    return -1;
+
+  return base_size - removed_size + added_size;
+}
+
+
+/**
+ * librdf_model_overlay_add_statement:
+ * @model: model object
+ * @statement: statement object
+ *
+ * Add a statement to the model.
+ *
+ * Adding back a removed base statement drops its tombstone; a
+ * statement already in the base is not added again.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_model_overlay_add_statement(librdf_model* model,
+                                   librdf_statement* statement)
+{
+  librdf_model_overlay_context *context=(librdf_model_overlay_context *)model->context;
+
+  if(librdf_storage_contains_statement(context->removed, statement))
+    return librdf_storage_remove_statement(context->removed, statement);
+
+  if(librdf_model_contains_statement(context->base, statement))
+    return 0;
+
+  return librdf_storage_add_statement(context->added, statement);
+}
+
+
+/**
+ * librdf_model_overlay_add_statements:
+ * @model: model object
+ * @statement_stream: stream of statements to use
+ *
+ * Add a stream of statements to the model.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_model_overlay_add_statements(librdf_model* model,
+                                    librdf_stream* statement_stream)
+{
+  int status=0;
+
+  while(!librdf_stream_end(statement_stream)) {
+    librdf_statement* statement=librdf_stream_get_object(statement_stream);
+
+    if(!statement) {
+      status=1;
+      break;
+    }
+
+    status=librdf_model_overlay_add_statement(model, statement);
+    if(status)
+      break;
+    librdf_stream_next(statement_stream);
+  }
+
+  return status;
+}
+
+
+/**
+ * librdf_model_overlay_remove_statement:
+ * @model: the model object
+ * @statement: the statement
+ *
+ * Remove a known statement from the model.
+ *
+ * A base statement is hidden by a tombstone.
+ *
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_model_overlay_remove_statement(librdf_model* model,
+                                      librdf_statement* statement)
+{
+  librdf_model_overlay_context *context=(librdf_model_overlay_context *)model->context;
+
+  if(librdf_storage_contains_statement(context->added, statement))
+    return librdf_storage_remove_statement(context->added, statement);
+
+  if(librdf_storage_contains_statement(context->removed, statement) ||
+     !librdf_model_contains_statement(context->base, statement))
+    return 0;
+
+  return librdf_storage_add_statement(context->removed, statement);
+}
+
+
+/**
+ * librdf_model_overlay_contains_statement:
+ * @model: the model object
+ * @statement: the statement
+ *
+ * Check for a statement in the model.
+ *
+ * Return value: non 0 if the model contains the statement
+ **/
+static int
+librdf_model_overlay_contains_statement(librdf_model* model,
+                                        librdf_statement* statement)
+{
+  librdf_model_overlay_context *context=(librdf_model_overlay_context *)model->context;
+
+  if(librdf_storage_contains_statement(context->added, statement))
+    return 1;
+
+  return librdf_model_contains_statement(context->base, statement) &&
+    !librdf_storage_contains_statement(context->removed, statement);
+}
+
+
+/* Union of a base stream and an added statements stream */
+
+typedef struct {
+  librdf_stream *streams[2];
+  int current;
+} librdf_model_overlay_stream_context;
+
+
+static int
+librdf_model_overlay_stream_end_of_stream(void* context)
+{
+  librdf_model_overlay_stream_context* scontext=(librdf_model_overlay_stream_context*)context;
+
+  while(scontext->current < 2 &&
+        librdf_stream_end(scontext->streams[scontext->current]))
+    scontext->current++;
+
+  return (scontext->current == 2);
+}
+
+
+static int
+librdf_model_overlay_stream_next_statement(void* context)
+{
+  librdf_model_overlay_stream_context* scontext=(librdf_model_overlay_stream_context*)context;
+
+  if(librdf_model_overlay_stream_end_of_stream(context))
+    return 1;
+
+  librdf_stream_next(scontext->streams[scontext->current]);
+
+  return librdf_model_overlay_stream_end_of_stream(context);
+}
+
+
+static void*
+librdf_model_overlay_stream_get_statement(void* context, int flags)
+{
+  librdf_model_overlay_stream_context* scontext=(librdf_model_overlay_stream_context*)context;
+  librdf_stream *stream;
+
+  if(librdf_model_overlay_stream_end_of_stream(context))
+    return NULL;
+
+  stream=scontext->streams[scontext->current];
+  switch(flags) {
+    case LIBRDF_ITERATOR_GET_METHOD_GET_OBJECT:
+      return librdf_stream_get_object(stream);
+
+    case LIBRDF_ITERATOR_GET_METHOD_GET_CONTEXT:
+      return librdf_stream_get_context2(stream);
+
+    default:
+      return NULL;
+  }
+}
+
+
+static void
+librdf_model_overlay_stream_finished(void* context)
+{
+  librdf_model_overlay_stream_context* scontext=(librdf_model_overlay_stream_context*)context;
+
+  if(scontext->streams[0])
+    librdf_free_stream(scontext->streams[0]);
+  if(scontext->streams[1])
+    librdf_free_stream(scontext->streams[1]);
+
+  LIBRDF_FREE(librdf_model_overlay_stream_context, scontext);
+}
+
+
+/* stream map dropping removed base statements */
+static librdf_statement*
+librdf_model_overlay_removed_map(librdf_stream *stream,
+                                 void* context, librdf_statement* statement)
+{
+  librdf_storage* removed=(librdf_storage*)context;
+
+  if(librdf_storage_contains_statement(removed, statement))
+    return NULL;
+
+  return statement;
+}
+
+
+/*
+ * librdf_model_overlay_new_stream - Make the overlay stream of a base and an added stream
+ * @model: overlay model
+ * @base_stream: stream of base statements
+ * @added_stream: stream of added statements
+ *
+ * Both streams are owned by the result (and freed on failure).
+ *
+ * Return value: new #librdf_stream or NULL on failure
+ */
+static librdf_stream*
+librdf_model_overlay_new_stream(librdf_model* model,
+                                librdf_stream* base_stream,
+                                librdf_stream* added_stream)
+{
+  librdf_model_overlay_context *context=(librdf_model_overlay_context *)model->context;
+  librdf_model_overlay_stream_context* scontext;
+  librdf_stream* stream;
+
+  if(!base_stream || !added_stream)
+    goto failed;
+
+  /* the map holds a reference so the stream may outlive the model */
+  librdf_storage_add_reference(context->removed);
+  if(librdf_stream_add_map(base_stream, &librdf_model_overlay_removed_map,
+                           (librdf_stream_map_free_context_handler)&librdf_free_storage,
+                           context->removed))
+    goto failed;
+
+  scontext = LIBRDF_CALLOC(librdf_model_overlay_stream_context*, 1,
+                           sizeof(*scontext));
+  if(!scontext)
+    goto failed;
+
+  scontext->streams[0]=base_stream;
+  scontext->streams[1]=added_stream;
+
+  stream=librdf_new_stream(model->world, (void*)scontext,
+                           &librdf_model_overlay_stream_end_of_stream,
+                           &librdf_model_overlay_stream_next_statement,
+                           &librdf_model_overlay_stream_get_statement,
+                           &librdf_model_overlay_stream_finished);
+  if(!stream)
+    librdf_model_overlay_stream_finished(scontext);
+
+  return stream;
+
+  failed:
+  if(base_stream)
+    librdf_free_stream(base_stream);
+  if(added_stream)
+    librdf_free_stream(added_stream);
+  return NULL;
+}
+
+
+/**
+ * librdf_model_overlay_serialise:
+ * @model: the model object
+ *
+ * Serialise the entire model as a stream.
+ *
+ * Return value: a #librdf_stream or NULL on failure
+ **/
+static librdf_stream*
+librdf_model_overlay_serialise(librdf_model* model)
+{
+  librdf_model_overlay_context *context=(librdf_model_overlay_context *)model->context;
+
+  return librdf_model_overlay_new_stream(model,
+                                         librdf_model_as_stream(context->base),
+                                         librdf_storage_serialise(context->added));
+}
+
+
+/**
+ * librdf_model_overlay_find_statements:
+ * @model: the model object
+ * @statement: the partial statement to match
+ *
+ * Find matching statements in the model.
+ *
+ * The partial statement is a statement where the subject, predicate
+ * and/or object can take the value NULL which indicates a match with
+ * any value in the model
+ *
+ * Return value: a #librdf_stream of statements (can be empty) or NULL
+ * on failure.
+ **/
+static librdf_stream*
+librdf_model_overlay_find_statements(librdf_model* model,
+                                     librdf_statement* statement)
+{
+  librdf_model_overlay_context *context=(librdf_model_overlay_context *)model->context;
+
+  return librdf_model_overlay_new_stream(model,
+                                         librdf_model_find_statements(context->base, statement),
+                                         librdf_storage_find_statements(context->added, statement));
+}
+
+
+static librdf_stream*
+librdf_model_overlay_find_statements_with_options(librdf_model* model,
+                                                  librdf_statement* statement,
+                                                  librdf_node* context_node,
+                                                  librdf_hash* options)
+{
+  if(context_node)
+    return NULL;
+
+  return librdf_model_overlay_find_statements(model, statement);
+}
+
+
+/* Iterator of one part of the statements of a stream */
+
+typedef struct {
+  librdf_stream *stream;
+  librdf_statement_part want;
+} librdf_model_overlay_node_iterator_context;
+
+
+static int
+librdf_model_overlay_node_iterator_is_end(void* iterator)
+{
+  librdf_model_overlay_node_iterator_context* icontext=(librdf_model_overlay_node_iterator_context*)iterator;
+
+  return librdf_stream_end(icontext->stream);
+}
+
+
+static int
+librdf_model_overlay_node_iterator_next_method(void* iterator)
+{
+  librdf_model_overlay_node_iterator_context* icontext=(librdf_model_overlay_node_iterator_context*)iterator;
+
+  return librdf_stream_next(icontext->stream);
+}
+
+
+static void*
+librdf_model_overlay_node_iterator_get_method(void* iterator, int flags)
+{
+  librdf_model_overlay_node_iterator_context* icontext=(librdf_model_overlay_node_iterator_context*)iterator;
+  librdf_statement* statement;
+
+  if(flags == LIBRDF_ITERATOR_GET_METHOD_GET_CONTEXT)
+    return librdf_stream_get_context2(icontext->stream);
+
+  if(flags != LIBRDF_ITERATOR_GET_METHOD_GET_OBJECT)
+    return NULL;
+
+  statement=librdf_stream_get_object(icontext->stream);
+  if(!statement)
+    return NULL;
+
+  switch(icontext->want) {
+    case LIBRDF_STATEMENT_SUBJECT:
+      return librdf_statement_get_subject(statement);
+
+    case LIBRDF_STATEMENT_PREDICATE:
+      return librdf_statement_get_predicate(statement);
+
+    case LIBRDF_STATEMENT_OBJECT:
+      return librdf_statement_get_object(statement);
+
+    case LIBRDF_STATEMENT_ALL:
+    default:
+      return NULL;
+  }
+}
+
+
+static void
+librdf_model_overlay_node_iterator_finished(void* iterator)
+{
+  librdf_model_overlay_node_iterator_context* icontext=(librdf_model_overlay_node_iterator_context*)iterator;
+
+  if(icontext->stream)
+    librdf_free_stream(icontext->stream);
+
+  LIBRDF_FREE(librdf_model_overlay_node_iterator_context, icontext);
+}
+
+
+/*
+ * librdf_model_overlay_find_nodes - Iterate one part of the matching statements
+ * @model: overlay model
+ * @subject: subject or NULL
+ * @predicate: predicate or NULL
+ * @object: object or NULL
+ * @want: part of the statements to return
+ *
+ * Return value: new #librdf_iterator or NULL on failure
+ */
+static librdf_iterator*
+librdf_model_overlay_find_nodes(librdf_model* model,
+                                librdf_node* subject, librdf_node* predicate,
+                                librdf_node* object,
+                                librdf_statement_part want)
+{
+  librdf_model_overlay_node_iterator_context* icontext;
+  librdf_statement* partial_statement;
+  librdf_stream* stream;
+  librdf_iterator* iterator;
+
+  partial_statement=librdf_new_statement_from_nodes(model->world,
+                                                    subject ? librdf_new_node_from_node(subject) : NULL,
+                                                    predicate ? librdf_new_node_from_node(predicate) : NULL,
+                                                    object ? librdf_new_node_from_node(object) : NULL);
+  if(!partial_statement)
+    return NULL;
+
+  stream=librdf_model_overlay_find_statements(model, partial_statement);
+  librdf_free_statement(partial_statement);
+  if(!stream)
+    return NULL;
+
+  icontext = LIBRDF_CALLOC(librdf_model_overlay_node_iterator_context*, 1,
+                           sizeof(*icontext));
+  if(!icontext) {
+    librdf_free_stream(stream);
+    return NULL;
+  }
+
+  icontext->stream=stream;
+  icontext->want=want;
+
+  iterator=librdf_new_iterator(model->world, (void*)icontext,
+                               &librdf_model_overlay_node_iterator_is_end,
+                               &librdf_model_overlay_node_iterator_next_method,
+                               &librdf_model_overlay_node_iterator_get_method,
+                               &librdf_model_overlay_node_iterator_finished);
+  if(!iterator)
+    librdf_model_overlay_node_iterator_finished(icontext);
+
+  return iterator;
+}
+
+
+/**
+ * librdf_model_overlay_get_sources:
+ * @model: #librdf_model object
+ * @arc: #librdf_node arc
+ * @target: #librdf_node target
+ *
+ * Return the sources (subjects) of arc in an RDF graph given arc (predicate) and target (object).
+ *
+ * Return value:  #librdf_iterator of #librdf_node objects (may be empty) or NULL on failure
+ **/
+static librdf_iterator*
+librdf_model_overlay_get_sources(librdf_model *model,
+                                 librdf_node *arc, librdf_node *target)
+{
+  return librdf_model_overlay_find_nodes(model, NULL, arc, target,
+                                         LIBRDF_STATEMENT_SUBJECT);
+}
+
+
+/**
+ * librdf_model_overlay_get_arcs:
+ * @model: #librdf_model object
+ * @source: #librdf_node source
+ * @target: #librdf_node target
+ *
+ * Return the arcs (predicates) of an arc in an RDF graph given source (subject) and target (object).
+ *
+ * Return value:  #librdf_iterator of #librdf_node objects (may be empty) or NULL on failure
+ **/
+static librdf_iterator*
+librdf_model_overlay_get_arcs(librdf_model *model,
+                              librdf_node *source, librdf_node *target)
+{
+  return librdf_model_overlay_find_nodes(model, source, NULL, target,
+                                         LIBRDF_STATEMENT_PREDICATE);
+}
+
+
+/**
+ * librdf_model_overlay_get_targets:
+ * @model: #librdf_model object
+ * @source: #librdf_node source
+ * @arc: #librdf_node arc
+ *
+ * Return the targets (objects) of an arc in an RDF graph given source (subject) and arc (predicate).
+ *
+ * Return value:  #librdf_iterator of #librdf_node objects (may be empty) or NULL on failure
+ **/
+static librdf_iterator*
+librdf_model_overlay_get_targets(librdf_model *model,
+                                 librdf_node *source, librdf_node *arc)
+{
+  return librdf_model_overlay_find_nodes(model, source, arc, NULL,
+                                         LIBRDF_STATEMENT_OBJECT);
+}
+
+
+/**
+ * librdf_model_overlay_get_arcs_in:
+ * @model: #librdf_model object
+ * @node: #librdf_node resource node
+ *
+ * Return the properties pointing to the given resource.
+ *
+ * Return value:  #librdf_iterator of #librdf_node objects (may be empty) or NULL on failure
+ **/
+static librdf_iterator*
+librdf_model_overlay_get_arcs_in(librdf_model *model, librdf_node *node)
+{
+  return librdf_model_overlay_find_nodes(model, NULL, NULL, node,
+                                         LIBRDF_STATEMENT_PREDICATE);
+}
+
+
+/**
+ * librdf_model_overlay_get_arcs_out:
+ * @model: #librdf_model object
+ * @node: #librdf_node resource node
+ *
+ * Return the properties pointing from the given resource.
+ *
+ * Return value:  #librdf_iterator of #librdf_node objects (may be empty) or NULL on failure
+ **/
+static librdf_iterator*
+librdf_model_overlay_get_arcs_out(librdf_model *model, librdf_node *node)
+{
+  return librdf_model_overlay_find_nodes(model, node, NULL, NULL,
+                                         LIBRDF_STATEMENT_PREDICATE);
+}
+
+
+/*
+ * librdf_model_overlay_has_statement - Check for a statement matching a pattern
+ */
+static int
+librdf_model_overlay_has_statement(librdf_model *model,
+                                   librdf_node *subject, librdf_node *predicate,
+                                   librdf_node *object)
+{
+  librdf_iterator* iterator;
+  int found;
+
+  iterator=librdf_model_overlay_find_nodes(model, subject, predicate, object,
+                                           LIBRDF_STATEMENT_SUBJECT);
+  if(!iterator)
+    return 0;
+
+  found=!librdf_iterator_end(iterator);
+  librdf_free_iterator(iterator);
+
+  return found;
+}
+
+
+/**
+ * librdf_model_overlay_has_arc_in:
+ * @model: #librdf_model object
+ * @node: #librdf_node resource node
+ * @property: #librdf_node property node
+ *
+ * Check if a node has a given property pointing to it.
+ *
+ * Return value: non 0 if arc property does point to the resource node
+ **/
+static int
+librdf_model_overlay_has_arc_in(librdf_model *model, librdf_node *node,
+                                librdf_node *property)
+{
+  return librdf_model_overlay_has_statement(model, NULL, property, node);
+}
+
+
+/**
+ * librdf_model_overlay_has_arc_out:
+ * @model: #librdf_model object
+ * @node: #librdf_node resource node
+ * @property: #librdf_node property node
+ *
+ * Check if a node has a given property pointing from it.
+ *
+ * Return value: non 0 if arc property does point from the resource node
+ **/
+static int
+librdf_model_overlay_has_arc_out(librdf_model *model, librdf_node *node,
+                                 librdf_node *property)
+{
+  return librdf_model_overlay_has_statement(model, node, property, NULL);
+}
+
+
+/**
+ * librdf_model_overlay_query_execute:
+ * @model: #librdf_model object
+ * @query: #librdf_query object
+ *
+ * Run a query against the model returning librdf_query_results.
+ *
+ * The query engine reads the model through its find methods.
+ *
+ * Return value: #librdf_query_results or NULL on failure
+ **/
+static librdf_query_results*
+librdf_model_overlay_query_execute(librdf_model* model,
+                                   librdf_query *query)
+{
+  return librdf_query_execute(query, model);
+}
+
+
+/**
+ * librdf_model_overlay_sync:
+ * @model: #librdf_model object
+ *
+ * Synchronise the model to the storage of the added statements.
+ *
+ * Return-value: Non-0 on failure
+ **/
+static int
+librdf_model_overlay_sync(librdf_model* model)
+{
+  librdf_model_overlay_context *context=(librdf_model_overlay_context *)model->context;
+  return librdf_storage_sync(context->added);
+}
+
+
+/* local function to register model_overlay functions */
+
+static void
+librdf_model_overlay_register_factory(librdf_model_factory *factory)
+{
+  factory->context_length     = sizeof(librdf_model_overlay_context);
+
+  factory->init               = librdf_model_overlay_init;
+  factory->terminate          = librdf_model_overlay_terminate;
+  factory->create             = librdf_model_overlay_create;
+  factory->clone              = librdf_model_overlay_clone;
+  factory->destroy            = librdf_model_overlay_destroy;
+  factory->size               = librdf_model_overlay_size;
+  factory->add_statement      = librdf_model_overlay_add_statement;
+  factory->add_statements     = librdf_model_overlay_add_statements;
+  factory->remove_statement   = librdf_model_overlay_remove_statement;
+  factory->contains_statement = librdf_model_overlay_contains_statement;
+  factory->serialise          = librdf_model_overlay_serialise;
+
+  factory->find_statements    = librdf_model_overlay_find_statements;
+  factory->get_sources        = librdf_model_overlay_get_sources;
+  factory->get_arcs           = librdf_model_overlay_get_arcs;
+  factory->get_targets        = librdf_model_overlay_get_targets;
+
+  factory->get_arcs_in        = librdf_model_overlay_get_arcs_in;
+  factory->get_arcs_out       = librdf_model_overlay_get_arcs_out;
+  factory->has_arc_in         = librdf_model_overlay_has_arc_in;
+  factory->has_arc_out        = librdf_model_overlay_has_arc_out;
+
+  /* No context methods; the model does not support contexts */
+
+  factory->query_execute      = librdf_model_overlay_query_execute;
+  factory->sync               = librdf_model_overlay_sync;
+  factory->find_statements_with_options = librdf_model_overlay_find_statements_with_options;
+}
+
+
+/**
+ * librdf_new_model_overlay:
+ * @world: redland world object
+ * @base: #librdf_model to layer over
+ * @storage: #librdf_storage to hold the statements added
+ * @options: #librdf_hash of options to use (or NULL)
+ *
+ * Constructor - Create a new #librdf_model layering changes over another.
+ *
+ * The new model starts with the statements of @base and records
+ * statements added in @storage and those of @base removed as
+ * tombstones in memory, so @base is never changed or copied.
+ * @base may be read-only and may itself be an overlay model, to
+ * layer several sets of changes.  Finds, targets and the like and
+ * queries merge the layers.  The model does not support contexts.
+ *
+ * The model holds references to @base and @storage.
+ * Options are presently not used.
+ *
+ * Return value: a new #librdf_model object or NULL on failure
+ **/
+librdf_model*
+librdf_new_model_overlay(librdf_world *world, librdf_model* base,
+                         librdf_storage *storage, librdf_hash* options)
+{
+  librdf_model *model;
+
+  librdf_world_open(world);
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(base, librdf_model, NULL);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, NULL);
+
+  if(!base || !storage)
+    return NULL;
+
+  model = LIBRDF_CALLOC(librdf_model*, 1, sizeof(*model));
+  if(!model)
+    return NULL;
+
+  model->world=world;
+
+  model->factory=librdf_get_model_factory(world, "overlay");
+  if(!model->factory) {
+    LIBRDF_FREE(librdf_model, model);
+    return NULL;
+  }
+
+  model->context = LIBRDF_CALLOC(void*, 1, model->factory->context_length);
+  if(!model->context) {
+    LIBRDF_FREE(librdf_model, model);
+    return NULL;
+  }
+
+  ((librdf_model_overlay_context*)model->context)->base=base;
+  librdf_model_add_reference(base);
+
+  if(model->factory->create(model, storage, options)) {
+    model->factory->destroy(model);
+    LIBRDF_FREE(data, model->context);
+    LIBRDF_FREE(librdf_model, model);
+    return NULL;
+  }
+
+  model->usage=1;
+
+  return model;
+}
+
+
+/**
+ * librdf_init_model_overlay:
+ * @world: world object
+ *
+ * INTERNAL - Initialise the model_overlay module
+ **/
+void
+librdf_init_model_overlay(librdf_world *world)
+{
+  librdf_model_register_factory(world,
+                                "overlay", "Model layering changes over a read-only model",
+                                &librdf_model_overlay_register_factory);
+}
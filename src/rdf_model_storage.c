@@ -681,6 +681,17 @@ librdf_model_storage_find_statements_with_options(librdf_model* model,
 }
 
 
+static librdf_stream*
+librdf_model_storage_find_statements_in_range(librdf_model* model,
+                                              librdf_node* predicate,
+                                              librdf_node* min,
+                                              librdf_node* max)
+{
+  librdf_model_storage_context *context=(librdf_model_storage_context *)model->context;
+  return librdf_storage_find_statements_in_range(context->storage, predicate, min, max);
+}
+
+
 /**
  * librdf_model_storage_transaction_start:
  * @storage: the storage object
@@ -808,6 +819,7 @@ librdf_model_storage_register_factory(librdf_model_factory *factory)
   factory->get_feature        = librdf_model_storage_get_feature;
   factory->set_feature        = librdf_model_storage_set_feature;
   factory->find_statements_with_options = librdf_model_storage_find_statements_with_options;
+  factory->find_statements_in_range = librdf_model_storage_find_statements_in_range;
 
   factory->transaction_start             = librdf_model_storage_transaction_start;
   factory->transaction_start_with_handle = librdf_model_storage_transaction_start_with_handle;
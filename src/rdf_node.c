@@ -32,6 +32,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <locale.h>
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
 #endif
@@ -44,16 +45,35 @@
 
 #ifndef STANDALONE
 
+static librdf_node* librdf_node_normalize(librdf_world* world, librdf_node* node);
+
+
+/* Literal nodes with values up to this many bytes are shared */
+#define LIBRDF_NODE_SHARED_LITERAL_MAX_LEN 16
+
+/* Size of the shared literals table (a power of 2) */
+#define LIBRDF_NODE_SHARED_LITERALS_SIZE 1024
+
+
 /**
  * librdf_init_node:
  * @world: redland world object
  *
  * INTERNAL - Initialise the node module.
  * 
+ * Literal nodes are immutable so the same short ones such as "true",
+ * "0" or "yes"@en are shared between callers through a fixed size
+ * table of references kept in the world.  Raptor term reference
+ * counts are not locked, so the table is not used with threads.
  **/
 void
 librdf_init_node(librdf_world* world)
 {
+#ifndef WITH_THREADS
+  world->shared_literals = LIBRDF_CALLOC(librdf_node**,
+                                         LIBRDF_NODE_SHARED_LITERALS_SIZE,
+                                         sizeof(librdf_node*));
+#endif
 }
 
 
@@ -67,6 +87,128 @@ librdf_init_node(librdf_world* world)
 void
 librdf_finish_node(librdf_world* world)
 {
+  int i;
+
+  if(!world->shared_literals)
+    return;
+
+  for(i = 0; i < LIBRDF_NODE_SHARED_LITERALS_SIZE; i++) {
+    if(world->shared_literals[i])
+      raptor_free_term(world->shared_literals[i]);
+  }
+  LIBRDF_FREE(librdf_node**, world->shared_literals);
+  world->shared_literals = NULL;
+}
+
+
+/*
+ * librdf_node_shared_literal_slot:
+ * @value: literal value
+ * @value_len: length of @value
+ * @language: language or NULL
+ * @language_len: length of @language
+ * @datatype: datatype URI or NULL
+ *
+ * INTERNAL - Get the shared literals table slot for a literal
+ *
+ * Raptor interns URIs so the datatype is hashed by its address.
+ *
+ * Return value: slot index
+ */
+static unsigned int
+librdf_node_shared_literal_slot(const unsigned char *value, size_t value_len,
+                                const unsigned char *language,
+                                size_t language_len,
+                                librdf_uri *datatype)
+{
+  /* FNV-1a */
+  unsigned long hash = 2166136261UL;
+  size_t i;
+
+  for(i = 0; i < value_len; i++)
+    hash = (hash ^ value[i]) * 16777619UL;
+  hash = (hash ^ '@') * 16777619UL;
+  for(i = 0; i < language_len; i++)
+    hash = (hash ^ language[i]) * 16777619UL;
+  hash ^= LIBRDF_GOOD_CAST(unsigned long, LIBRDF_GOOD_CAST(size_t, datatype) >> 4);
+  hash *= 16777619UL;
+
+  return LIBRDF_GOOD_CAST(unsigned int,
+                          hash & (LIBRDF_NODE_SHARED_LITERALS_SIZE - 1));
+}
+
+
+/*
+ * librdf_node_new_literal:
+ * @world: redland world object
+ * @value: literal UTF-8 encoded string value
+ * @value_len: literal string value length
+ * @language: literal XML language or NULL
+ * @language_len: length of @language
+ * @datatype: URI of typed literal datatype or NULL
+ *
+ * INTERNAL - Make a literal node, sharing short ones made before
+ *
+ * Return value: new #librdf_node object or NULL on failure
+ */
+static librdf_node*
+librdf_node_new_literal(librdf_world *world,
+                        const unsigned char *value, size_t value_len,
+                        const unsigned char *language, size_t language_len,
+                        librdf_uri *datatype)
+{
+  librdf_node** shared;
+  librdf_node* node;
+  unsigned int slot = 0;
+
+  /* worlds made from a template share its table */
+  if(world->template_world)
+    shared = world->template_world->shared_literals;
+  else
+    shared = world->shared_literals;
+
+  if(language && !*language) {
+    language = NULL;
+    language_len = 0;
+  }
+
+  if(!value || value_len > LIBRDF_NODE_SHARED_LITERAL_MAX_LEN ||
+     (language && datatype))
+    shared = NULL;
+
+  if(shared) {
+    slot = librdf_node_shared_literal_slot(value, value_len,
+                                           language, language_len, datatype);
+    node = shared[slot];
+    if(node &&
+       node->value.literal.string_len == value_len &&
+       !memcmp(node->value.literal.string, value, value_len) &&
+       node->value.literal.language_len == language_len &&
+       (!language_len ||
+        !memcmp(node->value.literal.language, language, language_len)) &&
+       ((!node->value.literal.datatype && !datatype) ||
+        (node->value.literal.datatype && datatype &&
+         raptor_uri_equals(node->value.literal.datatype, datatype))))
+      return raptor_term_copy(node);
+  }
+
+  node = raptor_new_term_from_counted_literal(world->raptor_world_ptr,
+                                              value, value_len,
+                                              datatype, language,
+                                              (unsigned char)language_len);
+  node = librdf_node_normalize(world, node);
+
+  /* only share nodes that are the value asked for, not a canonical
+   * replacement, so they are found again from the same input
+   */
+  if(shared && node && node->value.literal.string_len == value_len &&
+     !memcmp(node->value.literal.string, value, value_len)) {
+    if(shared[slot])
+      raptor_free_term(shared[slot]);
+    shared[slot] = raptor_term_copy(node);
+  }
+
+  return node;
 }
 
 
@@ -352,7 +494,6 @@ librdf_new_node_from_literal(librdf_world *world,
                              int is_wf_xml)
 {
   librdf_uri* datatype_uri;
-  librdf_node* n;
   
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, librdf_world, NULL);
   
@@ -360,10 +501,11 @@ librdf_new_node_from_literal(librdf_world *world,
 
   datatype_uri = (is_wf_xml ?  LIBRDF_RS_XMLLiteral_URI(world) : NULL);
 
-  n = raptor_new_term_from_literal(world->raptor_world_ptr,
-                                   string, datatype_uri,
-                                   (const unsigned char*)xml_language);
-  return librdf_node_normalize(world, n);
+  return librdf_node_new_literal(world,
+                                 string, string ? strlen((const char*)string) : 0,
+                                 (const unsigned char*)xml_language,
+                                 xml_language ? strlen(xml_language) : 0,
+                                 datatype_uri);
 }
 
 
@@ -388,16 +530,15 @@ librdf_new_node_from_typed_literal(librdf_world *world,
                                    const char *xml_language,
                                    librdf_uri *datatype_uri)
 {
-  librdf_node* n;
-
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, librdf_world, NULL);
   
   librdf_world_open(world);
 
-  n = raptor_new_term_from_literal(world->raptor_world_ptr,
-                                   value, datatype_uri,
-                                   (const unsigned char*)xml_language);
-  return librdf_node_normalize(world, n);
+  return librdf_node_new_literal(world,
+                                 value, value ? strlen((const char*)value) : 0,
+                                 (const unsigned char*)xml_language,
+                                 xml_language ? strlen(xml_language) : 0,
+                                 datatype_uri);
 }
 
 
@@ -428,18 +569,14 @@ librdf_new_node_from_typed_counted_literal(librdf_world *world,
                                            size_t xml_language_len,
                                            librdf_uri *datatype_uri)
 {
-  librdf_node* n;
-
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, librdf_world, NULL);
   
   librdf_world_open(world);
 
-  n = raptor_new_term_from_counted_literal(world->raptor_world_ptr,
-                                           value, value_len,
-                                           datatype_uri,
-                                           (const unsigned char*)xml_language,
-                                           (unsigned char)xml_language_len);
-  return librdf_node_normalize(world, n);
+  return librdf_node_new_literal(world, value, value_len,
+                                 (const unsigned char*)xml_language,
+                                 xml_language ? xml_language_len : 0,
+                                 datatype_uri);
 }
 
 
@@ -486,22 +623,20 @@ librdf_node*
 librdf_new_node_from_blank_identifier(librdf_world *world,
                                       const unsigned char *identifier)
 {
-  const unsigned char *blank = identifier;
-  librdf_node* node = NULL;
-  
+  unsigned char blank[LIBRDF_GENID_MAX_LEN];
+  size_t blank_len;
+
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, librdf_world, NULL);
   
   librdf_world_open(world);
 
-  if(!identifier)
-    blank = librdf_world_get_genid(world);
-  
-  node = raptor_new_term_from_blank(world->raptor_world_ptr, blank);
-
-  if(!identifier)
-    LIBRDF_FREE(char*, (char*)blank);
+  if(identifier)
+    return raptor_new_term_from_blank(world->raptor_world_ptr, identifier);
 
-  return node;
+  /* generate the identifier on the stack, raptor takes a copy */
+  blank_len = librdf_world_format_genid(world, blank);
+  return raptor_new_term_from_counted_blank(world->raptor_world_ptr,
+                                            blank, blank_len);
 }
 
 
@@ -522,6 +657,35 @@ librdf_new_node_from_node(librdf_node *node)
 }
 
 
+/**
+ * librdf_new_node_from_parsed_term:
+ * @world: redland world object
+ * @term: #raptor_term from a parser
+ *
+ * INTERNAL - Constructor - share a term made by a parser as a node.
+ *
+ * Parsers hand out terms that are only borrowed for the duration of
+ * the statement handler.  Since a #librdf_node is a #raptor_term this
+ * takes a reference to @term instead of building a new node with
+ * copies of its URI, string and language, so nodes of statements that
+ * are parsed and then discarded never allocate.  The same canonical
+ * form as librdf_new_node_from_typed_literal() is applied to literals.
+ *
+ * Return value: a new #librdf_node object or NULL on failure
+ **/
+librdf_node*
+librdf_new_node_from_parsed_term(librdf_world *world, raptor_term *term)
+{
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, librdf_world, NULL);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(term, raptor_term, NULL);
+
+  if(term->type == RAPTOR_TERM_TYPE_LITERAL)
+    return librdf_node_normalize(world, raptor_term_copy(term));
+
+  return raptor_term_copy(term);
+}
+
+
 /**
  * librdf_free_node:
  * @node: #librdf_node object
@@ -846,6 +1010,379 @@ librdf_node_is_blank(librdf_node *node)
 }
 
 
+/* XSD datatypes with ordered values and their kind of value */
+static const struct {
+  const char* name;
+  librdf_node_value_kind kind;
+} librdf_node_value_datatypes[] = {
+  { "integer",            LIBRDF_NODE_VALUE_NUMERIC },
+  { "decimal",            LIBRDF_NODE_VALUE_NUMERIC },
+  { "double",             LIBRDF_NODE_VALUE_NUMERIC },
+  { "float",              LIBRDF_NODE_VALUE_NUMERIC },
+  { "int",                LIBRDF_NODE_VALUE_NUMERIC },
+  { "long",               LIBRDF_NODE_VALUE_NUMERIC },
+  { "short",              LIBRDF_NODE_VALUE_NUMERIC },
+  { "byte",               LIBRDF_NODE_VALUE_NUMERIC },
+  { "nonNegativeInteger", LIBRDF_NODE_VALUE_NUMERIC },
+  { "nonPositiveInteger", LIBRDF_NODE_VALUE_NUMERIC },
+  { "positiveInteger",    LIBRDF_NODE_VALUE_NUMERIC },
+  { "negativeInteger",    LIBRDF_NODE_VALUE_NUMERIC },
+  { "unsignedLong",       LIBRDF_NODE_VALUE_NUMERIC },
+  { "unsignedInt",        LIBRDF_NODE_VALUE_NUMERIC },
+  { "unsignedShort",      LIBRDF_NODE_VALUE_NUMERIC },
+  { "unsignedByte",       LIBRDF_NODE_VALUE_NUMERIC },
+  { "dateTime",           LIBRDF_NODE_VALUE_DATETIME },
+  { "date",               LIBRDF_NODE_VALUE_DATETIME },
+  { NULL,                 LIBRDF_NODE_VALUE_NONE }
+};
+
+#define LIBRDF_NODE_XSD_NAMESPACE "http://www.w3.org/2001/XMLSchema#"
+#define LIBRDF_NODE_XSD_NAMESPACE_LEN 33
+
+
+/* Parse xsd:decimal, xsd:integer or xsd:double lexical form
+ *
+ * The lexical form always uses '.' so it is copied with the decimal
+ * point of the current locale before strtod() reads it.
+ */
+static int
+librdf_node_numeric_value_key(const char* string, double* key_p)
+{
+  char buffer[64];
+  char* copy = buffer;
+  const char* p;
+  char* end;
+  char point;
+  size_t len;
+  double value;
+  int rc = 1;
+
+  while(*string == ' ')
+    string++;
+
+  if(strcmp(string, "INF") && strcmp(string, "+INF") &&
+     strcmp(string, "-INF")) {
+    for(p = string; *p && *p != ' '; p++) {
+      if(!((*p >= '0' && *p <= '9') || *p == '.' || *p == '+' ||
+           *p == '-' || *p == 'e' || *p == 'E'))
+        return 1;
+    }
+  }
+
+  len = strlen(string);
+  if(len >= sizeof(buffer)) {
+    copy = LIBRDF_MALLOC(char*, len + 1);
+    if(!copy)
+      return 1;
+  }
+  memcpy(copy, string, len + 1);
+
+  point = *localeconv()->decimal_point;
+  if(point != '.') {
+    char* dot = strchr(copy, '.');
+
+    if(dot)
+      *dot = point;
+  }
+
+  value = strtod(copy, &end);
+  if(end != copy) {
+    while(*end == ' ')
+      end++;
+    if(!*end) {
+      *key_p = value;
+      rc = 0;
+    }
+  }
+
+  if(copy != buffer)
+    LIBRDF_FREE(char*, copy);
+
+  return rc;
+}
+
+
+/* Read exactly count digits */
+static int
+librdf_node_read_digits(const char** string_p, int count, long* value_p)
+{
+  const char* p = *string_p;
+  long value = 0;
+
+  while(count--) {
+    if(*p < '0' || *p > '9')
+      return 1;
+    value = value * 10 + (*p++ - '0');
+  }
+
+  *value_p = value;
+  *string_p = p;
+  return 0;
+}
+
+
+/*
+ * Parse xsd:dateTime or xsd:date lexical form into seconds since
+ * 1970-01-01T00:00:00Z.  Values without a timezone are taken as UTC.
+ */
+static int
+librdf_node_datetime_value_key(const char* string, double* key_p)
+{
+  const char* p = string;
+  int negative = 0;
+  long year = 0, month, day, hour = 0, minute = 0, second = 0;
+  long tz_hour, tz_minute;
+  long era, yoe, doy, doe, days;
+  double seconds;
+  double fraction = 0.0;
+
+  while(*p == ' ')
+    p++;
+
+  if(*p == '-') {
+    negative = 1;
+    p++;
+  }
+  /* at least 4 year digits */
+  if(librdf_node_read_digits(&p, 4, &year))
+    return 1;
+  while(*p >= '0' && *p <= '9')
+    year = year * 10 + (*p++ - '0');
+  if(negative)
+    year = -year;
+
+  if(*p++ != '-' || librdf_node_read_digits(&p, 2, &month) ||
+     *p++ != '-' || librdf_node_read_digits(&p, 2, &day))
+    return 1;
+  if(month < 1 || month > 12 || day < 1 || day > 31)
+    return 1;
+
+  if(*p == 'T') {
+    p++;
+    if(librdf_node_read_digits(&p, 2, &hour) ||
+       *p++ != ':' || librdf_node_read_digits(&p, 2, &minute) ||
+       *p++ != ':' || librdf_node_read_digits(&p, 2, &second))
+      return 1;
+    if(*p == '.') {
+      double scale = 0.1;
+
+      p++;
+      if(*p < '0' || *p > '9')
+        return 1;
+      while(*p >= '0' && *p <= '9') {
+        fraction += (*p++ - '0') * scale;
+        scale /= 10;
+      }
+    }
+  }
+
+  /* days from civil date (proleptic Gregorian) */
+  if(month <= 2)
+    year--;
+  era = (year >= 0 ? year : year - 399) / 400;
+  yoe = year - era * 400;
+  doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  days = era * 146097 + doe - 719468;
+
+  seconds = (double)days * 86400.0 + (double)(hour * 3600 + minute * 60 + second)
+            + fraction;
+
+  if(*p == 'Z') {
+    p++;
+  } else if(*p == '+' || *p == '-') {
+    int sign = (*p++ == '-') ? -1 : 1;
+
+    if(librdf_node_read_digits(&p, 2, &tz_hour) ||
+       *p++ != ':' || librdf_node_read_digits(&p, 2, &tz_minute))
+      return 1;
+    /* local time minus the offset is UTC */
+    seconds -= sign * (double)(tz_hour * 3600 + tz_minute * 60);
+  }
+
+  while(*p == ' ')
+    p++;
+  if(*p)
+    return 1;
+
+  *key_p = seconds;
+  return 0;
+}
+
+
+/**
+ * librdf_node_get_literal_value_key:
+ * @node: the node object
+ * @key_p: pointer to store the value sort key
+ *
+ * INTERNAL - Get the ordered value of a typed literal.
+ *
+ * Literals of the XSD numeric types are all one kind of value with
+ * the number as the key and xsd:dateTime and xsd:date literals
+ * another with the seconds since the epoch as the key.  Keys of one
+ * kind compare as the values do (to double precision).
+ *
+ * Return value: kind of value or LIBRDF_NODE_VALUE_NONE if @node has
+ * no ordered value
+ **/
+librdf_node_value_kind
+librdf_node_get_literal_value_key(librdf_node *node, double* key_p)
+{
+  const unsigned char* uri_string;
+  size_t uri_len;
+  const char* name;
+  const char* string;
+  int i;
+
+  if(!node || node->type != RAPTOR_TERM_TYPE_LITERAL ||
+     !node->value.literal.datatype)
+    return LIBRDF_NODE_VALUE_NONE;
+
+  uri_string = librdf_uri_as_counted_string(node->value.literal.datatype,
+                                            &uri_len);
+  if(uri_len <= LIBRDF_NODE_XSD_NAMESPACE_LEN ||
+     memcmp(uri_string, LIBRDF_NODE_XSD_NAMESPACE,
+            LIBRDF_NODE_XSD_NAMESPACE_LEN))
+    return LIBRDF_NODE_VALUE_NONE;
+  name = (const char*)uri_string + LIBRDF_NODE_XSD_NAMESPACE_LEN;
+  string = (const char*)node->value.literal.string;
+
+  for(i = 0; librdf_node_value_datatypes[i].name; i++) {
+    if(strcmp(name, librdf_node_value_datatypes[i].name))
+      continue;
+
+    if(librdf_node_value_datatypes[i].kind == LIBRDF_NODE_VALUE_NUMERIC) {
+      if(librdf_node_numeric_value_key(string, key_p))
+        return LIBRDF_NODE_VALUE_NONE;
+    } else {
+      if(librdf_node_datetime_value_key(string, key_p))
+        return LIBRDF_NODE_VALUE_NONE;
+    }
+
+    return librdf_node_value_datatypes[i].kind;
+  }
+
+  return LIBRDF_NODE_VALUE_NONE;
+}
+
+
+/**
+ * librdf_new_node_value_range:
+ * @min: lowest literal value or NULL
+ * @max: highest literal value or NULL
+ *
+ * INTERNAL - Constructor - make an inclusive range of literal values
+ *
+ * At least one of @min and @max must be given and both must be of
+ * the same kind as returned by librdf_node_get_literal_value_key().
+ *
+ * Return value: new range or NULL on failure
+ **/
+librdf_node_value_range*
+librdf_new_node_value_range(librdf_node* min, librdf_node* max)
+{
+  librdf_node_value_range* range;
+  librdf_node_value_kind kind = LIBRDF_NODE_VALUE_NONE;
+  double min_key = 0.0, max_key = 0.0;
+
+  if(!min && !max)
+    return NULL;
+
+  if(min) {
+    kind = librdf_node_get_literal_value_key(min, &min_key);
+    if(kind == LIBRDF_NODE_VALUE_NONE)
+      return NULL;
+  }
+  if(max) {
+    librdf_node_value_kind max_kind;
+
+    max_kind = librdf_node_get_literal_value_key(max, &max_key);
+    if(max_kind == LIBRDF_NODE_VALUE_NONE || (min && max_kind != kind))
+      return NULL;
+    kind = max_kind;
+  }
+
+  range = LIBRDF_CALLOC(librdf_node_value_range*, 1, sizeof(*range));
+  if(!range)
+    return NULL;
+
+  range->kind = kind;
+  range->has_min = (min != NULL);
+  range->min = min_key;
+  range->has_max = (max != NULL);
+  range->max = max_key;
+
+  return range;
+}
+
+
+/**
+ * librdf_free_node_value_range:
+ * @range: range
+ *
+ * INTERNAL - Destructor - destroy a range of literal values
+ **/
+void
+librdf_free_node_value_range(librdf_node_value_range* range)
+{
+  if(range)
+    LIBRDF_FREE(librdf_node_value_range, range);
+}
+
+
+/**
+ * librdf_node_value_range_compare:
+ * @range: range
+ * @kind: kind of value
+ * @key: value sort key
+ *
+ * INTERNAL - Compare a value key with a range of literal values
+ *
+ * Kinds of values sort before the values of higher kinds.
+ *
+ * Return value: <0 if the value is before the range, 0 if inside,
+ * >0 if after
+ **/
+int
+librdf_node_value_range_compare(librdf_node_value_range* range,
+                                librdf_node_value_kind kind, double key)
+{
+  if(kind != range->kind)
+    return (kind < range->kind) ? -1 : 1;
+
+  if(range->has_min && key < range->min)
+    return -1;
+  if(range->has_max && key > range->max)
+    return 1;
+
+  return 0;
+}
+
+
+/**
+ * librdf_node_value_range_contains:
+ * @range: range
+ * @node: node
+ *
+ * INTERNAL - Check if a node is a literal with a value in a range
+ *
+ * Return value: non 0 if @node is in the range
+ **/
+int
+librdf_node_value_range_contains(librdf_node_value_range* range,
+                                 librdf_node* node)
+{
+  librdf_node_value_kind kind;
+  double key;
+
+  kind = librdf_node_get_literal_value_key(node, &key);
+  if(kind == LIBRDF_NODE_VALUE_NONE)
+    return 0;
+
+  return !librdf_node_value_range_compare(range, kind, key);
+}
+
+
 /**
  * librdf_node_encode:
  * @node: the node to serialise
@@ -1159,6 +1696,76 @@ librdf_node_decode(librdf_world *world, size_t *size_p,
 }
 
 
+/**
+ * librdf_node_encoded_length:
+ * @buffer: the buffer holding an encoded node
+ * @length: buffer size
+ *
+ * INTERNAL - Get the size of a serialised node without decoding it.
+ *
+ * Reads only the header of the node encoding made by
+ * librdf_node_encode() so that encoded nodes can be stepped over or
+ * compared as bytes.
+ *
+ * Return value: bytes used by the encoded node or 0 on a bad encoding
+ **/
+size_t
+librdf_node_encoded_length(const unsigned char *buffer, size_t length)
+{
+  size_t total_length;
+  size_t datatype_uri_length = 0;
+  size_t language_length = 0;
+
+  if(length < 1)
+    return 0;
+
+  switch(buffer[0]) {
+    case 'R': /* URI / Resource */
+    case 'B': /* RAPTOR_TERM_TYPE_BLANK */
+      if(length < 3)
+        return 0;
+      total_length = 3 + LIBRDF_GOOD_CAST(size_t, (buffer[1] << 8) | buffer[2]) + 1;
+      break;
+
+    case 'L': /* Old encoding form for Literal */
+      if(length < 6)
+        return 0;
+      total_length = 6 + LIBRDF_GOOD_CAST(size_t, (buffer[2] << 8) | buffer[3]) + 1;
+      language_length = LIBRDF_GOOD_CAST(size_t, buffer[5]);
+      break;
+
+    case 'M': /* Literal for Redland 0.9.12+ */
+      if(length < 6)
+        return 0;
+      total_length = 6 + LIBRDF_GOOD_CAST(size_t, (buffer[1] << 8) | buffer[2]) + 1;
+      datatype_uri_length = LIBRDF_GOOD_CAST(size_t, (buffer[3] << 8) | buffer[4]);
+      language_length = LIBRDF_GOOD_CAST(size_t, buffer[5]);
+      break;
+
+    case 'N': /* Literal for redland 1.0.5+ (long literal) */
+      if(length < 8)
+        return 0;
+      total_length = 8 + LIBRDF_GOOD_CAST(size_t, ((size_t)buffer[1] << 24) | (buffer[2] << 16) | (buffer[3] << 8) | buffer[4]) + 1;
+      datatype_uri_length = LIBRDF_GOOD_CAST(size_t, (buffer[5] << 8) | buffer[6]);
+      language_length = LIBRDF_GOOD_CAST(size_t, buffer[7]);
+      break;
+
+    default:
+      return 0;
+  }
+
+  if(datatype_uri_length)
+    total_length += datatype_uri_length + 1;
+  if(language_length)
+    total_length += language_length + 1;
+
+  if(total_length > length)
+    return 0;
+
+  return total_length;
+}
+
+
 #ifndef REDLAND_DISABLE_DEPRECATED
 /**
  * librdf_node_to_string:
@@ -1625,6 +2232,67 @@ main(int argc, char *argv[])
     return(1);
   }
     
+  if(1) {
+    librdf_node *en1, *en2, *fr;
+
+    fprintf(stdout, "%s: Making short literals with languages\n", program);
+    en1=librdf_new_node_from_literal(world, (const unsigned char*)"yes",
+                                     "en", 0);
+    en2=librdf_new_node_from_typed_counted_literal(world,
+                                                   (const unsigned char*)"yes", 3,
+                                                   "en", 2, NULL);
+    fr=librdf_new_node_from_literal(world, (const unsigned char*)"yes",
+                                    "fr", 0);
+    if(!en1 || !en2 || !fr) {
+      fprintf(stderr, "%s: Failed to make short literals\n", program);
+      return(1);
+    }
+    if(!librdf_node_equals(en1, en2) || librdf_node_equals(en1, fr)) {
+      fprintf(stderr, "%s: Short literals compare wrongly\n", program);
+      return(1);
+    }
+    librdf_free_node(en1);
+    librdf_free_node(en2);
+    librdf_free_node(fr);
+  }
+
+  if(1) {
+    librdf_uri *integer_uri, *double_uri;
+    librdf_node *low, *high, *value;
+    librdf_node_value_range* range;
+
+    fprintf(stdout, "%s: Checking literal value ranges\n", program);
+    integer_uri=librdf_new_uri(world, (const unsigned char*)"http://www.w3.org/2001/XMLSchema#integer");
+    double_uri=librdf_new_uri(world, (const unsigned char*)"http://www.w3.org/2001/XMLSchema#double");
+    low=librdf_new_node_from_typed_literal(world, (const unsigned char*)"9",
+                                           NULL, integer_uri);
+    high=librdf_new_node_from_typed_literal(world, (const unsigned char*)"1.5E2",
+                                            NULL, double_uri);
+    value=librdf_new_node_from_typed_literal(world, (const unsigned char*)"100",
+                                             NULL, integer_uri);
+    range=librdf_new_node_value_range(low, high);
+    if(!range || !librdf_node_value_range_contains(range, value) ||
+       librdf_node_value_range_contains(range, node7)) {
+      fprintf(stderr, "%s: Literal value range check failed\n", program);
+      return(1);
+    }
+    librdf_free_node_value_range(range);
+
+    /* "100" sorts before "9" as a string but not as a value */
+    range=librdf_new_node_value_range(NULL, low);
+    if(!range || librdf_node_value_range_contains(range, value)) {
+      fprintf(stderr, "%s: Literal value upper bound check failed\n", program);
+      return(1);
+    }
+    librdf_free_node_value_range(range);
+
+    librdf_free_node(low);
+    librdf_free_node(high);
+    librdf_free_node(value);
+    librdf_free_uri(integer_uri);
+    librdf_free_uri(double_uri);
+  }
+
   big_literal_length=100000;
   big_literal = LIBRDF_MALLOC(unsigned char*, big_literal_length + 1);
   for(i=0; i<big_literal_length; i++)
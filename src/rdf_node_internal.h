@@ -80,6 +80,31 @@ struct librdf_node_s
 void librdf_init_node(librdf_world* world);
 void librdf_finish_node(librdf_world* world);
 
+librdf_node* librdf_new_node_from_parsed_term(librdf_world *world, raptor_term *term);
+size_t librdf_node_encoded_length(const unsigned char *buffer, size_t length);
+
+/* Kinds of literal values that have an order */
+typedef enum {
+  LIBRDF_NODE_VALUE_NONE,
+  LIBRDF_NODE_VALUE_NUMERIC,
+  LIBRDF_NODE_VALUE_DATETIME
+} librdf_node_value_kind;
+
+/* Inclusive range of literal values of one kind */
+typedef struct {
+  librdf_node_value_kind kind;
+  int has_min;
+  double min;
+  int has_max;
+  double max;
+} librdf_node_value_range;
+
+librdf_node_value_kind librdf_node_get_literal_value_key(librdf_node *node, double* key_p);
+librdf_node_value_range* librdf_new_node_value_range(librdf_node* min, librdf_node* max);
+void librdf_free_node_value_range(librdf_node_value_range* range);
+int librdf_node_value_range_compare(librdf_node_value_range* range, librdf_node_value_kind kind, double key);
+int librdf_node_value_range_contains(librdf_node_value_range* range, librdf_node* node);
+
 /* exported public in error but never usable */
 librdf_digest* librdf_node_get_digest(librdf_node* node);
 
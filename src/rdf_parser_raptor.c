@@ -66,6 +66,9 @@ typedef struct {
 } librdf_parser_raptor_context;
 
 
+/* Most statements that can be reused from a stream */
+#define LIBRDF_PARSER_RAPTOR_SPARE_STATEMENTS 64
+
 typedef struct {
   librdf_parser_raptor_context* pcontext; /* parser context */
 
@@ -87,9 +90,86 @@ typedef struct {
    */
   librdf_statement* current; /* current statement */
   librdf_list* statements;
+
+  /* Statements handed out and dropped again without anyone keeping a
+   * reference are cleared and kept here to be reused for the next
+   * ones parsed, so a parse-and-discard stream allocates statements
+   * for one batch of parsing only.
+   */
+  librdf_statement* spare[LIBRDF_PARSER_RAPTOR_SPARE_STATEMENTS];
+  int spare_count;
+
+  /* parse start time and statements seen for the world metrics */
+  double start;
+  unsigned long statements_count;
+
+  /* trace span of the whole parse */
+  librdf_trace_span span;
 } librdf_parser_raptor_stream_context;
 
 
+/*
+ * librdf_parser_raptor_trace_begin - Begin the trace span of a parse
+ * @scontext: stream context
+ *
+ * The span lasts until the stream context is finished, so for a
+ * parse as a stream it includes the time the statements are used.
+ */
+static void
+librdf_parser_raptor_trace_begin(librdf_parser_raptor_stream_context* scontext)
+{
+  librdf_parser* parser = scontext->pcontext->parser;
+
+  if(!LIBRDF_TRACE_SPAN_INIT(parser->world, &scontext->span, "parser", "parse"))
+    return;
+
+  librdf_trace_span_add_string(&scontext->span, "syntax",
+                               parser->factory->name);
+  librdf_trace_span_begin(&scontext->span);
+}
+
+
+/*
+ * librdf_parser_raptor_new_stream_statement - helper to get an empty statement
+ * @scontext: stream context
+ *
+ * Return value: a spare statement, a new one or NULL on failure
+ */
+static librdf_statement*
+librdf_parser_raptor_new_stream_statement(librdf_parser_raptor_stream_context* scontext)
+{
+  if(scontext->spare_count)
+    return scontext->spare[--scontext->spare_count];
+
+  return librdf_new_statement(scontext->pcontext->parser->world);
+}
+
+
+/*
+ * librdf_parser_raptor_free_stream_statement - helper to drop a statement
+ * @scontext: stream context
+ * @statement: statement
+ *
+ * Keeps @statement as a spare if this was the only reference to it.
+ */
+static void
+librdf_parser_raptor_free_stream_statement(librdf_parser_raptor_stream_context* scontext,
+                                           librdf_statement* statement)
+{
+  if(!statement)
+    return;
+
+  if(statement->usage == 1 &&
+     scontext->spare_count < LIBRDF_PARSER_RAPTOR_SPARE_STATEMENTS) {
+    librdf_statement_clear(statement);
+    scontext->spare[scontext->spare_count++] = statement;
+    return;
+  }
+
+  librdf_free_statement(statement);
+}
+
+
 static int
 librdf_parser_raptor_relay_filter(void* user_data, raptor_uri* uri)
 {
@@ -179,83 +259,58 @@ librdf_parser_raptor_new_statement_handler(void *context,
   librdf_world* world=scontext->pcontext->parser->world;
   int rc;
 
-  statement=librdf_new_statement(world);
-  if(!statement)
-    return;
+  /* the nodes share the terms of the parsed statement */
 
-  if(rstatement->subject->type == RAPTOR_TERM_TYPE_BLANK) {
-    node = librdf_new_node_from_blank_identifier(world, (const unsigned char*)rstatement->subject->value.blank.string);
-  } else if (rstatement->subject->type == RAPTOR_TERM_TYPE_URI) {
-    node = librdf_new_node_from_uri(world, (librdf_uri*)rstatement->subject->value.uri);
-  } else {
+  if(rstatement->subject->type != RAPTOR_TERM_TYPE_BLANK &&
+     rstatement->subject->type != RAPTOR_TERM_TYPE_URI) {
     librdf_log(world,
                0, LIBRDF_LOG_ERROR, LIBRDF_FROM_PARSER, NULL,
                "Unknown Raptor subject identifier type %d",
                rstatement->subject->type);
-    librdf_free_statement(statement);
     return;
   }
 
-  if(!node) {
-    librdf_log(world,
-               0, LIBRDF_LOG_FATAL, LIBRDF_FROM_PARSER, NULL,
-               "Cannot create subject node");
-    librdf_free_statement(statement);
-    return;
-  }
-
-  librdf_statement_set_subject(statement, node);
-
-
-  if(rstatement->predicate->type == RAPTOR_TERM_TYPE_URI) {
-    node = librdf_new_node_from_uri(world, (librdf_uri*)rstatement->predicate->value.uri);
-  } else {
+  if(rstatement->predicate->type != RAPTOR_TERM_TYPE_URI) {
     librdf_log(world,
                0, LIBRDF_LOG_ERROR, LIBRDF_FROM_PARSER, NULL,
                "Unknown Raptor predicate identifier type %d",
                rstatement->predicate->type);
-    librdf_free_statement(statement);
     return;
   }
 
-  if(!node) {
-    librdf_log(world,
-               0, LIBRDF_LOG_FATAL, LIBRDF_FROM_PARSER, NULL,
-               "Cannot create predicate node");
-    librdf_free_statement(statement);
-    return;
-  }
-
-  librdf_statement_set_predicate(statement, node);
-
-  if(rstatement->object->type == RAPTOR_TERM_TYPE_LITERAL) {
-    node = librdf_new_node_from_typed_literal(world,
-                                              rstatement->object->value.literal.string,
-                                              (const char *)rstatement->object->value.literal.language,
-                                              (librdf_uri*)rstatement->object->value.literal.datatype);
-  } else if(rstatement->object->type == RAPTOR_TERM_TYPE_BLANK) {
-    node = librdf_new_node_from_blank_identifier(world, rstatement->object->value.blank.string);
-  } else if(rstatement->object->type == RAPTOR_TERM_TYPE_URI) {
-    node = librdf_new_node_from_uri(world, (librdf_uri*)rstatement->object->value.uri);
-  } else {
+  if(rstatement->object->type != RAPTOR_TERM_TYPE_LITERAL &&
+     rstatement->object->type != RAPTOR_TERM_TYPE_BLANK &&
+     rstatement->object->type != RAPTOR_TERM_TYPE_URI) {
     librdf_log(world,
                0, LIBRDF_LOG_ERROR, LIBRDF_FROM_PARSER, NULL,
                "Unknown Raptor object identifier type %d",
                rstatement->object->type);
-    librdf_free_statement(statement);
     return;
   }
 
-  if(!node) {
+  scontext->statements_count++;
+
+  statement=librdf_parser_raptor_new_stream_statement(scontext);
+  if(!statement)
+    return;
+
+  librdf_statement_set_subject(statement,
+                               librdf_new_node_from_parsed_term(world, rstatement->subject));
+  librdf_statement_set_predicate(statement,
+                                 librdf_new_node_from_parsed_term(world, rstatement->predicate));
+  librdf_statement_set_object(statement,
+                              librdf_new_node_from_parsed_term(world, rstatement->object));
+
+  if(!librdf_statement_get_subject(statement) ||
+     !librdf_statement_get_predicate(statement) ||
+     !librdf_statement_get_object(statement)) {
     librdf_log(world,
                0, LIBRDF_LOG_FATAL, LIBRDF_FROM_PARSER, NULL,
-               "Cannot create object node");
-    librdf_free_statement(statement);
+               "Cannot create statement nodes");
+    librdf_parser_raptor_free_stream_statement(scontext, statement);
     return;
   }
 
-  librdf_statement_set_object(statement, node);
-
 #if defined(LIBRDF_DEBUG) && LIBRDF_DEBUG > 1
   if(1) {
     raptor_iostream *iostr;
@@ -270,17 +325,17 @@ librdf_parser_raptor_new_statement_handler(void *context,
        rstatement->graph &&
        (rstatement->graph->type == RAPTOR_TERM_TYPE_URI ||
         rstatement->graph->type == RAPTOR_TERM_TYPE_BLANK)) {
-      node = librdf_new_node_from_uri(world, (librdf_uri*)rstatement->graph->value.uri);
+      node = librdf_new_node_from_parsed_term(world, rstatement->graph);
       rc = librdf_model_context_add_statement(scontext->model, node, statement);
       librdf_free_node(node);
     } else {
       rc = librdf_model_add_statement(scontext->model, statement);
     }
-    librdf_free_statement(statement);
+    librdf_parser_raptor_free_stream_statement(scontext, statement);
   } else {
     rc=librdf_list_add(scontext->statements, statement);
     if(rc)
-      librdf_free_statement(statement);
+      librdf_parser_raptor_free_stream_statement(scontext, statement);
   }
   if(rc) {
     librdf_log(world,
@@ -437,6 +492,8 @@ librdf_parser_raptor_parse_file_handle_as_stream(void *context,
 
   scontext->pcontext=pcontext;
   pcontext->stream_context=scontext;
+  librdf_parser_raptor_trace_begin(scontext);
+  scontext->start = LIBRDF_METRICS_START(pcontext->parser->world);
 
   scontext->statements=librdf_new_list(pcontext->parser->world);
   if(!scontext->statements)
@@ -604,6 +661,8 @@ librdf_parser_raptor_parse_as_stream_common(void *context, librdf_uri *uri,
 
   scontext->pcontext=pcontext;
   pcontext->stream_context=scontext;
+  librdf_parser_raptor_trace_begin(scontext);
+  scontext->start = LIBRDF_METRICS_START(pcontext->parser->world);
 
   scontext->statements=librdf_new_list(pcontext->parser->world);
   if(!scontext->statements)
@@ -879,6 +938,8 @@ librdf_parser_raptor_parse_into_model_common(void *context,
 
   scontext->pcontext=pcontext;
   pcontext->stream_context=scontext;
+  librdf_parser_raptor_trace_begin(scontext);
+  scontext->start = LIBRDF_METRICS_START(pcontext->parser->world);
 
   if(pcontext->nspace_prefixes)
     raptor_free_sequence(pcontext->nspace_prefixes);
@@ -1095,7 +1156,7 @@ librdf_parser_raptor_serialise_next_statement(void* context)
 {
   librdf_parser_raptor_stream_context* scontext=(librdf_parser_raptor_stream_context*)context;
 
-  librdf_free_statement(scontext->current);
+  librdf_parser_raptor_free_stream_statement(scontext, scontext->current);
   scontext->current=NULL;
 
   /* get another statement if there is one */
@@ -1171,6 +1232,19 @@ librdf_parser_raptor_serialise_finished(void* context)
       librdf_free_list(scontext->statements);
     }
 
+    while(scontext->spare_count)
+      librdf_free_statement(scontext->spare[--scontext->spare_count]);
+
+    if(world)
+      librdf_metrics_parse_record(world, scontext->statements_count,
+                                  scontext->start);
+
+    if(scontext->span.world) {
+      librdf_trace_span_add_number(&scontext->span, "statements",
+                                   (long)scontext->statements_count);
+      librdf_trace_span_end(&scontext->span);
+    }
+
     if(scontext->fh && scontext->close_fh)
       fclose(scontext->fh);
 
@@ -69,6 +69,8 @@ int librdf_query_set_offset(librdf_query *query, int offset);
 
 REDLAND_API
 librdf_stream* librdf_query_results_as_stream(librdf_query_results* query_results);
+REDLAND_API
+int librdf_query_results_add_to_model(librdf_query_results* query_results, librdf_model* model);
 
 REDLAND_API
 int librdf_query_results_get_count(librdf_query_results* query_results);
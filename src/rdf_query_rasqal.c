@@ -292,8 +292,11 @@ rasqal_redland_new_triples_source(rasqal_query* rdf_query,
   librdf_query_rasqal_context *context;
   librdf_iterator* cit;
 
-  rtsc->world = world;
   rtsc->query = (librdf_query*)rasqal_query_get_user_data(rdf_query);
+  /* The factory may be shared by worlds made from a template world so
+   * use the world of the query being run.
+   */
+  rtsc->world = rtsc->query->world;
   context = (librdf_query_rasqal_context*)rtsc->query->context;
   rtsc->model = context->model;
 
@@ -404,6 +407,9 @@ typedef struct {
   /* query statement, made from the nodes above (even when exact) */
   librdf_statement *qstatement;
   librdf_stream *stream;
+  /* trace span from the find to the end of the match and matches seen */
+  librdf_trace_span span;
+  long matches;
 } rasqal_redland_triples_match_context;
 
 
@@ -422,6 +428,8 @@ rasqal_redland_bind_match(struct rasqal_triples_match_s* rtm,
   statement=librdf_stream_get_object(rtmc->stream);
   if(!statement)
     return (rasqal_triple_parts)0;
+
+  rtmc->matches++;
   
 #if defined(LIBRDF_DEBUG) && LIBRDF_DEBUG > 1
   LIBRDF_DEBUG1("  matched statement ");
@@ -585,6 +593,10 @@ rasqal_redland_finish_triples_match(struct rasqal_triples_match_s* rtm,
       librdf_free_stream(rtmc->stream);
       rtmc->stream=NULL;
     }
+    if(rtmc->span.world) {
+      librdf_trace_span_add_number(&rtmc->span, "matches", rtmc->matches);
+      librdf_trace_span_end(&rtmc->span);
+    }
     if(rtmc->qstatement)
       librdf_free_statement(rtmc->qstatement);
     LIBRDF_FREE(rasqal_redland_triples_match_context, rtmc);
@@ -680,6 +692,15 @@ rasqal_redland_init_triples_match(rasqal_triples_match* rtm,
   fputc('\n', stderr);
 #endif
   
+  if(LIBRDF_TRACE_SPAN_INIT(rtsc->world, &rtmc->span, "query", "triples_match")) {
+    const char* pattern;
+
+    librdf_metrics_operation_name(librdf_metrics_find_operation(rtmc->qstatement),
+                                  &pattern);
+    librdf_trace_span_add_string(&rtmc->span, "pattern", pattern);
+    librdf_trace_span_begin(&rtmc->span);
+  }
+
   if(rtmc->origin)
     rtmc->stream=librdf_model_find_statements_in_context(rtsc->model, 
                                                          rtmc->qstatement,
@@ -698,11 +719,35 @@ rasqal_redland_init_triples_match(rasqal_triples_match* rtm,
 }
 
 
+/*
+ * librdf_query_rasqal_trace_begin - Begin a trace span for a query phase
+ * @query: #librdf_query object
+ * @span: span to begin
+ * @phase: query execution phase
+ */
+static void
+librdf_query_rasqal_trace_begin(librdf_query* query, librdf_trace_span* span,
+                                librdf_metrics_query_phase phase)
+{
+  librdf_query_rasqal_context *context=(librdf_query_rasqal_context*)query->context;
+
+  if(!LIBRDF_TRACE_SPAN_INIT(query->world, span, "query",
+                             librdf_metrics_query_phase_name(phase)))
+    return;
+
+  librdf_trace_span_add_string(span, "language", context->language);
+  librdf_trace_span_begin(span);
+}
+
+
 static librdf_query_results*
 librdf_query_rasqal_execute(librdf_query* query, librdf_model* model)
 {
   librdf_query_rasqal_context *context=(librdf_query_rasqal_context*)query->context;
   librdf_query_results* results;
+  librdf_trace_span span;
+  double start;
+  int rc;
 
   if (context->model)
     librdf_free_model(context->model);
@@ -711,14 +756,25 @@ librdf_query_rasqal_execute(librdf_query* query, librdf_model* model)
   librdf_model_add_reference(model);
 
   /* This assumes raptor's URI implementation is librdf_uri */
-  if(rasqal_query_prepare(context->rq, context->query_string, 
-                          (raptor_uri*)context->uri))
+  librdf_query_rasqal_trace_begin(query, &span, LIBRDF_METRICS_QUERY_PREPARE);
+  start = LIBRDF_METRICS_START(query->world);
+  rc = rasqal_query_prepare(context->rq, context->query_string, 
+                            (raptor_uri*)context->uri);
+  librdf_metrics_query_record(query->world, LIBRDF_METRICS_QUERY_PREPARE,
+                              start);
+  LIBRDF_TRACE_SPAN_END(&span);
+  if(rc)
     return NULL;
 
   if(context->results)
     rasqal_free_query_results(context->results);
   
+  librdf_query_rasqal_trace_begin(query, &span, LIBRDF_METRICS_QUERY_EXECUTE);
+  start = LIBRDF_METRICS_START(query->world);
   context->results=rasqal_query_execute(context->rq);
+  librdf_metrics_query_record(query->world, LIBRDF_METRICS_QUERY_EXECUTE,
+                              start);
+  LIBRDF_TRACE_SPAN_END(&span);
   if(!context->results)
     return NULL;
   
@@ -995,18 +1051,22 @@ librdf_query_rasqal_query_results_update_statement(void* context)
   if(!rstatement)
     return 1;
   
-  scontext->statement=librdf_new_statement(world);
-  if(!scontext->statement)
-    return 1;
+  /* the statement left by the previous triple is reused if nothing
+   * else holds it */
+  if(!scontext->statement) {
+    scontext->statement=librdf_new_statement(world);
+    if(!scontext->statement)
+      return 1;
+  }
+
+  /* The triple terms are raptor terms made with the same raptor world
+   * so they are shared as nodes rather than rebuilt from strings.
+   */
 
   /* subject */
   
-  if(rstatement->subject->type == RAPTOR_TERM_TYPE_BLANK) {
-    node = librdf_new_node_from_blank_identifier(world, rstatement->subject->value.blank.string);
-  } else if(rstatement->subject->type == RAPTOR_TERM_TYPE_URI) {
-    node = librdf_new_node_from_uri_string(world,
-                                           librdf_uri_as_string((librdf_uri*)rstatement->subject->value.uri));
-  } else {
+  if(rstatement->subject->type != RAPTOR_TERM_TYPE_BLANK &&
+     rstatement->subject->type != RAPTOR_TERM_TYPE_URI) {
     librdf_log(world,
                0, LIBRDF_LOG_ERROR, LIBRDF_FROM_QUERY, NULL,
                "Unknown Raptor subject identifier type %d",
@@ -1014,6 +1074,7 @@ librdf_query_rasqal_query_results_update_statement(void* context)
     goto fail;
   }
 
+  node = librdf_new_node_from_parsed_term(world, rstatement->subject);
   if(!node) {
     librdf_log(world,
                0, LIBRDF_LOG_ERROR, LIBRDF_FROM_QUERY, NULL,
@@ -1025,10 +1086,7 @@ librdf_query_rasqal_query_results_update_statement(void* context)
 
   /* predicate */
 
-  if(rstatement->predicate->type == RAPTOR_TERM_TYPE_URI) {
-    node = librdf_new_node_from_uri_string(world,
-                                           librdf_uri_as_string((librdf_uri*)rstatement->predicate->value.uri));
-  } else {
+  if(rstatement->predicate->type != RAPTOR_TERM_TYPE_URI) {
     librdf_log(world,
                0, LIBRDF_LOG_ERROR, LIBRDF_FROM_QUERY, NULL,
                "Unknown Raptor predicate identifier type %d",
@@ -1036,6 +1094,7 @@ librdf_query_rasqal_query_results_update_statement(void* context)
     goto fail;
   }
 
+  node = librdf_new_node_from_parsed_term(world, rstatement->predicate);
   if(!node) {
     librdf_log(world,
                0, LIBRDF_LOG_ERROR, LIBRDF_FROM_QUERY, NULL,
@@ -1047,17 +1106,9 @@ librdf_query_rasqal_query_results_update_statement(void* context)
   
   /* object */
 
-  if(rstatement->object->type == RAPTOR_TERM_TYPE_LITERAL) {
-    node = librdf_new_node_from_typed_literal(world,
-                                              rstatement->object->value.literal.string,
-                                              (const char*)rstatement->object->value.literal.language,
-                                              (librdf_uri*)rstatement->object->value.literal.datatype);
-  } else if(rstatement->object->type == RAPTOR_TERM_TYPE_BLANK) {
-    node = librdf_new_node_from_blank_identifier(world, rstatement->object->value.blank.string);
-  } else if(rstatement->object->type == RAPTOR_TERM_TYPE_URI) {
-    node = librdf_new_node_from_uri_string(world,
-                                           librdf_uri_as_string((librdf_uri*)rstatement->object->value.uri));
-  } else {
+  if(rstatement->object->type != RAPTOR_TERM_TYPE_LITERAL &&
+     rstatement->object->type != RAPTOR_TERM_TYPE_BLANK &&
+     rstatement->object->type != RAPTOR_TERM_TYPE_URI) {
     librdf_log(world,
                0, LIBRDF_LOG_ERROR, LIBRDF_FROM_PARSER, NULL,
                "Unknown Raptor object identifier type %d",
@@ -1065,6 +1116,7 @@ librdf_query_rasqal_query_results_update_statement(void* context)
     goto fail;
   }
 
+  node = librdf_new_node_from_parsed_term(world, rstatement->object);
   if(!node) {
     librdf_log(world,
                0, LIBRDF_LOG_ERROR, LIBRDF_FROM_QUERY, NULL,
@@ -1092,8 +1144,13 @@ librdf_query_rasqal_query_results_next_statement(void* context)
     return 1;
   
   if(scontext->statement) {
-    librdf_free_statement(scontext->statement);
-    scontext->statement=NULL;
+    if(scontext->statement->usage == 1)
+      /* only held here; empty it for the next triple */
+      librdf_statement_clear(scontext->statement);
+    else {
+      librdf_free_statement(scontext->statement);
+      scontext->statement=NULL;
+    }
   }
 
   scontext->finished = !scontext->qcontext->results;
@@ -802,6 +802,41 @@ librdf_query_results_as_stream(librdf_query_results* query_results)
 }
 
 
+/**
+ * librdf_query_results_add_to_model:
+ * @query_results: #librdf_query_results query_results
+ * @model: #librdf_model to add the statements to
+ *
+ * Add a query result RDF graph to a model
+ *
+ * The statements of an RDF graph query result (see
+ * librdf_query_results_is_graph()) are added with
+ * librdf_model_add_statements() so the model storage can add them
+ * as one batch rather than one at a time.
+ *
+ * Return value: non 0 on failure
+ */
+int
+librdf_query_results_add_to_model(librdf_query_results* query_results,
+                                  librdf_model* model)
+{
+  librdf_stream* stream;
+  int rc;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(query_results, librdf_query_results, 1);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(model, librdf_model, 1);
+
+  stream=librdf_query_results_as_stream(query_results);
+  if(!stream)
+    return 1;
+
+  rc=librdf_model_add_statements(model, stream);
+  librdf_free_stream(stream);
+
+  return rc;
+}
+
+
 /**
  * librdf_new_query_results_formatter2:
  * @query_results: #librdf_query_results query_results
@@ -114,6 +114,10 @@ librdf_raptor_log_handler(void *data, raptor_log_message *message)
 int
 librdf_raptor_free_bnode_hash(librdf_world* world)
 {
+  /* worlds made from a template map bnode ids with the template's hash */
+  if(world->template_world)
+    world = world->template_world;
+
   if(world->bnode_hash) {
     librdf_free_hash(world->bnode_hash);
     world->bnode_hash = NULL;
@@ -126,6 +130,9 @@ librdf_raptor_free_bnode_hash(librdf_world* world)
 int
 librdf_raptor_reset_bnode_hash(librdf_world* world)
 {
+  if(world->template_world)
+    world = world->template_world;
+
   librdf_raptor_free_bnode_hash(world);
 
   world->bnode_hash = librdf_new_hash(world, NULL);
@@ -906,7 +906,8 @@ int main(int argc, char *argv[]);
 int
 main(int argc, char *argv[]) 
 {
-  librdf_statement *statement, *statement2;
+  librdf_statement *statement, *statement2, *pattern;
+  librdf_statement_encoded_parts parts;
   int size, size2;
   const char *program=librdf_basename((const char*)argv[0]);
   char *s, *buffer;
@@ -955,6 +956,30 @@ main(int argc, char *argv[])
     fprintf(stdout, "%s: Decoding statement failed\n", program);
     return(1);
   }
+
+  fprintf(stdout, "%s: Matching encoded statement with patterns\n", program);
+  memset(&parts, '\0', sizeof(parts));
+  pattern=librdf_new_statement_from_nodes(world, NULL,
+                                          librdf_new_node_from_node(librdf_statement_get_predicate(statement)),
+                                          NULL);
+  if(librdf_statement_encoded_parts_set(world, &parts, pattern, NULL) ||
+     librdf_statement_encoded_parts_match(&parts, (unsigned char*)buffer,
+                                          size) != 1) {
+    fprintf(stdout, "%s: Encoded statement did not match its predicate\n",
+            program);
+    return(1);
+  }
+  librdf_statement_set_object(pattern, librdf_new_node_from_literal(world, (const unsigned char*)"Someone Else", NULL, 0));
+  if(librdf_statement_encoded_parts_set(world, &parts, pattern, NULL) ||
+     librdf_statement_encoded_parts_match(&parts, (unsigned char*)buffer,
+                                          size) != 0) {
+    fprintf(stdout, "%s: Encoded statement matched a different object\n",
+            program);
+    return(1);
+  }
+  librdf_statement_encoded_parts_clear(&parts);
+  librdf_free_statement(pattern);
+
   LIBRDF_FREE(char*, buffer);
    
   fprintf(stdout, "%s: New statement is: ", program);
@@ -27,10 +27,6 @@
 #ifndef LIBRDF_STATEMENT_H
 #define LIBRDF_STATEMENT_H
 
-#ifdef LIBRDF_INTERNAL
-#include <rdf_statement_internal.h>
-#endif
-
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -60,6 +56,11 @@ typedef enum {
 } librdf_statement_part;
 
 
+#ifdef LIBRDF_INTERNAL
+#include <rdf_statement_internal.h>
+#endif
+
+
 /* initialising functions / constructors */
 
 /* Create a new Statement. */
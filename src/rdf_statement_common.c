@@ -213,4 +213,241 @@ librdf_statement_encode_parts2(librdf_world* world,
   return total_length;
 }
 
+
+/*
+ * librdf_statement_encoded_parts_add_node - Encode a node at the end of the parts scratch
+ * @parts: encoded parts
+ * @index: part index
+ * @node: node or NULL
+ * @used: pointer to bytes of the scratch used so far
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_statement_encoded_parts_add_node(librdf_statement_encoded_parts* parts,
+                                        int index, librdf_node* node,
+                                        size_t* used)
+{
+  size_t node_len=0;
+
+  parts->offsets[index]=*used;
+  parts->lengths[index]=0;
+  if(!node)
+    return 0;
+
+  /* length 0 means no limit to librdf_node_encode so never pass it */
+  if(parts->buffer_len > *used)
+    node_len=librdf_node_encode(node, parts->buffer + *used,
+                                parts->buffer_len - *used);
+
+  if(!node_len) {
+    /* too small; measure, grow and try once more */
+    unsigned char *buffer;
+    size_t buffer_len;
+
+    node_len=librdf_node_encode(node, NULL, 0);
+    if(!node_len)
+      return 1;
+
+    buffer_len=(*used + node_len) * 2;
+    buffer = LIBRDF_MALLOC(unsigned char*, buffer_len);
+    if(!buffer)
+      return 1;
+    if(*used)
+      memcpy(buffer, parts->buffer, *used);
+    if(parts->buffer)
+      LIBRDF_FREE(data, parts->buffer);
+    parts->buffer=buffer;
+    parts->buffer_len=buffer_len;
+
+    node_len=librdf_node_encode(node, parts->buffer + *used,
+                                parts->buffer_len - *used);
+    if(!node_len)
+      return 1;
+  }
+
+  parts->lengths[index]=node_len;
+  *used += node_len;
+
+  return 0;
+}
+
+
+/**
+ * librdf_statement_encoded_parts_set:
+ * @world: redland world object
+ * @parts: encoded parts
+ * @statement: statement to serialise
+ * @context_node: #librdf_node context node (can be NULL)
+ *
+ * INTERNAL - Encode each node of a statement once into the parts scratch.
+ *
+ * Any combination of the parts can then be built with
+ * librdf_statement_encoded_parts_get() by copying, instead of
+ * encoding the nodes again for each with
+ * librdf_statement_encode_parts2().  The scratch is kept for the next
+ * statement and freed by librdf_statement_encoded_parts_clear().
+ *
+ * Return value: non 0 on failure
+ **/
+int
+librdf_statement_encoded_parts_set(librdf_world* world,
+                                   librdf_statement_encoded_parts* parts,
+                                   librdf_statement* statement,
+                                   librdf_node* context_node)
+{
+  size_t used=0;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(statement, librdf_statement, 1);
+
+  if(librdf_statement_encoded_parts_add_node(parts, 0, statement->subject,
+                                             &used) ||
+     librdf_statement_encoded_parts_add_node(parts, 1, statement->predicate,
+                                             &used) ||
+     librdf_statement_encoded_parts_add_node(parts, 2, statement->object,
+                                             &used) ||
+     librdf_statement_encoded_parts_add_node(parts, 3, context_node, &used))
+    return 1;
+
+  return 0;
+}
+
+
+/**
+ * librdf_statement_encoded_parts_get:
+ * @parts: encoded parts from librdf_statement_encoded_parts_set()
+ * @buffer: the buffer to use
+ * @length: buffer size
+ * @fields: fields to encode
+ * @with_context: non 0 to encode the context node too, if any
+ *
+ * INTERNAL - Serialise parts of an encoded statement into a buffer.
+ *
+ * The result is the same as librdf_statement_encode_parts2() for the
+ * statement and either the context node or NULL.  If buffer is NULL,
+ * no work is done but the size of buffer required is returned.
+ *
+ * Return value: the number of bytes written or 0 on failure.
+ **/
+size_t
+librdf_statement_encoded_parts_get(librdf_statement_encoded_parts* parts,
+                                   unsigned char *buffer, size_t length,
+                                   librdf_statement_part fields,
+                                   int with_context)
+{
+  /* the part letters in the order encoded */
+  static const char part_codes[4]={ 's', 'p', 'o', 'c' };
+  int wanted[4];
+  size_t total_length=1;
+  unsigned char *p;
+  int i;
+
+  wanted[0]=(fields & LIBRDF_STATEMENT_SUBJECT) != 0;
+  wanted[1]=(fields & LIBRDF_STATEMENT_PREDICATE) != 0;
+  wanted[2]=(fields & LIBRDF_STATEMENT_OBJECT) != 0;
+  wanted[3]=with_context;
+
+  for(i=0; i < 4; i++)
+    if(wanted[i] && parts->lengths[i])
+      total_length += 1 + parts->lengths[i];
+
+  if(!buffer)
+    return total_length;
+
+  if(length < total_length)
+    return 0;
+
+  p=buffer;
+  /* magic number 'x' */
+  *p++='x';
+  for(i=0; i < 4; i++) {
+    if(!wanted[i] || !parts->lengths[i])
+      continue;
+    *p++=(unsigned char)part_codes[i];
+    memcpy(p, parts->buffer + parts->offsets[i], parts->lengths[i]);
+    p += parts->lengths[i];
+  }
+
+  return total_length;
+}
+
+
+/**
+ * librdf_statement_encoded_parts_match:
+ * @parts: encoded parts from librdf_statement_encoded_parts_set()
+ * @buffer: encoded statement parts
+ * @length: buffer size
+ *
+ * INTERNAL - Compare encoded statement parts with the parts of a pattern.
+ *
+ * Each node in the buffer, as written by librdf_statement_encode_parts2(),
+ * is compared as bytes with the same part of the pattern if that is
+ * present.  Parts missing from the pattern or from the buffer are not
+ * compared, so a statement split over a hash key and value can be
+ * checked one half at a time without decoding any nodes.
+ *
+ * Return value: 1 if the present parts match, 0 if one does not, or
+ * <0 if the bytes cannot tell such as for the old literal encoding
+ **/
+int
+librdf_statement_encoded_parts_match(librdf_statement_encoded_parts* parts,
+                                     const unsigned char *buffer,
+                                     size_t length)
+{
+  /* the part letters in the order encoded */
+  static const char part_codes[4]={ 's', 'p', 'o', 'c' };
+  const unsigned char *p=buffer;
+  const unsigned char *end=buffer + length;
+  int result=1;
+
+  /* magic number 'x' */
+  if(length < 1 || *p++ != 'x')
+    return -1;
+
+  while(p < end) {
+    size_t node_len;
+    int i;
+
+    for(i=0; i < 4; i++)
+      if(*p == part_codes[i])
+        break;
+    if(i == 4)
+      return -1;
+    p++;
+
+    node_len=librdf_node_encoded_length(p, LIBRDF_GOOD_CAST(size_t, end - p));
+    if(!node_len)
+      return -1;
+
+    if(parts->lengths[i]) {
+      if(*p == 'L')
+        /* equal literals may encode differently; decode to compare */
+        result=-1;
+      else if(node_len != parts->lengths[i] ||
+              memcmp(p, parts->buffer + parts->offsets[i], node_len))
+        return 0;
+    }
+
+    p += node_len;
+  }
+
+  return result;
+}
+
+
+/**
+ * librdf_statement_encoded_parts_clear:
+ * @parts: encoded parts
+ *
+ * INTERNAL - Free the scratch of encoded parts.
+ *
+ **/
+void
+librdf_statement_encoded_parts_clear(librdf_statement_encoded_parts* parts)
+{
+  if(parts->buffer)
+    LIBRDF_FREE(data, parts->buffer);
+  memset(parts, '\0', sizeof(*parts));
+}
+
 #endif
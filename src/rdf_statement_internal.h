@@ -36,6 +36,25 @@ extern "C" {
 void librdf_init_statement(librdf_world *world);
 void librdf_finish_statement(librdf_world *world);
 
+/* The nodes of one statement encoded once, for building several
+ * encodings of its parts as by librdf_statement_encode_parts2()
+ */
+typedef struct {
+  /* scratch holding the encoded nodes back to back; kept for reuse */
+  unsigned char *buffer;
+  size_t buffer_len;
+  /* offset in buffer and length of the encoded subject, predicate,
+   * object and context node; length 0 if the node is absent
+   */
+  size_t offsets[4];
+  size_t lengths[4];
+} librdf_statement_encoded_parts;
+
+int librdf_statement_encoded_parts_set(librdf_world* world, librdf_statement_encoded_parts* parts, librdf_statement* statement, librdf_node* context_node);
+size_t librdf_statement_encoded_parts_get(librdf_statement_encoded_parts* parts, unsigned char *buffer, size_t length, librdf_statement_part fields, int with_context);
+int librdf_statement_encoded_parts_match(librdf_statement_encoded_parts* parts, const unsigned char *buffer, size_t length);
+void librdf_statement_encoded_parts_clear(librdf_statement_encoded_parts* parts);
+
 #ifdef __cplusplus
 }
 #endif
@@ -65,6 +65,12 @@ static librdf_iterator* librdf_storage_node_stream_to_node_create(librdf_storage
 void
 librdf_storage_load_all_modules(librdf_world *world);
 
+static void
+librdf_storage_register_all_modules(librdf_world *world);
+
+static int
+librdf_storage_load_module_by_name(librdf_world *world, const char* name);
+
 static lt_dlhandle
 librdf_storage_load_module(librdf_world *world,
                            const char* lib_name,
@@ -106,7 +112,14 @@ librdf_init_storage(librdf_world *world)
     world->storage_modules = raptor_new_sequence(
         (raptor_data_free_handler)lt_dlclose, NULL);
 
-  librdf_storage_load_all_modules(world);
+  if (!world->storage_module_stubs)
+    world->storage_module_stubs = raptor_new_sequence(
+        (raptor_data_free_handler)librdf_free_storage_module_stub, NULL);
+
+  /* Only record the module names here; each module is loaded the
+   * first time a storage with its name is asked for.
+   */
+  librdf_storage_register_all_modules(world);
 
 #else /* monolithic */
   
@@ -146,6 +159,11 @@ librdf_finish_storage(librdf_world *world)
   }
 
 #ifdef MODULAR_LIBRDF
+  if(world->storage_module_stubs) {
+    raptor_free_sequence(world->storage_module_stubs);
+    world->storage_module_stubs=NULL;
+  }
+
   if(world->storage_modules) {
     raptor_free_sequence(world->storage_modules);
     world->storage_modules=NULL;
@@ -172,13 +190,50 @@ librdf_free_storage_factory(librdf_storage_factory* factory)
 
 #ifdef MODULAR_LIBRDF
 
+/**
+ * librdf_free_storage_module_stub:
+ * @stub: storage module stub
+ *
+ * INTERNAL - Destructor for a storage module stub
+ **/
+void
+librdf_free_storage_module_stub(librdf_storage_module_stub* stub)
+{
+  if(stub->name)
+    LIBRDF_FREE(char*, stub->name);
+  if(stub->filename)
+    LIBRDF_FREE(char*, stub->filename);
+  LIBRDF_FREE(librdf_storage_module_stub, stub);
+}
+
+
+static librdf_storage_module_stub*
+librdf_storage_find_module_stub(librdf_world *world, const char* name,
+                                size_t name_len)
+{
+  librdf_storage_module_stub* stub;
+  int i;
+
+  for(i = 0;
+      (stub = (librdf_storage_module_stub*)raptor_sequence_get_at(world->storage_module_stubs, i));
+      i++) {
+    if(strlen(stub->name) == name_len && !strncmp(stub->name, name, name_len))
+      return stub;
+  }
+
+  return NULL;
+}
+
+
 static int
 ltdl_module_callback(const char* filename, void* data)
 {
   librdf_world* world = (librdf_world*)data;
   const char* name = librdf_basename(filename);
   size_t name_len = strlen(name);
-  lt_dlhandle module;
+  const char* storage_name;
+  size_t storage_name_len;
+  librdf_storage_module_stub* stub;
 
   /* Currently require that storage module files to be loaded start
    * with the string "librdf_storage_".
@@ -218,30 +273,55 @@ ltdl_module_callback(const char* filename, void* data)
 #endif
     return 0;
   }
+#endif
+
+  /* The storage name is the rest of the file name up to any suffix:
+   * "librdf_storage_mysql.so" provides the "mysql" storage.
+   */
+  storage_name = name + 15;
+  storage_name_len = strcspn(storage_name, ".");
+  if(!storage_name_len)
+    return 0;
+
+  /* Ignore the same module seen twice such as .la and .so files */
+  if(librdf_storage_find_module_stub(world, storage_name, storage_name_len))
+    return 0;
 
 #if defined(LIBRDF_DEBUG) && LIBRDF_DEBUG > 1
-  LIBRDF_DEBUG3("LOADING storage module file %s (%s)\n", name, filename);
+  LIBRDF_DEBUG3("REGISTERING storage module file %s (%s)\n", name, filename);
 #endif
 
-#endif
+  stub = LIBRDF_CALLOC(librdf_storage_module_stub*, 1, sizeof(*stub));
+  if(!stub)
+    return 1;
 
-  module = librdf_storage_load_module(world, filename,
-                                      "librdf_storage_module_register_factory");
-  if(module)
-    raptor_sequence_push(world->storage_modules, module);
+  stub->name = LIBRDF_MALLOC(char*, storage_name_len + 1);
+  stub->filename = LIBRDF_MALLOC(char*, strlen(filename) + 1);
+  if(!stub->name || !stub->filename) {
+    librdf_free_storage_module_stub(stub);
+    return 1;
+  }
+  memcpy(stub->name, storage_name, storage_name_len);
+  stub->name[storage_name_len] = '\0';
+  strcpy(stub->filename, filename);
+
+  if(raptor_sequence_push(world->storage_module_stubs, stub))
+    return 1;
 
   return 0;
 }
 
 
 /**
- * librdf_storage_load_all_modules:
+ * librdf_storage_register_all_modules:
  * @world: redland world object
  *
- * INTERNAL - Load and initialize/register all installed storage modules
+ * INTERNAL - Record the name of every installed storage module
+ *
+ * No module is opened here; see librdf_storage_load_module_by_name()
  **/
-void
-librdf_storage_load_all_modules(librdf_world *world)
+static void
+librdf_storage_register_all_modules(librdf_world *world)
 {
   char const *path;
 
@@ -262,6 +342,69 @@ librdf_storage_load_all_modules(librdf_world *world)
 }
 
 
+/**
+ * librdf_storage_load_module_by_name:
+ * @world: redland world object
+ * @name: storage name
+ *
+ * INTERNAL - Load and initialize/register the storage module for a name
+ *
+ * A module is only ever tried once, whether it loads or not.
+ *
+ * Return value: non-0 if no module was loaded
+ **/
+static int
+librdf_storage_load_module_by_name(librdf_world *world, const char* name)
+{
+  librdf_storage_module_stub* stub;
+  lt_dlhandle module;
+
+  if(!world->storage_module_stubs)
+    return 1;
+
+  stub = librdf_storage_find_module_stub(world, name, strlen(name));
+  if(!stub || stub->loaded)
+    return 1;
+
+  stub->loaded = 1;
+
+  module = librdf_storage_load_module(world, stub->filename,
+                                      "librdf_storage_module_register_factory");
+  if(!module)
+    return 1;
+
+  raptor_sequence_push(world->storage_modules, module);
+  return 0;
+}
+
+
+/**
+ * librdf_storage_load_all_modules:
+ * @world: redland world object
+ *
+ * INTERNAL - Load and initialize/register all installed storage modules
+ *
+ * Only needed when the full list of storages is wanted such as
+ * when enumerating them.
+ **/
+void
+librdf_storage_load_all_modules(librdf_world *world)
+{
+  librdf_storage_module_stub* stub;
+  int i;
+
+  if(!world->storage_module_stubs)
+    return;
+
+  for(i = 0;
+      (stub = (librdf_storage_module_stub*)raptor_sequence_get_at(world->storage_module_stubs, i));
+      i++) {
+    if(!stub->loaded)
+      librdf_storage_load_module_by_name(world, stub->name);
+  }
+}
+
+
 /**
  * librdf_storage_load_module:
  * @world: redland world object
@@ -447,6 +590,18 @@ librdf_get_storage_factory(librdf_world* world, const char *name)
       break;
   }
 
+#ifdef MODULAR_LIBRDF
+  /* not registered yet so try loading a module of that name */
+  if(!factory && !librdf_storage_load_module_by_name(world, name)) {
+    for(i=0;
+        (factory=(librdf_storage_factory*)raptor_sequence_get_at(world->storages, i));
+        i++) {
+      if(!strcmp(factory->name, name))
+        break;
+    }
+  }
+#endif
+
   if(!factory) {
     LIBRDF_DEBUG2("No storage with name %s found\n", name);
     return NULL;
@@ -477,6 +632,11 @@ librdf_storage_enumerate(librdf_world* world,
   
   librdf_world_open(world);
 
+#ifdef MODULAR_LIBRDF
+  /* the full list needs every module registered */
+  librdf_storage_load_all_modules(world);
+#endif
+
   factory = (librdf_storage_factory*)raptor_sequence_get_at(world->storages,
                                                             ioffset);
   if(!factory)
@@ -721,6 +881,8 @@ librdf_free_storage(librdf_storage* storage)
   if(storage->factory)
     storage->factory->terminate(storage);
 
+  librdf_metrics_storage_finished(storage);
+
   LIBRDF_FREE(librdf_storage, storage);
 }
 
@@ -864,6 +1026,30 @@ librdf_storage_size(librdf_storage* storage)
 }
 
 
+/*
+ * librdf_storage_trace_begin - Begin a trace span for a storage operation
+ * @storage: #librdf_storage object
+ * @span: span to begin
+ * @operation: storage operation
+ *
+ * Only tests a flag when tracing is off.
+ */
+static void
+librdf_storage_trace_begin(librdf_storage* storage, librdf_trace_span* span,
+                           librdf_metrics_operation operation)
+{
+  const char* pattern;
+
+  if(!LIBRDF_TRACE_SPAN_INIT(storage->world, span, "storage",
+                             librdf_metrics_operation_name(operation, &pattern)))
+    return;
+
+  librdf_trace_span_add_string(span, "storage", storage->factory->name);
+  librdf_trace_span_add_string(span, "pattern", pattern);
+  librdf_trace_span_begin(span);
+}
+
+
 /**
  * librdf_storage_add_statement:
  * @storage: #librdf_storage object
@@ -900,8 +1086,18 @@ librdf_storage_add_statement(librdf_storage* storage,
 
   /* object can be any node - no check needed */
 
-  if(storage->factory->add_statement)
-    return storage->factory->add_statement(storage, statement);
+  if(storage->factory->add_statement) {
+    librdf_trace_span span;
+    double start;
+    int rc;
+
+    librdf_storage_trace_begin(storage, &span, LIBRDF_METRICS_ADD);
+    start = LIBRDF_METRICS_START(storage->world);
+    rc = storage->factory->add_statement(storage, statement);
+    librdf_metrics_storage_record(storage, LIBRDF_METRICS_ADD, start);
+    LIBRDF_TRACE_SPAN_END(&span);
+    return rc;
+  }
 
   return -1;
 }
@@ -928,8 +1124,17 @@ librdf_storage_add_statements(librdf_storage* storage,
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 1);
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(statement_stream, librdf_stream, 1);
 
-  if(storage->factory->add_statements)
-    return storage->factory->add_statements(storage, statement_stream);
+  if(storage->factory->add_statements) {
+    librdf_trace_span span;
+    double start;
+
+    librdf_storage_trace_begin(storage, &span, LIBRDF_METRICS_ADD);
+    start = LIBRDF_METRICS_START(storage->world);
+    status = storage->factory->add_statements(storage, statement_stream);
+    librdf_metrics_storage_record(storage, LIBRDF_METRICS_ADD, start);
+    LIBRDF_TRACE_SPAN_END(&span);
+    return status;
+  }
 
   while(!librdf_stream_end(statement_stream)) {
     librdf_statement* statement=librdf_stream_get_object(statement_stream);
@@ -969,8 +1174,18 @@ librdf_storage_remove_statement(librdf_storage* storage,
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 1);
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(statement, librdf_statement, 1);
 
-  if(storage->factory->remove_statement)
-    return storage->factory->remove_statement(storage, statement);
+  if(storage->factory->remove_statement) {
+    librdf_trace_span span;
+    double start;
+    int rc;
+
+    librdf_storage_trace_begin(storage, &span, LIBRDF_METRICS_REMOVE);
+    start = LIBRDF_METRICS_START(storage->world);
+    rc = storage->factory->remove_statement(storage, statement);
+    librdf_metrics_storage_record(storage, LIBRDF_METRICS_REMOVE, start);
+    LIBRDF_TRACE_SPAN_END(&span);
+    return rc;
+  }
   return 1;
 }
 
@@ -988,13 +1203,23 @@ int
 librdf_storage_contains_statement(librdf_storage* storage,
                                   librdf_statement* statement) 
 {
+  librdf_trace_span span;
+  double start;
+  int rc;
+
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 0);
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(statement, librdf_statement, 1);
 
   if(!librdf_statement_is_complete(statement))
     return 1;
 
-  return storage->factory->contains_statement(storage, statement) ? -1 : 0;
+  librdf_storage_trace_begin(storage, &span, LIBRDF_METRICS_CONTAINS);
+  start = LIBRDF_METRICS_START(storage->world);
+  rc = storage->factory->contains_statement(storage, statement) ? -1 : 0;
+  librdf_metrics_storage_record(storage, LIBRDF_METRICS_CONTAINS, start);
+  LIBRDF_TRACE_SPAN_END(&span);
+
+  return rc;
 }
 
 
@@ -1009,33 +1234,28 @@ librdf_storage_contains_statement(librdf_storage* storage,
 librdf_stream*
 librdf_storage_serialise(librdf_storage* storage) 
 {
-  return storage->factory->serialise(storage);
+  librdf_stream *stream;
+  librdf_trace_span span;
+  double start;
+
+  librdf_storage_trace_begin(storage, &span, LIBRDF_METRICS_FIND);
+  start = LIBRDF_METRICS_START(storage->world);
+  stream = storage->factory->serialise(storage);
+  librdf_metrics_storage_record(storage, LIBRDF_METRICS_FIND, start);
+  LIBRDF_TRACE_SPAN_END(&span);
+
+  return stream;
 }
 
 
-/**
- * librdf_storage_find_statements:
- * @storage: #librdf_storage object
- * @statement: #librdf_statement partial statement to find
- *
- * Search the storage for matching statements.
- * 
- * Searches the storage for a (partial) statement as described in
- * librdf_statement_match() and returns a #librdf_stream of
- * matching #librdf_statement objects.
- * 
- * Return value:  #librdf_stream of matching statements (may be empty) or NULL on failure
- **/
-librdf_stream*
-librdf_storage_find_statements(librdf_storage* storage,
-                               librdf_statement* statement) 
+/* Find statements with the most efficient method of the storage */
+static librdf_stream*
+librdf_storage_find_statements_common(librdf_storage* storage,
+                                      librdf_statement* statement)
 {
   librdf_node *subject, *predicate, *object;
   librdf_iterator *iterator;
   
-  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, NULL);
-  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(statement, librdf_statement, NULL);
-
   subject=librdf_statement_get_subject(statement);
   predicate=librdf_statement_get_predicate(statement);
   object=librdf_statement_get_object(statement);
@@ -1073,6 +1293,42 @@ librdf_storage_find_statements(librdf_storage* storage,
 }
 
 
+/**
+ * librdf_storage_find_statements:
+ * @storage: #librdf_storage object
+ * @statement: #librdf_statement partial statement to find
+ *
+ * Search the storage for matching statements.
+ * 
+ * Searches the storage for a (partial) statement as described in
+ * librdf_statement_match() and returns a #librdf_stream of
+ * matching #librdf_statement objects.
+ * 
+ * Return value:  #librdf_stream of matching statements (may be empty) or NULL on failure
+ **/
+librdf_stream*
+librdf_storage_find_statements(librdf_storage* storage,
+                               librdf_statement* statement) 
+{
+  librdf_stream *stream;
+  librdf_metrics_operation operation;
+  librdf_trace_span span;
+  double start;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, NULL);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(statement, librdf_statement, NULL);
+
+  operation = librdf_metrics_find_operation(statement);
+  librdf_storage_trace_begin(storage, &span, operation);
+  start = LIBRDF_METRICS_START(storage->world);
+  stream = librdf_storage_find_statements_common(storage, statement);
+  librdf_metrics_storage_record(storage, operation, start);
+  LIBRDF_TRACE_SPAN_END(&span);
+
+  return stream;
+}
+
+
 typedef struct {
   librdf_storage *storage;
   librdf_stream *stream;
@@ -1305,15 +1561,25 @@ librdf_iterator*
 librdf_storage_get_sources(librdf_storage *storage,
                            librdf_node *arc, librdf_node *target) 
 {
+  librdf_iterator *iterator;
+  librdf_trace_span span;
+  double start;
+
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, NULL);
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(arc, librdf_node, NULL);
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(target, librdf_node, NULL);
 
+  librdf_storage_trace_begin(storage, &span, LIBRDF_METRICS_FIND_PO);
+  start = LIBRDF_METRICS_START(storage->world);
   if (storage->factory->find_sources)
-    return storage->factory->find_sources(storage, arc, target);
+    iterator = storage->factory->find_sources(storage, arc, target);
+  else
+    iterator = librdf_storage_node_stream_to_node_create(storage, arc, target,
+                                                         LIBRDF_STATEMENT_SUBJECT);
+  librdf_metrics_storage_record(storage, LIBRDF_METRICS_FIND_PO, start);
+  LIBRDF_TRACE_SPAN_END(&span);
 
-  return librdf_storage_node_stream_to_node_create(storage, arc, target,
-                                                   LIBRDF_STATEMENT_SUBJECT);
+  return iterator;
 }
 
 
@@ -1334,15 +1600,25 @@ librdf_iterator*
 librdf_storage_get_arcs(librdf_storage *storage,
                         librdf_node *source, librdf_node *target) 
 {
+  librdf_iterator *iterator;
+  librdf_trace_span span;
+  double start;
+
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, NULL);
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(source, librdf_node, NULL);
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(target, librdf_node, NULL);
 
+  librdf_storage_trace_begin(storage, &span, LIBRDF_METRICS_FIND_SO);
+  start = LIBRDF_METRICS_START(storage->world);
   if (storage->factory->find_arcs)
-    return storage->factory->find_arcs(storage, source, target);
+    iterator = storage->factory->find_arcs(storage, source, target);
+  else
+    iterator = librdf_storage_node_stream_to_node_create(storage, source, target,
+                                                         LIBRDF_STATEMENT_PREDICATE);
+  librdf_metrics_storage_record(storage, LIBRDF_METRICS_FIND_SO, start);
+  LIBRDF_TRACE_SPAN_END(&span);
 
-  return librdf_storage_node_stream_to_node_create(storage, source, target,
-                                                   LIBRDF_STATEMENT_PREDICATE);
+  return iterator;
 }
 
 
@@ -1363,15 +1639,25 @@ librdf_iterator*
 librdf_storage_get_targets(librdf_storage *storage,
                            librdf_node *source, librdf_node *arc) 
 {
+  librdf_iterator *iterator;
+  librdf_trace_span span;
+  double start;
+
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, NULL);
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(source, librdf_node, NULL);
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(arc, librdf_node, NULL);
 
+  librdf_storage_trace_begin(storage, &span, LIBRDF_METRICS_FIND_SP);
+  start = LIBRDF_METRICS_START(storage->world);
   if (storage->factory->find_targets)
-    return storage->factory->find_targets(storage, source, arc);
+    iterator = storage->factory->find_targets(storage, source, arc);
+  else
+    iterator = librdf_storage_node_stream_to_node_create(storage, source, arc,
+                                                         LIBRDF_STATEMENT_OBJECT);
+  librdf_metrics_storage_record(storage, LIBRDF_METRICS_FIND_SP, start);
+  LIBRDF_TRACE_SPAN_END(&span);
 
-  return librdf_storage_node_stream_to_node_create(storage, source, arc,
-                                                   LIBRDF_STATEMENT_OBJECT);
+  return iterator;
 }
 
 
@@ -1513,8 +1799,18 @@ librdf_storage_context_add_statement(librdf_storage* storage,
   if(!context)
     return librdf_storage_add_statement(storage, statement);
 
-  if(storage->factory->context_add_statement)
-    return storage->factory->context_add_statement(storage, context, statement);
+  if(storage->factory->context_add_statement) {
+    librdf_trace_span span;
+    double start;
+    int rc;
+
+    librdf_storage_trace_begin(storage, &span, LIBRDF_METRICS_ADD);
+    start = LIBRDF_METRICS_START(storage->world);
+    rc = storage->factory->context_add_statement(storage, context, statement);
+    librdf_metrics_storage_record(storage, LIBRDF_METRICS_ADD, start);
+    LIBRDF_TRACE_SPAN_END(&span);
+    return rc;
+  }
   return 1;
 }
 
@@ -1544,8 +1840,17 @@ librdf_storage_context_add_statements(librdf_storage* storage,
   if(!context)
     return librdf_storage_add_statements(storage, stream);
 
-  if(storage->factory->context_add_statements)
-    return storage->factory->context_add_statements(storage, context, stream);
+  if(storage->factory->context_add_statements) {
+    librdf_trace_span span;
+    double start;
+
+    librdf_storage_trace_begin(storage, &span, LIBRDF_METRICS_ADD);
+    start = LIBRDF_METRICS_START(storage->world);
+    status = storage->factory->context_add_statements(storage, context, stream);
+    librdf_metrics_storage_record(storage, LIBRDF_METRICS_ADD, start);
+    LIBRDF_TRACE_SPAN_END(&span);
+    return status;
+  }
 
   if(!storage->factory->context_add_statement)
     return 1;
@@ -1585,13 +1890,23 @@ librdf_storage_context_remove_statement(librdf_storage* storage,
                                         librdf_node* context,
                                         librdf_statement* statement) 
 {
+  librdf_trace_span span;
+  double start;
+  int rc;
+
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 1);
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(statement, librdf_statement, 1);
 
   if(!storage->factory->context_remove_statement)
     return 1;
   
-  return storage->factory->context_remove_statement(storage, context, statement);
+  librdf_storage_trace_begin(storage, &span, LIBRDF_METRICS_REMOVE);
+  start = LIBRDF_METRICS_START(storage->world);
+  rc = storage->factory->context_remove_statement(storage, context, statement);
+  librdf_metrics_storage_record(storage, LIBRDF_METRICS_REMOVE, start);
+  LIBRDF_TRACE_SPAN_END(&span);
+
+  return rc;
 }
 
 
@@ -1733,12 +2048,55 @@ librdf_storage_sync(librdf_storage* storage)
 {
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 1);
 
-  if(storage->factory->sync)
-    return storage->factory->sync(storage);
+  if(storage->factory->sync) {
+    librdf_trace_span span;
+    double start;
+    int rc;
+
+    librdf_storage_trace_begin(storage, &span, LIBRDF_METRICS_SYNC);
+    start = LIBRDF_METRICS_START(storage->world);
+    rc = storage->factory->sync(storage);
+    librdf_metrics_storage_record(storage, LIBRDF_METRICS_SYNC, start);
+    LIBRDF_TRACE_SPAN_END(&span);
+    return rc;
+  }
   return 0;
 }
 
 
+/* Find statements in a context with the storage methods there are */
+static librdf_stream*
+librdf_storage_find_statements_in_context_common(librdf_storage* storage,
+                                                 librdf_statement* statement,
+                                                 librdf_node* context_node)
+{
+  librdf_stream *stream;
+
+  if(storage->factory->find_statements_in_context)
+    return storage->factory->find_statements_in_context(storage, statement, context_node);
+
+  /* let the storage reject statements while scanning the context */
+  if(storage->factory->scan_statements)
+    return storage->factory->scan_statements(storage, statement, context_node);
+
+  statement=librdf_new_statement_from_statement(statement);
+  if(!statement)
+    return NULL;
+
+  stream=librdf_storage_context_as_stream(storage, context_node);
+  if(!stream) {
+    librdf_free_statement(statement);
+    return NULL;
+  }
+
+  librdf_stream_add_map(stream, 
+                        &librdf_stream_statement_find_map,
+                        (librdf_stream_map_free_context_handler)&librdf_free_statement, (void*)statement);
+
+  return stream;
+}
+
+
 /**
  * librdf_storage_find_statements_in_context:
  * @storage: #librdf_storage object
@@ -1758,26 +2116,20 @@ librdf_stream*
 librdf_storage_find_statements_in_context(librdf_storage* storage, librdf_statement* statement, librdf_node* context_node) 
 {
   librdf_stream *stream;
+  librdf_metrics_operation operation;
+  librdf_trace_span span;
+  double start;
 
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, NULL);
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(statement, librdf_statement, NULL);
 
-  if(storage->factory->find_statements_in_context)
-    return storage->factory->find_statements_in_context(storage, statement, context_node);
-
-  statement=librdf_new_statement_from_statement(statement);
-  if(!statement)
-    return NULL;
-
-  stream=librdf_storage_context_as_stream(storage, context_node);
-  if(!stream) {
-    librdf_free_statement(statement);
-    return NULL;
-  }
-
-  librdf_stream_add_map(stream, 
-                        &librdf_stream_statement_find_map,
-                        (librdf_stream_map_free_context_handler)&librdf_free_statement, (void*)statement);
+  operation = librdf_metrics_find_operation(statement);
+  librdf_storage_trace_begin(storage, &span, operation);
+  start = LIBRDF_METRICS_START(storage->world);
+  stream = librdf_storage_find_statements_in_context_common(storage, statement,
+                                                            context_node);
+  librdf_metrics_storage_record(storage, operation, start);
+  LIBRDF_TRACE_SPAN_END(&span);
 
   return stream;
 }
@@ -1878,13 +2230,96 @@ librdf_storage_find_statements_with_options(librdf_storage* storage,
                                             librdf_node* context_node,
                                             librdf_hash* options) 
 {
-  if(storage->factory->find_statements_with_options)
-    return storage->factory->find_statements_with_options(storage, statement, context_node, options);
+  if(storage->factory->find_statements_with_options) {
+    librdf_stream *stream;
+    librdf_metrics_operation operation;
+    librdf_trace_span span;
+    double start;
+
+    operation = librdf_metrics_find_operation(statement);
+    librdf_storage_trace_begin(storage, &span, operation);
+    start = LIBRDF_METRICS_START(storage->world);
+    stream = storage->factory->find_statements_with_options(storage, statement, context_node, options);
+    librdf_metrics_storage_record(storage, operation, start);
+    LIBRDF_TRACE_SPAN_END(&span);
+    return stream;
+  }
   else
     return librdf_storage_find_statements_in_context(storage, statement, context_node);
 }
 
 
+/**
+ * librdf_storage_find_statements_in_range:
+ * @storage: #librdf_storage object
+ * @predicate: #librdf_node predicate
+ * @min: #librdf_node lowest literal value or NULL
+ * @max: #librdf_node highest literal value or NULL
+ *
+ * Search the storage for statements with a literal value in a range.
+ * 
+ * See librdf_model_find_statements_in_range() for the values that
+ * are compared.
+ * 
+ * Return value:  #librdf_stream of matching statements (may be empty) or NULL on failure
+ **/
+librdf_stream*
+librdf_storage_find_statements_in_range(librdf_storage* storage,
+                                        librdf_node* predicate,
+                                        librdf_node* min, librdf_node* max) 
+{
+  librdf_node_value_range* range;
+  librdf_statement* statement;
+  librdf_stream* stream;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, NULL);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(predicate, librdf_node, NULL);
+
+  if(storage->factory->find_statements_in_range) {
+    librdf_trace_span span;
+    double start;
+
+    librdf_storage_trace_begin(storage, &span, LIBRDF_METRICS_FIND_P);
+    start = LIBRDF_METRICS_START(storage->world);
+    stream = storage->factory->find_statements_in_range(storage, predicate, min, max);
+    librdf_metrics_storage_record(storage, LIBRDF_METRICS_FIND_P, start);
+    LIBRDF_TRACE_SPAN_END(&span);
+    return stream;
+  }
+
+  range=librdf_new_node_value_range(min, max);
+  if(!range) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "Range bounds are not comparable literal values");
+    return NULL;
+  }
+
+  statement=librdf_new_statement(storage->world);
+  if(!statement) {
+    librdf_free_node_value_range(range);
+    return NULL;
+  }
+  librdf_statement_set_predicate(statement, librdf_new_node_from_node(predicate));
+
+  stream=librdf_storage_find_statements(storage, statement);
+  librdf_free_statement(statement);
+  if(!stream) {
+    librdf_free_node_value_range(range);
+    return NULL;
+  }
+
+  if(librdf_stream_add_map(stream, 
+                           &librdf_stream_value_range_map,
+                           (librdf_stream_map_free_context_handler)&librdf_free_node_value_range,
+                           (void*)range)) {
+    /* error - stream_add_map failed and freed the range */
+    librdf_free_stream(stream);
+    stream=NULL;
+  }
+
+  return stream;
+}
+
 
 /**
  * librdf_storage_transaction_start:
@@ -1934,9 +2369,19 @@ librdf_storage_transaction_start_with_handle(librdf_storage* storage, void* hand
 int
 librdf_storage_transaction_commit(librdf_storage* storage) 
 {
-  if(storage->factory->transaction_commit)
-    return storage->factory->transaction_commit(storage);
-  else
+  if(storage->factory->transaction_commit) {
+    librdf_trace_span span;
+    double start;
+    int rc;
+
+    librdf_storage_trace_begin(storage, &span, LIBRDF_METRICS_TRANSACTION_COMMIT);
+    start = LIBRDF_METRICS_START(storage->world);
+    rc = storage->factory->transaction_commit(storage);
+    librdf_metrics_storage_record(storage, LIBRDF_METRICS_TRANSACTION_COMMIT,
+                                  start);
+    LIBRDF_TRACE_SPAN_END(&span);
+    return rc;
+  } else
     return 1;
 }
 
@@ -1985,10 +2430,238 @@ librdf_storage_transaction_get_handle(librdf_storage* storage)
 
 #ifdef STANDALONE
 
+#include <locale.h>
+
 /* one more prototype */
 int main(int argc, char *argv[]);
 
 
+#define RANGE_TEST_XSD "http://www.w3.org/2001/XMLSchema#"
+
+/* Count the statements in a stream and free it */
+static int
+storage_test_count_stream(librdf_stream* stream)
+{
+  int count = 0;
+
+  if(!stream)
+    return -1;
+
+  for(; !librdf_stream_end(stream); librdf_stream_next(stream))
+    count++;
+  librdf_free_stream(stream);
+
+  return count;
+}
+
+
+/* Add typed literal values and check the storage and model range finds */
+static int
+storage_test_range(librdf_world* world, const char* program,
+                   const char* name, const char* options)
+{
+  /* values found in [2.5, 6] are 2.5, 3, 4, 5, 6.0 and 6 */
+  static const char* const values[][2] = {
+    { "1", "integer" }, { "2", "integer" }, { "2.5", "decimal" },
+    { "3", "integer" }, { "4", "integer" }, { "5", "integer" },
+    { "6.0", "decimal" }, { "6", "int" }, { "6.5", "decimal" },
+    { "7", "integer" }, { "4", NULL }, { "1.0E1", "double" }
+  };
+  librdf_storage* storage;
+  librdf_model* model;
+  librdf_node* predicate;
+  librdf_node* min;
+  librdf_node* max;
+  librdf_uri* decimal;
+  int count;
+  int i;
+  int rc = 0;
+
+  fprintf(stdout, "%s: Testing range finds with %s storage options %s\n",
+          program, name, options);
+
+  storage = librdf_new_storage(world, name, "test", options);
+  if(!storage) {
+    fprintf(stderr, "%s: WARNING: Failed to create new storage %s\n",
+            program, name);
+    return 0;
+  }
+  model = librdf_new_model(world, storage, NULL);
+  if(!model) {
+    librdf_free_storage(storage);
+    return 1;
+  }
+
+  predicate = librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/value");
+
+  for(i = 0; i < (int)(sizeof(values) / sizeof(values[0])); i++) {
+    librdf_statement* statement;
+    librdf_uri* datatype = NULL;
+    char subject[64];
+
+    sprintf(subject, "http://example.org/s%d", i);
+    if(values[i][1]) {
+      char uri[64];
+
+      sprintf(uri, RANGE_TEST_XSD "%s", values[i][1]);
+      datatype = librdf_new_uri(world, (const unsigned char*)uri);
+    }
+    statement = librdf_new_statement_from_nodes(world,
+      librdf_new_node_from_uri_string(world, (const unsigned char*)subject),
+      librdf_new_node_from_node(predicate),
+      librdf_new_node_from_typed_literal(world, (const unsigned char*)values[i][0], NULL, datatype));
+    librdf_storage_add_statement(storage, statement);
+    librdf_free_statement(statement);
+    if(datatype)
+      librdf_free_uri(datatype);
+  }
+
+  decimal = librdf_new_uri(world, (const unsigned char*)RANGE_TEST_XSD "decimal");
+  min = librdf_new_node_from_typed_literal(world, (const unsigned char*)"2.5", NULL, decimal);
+  max = librdf_new_node_from_typed_literal(world, (const unsigned char*)"6", NULL, decimal);
+
+  count = storage_test_count_stream(librdf_storage_find_statements_in_range(storage, predicate, min, max));
+  if(count != 6) {
+    fprintf(stderr, "%s: %s storage range find returned %d statements, expected 6\n",
+            program, name, count);
+    rc = 1;
+  }
+
+  count = storage_test_count_stream(librdf_model_find_statements_in_range(model, predicate, min, NULL));
+  if(count != 9) {
+    fprintf(stderr, "%s: %s model range find returned %d statements, expected 9\n",
+            program, name, count);
+    rc = 1;
+  }
+
+  librdf_free_node(min);
+  librdf_free_node(max);
+  librdf_free_uri(decimal);
+  librdf_free_node(predicate);
+  librdf_free_model(model);
+  librdf_free_storage(storage);
+
+  return rc;
+}
+
+
+#ifdef STORAGE_FILE
+#define JOURNAL_TEST_NAME "rdf_storage_test_journal.rdf"
+
+static librdf_statement*
+storage_test_journal_statement(librdf_world* world, int i)
+{
+  char subject[64];
+
+  sprintf(subject, "http://example.org/s%d", i);
+  return librdf_new_statement_from_nodes(world,
+    librdf_new_node_from_uri_string(world, (const unsigned char*)subject),
+    librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/p"),
+    librdf_new_node_from_literal(world, (const unsigned char*)"value \"quoted\"\n", NULL, 0));
+}
+
+
+/* Open the journal test store and check its size, freeing it on failure */
+static int
+storage_test_journal_size(librdf_world* world, const char* program,
+                          librdf_storage** storage_p, int expected)
+{
+  int size;
+
+  *storage_p = librdf_new_storage(world, "file", JOURNAL_TEST_NAME,
+                                  "journal='yes'");
+  if(!*storage_p) {
+    fprintf(stderr, "%s: Failed to open journaled file storage\n", program);
+    return 1;
+  }
+
+  size = librdf_storage_size(*storage_p);
+  if(size != expected) {
+    fprintf(stderr, "%s: journaled file storage has %d statements, expected %d\n",
+            program, size, expected);
+    librdf_free_storage(*storage_p);
+    *storage_p = NULL;
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/* Write a journal, cut its last record short and reopen the store */
+static int
+storage_test_journal(librdf_world* world, const char* program)
+{
+  librdf_storage* storage;
+  librdf_statement* statement;
+  FILE *fh;
+  int i;
+  int rc = 0;
+
+  fprintf(stdout, "%s: Testing journaled file storage with a cut short journal\n",
+          program);
+
+  remove(JOURNAL_TEST_NAME);
+  remove(JOURNAL_TEST_NAME ".journal");
+
+  if(storage_test_journal_size(world, program, &storage, 0)) {
+    rc = 1;
+    goto tidy;
+  }
+  for(i = 0; i < 3; i++) {
+    statement = storage_test_journal_statement(world, i);
+    librdf_storage_add_statement(storage, statement);
+    librdf_free_statement(statement);
+  }
+  statement = storage_test_journal_statement(world, 1);
+  librdf_storage_remove_statement(storage, statement);
+  librdf_free_statement(statement);
+  librdf_free_storage(storage);
+
+  /* as if killed while writing a record */
+  fh = fopen(JOURNAL_TEST_NAME ".journal", "a");
+  if(!fh) {
+    fprintf(stderr, "%s: Failed to append to the journal\n", program);
+    rc = 1;
+    goto tidy;
+  }
+  fputs("<http://example.org/s9> <http://example.org/p> \"cut", fh);
+  fclose(fh);
+
+  /* s0 and s2 are kept and the store takes more changes */
+  if(storage_test_journal_size(world, program, &storage, 2))
+    rc = 1;
+  else {
+    statement = storage_test_journal_statement(world, 2);
+    if(librdf_storage_contains_statement(storage, statement) <= 0) {
+      fprintf(stderr, "%s: journaled file storage lost a statement\n", program);
+      rc = 1;
+    }
+    librdf_free_statement(statement);
+
+    statement = storage_test_journal_statement(world, 3);
+    librdf_storage_add_statement(storage, statement);
+    librdf_free_statement(statement);
+    librdf_free_storage(storage);
+  }
+
+  if(!rc) {
+    if(storage_test_journal_size(world, program, &storage, 3))
+      rc = 1;
+    else
+      librdf_free_storage(storage);
+  }
+
+  tidy:
+  remove(JOURNAL_TEST_NAME);
+  remove(JOURNAL_TEST_NAME "~");
+  remove(JOURNAL_TEST_NAME ".journal");
+
+  return rc;
+}
+#endif
+
+
 int
 main(int argc, char *argv[]) 
 {
@@ -2066,6 +2739,24 @@ main(int argc, char *argv[])
   }
   
 
+  ret += storage_test_range(world, program, "hashes",
+                            "hash-type='memory'");
+#ifdef STORAGE_TREES
+  ret += storage_test_range(world, program, "trees", "index-values='no'");
+  ret += storage_test_range(world, program, "trees", "index-values='yes'");
+#endif
+
+#ifdef STORAGE_FILE
+  ret += storage_test_journal(world, program);
+#endif
+
+  /* the lexical forms use '.' whatever the locale */
+  if(setlocale(LC_NUMERIC, "de_DE.UTF-8") || setlocale(LC_NUMERIC, "fr_FR.UTF-8")) {
+    ret += storage_test_range(world, program, "hashes",
+                              "hash-type='memory'");
+    setlocale(LC_NUMERIC, "C");
+  }
+
   librdf_free_world(world);
   
   return ret;
@@ -96,6 +96,8 @@ librdf_stream* librdf_storage_find_statements(librdf_storage* storage, librdf_st
 REDLAND_API
 librdf_stream* librdf_storage_find_statements_with_options(librdf_storage* storage, librdf_statement* statement, librdf_node* context_node, librdf_hash* options);
 REDLAND_API
+librdf_stream* librdf_storage_find_statements_in_range(librdf_storage* storage, librdf_node* predicate, librdf_node* min, librdf_node* max);
+REDLAND_API
 librdf_iterator* librdf_storage_get_sources(librdf_storage *storage, librdf_node *arc, librdf_node *target);
 REDLAND_API
 librdf_iterator* librdf_storage_get_arcs(librdf_storage *storage, librdf_node *source, librdf_node *target);
@@ -61,9 +61,41 @@ typedef struct
 
   /* serializing format ('file' factory only) */
   char *format_name;
+
+  /* journaled mode ('file' factory only) */
+  int journal;
+  /* name".journal\0" */
+  char *journal_name;
+  /* journal file opened for appending, iostream over it and N-Quads
+   * serializer writing to that or NULL */
+  FILE *journal_fh;
+  raptor_iostream *journal_iostr;
+  raptor_serializer *journal_serializer;
+  /* graph terms marking add and remove records */
+  librdf_node *journal_add_node;
+  librdf_node *journal_remove_node;
+  /* journal size in bytes to trigger compaction into the base file */
+  long journal_compact_size;
+  /* non-0 if the next sync must compact the journal */
+  int journal_compact;
+  /* non-0 while replaying the journal; records are not re-logged */
+  int replaying;
+  /* records applied and non-0 if applying one failed during replay */
+  int replay_count;
+  int replay_failed;
 } librdf_storage_file_instance;
 
 
+/* Graph terms marking the operation of an N-Quads journal record */
+#define LIBRDF_STORAGE_FILE_JOURNAL_ADD \
+  "http://librdf.org/storage/file/journal#add"
+#define LIBRDF_STORAGE_FILE_JOURNAL_REMOVE \
+  "http://librdf.org/storage/file/journal#remove"
+
+/* Default journal size that triggers compaction: 1 Mbyte */
+#define LIBRDF_STORAGE_FILE_JOURNAL_COMPACT_SIZE (1024 * 1024)
+
+
 /* prototypes for local functions */
 static int librdf_storage_file_init(librdf_storage* storage, const char *name, librdf_hash* options);
 static int librdf_storage_file_open(librdf_storage* storage, librdf_model* model);
@@ -77,6 +109,11 @@ static librdf_stream* librdf_storage_file_serialise(librdf_storage* storage);
 static librdf_stream* librdf_storage_file_find_statements(librdf_storage* storage, librdf_statement* statement);
 
 static int librdf_storage_file_sync(librdf_storage *storage);
+static int librdf_storage_file_write_base(librdf_storage *storage);
+
+static int librdf_storage_file_journal_replay(librdf_storage* storage);
+static int librdf_storage_file_journal_log(librdf_storage* storage, librdf_statement* statement, int is_remove);
+static void librdf_storage_file_journal_close(librdf_storage* storage);
 
 static void librdf_storage_file_register_factory(librdf_storage_factory *factory);
 
@@ -121,6 +158,14 @@ librdf_storage_file_init(librdf_storage* storage, const char *name,
     if(context->format_name)
       format_name = context->format_name;
   }
+
+  if(!is_uri) {
+    context->journal = (librdf_hash_get_as_boolean(options, "journal") > 0);
+    context->journal_compact_size = librdf_hash_get_as_long(options,
+                                                            "journal-size");
+    if(context->journal_compact_size <= 0)
+      context->journal_compact_size = LIBRDF_STORAGE_FILE_JOURNAL_COMPACT_SIZE;
+  }
   
 
   if(is_uri)
@@ -157,8 +202,27 @@ librdf_storage_file_init(librdf_storage* storage, const char *name,
     librdf_free_parser(parser);
   }
 
+  if(context->journal) {
+    /* name".journal\0" */
+    context->journal_name = LIBRDF_MALLOC(char*, context->name_len + 9);
+    if(!context->journal_name)
+      goto done;
+    strcpy(context->journal_name, context->name);
+    strcpy(context->journal_name + context->name_len, ".journal");
+
+  }
+
   context->changed = 0;
 
+  if(context->journal && !access((const char*)context->journal_name, F_OK)) {
+    if(librdf_storage_file_journal_replay(storage))
+      goto done;
+
+    /* fold the replayed journal into the base file at the next sync */
+    context->changed = 1;
+    context->journal_compact = 1;
+  }
+
   rc = 0;
 
   done:
@@ -181,6 +245,11 @@ librdf_storage_file_terminate(librdf_storage* storage)
 
   librdf_storage_file_sync(storage);
 
+  librdf_storage_file_journal_close(storage);
+
+  if(context->journal_name)
+    LIBRDF_FREE(char*, context->journal_name);
+
   if(context->format_name)
     LIBRDF_FREE(char*, context->format_name);
 
@@ -226,8 +295,14 @@ static int
 librdf_storage_file_add_statement(librdf_storage* storage, librdf_statement* statement)
 {
   librdf_storage_file_instance* context=(librdf_storage_file_instance*)storage->instance;
+  int rc;
+
   context->changed=1;
-  return librdf_model_add_statement(context->model, statement);
+  rc = librdf_model_add_statement(context->model, statement);
+  if(!rc && context->journal)
+    rc = librdf_storage_file_journal_log(storage, statement, 0);
+
+  return rc;
 }
 
 
@@ -236,8 +311,30 @@ librdf_storage_file_add_statements(librdf_storage* storage,
                                    librdf_stream* statement_stream)
 {
   librdf_storage_file_instance* context=(librdf_storage_file_instance*)storage->instance;
-  context->changed=1;
-  return librdf_model_add_statements(context->model, statement_stream);
+  int rc = 0;
+
+  if(!context->journal) {
+    context->changed=1;
+    return librdf_model_add_statements(context->model, statement_stream);
+  }
+
+  /* journaled mode: every statement needs a journal record */
+  while(!librdf_stream_end(statement_stream)) {
+    librdf_statement* statement = librdf_stream_get_object(statement_stream);
+
+    if(!statement) {
+      rc = 1;
+      break;
+    }
+
+    rc = librdf_storage_file_add_statement(storage, statement);
+    if(rc)
+      break;
+
+    librdf_stream_next(statement_stream);
+  }
+
+  return rc;
 }
 
 
@@ -245,8 +342,14 @@ static int
 librdf_storage_file_remove_statement(librdf_storage* storage, librdf_statement* statement)
 {
   librdf_storage_file_instance* context=(librdf_storage_file_instance*)storage->instance;
+  int rc;
+
   context->changed=1;
-  return librdf_model_remove_statement(context->model, statement);
+  rc = librdf_model_remove_statement(context->model, statement);
+  if(!rc && context->journal)
+    rc = librdf_storage_file_journal_log(storage, statement, 1);
+
+  return rc;
 }
 
 
@@ -276,6 +379,69 @@ librdf_storage_file_find_statements(librdf_storage* storage, librdf_statement* s
 
 static int
 librdf_storage_file_sync(librdf_storage *storage)
+{
+  librdf_storage_file_instance* context=(librdf_storage_file_instance*)storage->instance;
+  int rc;
+
+  if(!context->changed)
+    return 0;
+
+  if(!context->journal)
+    return librdf_storage_file_write_base(storage);
+
+  /* journaled mode: flush the appended records and only rewrite the
+   * base file once the journal has grown large enough
+   */
+  if(context->journal_fh) {
+    if(fflush(context->journal_fh)) {
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "failed to write journal file '%s' - %s",
+                 context->journal_name, strerror(errno));
+      return 1;
+    }
+
+    if(ftell(context->journal_fh) >= context->journal_compact_size)
+      context->journal_compact = 1;
+  }
+
+  if(!context->journal_compact) {
+    context->changed = 0;
+    return 0;
+  }
+
+  /* compact: write the whole model into the base file then drop the
+   * journal.  If this is interrupted after the base file is replaced,
+   * replaying the old journal over the new base gives the same model.
+   */
+  rc = librdf_storage_file_write_base(storage);
+  if(rc)
+    return rc;
+
+  librdf_storage_file_journal_close(storage);
+  if(remove(context->journal_name) < 0 && errno != ENOENT) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "failed to remove journal file '%s' - %s",
+               context->journal_name, strerror(errno));
+    return 1;
+  }
+
+  context->journal_compact = 0;
+
+  return 0;
+}
+
+
+/*
+ * librdf_storage_file_write_base - Write the whole model to the storage file
+ * @storage: the storage
+ *
+ * Serializes to name".new", keeping the old file as name"~" until the
+ * new file has been renamed into place.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+librdf_storage_file_write_base(librdf_storage *storage)
 {
   librdf_storage_file_instance* context=(librdf_storage_file_instance*)storage->instance;
   char *backup_name;
@@ -284,9 +450,6 @@ librdf_storage_file_sync(librdf_storage *storage)
   FILE *fh;
   int rc=0;
 
-  if(!context->changed)
-    return 0;
-
   if(!context->name) {
     /* FIXME - URI cannot be written */
     context->changed=0;
@@ -373,6 +536,279 @@ librdf_storage_file_sync(librdf_storage *storage)
 }
 
 
+/*
+ * librdf_storage_file_journal_log - Append a statement record to the journal
+ * @storage: the storage
+ * @statement: statement added or removed
+ * @is_remove: non-0 if the statement was removed
+ *
+ * Records are N-Quads lines written by the raptor serializer where
+ * the graph term gives the operation.  The journal is opened for
+ * appending on the first record.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+librdf_storage_file_journal_log(librdf_storage* storage,
+                                librdf_statement* statement, int is_remove)
+{
+  librdf_storage_file_instance* context=(librdf_storage_file_instance*)storage->instance;
+  librdf_node* graph;
+  int rc;
+
+  if(context->replaying)
+    return 0;
+
+  if(!context->journal_fh) {
+    context->journal_fh = fopen(context->journal_name, "a");
+    if(!context->journal_fh) {
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "failed to open journal file '%s' for appending - %s",
+                 context->journal_name, strerror(errno));
+      return 1;
+    }
+    fseek(context->journal_fh, 0L, SEEK_END);
+
+    context->journal_iostr = raptor_new_iostream_to_file_handle(storage->world->raptor_world_ptr,
+                                                                context->journal_fh);
+    context->journal_serializer = raptor_new_serializer(storage->world->raptor_world_ptr,
+                                                        "nquads");
+    context->journal_add_node = librdf_new_node_from_uri_string(storage->world,
+                                                                (const unsigned char*)LIBRDF_STORAGE_FILE_JOURNAL_ADD);
+    context->journal_remove_node = librdf_new_node_from_uri_string(storage->world,
+                                                                   (const unsigned char*)LIBRDF_STORAGE_FILE_JOURNAL_REMOVE);
+    if(!context->journal_iostr || !context->journal_serializer ||
+       !context->journal_add_node || !context->journal_remove_node ||
+       raptor_serializer_start_to_iostream(context->journal_serializer, NULL,
+                                           context->journal_iostr)) {
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "failed to start writing journal file '%s'",
+                 context->journal_name);
+      librdf_storage_file_journal_close(storage);
+      return 1;
+    }
+  }
+
+  /* the graph term of the record gives the operation */
+  graph = statement->graph;
+  statement->graph = is_remove ? context->journal_remove_node
+                               : context->journal_add_node;
+  rc = raptor_serializer_serialize_statement(context->journal_serializer,
+                                             statement);
+  statement->graph = graph;
+  if(rc)
+    return 1;
+
+  /* Blank node labels are not kept when the base file is parsed again
+   * so a record using one cannot be replayed against it later
+   */
+  if(librdf_node_is_blank(librdf_statement_get_subject(statement)) ||
+     librdf_node_is_blank(librdf_statement_get_object(statement)))
+    context->journal_compact = 1;
+
+  return 0;
+}
+
+
+static void
+librdf_storage_file_journal_close(librdf_storage* storage)
+{
+  librdf_storage_file_instance* context=(librdf_storage_file_instance*)storage->instance;
+
+  if(context->journal_serializer) {
+    raptor_serializer_serialize_end(context->journal_serializer);
+    raptor_free_serializer(context->journal_serializer);
+    context->journal_serializer = NULL;
+  }
+
+  if(context->journal_add_node) {
+    librdf_free_node(context->journal_add_node);
+    context->journal_add_node = NULL;
+  }
+
+  if(context->journal_remove_node) {
+    librdf_free_node(context->journal_remove_node);
+    context->journal_remove_node = NULL;
+  }
+
+  if(context->journal_iostr) {
+    raptor_free_iostream(context->journal_iostr);
+    context->journal_iostr = NULL;
+  }
+
+  if(context->journal_fh) {
+    fclose(context->journal_fh);
+    context->journal_fh = NULL;
+  }
+}
+
+
+static void
+librdf_storage_file_journal_replay_handler(void *user_data,
+                                           raptor_statement *statement)
+{
+  librdf_storage* storage = (librdf_storage*)user_data;
+  librdf_storage_file_instance* context=(librdf_storage_file_instance*)storage->instance;
+  librdf_node* graph = statement->graph;
+  int is_remove = 0;
+
+  if(graph && librdf_node_is_resource(graph))
+    is_remove = !strcmp((const char*)librdf_uri_as_string(librdf_node_get_uri(graph)),
+                        LIBRDF_STORAGE_FILE_JOURNAL_REMOVE);
+
+  /* apply the triple only; the memory store has no contexts.
+   * Replaying over a base file that already has the journal folded
+   * in may remove a statement that is not there, which is fine.
+   */
+  statement->graph = NULL;
+  if(is_remove) {
+    if(librdf_model_contains_statement(context->model, statement) > 0 &&
+       librdf_model_remove_statement(context->model, statement))
+      context->replay_failed = 1;
+  } else if(librdf_model_add_statement(context->model, statement))
+    context->replay_failed = 1;
+  statement->graph = graph;
+
+  context->replay_count++;
+}
+
+
+/*
+ * librdf_storage_file_journal_replay - Apply the journal to the model
+ * @storage: the storage
+ *
+ * Replays the add and remove records in the journal, in order, over
+ * the model parsed from the base file.  A record that is cut short or
+ * does not parse, such as the last one written when the process was
+ * killed, ends the journal: it and anything after it are dropped from
+ * the file with a warning so the store can still be opened.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+librdf_storage_file_journal_replay(librdf_storage* storage)
+{
+  librdf_storage_file_instance* context=(librdf_storage_file_instance*)storage->instance;
+  raptor_parser* rparser = NULL;
+  FILE *fh;
+  unsigned char *buffer = NULL;
+  long length;
+  size_t offset;
+  int rc = 1;
+
+  fh = fopen(context->journal_name, "rb");
+  if(!fh) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "failed to open journal file '%s' - %s",
+               context->journal_name, strerror(errno));
+    return 1;
+  }
+
+  /* read it all; the journal is compacted once it is journal-size long */
+  if(fseek(fh, 0L, SEEK_END) || (length = ftell(fh)) < 0 ||
+     fseek(fh, 0L, SEEK_SET))
+    goto read_failed;
+  buffer = LIBRDF_MALLOC(unsigned char*, (size_t)length + 1);
+  if(!buffer)
+    goto read_failed;
+  if(length && fread(buffer, 1, (size_t)length, fh) != (size_t)length)
+    goto read_failed;
+  fclose(fh);
+  fh = NULL;
+
+  rparser = raptor_new_parser(storage->world->raptor_world_ptr, "nquads");
+  if(!rparser)
+    goto done;
+
+  raptor_parser_set_statement_handler(rparser, storage,
+                                      librdf_storage_file_journal_replay_handler);
+
+  /* map journal blank node labels consistently for this replay */
+  librdf_raptor_reset_bnode_hash(storage->world);
+
+  context->replaying = 1;
+  context->replay_failed = 0;
+
+  if(raptor_parser_parse_start(rparser, (raptor_uri*)context->uri)) {
+    context->replaying = 0;
+    librdf_raptor_free_bnode_hash(storage->world);
+    goto done;
+  }
+
+  /* feed one complete line at a time; each record line must give
+   * exactly one statement
+   */
+  for(offset = 0; offset < (size_t)length; ) {
+    unsigned char *line = buffer + offset;
+    unsigned char *eol;
+    size_t line_len;
+    int count = context->replay_count;
+    int is_record;
+
+    eol = (unsigned char*)memchr(line, '\n', (size_t)length - offset);
+    if(!eol)
+      break;
+    line_len = (size_t)(eol - line) + 1;
+
+    is_record = (line_len > 1 && *line != '#');
+    if(raptor_parser_parse_chunk(rparser, line, line_len, 0) ||
+       (is_record && context->replay_count != count + 1))
+      break;
+
+    if(context->replay_failed)
+      break;
+
+    offset += line_len;
+  }
+  raptor_parser_parse_chunk(rparser, NULL, 0, 1);
+
+  context->replaying = 0;
+  librdf_raptor_free_bnode_hash(storage->world);
+
+  if(context->replay_failed) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "failed to replay journal file '%s'", context->journal_name);
+    goto done;
+  }
+
+  if(offset < (size_t)length) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_WARN, LIBRDF_FROM_STORAGE, NULL,
+               "Ignoring incomplete or bad journal file '%s' record at byte %ld - dropping the last %ld bytes",
+               context->journal_name, (long)offset, length - (long)offset);
+
+    /* rewrite the complete records so appended ones follow them */
+    fh = fopen(context->journal_name, "wb");
+    if(!fh || (offset && fwrite(buffer, 1, offset, fh) != offset) ||
+       fclose(fh)) {
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "failed to write journal file '%s' - %s",
+                 context->journal_name, strerror(errno));
+      fh = NULL;
+      goto done;
+    }
+    fh = NULL;
+  }
+
+  rc = 0;
+  goto done;
+
+  read_failed:
+  librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+             "failed to read journal file '%s' - %s",
+             context->journal_name, strerror(errno));
+
+  done:
+  if(rparser)
+    raptor_free_parser(rparser);
+  if(buffer)
+    LIBRDF_FREE(char*, buffer);
+  if(fh)
+    fclose(fh);
+
+  return rc;
+}
+
+
 static librdf_node*
 librdf_storage_file_get_feature(librdf_storage* storage, librdf_uri* feature)
 {
@@ -126,6 +126,11 @@ typedef struct
   size_t key_buffer_len;
   unsigned char *value_buffer;
   size_t value_buffer_len;
+
+  /* nodes of the statement being added, removed or checked, each
+   * encoded once and copied into the keys and values of every hash
+   */
+  librdf_statement_encoded_parts encoded_parts;
 } librdf_storage_hashes_instance;
 
 
@@ -148,6 +153,7 @@ static int librdf_storage_hashes_remove_statement(librdf_storage* storage, librd
 static int librdf_storage_hashes_contains_statement(librdf_storage* storage, librdf_statement* statement);
 static librdf_stream* librdf_storage_hashes_serialise(librdf_storage* storage);
 static librdf_stream* librdf_storage_hashes_find_statements(librdf_storage* storage, librdf_statement* statement);
+static librdf_stream* librdf_storage_hashes_scan_statements(librdf_storage* storage, librdf_statement* statement, librdf_node* context_node);
 static librdf_iterator* librdf_storage_hashes_find_sources(librdf_storage* storage, librdf_node* arc, librdf_node *target);
 static librdf_iterator* librdf_storage_hashes_find_arcs(librdf_storage* storage, librdf_node* source, librdf_node *target);
 static librdf_iterator* librdf_storage_hashes_find_targets(librdf_storage* storage, librdf_node* source, librdf_node *arc);
@@ -162,6 +168,7 @@ static void librdf_storage_hashes_serialise_finished(void* context);
 static int librdf_storage_hashes_context_add_statement(librdf_storage* storage, librdf_node* context_node, librdf_statement* statement);
 static int librdf_storage_hashes_context_remove_statement(librdf_storage* storage, librdf_node* context_node, librdf_statement* statement);
 static librdf_stream* librdf_storage_hashes_context_serialise(librdf_storage* storage, librdf_node* context_node);
+static librdf_stream* librdf_storage_hashes_context_serialise_common(librdf_storage* storage, librdf_node* context_node, librdf_statement* partial);
 
 /* context list statement stream methods */
 static int librdf_storage_hashes_context_serialise_end_of_stream(void* context);
@@ -462,6 +469,8 @@ librdf_storage_hashes_terminate(librdf_storage* storage)
   if(context->value_buffer)
     LIBRDF_FREE(data, context->value_buffer);
 
+  librdf_statement_encoded_parts_clear(&context->encoded_parts);
+
   if(context->name)
     LIBRDF_FREE(char*, context->name);
 
@@ -522,6 +531,28 @@ librdf_storage_hashes_clone(librdf_storage* new_storage, librdf_storage* old_sto
     goto failed;
   }
 
+  /* In-memory hashes are cloned with their contents, copy-on-write */
+  if(new_hash_type && !strcmp(new_hash_type, "memory")) {
+    librdf_storage_hashes_instance* new_context;
+    int i;
+
+    new_context = (librdf_storage_hashes_instance*)new_storage->instance;
+    for(i=0; i<new_context->hash_count; i++) {
+      librdf_hash* hash;
+
+      if(!old_context->hashes[i])
+        continue;
+
+      hash=librdf_new_hash_from_hash(old_context->hashes[i]);
+      if(!hash)
+        return 1;
+
+      if(new_context->hashes[i])
+        librdf_free_hash(new_context->hashes[i]);
+      new_context->hashes[i]=hash;
+    }
+  }
+
   return 0;
 
   failed:
@@ -633,7 +664,6 @@ librdf_storage_hashes_add_remove_statement(librdf_storage* storage,
   librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
   int i;
   int status=0;
-  librdf_world* world = storage->world;
 
 #if defined(LIBRDF_DEBUG) && LIBRDF_DEBUG > 1
   if(is_addition)
@@ -644,6 +674,12 @@ librdf_storage_hashes_add_remove_statement(librdf_storage* storage,
   fputc('\n', stderr);
 #endif  
 
+  /* encode each node once for all the keys and values */
+  if(librdf_statement_encoded_parts_set(storage->world,
+                                        &context->encoded_parts,
+                                        statement, context_node))
+    return 1;
+
   for(i=0; i<context->hash_count; i++) {
     librdf_hash_datum hd_key, hd_value; /* on stack */
     size_t key_len, value_len;
@@ -654,22 +690,17 @@ librdf_storage_hashes_add_remove_statement(librdf_storage* storage,
     if(!fields)
       continue;
     
-    key_len = librdf_statement_encode_parts2(world, statement, NULL, NULL, 0,
-                                             fields);
-    if(!key_len)
-      return 1;
+    key_len = librdf_statement_encoded_parts_get(&context->encoded_parts,
+                                                 NULL, 0, fields, 0);
     if(librdf_storage_hashes_grow_buffer(&context->key_buffer, 
                                          &context->key_buffer_len, key_len)) {
       status=1;
       break;
     }
        
-    if(!librdf_statement_encode_parts2(world, statement, NULL,
+    librdf_statement_encoded_parts_get(&context->encoded_parts,
                                        context->key_buffer,
-                                       context->key_buffer_len, fields)) {
-      status=1;
-      break;
-    }
+                                       context->key_buffer_len, fields, 0);
 
     
     /* ENCODE VALUE */
@@ -678,25 +709,17 @@ librdf_storage_hashes_add_remove_statement(librdf_storage* storage,
     if(!fields)
       continue;
     
-    value_len=librdf_statement_encode_parts2(world, statement, context_node,
-                                             NULL, 0, fields);
-    if(!value_len) {
-      status=1;
-      break;
-    }
-    
+    value_len = librdf_statement_encoded_parts_get(&context->encoded_parts,
+                                                   NULL, 0, fields, 1);
     if(librdf_storage_hashes_grow_buffer(&context->value_buffer, 
                                          &context->value_buffer_len, value_len)) {
       status=1;
       break;
     }
        
-    if(!librdf_statement_encode_parts2(world, statement, context_node,
+    librdf_statement_encoded_parts_get(&context->encoded_parts,
                                        context->value_buffer,
-                                       context->value_buffer_len, fields)) {
-      status=1;
-      break;
-    }
+                                       context->value_buffer_len, fields, 1);
 
 
 #if defined(LIBRDF_DEBUG) && LIBRDF_DEBUG > 1
@@ -767,7 +790,6 @@ librdf_storage_hashes_contains_statement(librdf_storage* storage, librdf_stateme
 {
   librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
   librdf_hash_datum hd_key, hd_value; /* on stack */
-  unsigned char *key_buffer, *value_buffer;
   size_t key_len, value_len;
   int hash_index=context->all_statements_hash_index;
   librdf_statement_part fields;
@@ -790,56 +812,40 @@ librdf_storage_hashes_contains_statement(librdf_storage* storage, librdf_stateme
     return status;
   }
 
+  if(librdf_statement_encoded_parts_set(world, &context->encoded_parts,
+                                        statement, NULL))
+    return 1;
+
   /* ENCODE KEY */
   fields=(librdf_statement_part)context->hash_descriptions[hash_index]->key_fields;
-  key_len = librdf_statement_encode_parts2(world, statement, NULL,
-                                           NULL, 0, fields);
-  if(!key_len)
-    return 1;
-  key_buffer = LIBRDF_MALLOC(unsigned char*, key_len);
-  if(!key_buffer)
+  key_len = librdf_statement_encoded_parts_get(&context->encoded_parts,
+                                               NULL, 0, fields, 0);
+  if(librdf_storage_hashes_grow_buffer(&context->key_buffer,
+                                       &context->key_buffer_len, key_len))
     return 1;
-       
-  if(!librdf_statement_encode_parts2(world, statement, NULL,
-                                     key_buffer, key_len, fields)) {
-    LIBRDF_FREE(data, key_buffer);
-    return 1;
-  }
+  librdf_statement_encoded_parts_get(&context->encoded_parts,
+                                     context->key_buffer,
+                                     context->key_buffer_len, fields, 0);
 
   /* ENCODE VALUE */
   fields=(librdf_statement_part)context->hash_descriptions[hash_index]->value_fields;
-  value_len = librdf_statement_encode_parts2(world, statement, NULL,
-                                             NULL, 0, fields);
-  if(!value_len) {
-    LIBRDF_FREE(data, key_buffer);
-    return 1;
-  }
-    
-  value_buffer = LIBRDF_MALLOC(unsigned char*, value_len);
-  if(!value_buffer) {
-    LIBRDF_FREE(data, key_buffer);
+  value_len = librdf_statement_encoded_parts_get(&context->encoded_parts,
+                                                 NULL, 0, fields, 0);
+  if(librdf_storage_hashes_grow_buffer(&context->value_buffer,
+                                       &context->value_buffer_len, value_len))
     return 1;
-  }
-
-       
-  if(!librdf_statement_encode_parts2(world, statement, NULL,
-                                     value_buffer, value_len, fields)) {
-    LIBRDF_FREE(data, key_buffer);
-    LIBRDF_FREE(data, value_buffer);
-    return 1;
-  }
+  librdf_statement_encoded_parts_get(&context->encoded_parts,
+                                     context->value_buffer,
+                                     context->value_buffer_len, fields, 0);
 
 
 #if defined(LIBRDF_DEBUG) && LIBRDF_DEBUG > 1
   LIBRDF_DEBUG4("Using %s hash key %d bytes -> value %d bytes\n", context->hash_descriptions[hash_index]->name, key_len, value_len);
 #endif
 
-  hd_key.data=key_buffer; hd_key.size=key_len;
-  hd_value.data=value_buffer; hd_value.size=value_len;
+  hd_key.data=context->key_buffer; hd_key.size=key_len;
+  hd_value.data=context->value_buffer; hd_value.size=value_len;
   status=librdf_hash_exists(context->hashes[hash_index], &hd_key, &hd_value);
-  
-  LIBRDF_FREE(data, key_buffer);
-  LIBRDF_FREE(data, value_buffer);
 
   /* DO NOT free statement, ownership was not passed in */
   return status;
@@ -859,12 +865,72 @@ typedef struct {
   int index_contexts; /* true if this storage indexes contexts */
   librdf_node *context_node;
   int current_is_ok; /* true when current statement and context_node fresh */
+  /* owned pattern statements must match and its nodes encoded, or NULL */
+  librdf_statement* partial;
+  librdf_statement_encoded_parts partial_parts;
 } librdf_storage_hashes_serialise_stream_context;
 
 
+/*
+ * librdf_storage_hashes_serialise_skip - Move a scan to the next statement matching the pattern
+ * @scontext: serialise stream context
+ *
+ * The bound parts of the pattern are compared as encoded bytes with
+ * the hash key and value so statements that do not match are never
+ * decoded.
+ */
+static void
+librdf_storage_hashes_serialise_skip(librdf_storage_hashes_serialise_stream_context* scontext)
+{
+  while(!librdf_iterator_end(scontext->iterator)) {
+    librdf_hash_datum* hd;
+    int match;
+
+    hd=(librdf_hash_datum*)librdf_iterator_get_key(scontext->iterator);
+    match=librdf_statement_encoded_parts_match(&scontext->partial_parts,
+                                               (unsigned char*)hd->data,
+                                               hd->size);
+    if(match) {
+      int value_match;
+
+      hd=(librdf_hash_datum*)librdf_iterator_get_value(scontext->iterator);
+      value_match=librdf_statement_encoded_parts_match(&scontext->partial_parts,
+                                                       (unsigned char*)hd->data,
+                                                       hd->size);
+      if(value_match <= 0)
+        match=value_match;
+    }
+
+    if(match < 0) {
+      /* the bytes cannot tell; decode and match the statement */
+      librdf_statement* statement;
+
+      statement=(librdf_statement*)librdf_storage_hashes_serialise_get_statement(scontext, LIBRDF_ITERATOR_GET_METHOD_GET_OBJECT);
+      match=(statement && librdf_statement_match(statement, scontext->partial));
+    }
+
+    if(match)
+      break;
+
+    scontext->current_is_ok=0;
+    if(librdf_iterator_next(scontext->iterator))
+      break;
+  }
+}
+
+
+/*
+ * librdf_storage_hashes_serialise_common - Serialise statements from a hash
+ * @storage: the storage
+ * @hash_index: index of hash to use with search_node
+ * @search_node: node to search for or NULL for all statements
+ * @want: part of decoded statement to return with search_node
+ * @partial: pattern statements must match or NULL; ownership is passed in
+ */
 static librdf_stream*
 librdf_storage_hashes_serialise_common(librdf_storage* storage, int hash_index,
-                                       librdf_node* search_node, int want)
+                                       librdf_node* search_node, int want,
+                                       librdf_statement* partial)
 {
   librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
   librdf_storage_hashes_serialise_stream_context *scontext;
@@ -873,22 +939,23 @@ librdf_storage_hashes_serialise_common(librdf_storage* storage, int hash_index,
   
   scontext = LIBRDF_CALLOC(librdf_storage_hashes_serialise_stream_context*,
                            1, sizeof(*scontext));
-  if(!scontext)
+  if(!scontext) {
+    if(partial)
+      librdf_free_statement(partial);
     return NULL;
+  }
 
   scontext->hash_context=context;
+  scontext->partial=partial;
 
   librdf_statement_init(storage->world, &scontext->current);
 
   hash=context->hashes[scontext->index];
 
   scontext->key=librdf_new_hash_datum(storage->world, NULL, 0);
-  if(!scontext->key)
-    return NULL;
-  
   scontext->value=librdf_new_hash_datum(storage->world, NULL, 0);
-  if(!scontext->value) {
-    librdf_free_hash_datum(scontext->key);
+  if(!scontext->key || !scontext->value) {
+    librdf_storage_hashes_serialise_finished((void*)scontext);
     return NULL;
   }
 
@@ -914,6 +981,16 @@ librdf_storage_hashes_serialise_common(librdf_storage* storage, int hash_index,
   scontext->storage=storage;
   librdf_storage_add_reference(scontext->storage);
 
+  if(scontext->partial) {
+    if(librdf_statement_encoded_parts_set(storage->world,
+                                          &scontext->partial_parts,
+                                          scontext->partial, NULL)) {
+      librdf_storage_hashes_serialise_finished((void*)scontext);
+      return NULL;
+    }
+    librdf_storage_hashes_serialise_skip(scontext);
+  }
+
   stream=librdf_new_stream(storage->world,
                            (void*)scontext,
                            &librdf_storage_hashes_serialise_end_of_stream,
@@ -936,7 +1013,7 @@ librdf_storage_hashes_serialise(librdf_storage* storage)
   librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
   return librdf_storage_hashes_serialise_common(storage, 
                                                 context->all_statements_hash_index,
-                                                NULL, 0);
+                                                NULL, 0, NULL);
 }
 
 
@@ -955,7 +1032,13 @@ librdf_storage_hashes_serialise_next_statement(void* context)
   librdf_storage_hashes_serialise_stream_context* scontext=(librdf_storage_hashes_serialise_stream_context*)context;
 
   scontext->current_is_ok=0;
-  return librdf_iterator_next(scontext->iterator);
+  if(librdf_iterator_next(scontext->iterator))
+    return 1;
+
+  if(scontext->partial)
+    librdf_storage_hashes_serialise_skip(scontext);
+
+  return librdf_iterator_end(scontext->iterator);
 }
 
 
@@ -1058,6 +1141,11 @@ librdf_storage_hashes_serialise_finished(void* context)
 
   librdf_statement_clear(&scontext->current);
 
+  if(scontext->partial) {
+    librdf_free_statement(scontext->partial);
+    librdf_statement_encoded_parts_clear(&scontext->partial_parts);
+  }
+
   if(scontext->storage)
     librdf_storage_remove_reference(scontext->storage);
 
@@ -1075,7 +1163,7 @@ librdf_storage_hashes_serialise_finished(void* context)
  * Return a stream of statements matching the given statement (or
  * all statements if NULL).  Parts (subject, predicate, object) of the
  * statement can be empty in which case any statement part will match that.
- * Uses #librdf_statement_match to do the matching.
+ * Uses librdf_storage_hashes_scan_statements() to do the matching.
  * 
  * Return value: a #librdf_stream or NULL on failure
  **/
@@ -1093,23 +1181,57 @@ librdf_storage_hashes_find_statements(librdf_storage* storage, librdf_statement*
     stream=librdf_storage_hashes_serialise_common(storage,
                                                   context->p2so_index,
                                                   librdf_statement_get_predicate(statement),
-                                                  LIBRDF_STATEMENT_SUBJECT|LIBRDF_STATEMENT_OBJECT);
-  } else {
-    statement=librdf_new_statement_from_statement(statement);
-    if(!statement)
-      return NULL;
-
-    stream=librdf_storage_hashes_serialise(storage);
-    if(stream)
-      librdf_stream_add_map(stream, 
-                            &librdf_stream_statement_find_map,
-                            (librdf_stream_map_free_context_handler)&librdf_free_statement, (void*)statement);
-  }
+                                                  LIBRDF_STATEMENT_SUBJECT|LIBRDF_STATEMENT_OBJECT,
+                                                  NULL);
+  } else
+    stream=librdf_storage_hashes_scan_statements(storage, statement, NULL);
   
   return stream;
 }
 
 
+/**
+ * librdf_storage_hashes_scan_statements:
+ * @storage: the storage
+ * @statement: the statement to match
+ * @context_node: context to scan or NULL for all statements
+ *
+ * Scan for statements matching a partial statement.
+ * 
+ * Each hash entry scanned is compared with the bound parts of the
+ * statement as encoded bytes so only the statements returned are
+ * decoded.
+ * 
+ * Return value: a #librdf_stream or NULL on failure
+ **/
+static librdf_stream*
+librdf_storage_hashes_scan_statements(librdf_storage* storage,
+                                      librdf_statement* statement,
+                                      librdf_node* context_node)
+{
+  librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
+  librdf_statement* partial=NULL;
+
+  if(statement &&
+     (librdf_statement_get_subject(statement) ||
+      librdf_statement_get_predicate(statement) ||
+      librdf_statement_get_object(statement))) {
+    partial=librdf_new_statement_from_statement(statement);
+    if(!partial)
+      return NULL;
+  }
+
+  if(context_node)
+    return librdf_storage_hashes_context_serialise_common(storage,
+                                                          context_node,
+                                                          partial);
+
+  return librdf_storage_hashes_serialise_common(storage,
+                                                context->all_statements_hash_index,
+                                                NULL, 0, partial);
+}
+
+
 typedef struct {
   librdf_storage* storage;   /* (shared) pointer to storage */
   int hash_index;            /* index of hash in storage list of hashes */
@@ -1565,9 +1687,44 @@ typedef struct {
   librdf_node *context_node;
   char *context_node_data;
   int current_is_ok; /* true when current statement and context_node fresh */
+  /* owned pattern statements must match and its nodes encoded, or NULL */
+  librdf_statement* partial;
+  librdf_statement_encoded_parts partial_parts;
 } librdf_storage_hashes_context_serialise_stream_context;
 
 
+/*
+ * librdf_storage_hashes_context_serialise_skip - Move a context scan to the next statement matching the pattern
+ * @scontext: context serialise stream context
+ */
+static void
+librdf_storage_hashes_context_serialise_skip(librdf_storage_hashes_context_serialise_stream_context* scontext)
+{
+  while(!librdf_iterator_end(scontext->iterator)) {
+    librdf_hash_datum* hd;
+    int match;
+
+    hd=(librdf_hash_datum*)librdf_iterator_get_value(scontext->iterator);
+    match=librdf_statement_encoded_parts_match(&scontext->partial_parts,
+                                               (unsigned char*)hd->data,
+                                               hd->size);
+    if(match < 0) {
+      librdf_statement* statement;
+
+      statement=(librdf_statement*)librdf_storage_hashes_context_serialise_get_statement(scontext, LIBRDF_ITERATOR_GET_METHOD_GET_OBJECT);
+      match=(statement && librdf_statement_match(statement, scontext->partial));
+    }
+
+    if(match)
+      break;
+
+    scontext->current_is_ok=0;
+    if(librdf_iterator_next(scontext->iterator))
+      break;
+  }
+}
+
+
 /**
  * librdf_storage_hashes_context_serialise:
  * @storage: #librdf_storage object
@@ -1580,6 +1737,22 @@ typedef struct {
 static librdf_stream*
 librdf_storage_hashes_context_serialise(librdf_storage* storage,
                                         librdf_node* context_node) 
+{
+  return librdf_storage_hashes_context_serialise_common(storage, context_node,
+                                                        NULL);
+}
+
+
+/*
+ * librdf_storage_hashes_context_serialise_common - Serialise statements in a context
+ * @storage: the storage
+ * @context_node: context node
+ * @partial: pattern statements must match or NULL; ownership is passed in
+ */
+static librdf_stream*
+librdf_storage_hashes_context_serialise_common(librdf_storage* storage,
+                                               librdf_node* context_node,
+                                               librdf_statement* partial)
 {
   librdf_storage_hashes_instance* context=(librdf_storage_hashes_instance*)storage->instance;
   librdf_storage_hashes_context_serialise_stream_context* scontext;
@@ -1589,23 +1762,27 @@ librdf_storage_hashes_context_serialise(librdf_storage* storage,
   if(context->contexts_index <0) {
     librdf_log(storage->world, 0, LIBRDF_LOG_WARN, LIBRDF_FROM_STORAGE, NULL,
                "Storage was created without context support");
+    if(partial)
+      librdf_free_statement(partial);
     return NULL;
   }
   
   scontext = LIBRDF_CALLOC(librdf_storage_hashes_context_serialise_stream_context*,
                            1, sizeof(*scontext));
-  if(!scontext)
+  if(!scontext) {
+    if(partial)
+      librdf_free_statement(partial);
     return NULL;
+  }
+
+  scontext->partial=partial;
 
   librdf_statement_init(storage->world, &scontext->current);
 
   scontext->key=librdf_new_hash_datum(storage->world, NULL, 0);
-  if(!scontext->key)
-    return NULL;
-  
   scontext->value=librdf_new_hash_datum(storage->world, NULL, 0);
-  if(!scontext->value) {
-    librdf_free_hash_datum(scontext->key);
+  if(!scontext->key || !scontext->value) {
+    librdf_storage_hashes_context_serialise_finished((void*)scontext);
     return NULL;
   }
 
@@ -1628,6 +1805,16 @@ librdf_storage_hashes_context_serialise(librdf_storage* storage,
   scontext->storage=storage;
   librdf_storage_add_reference(scontext->storage);
 
+  if(scontext->partial) {
+    if(librdf_statement_encoded_parts_set(storage->world,
+                                          &scontext->partial_parts,
+                                          scontext->partial, NULL)) {
+      librdf_storage_hashes_context_serialise_finished((void*)scontext);
+      return NULL;
+    }
+    librdf_storage_hashes_context_serialise_skip(scontext);
+  }
+
   stream=librdf_new_stream(storage->world,
                            (void*)scontext,
                            &librdf_storage_hashes_context_serialise_end_of_stream,
@@ -1658,7 +1845,13 @@ librdf_storage_hashes_context_serialise_next_statement(void* context)
   librdf_storage_hashes_context_serialise_stream_context* scontext=(librdf_storage_hashes_context_serialise_stream_context*)context;
 
   scontext->current_is_ok=0;
-  return librdf_iterator_next(scontext->iterator);
+  if(librdf_iterator_next(scontext->iterator))
+    return 1;
+
+  if(scontext->partial)
+    librdf_storage_hashes_context_serialise_skip(scontext);
+
+  return librdf_iterator_end(scontext->iterator);
 }
 
 
@@ -1734,6 +1927,11 @@ librdf_storage_hashes_context_serialise_finished(void* context)
   if(scontext->context_node_data)
     LIBRDF_FREE(char*, scontext->context_node_data);
 
+  if(scontext->partial) {
+    librdf_free_statement(scontext->partial);
+    librdf_statement_encoded_parts_clear(&scontext->partial_parts);
+  }
+
   if(scontext->storage)
     librdf_storage_remove_reference(scontext->storage);
   
@@ -1956,6 +2154,7 @@ librdf_storage_hashes_register_factory(librdf_storage_factory *factory)
   factory->context_add_statement    = librdf_storage_hashes_context_add_statement;
   factory->context_remove_statement = librdf_storage_hashes_context_remove_statement;
   factory->context_serialise        = librdf_storage_hashes_context_serialise;
+  factory->scan_statements          = librdf_storage_hashes_scan_statements;
   factory->sync                     = librdf_storage_hashes_sync;
   factory->get_contexts             = librdf_storage_hashes_get_contexts;
   factory->get_feature              = librdf_storage_hashes_get_feature;
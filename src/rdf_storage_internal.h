@@ -48,6 +48,9 @@ struct librdf_storage_s
   void *instance;
   int index_contexts;
   struct librdf_storage_factory_s* factory;
+
+  /* operation metrics of this instance once any are recorded or NULL */
+  struct librdf_metrics_storage_s* metrics;
 };
 
 void librdf_init_storage_list(librdf_world *world);
@@ -79,6 +82,23 @@ void librdf_init_storage_sqlite(librdf_world *world);
 #endif
 
 
+#ifdef MODULAR_LIBRDF
+/* A storage module that has been found but not necessarily loaded */
+typedef struct
+{
+  /* storage name provided by the module such as "mysql" */
+  char* name;
+
+  /* module file to open with lt_dlopenext() */
+  char* filename;
+
+  /* non-0 once loading the module has been tried */
+  int loaded;
+} librdf_storage_module_stub;
+
+void librdf_free_storage_module_stub(librdf_storage_module_stub* stub);
+#endif
+
 /* module init */
 void librdf_init_storage(librdf_world *world);
 
@@ -240,6 +240,15 @@ struct librdf_storage_factory_s {
 
   /** Storage engine returns query results - OPTIONAL */
   librdf_query_results* (*query_execute)(librdf_storage* storage, librdf_query *query);
+
+  /** Search for statements with a predicate and a literal object
+   * value in a range - OPTIONAL */
+  librdf_stream* (*find_statements_in_range)(librdf_storage* storage, librdf_node* predicate, librdf_node* min, librdf_node* max);
+
+  /** Serialise the statements matching a partial statement, in a
+   * context if the context node is not NULL, rejecting the rest inside
+   * the scan before they are built - OPTIONAL */
+  librdf_stream* (*scan_statements)(librdf_storage* storage, librdf_statement* statement, librdf_node* context_node);
 };
 
 
@@ -150,19 +150,30 @@ typedef struct {
   /* hash of model name in the database (table Models, column ID) */
   u64 model;
 
-  /* if inserts should be optimized by locking and index optimizations */
+  /* if inserts should be optimized by locking and index optimizations
+   * and stream inserts batched into multi-row inserts */
   int bulk;
 
+  /* statements per multi-row insert batch in bulk mode */
+  int bulk_batch;
+
   /* if a table with merged models should be maintained */
   int merge;
 
   /* if mysql MYSQL_OPT_RECONNECT should be set on new connections */
   int reconnect;
 
+  /* rows fetched at a time from a server-side cursor by find, or 0 to
+   * read unbuffered results with mysql_use_result */
+  int fetch_size;
+
   /* digest object for node hashes */
   librdf_digest *digest;
 
   MYSQL* transaction_handle;
+
+  /* non-0 while a bulk add collects rows in the pending sequences */
+  int batching;
   
   raptor_sequence* pending_inserts[4];
   librdf_hash* pending_insert_hash_nodes;
@@ -183,6 +194,8 @@ typedef struct {
   char *config_dir;
 } librdf_storage_mysql_instance;
 
+#define LIBRDF_STORAGE_MYSQL_DEFAULT_BULK_BATCH 1000
+
 /* prototypes for local functions */
 static int librdf_storage_mysql_init(librdf_storage* storage, const char *name,
                                      librdf_hash* options);
@@ -242,6 +255,13 @@ typedef struct {
   MYSQL *handle;
   MYSQL_RES *results;
   int is_literal_match;
+  /* server-side cursor with one growing string buffer per column */
+  MYSQL_STMT *stmt;
+  MYSQL_BIND *binds;
+  char **row;
+  unsigned int fields;
+  /* handle is the transaction connection, never released here */
+  int is_transaction;
 } librdf_storage_mysql_sos_context;
 
 typedef struct {
@@ -267,6 +287,8 @@ static int librdf_storage_mysql_context_add_statement_helper(librdf_storage* sto
                                                              u64 ctxt,
                                                              librdf_statement* statement);
 static int librdf_storage_mysql_find_statements_in_context_augment_query(char **query, const char *addition);
+static int librdf_storage_mysql_find_statements_open_cursor(librdf_storage_mysql_sos_context* sos, const char *query, int fetch_size);
+static char** librdf_storage_mysql_find_statements_fetch_cursor_row(librdf_storage_mysql_sos_context* sos);
 
 /* methods for stream of statements */
 static int librdf_storage_mysql_find_statements_in_context_end_of_stream(void* context);
@@ -380,6 +402,9 @@ librdf_storage_mysql_finish_connections(librdf_storage* storage)
   }
 }
 
+static MYSQL* librdf_storage_mysql_get_pooled_handle(librdf_storage* storage);
+
+
 /*
  * librdf_storage_mysql_get_handle - get a connection handle to the MySQL server
  * @storage: the storage
@@ -393,12 +418,30 @@ static MYSQL*
 librdf_storage_mysql_get_handle(librdf_storage* storage)
 {
   librdf_storage_mysql_instance* context=(librdf_storage_mysql_instance*)storage->instance;
-  librdf_storage_mysql_connection* connection= NULL;
-  int i;
 
   if(context->transaction_handle)
     return context->transaction_handle;
 
+  return librdf_storage_mysql_get_pooled_handle(storage);
+}
+
+
+/*
+ * librdf_storage_mysql_get_pooled_handle - get a pooled connection handle to the MySQL server
+ * @storage: the storage
+ *
+ * As librdf_storage_mysql_get_handle() but never returns the
+ * transaction handle, for results that are read while other queries run.
+ *
+ * Return value: Non-zero on succes.
+ **/
+static MYSQL*
+librdf_storage_mysql_get_pooled_handle(librdf_storage* storage)
+{
+  librdf_storage_mysql_instance* context=(librdf_storage_mysql_instance*)storage->instance;
+  librdf_storage_mysql_connection* connection= NULL;
+  int i;
+
   /* Look for an open connection handle to return */
   for(i=0; i < context->connections_count; i++) {
     if(LIBRDF_STORAGE_MYSQL_CONNECTION_OPEN == context->connections[i].status) {
@@ -511,10 +554,16 @@ librdf_storage_mysql_release_handle(librdf_storage* storage, MYSQL *handle)
  * The boolean bulk option can be set to true if optimized inserts (table
  * locks and temporary key disabling) is wanted. Note that this will block
  * all other access, and requires table locking and alter table privileges.
+ * Streams of statements are then added with multi-row INSERT IGNORE
+ * statements of up to bulk-batch statements (default 1000) each.
  *
  * The boolean merge option can be set to true if a merged "view" of all
  * models should be maintained. This "view" will be a table with TYPE=MERGE.
  *
+ * The fetch-size option can be set to a number of rows to make find and
+ * serialise streams read from a server-side cursor that many rows at a
+ * time rather than from an unbuffered result.
+ *
  * Return value: Non-zero on failure.
  **/
 static int
@@ -587,6 +636,11 @@ librdf_storage_mysql_init(librdf_storage* storage, const char *name,
   /* Reconnect? */
   context->reconnect = (librdf_hash_get_as_boolean(options, "reconnect")>0);
 
+  /* Read find results through a server-side cursor? */
+  context->fetch_size = (int)librdf_hash_get_as_long(options, "fetch-size");
+  if(context->fetch_size < 0)
+    context->fetch_size = 0;
+
   context->layout = librdf_hash_get_del(options, "layout");
   if(!context->layout) {
     context->layout = LIBRDF_MALLOC(char*, strlen(default_layout) + 1);
@@ -714,6 +768,9 @@ librdf_storage_mysql_init(librdf_storage* storage, const char *name,
 
   /* Optimize loads? */
   context->bulk = (librdf_hash_get_as_boolean(options, "bulk")>0);
+  context->bulk_batch = (int)librdf_hash_get_as_long(options, "bulk-batch");
+  if(context->bulk_batch <= 0)
+    context->bulk_batch = LIBRDF_STORAGE_MYSQL_DEFAULT_BULK_BATCH;
 
   /* Truncate model? */
   if(!status && (librdf_hash_get_as_boolean(options, "new")>0))
@@ -1048,7 +1105,8 @@ free_pending_row(pending_row* prow)
 
 
 static raptor_stringbuffer*
-format_pending_row_sequence(const table_info *table, raptor_sequence* seq)
+format_pending_row_sequence(const table_info *table, const char *insert,
+                            raptor_sequence* seq)
 {
   int i;
   raptor_stringbuffer* sb;
@@ -1064,7 +1122,7 @@ format_pending_row_sequence(const table_info *table, raptor_sequence* seq)
   sb=raptor_new_stringbuffer();
 
   raptor_stringbuffer_append_string(sb,
-                                    (const unsigned char*)"REPLACE INTO ", 1);
+                                    (const unsigned char*)insert, 1);
   raptor_stringbuffer_append_string(sb,
                                     (const unsigned char*)table->name, 1);
   raptor_stringbuffer_append_string(sb,
@@ -1114,6 +1172,201 @@ format_pending_row_sequence(const table_info *table, raptor_sequence* seq)
 }
 
 
+static raptor_stringbuffer*
+format_pending_statement_sequence(u64 model, const char *insert,
+                                  raptor_sequence* seq)
+{
+  const table_info *table=&mysql_tables[TABLE_STATEMENTS];
+  raptor_stringbuffer* sb;
+  char uint64_buffer[64];
+  int i;
+
+  if(!raptor_sequence_size(seq))
+    return NULL;
+
+  sb=raptor_new_stringbuffer();
+
+  raptor_stringbuffer_append_string(sb, (const unsigned char*)insert, 1);
+  raptor_stringbuffer_append_string(sb, (const unsigned char*)"Statements", 1);
+  sprintf(uint64_buffer, UINT64_T_FMT, model);
+  raptor_stringbuffer_append_string(sb, (const unsigned char*)uint64_buffer, 1);
+  raptor_stringbuffer_append_counted_string(sb, (const unsigned char*)" (", 2, 1);
+  raptor_stringbuffer_append_string(sb, (const unsigned char*)table->columns, 1);
+  raptor_stringbuffer_append_counted_string(sb, (const unsigned char*)") VALUES ", 9, 1);
+
+  for(i=0; i< raptor_sequence_size(seq); i++) {
+    pending_row* prow=(pending_row*)raptor_sequence_get_at(seq, i);
+    int j;
+
+    if(i > 0)
+      raptor_stringbuffer_append_counted_string(sb,
+                                           (const unsigned char*)", ", 2, 1);
+
+    raptor_stringbuffer_append_counted_string(sb,
+                                           (const unsigned char*)"(", 1, 1);
+
+    for(j=0; j < 4; j++) {
+      if(j > 0)
+        raptor_stringbuffer_append_counted_string(sb,
+                                           (const unsigned char*)", ", 2, 1);
+      sprintf(uint64_buffer, UINT64_T_FMT, prow->uints[j]);
+      raptor_stringbuffer_append_string(sb,
+                                     (const unsigned char*)uint64_buffer, 1);
+    }
+
+    raptor_stringbuffer_append_counted_string(sb,
+                                           (const unsigned char*)")", 1, 1);
+  }
+
+  return sb;
+}
+
+
+/*
+ * librdf_storage_mysql_pending_init:
+ * @storage: storage object
+ *
+ * INTERNAL - create the sequences of node and statement rows pending insert
+ */
+static void
+librdf_storage_mysql_pending_init(librdf_storage *storage)
+{
+  librdf_storage_mysql_instance* context=(librdf_storage_mysql_instance* )storage->instance;
+  int i;
+
+  for(i=0; i<= TABLE_STATEMENTS; i++)
+    context->pending_inserts[i] = raptor_new_sequence((raptor_data_free_handler)free_pending_row, NULL);
+
+  context->pending_insert_hash_nodes=librdf_new_hash(storage->world, NULL);
+  if(!context->pending_insert_hash_nodes)
+    LIBRDF_FATAL1(storage->world, LIBRDF_FROM_STORAGE, 
+                  "Failed to create MySQL seen nodes hash from factory");
+  
+  if(librdf_hash_open(context->pending_insert_hash_nodes, NULL, 0, 1, 1, NULL))
+    LIBRDF_FATAL1(storage->world, LIBRDF_FROM_STORAGE,
+                  "Failed to open MySQL seen nodes hash");
+
+  context->pending_statements = raptor_new_sequence((raptor_data_free_handler)free_pending_row, NULL);
+}
+
+
+/*
+ * librdf_storage_mysql_pending_free:
+ * @storage: storage object
+ *
+ * INTERNAL - free the rows pending insert
+ */
+static void
+librdf_storage_mysql_pending_free(librdf_storage *storage)
+{
+  librdf_storage_mysql_instance* context=(librdf_storage_mysql_instance* )storage->instance;
+  int i;
+
+  for(i=0; i<= TABLE_STATEMENTS; i++) {
+    raptor_sequence* seq;
+    seq=context->pending_inserts[i];
+    if(seq)
+      raptor_free_sequence(seq);
+    context->pending_inserts[i]=NULL;
+  }
+  
+  if(context->pending_insert_hash_nodes) {
+    librdf_free_hash(context->pending_insert_hash_nodes);
+    context->pending_insert_hash_nodes=NULL;
+  }
+
+  if(context->pending_statements) {
+    raptor_free_sequence(context->pending_statements);
+    context->pending_statements=NULL;
+  }
+}
+
+
+/*
+ * librdf_storage_mysql_pending_flush:
+ * @storage: storage object
+ * @handle: MySQL connection handle
+ * @insert: insert statement verb such as "REPLACE INTO "
+ *
+ * INTERNAL - insert the pending node rows and then statement rows
+ *
+ * Each table gets one multi-row insert.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+librdf_storage_mysql_pending_flush(librdf_storage *storage, MYSQL *handle,
+                                   const char *insert)
+{
+  librdf_storage_mysql_instance* context=(librdf_storage_mysql_instance* )storage->instance;
+  const char* query;
+  size_t query_len;
+  raptor_stringbuffer* sb;
+  int i;
+
+  /* INSERT node values */
+  for(i=0; i< TABLE_STATEMENTS; i++) {
+    raptor_sequence* seq;
+    const table_info *table;
+
+    seq=context->pending_inserts[i];
+    table=&mysql_tables[i];
+
+    /* sort pending nodes to always be inserted in same order */
+    raptor_sequence_sort(seq, compare_pending_rows);
+
+    sb=format_pending_row_sequence(table, insert, seq);
+    if(!sb)
+      continue;
+
+    query_len=raptor_stringbuffer_length(sb);
+    query=(char*)raptor_stringbuffer_as_string(sb);
+    
+#ifdef LIBRDF_DEBUG_SQL
+    LIBRDF_DEBUG2("SQL: >>%s<<\n", query);
+#endif
+    if(mysql_real_query(handle, query, query_len)) {
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "MySQL query to table %s failed: %s", table->name,
+                 mysql_error(handle));
+      raptor_free_stringbuffer(sb);
+      return 1;
+    }
+    
+    raptor_free_stringbuffer(sb);
+  }
+
+
+  /* INSERT STATEMENT* */
+
+  /* sort pending statements to always be inserted in same order */
+  raptor_sequence_sort(context->pending_statements, compare_pending_rows);
+
+  sb=format_pending_statement_sequence(context->model, insert,
+                                       context->pending_statements);
+  if(!sb)
+    return 0;
+
+  query_len=raptor_stringbuffer_length(sb);
+  query=(char*)raptor_stringbuffer_as_string(sb);
+#ifdef LIBRDF_DEBUG_SQL
+  LIBRDF_DEBUG2("SQL: >>%s<<\n", query);
+#endif
+  if(mysql_real_query(handle, query, query_len) &&
+     mysql_errno(handle) != ER_DUP_ENTRY) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "MySQL insert into Statements failed with error %s",
+               mysql_error(handle));
+    raptor_free_stringbuffer(sb);
+    return 1;
+  }
+
+  raptor_free_stringbuffer(sb);
+
+  return 0;
+}
+
+
 /*
  * librdf_storage_mysql_node_hash_common - Create/get hash value for node
  * @storage: the storage
@@ -1218,8 +1471,9 @@ librdf_storage_mysql_node_hash_common(librdf_storage* storage,
   
   table=&mysql_tables[node_type];
 
-  if(context->transaction_handle) {
-    /* In a transaction, check this node has not already been handled */
+  if(context->transaction_handle || context->batching) {
+    /* In a transaction or bulk batch, check this node has not already
+     * been handled */
 
     /* Store the new */
     hd_key.data=&hash;
@@ -1329,14 +1583,14 @@ librdf_storage_mysql_node_hash_common(librdf_storage* storage,
   raptor_sequence_push(seq, prow);
 
 
-  if(context->transaction_handle) {
-    /* in a transaction */
+  if(context->transaction_handle || context->batching) {
+    /* in a transaction or bulk batch */
   } else {
     /* not in a transaction so run it now */
     raptor_stringbuffer *sb=NULL;
     size_t query_len;
 
-    sb=format_pending_row_sequence(table, seq);
+    sb=format_pending_row_sequence(table, "REPLACE INTO ", seq);
     
     query_len=raptor_stringbuffer_length(sb);
     query=(char*)raptor_stringbuffer_as_string(sb);
@@ -1359,7 +1613,7 @@ librdf_storage_mysql_node_hash_common(librdf_storage* storage,
   }
   
   tidy:
-  if(!context->transaction_handle) {
+  if(!context->transaction_handle && !context->batching) {
     /* if not in a transaction, lose this */
     if(seq)
       raptor_free_sequence(seq);
@@ -1554,6 +1808,77 @@ librdf_storage_mysql_stop_bulk(librdf_storage* storage)
 }
 
 
+/*
+ * librdf_storage_mysql_bulk_flush - Insert the rows of a bulk batch
+ * @storage: the storage
+ *
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_mysql_bulk_flush(librdf_storage* storage)
+{
+  MYSQL *handle;
+  int rc;
+
+  /* Get MySQL connection handle */
+  handle=librdf_storage_mysql_get_handle(storage);
+  if(!handle)
+    return 1;
+
+  rc=librdf_storage_mysql_pending_flush(storage, handle, "INSERT IGNORE INTO ");
+
+  librdf_storage_mysql_release_handle(storage, handle);
+
+  /* start the next batch empty */
+  librdf_storage_mysql_pending_free(storage);
+  librdf_storage_mysql_pending_init(storage);
+
+  return rc;
+}
+
+
+/*
+ * librdf_storage_mysql_bulk_add_statements - Add a stream of statements in batches
+ * @storage: the storage
+ * @ctxt: u64 context hash
+ * @statement_stream: the stream of statements
+ *
+ * The node and statement rows are collected like in a transaction
+ * and inserted with one multi-row INSERT IGNORE per table every
+ * bulk-batch statements, rather than one query per node and statement.
+ *
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_mysql_bulk_add_statements(librdf_storage* storage, u64 ctxt,
+                                         librdf_stream* statement_stream)
+{
+  librdf_storage_mysql_instance* context=(librdf_storage_mysql_instance*)storage->instance;
+  int rc=0;
+
+  librdf_storage_mysql_pending_init(storage);
+  context->batching=1;
+
+  while(!rc && !librdf_stream_end(statement_stream)) {
+    librdf_statement* statement=librdf_stream_get_object(statement_stream);
+    rc=librdf_storage_mysql_context_add_statement_helper(storage, ctxt,
+                                                         statement);
+    librdf_stream_next(statement_stream);
+
+    if(!rc && raptor_sequence_size(context->pending_statements) >= context->bulk_batch)
+      rc=librdf_storage_mysql_bulk_flush(storage);
+  }
+
+  if(!rc)
+    rc=librdf_storage_mysql_bulk_flush(storage);
+
+  context->batching=0;
+  librdf_storage_mysql_pending_free(storage);
+
+  return rc;
+}
+
+
 /**
  * librdf_storage_mysql_context_add_statements:
  * @storage: the storage
@@ -1588,6 +1913,11 @@ librdf_storage_mysql_context_add_statements(librdf_storage* storage,
       return 1;
   }
 
+  /* Batch inserts unless a transaction is already collecting them */
+  if(context->bulk && !context->transaction_handle)
+    return librdf_storage_mysql_bulk_add_statements(storage, ctxt,
+                                                    statement_stream);
+
   while(!helper && !librdf_stream_end(statement_stream)) {
     librdf_statement* statement=librdf_stream_get_object(statement_stream);
     helper=librdf_storage_mysql_context_add_statement_helper(storage, ctxt,
@@ -1664,8 +1994,8 @@ librdf_storage_mysql_context_add_statement_helper(librdf_storage* storage,
     goto tidy;
   }
 
-  if(context->transaction_handle) {
-    /* in a transaction */
+  if(context->transaction_handle || context->batching) {
+    /* in a transaction or bulk batch */
     pending_row* prow;
     
     prow = LIBRDF_CALLOC(pending_row*, 1, sizeof(*prow));
@@ -2097,7 +2427,17 @@ librdf_storage_mysql_find_statements_with_options(librdf_storage* storage,
   }
 
   /* Get MySQL connection handle */
-  sos->handle=librdf_storage_mysql_get_handle(storage);
+  /* Inside a transaction the find must see its uncommitted changes so
+   * it uses the transaction connection, reading all the results at
+   * once so the connection is free for other queries.  Otherwise the
+   * connection stays reserved until the stream is finished so never
+   * share it.
+   */
+  if(context->transaction_handle) {
+    sos->handle=context->transaction_handle;
+    sos->is_transaction=1;
+  } else
+    sos->handle=librdf_storage_mysql_get_pooled_handle(storage);
   if(!sos->handle) {
     librdf_storage_mysql_find_statements_in_context_finished((void*)sos);
     return NULL;
@@ -2264,11 +2604,29 @@ librdf_storage_mysql_find_statements_with_options(librdf_storage* storage,
 #ifdef LIBRDF_DEBUG_SQL
   LIBRDF_DEBUG2("SQL: >>%s<<\n", query);
 #endif
-  if(mysql_real_query(sos->handle, query, strlen(query)) ||
+  if(sos->is_transaction) {
+    if(mysql_real_query(sos->handle, query, strlen(query)) ||
+       !(sos->results=mysql_store_result(sos->handle))) {
+      librdf_log(sos->storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "MySQL query failed: %s",
+                 mysql_error(sos->handle));
+      LIBRDF_FREE(char*, query);
+      librdf_storage_mysql_find_statements_in_context_finished((void*)sos);
+      return NULL;
+    }
+  } else if(context->fetch_size) {
+    if(librdf_storage_mysql_find_statements_open_cursor(sos, query,
+                                                        context->fetch_size)) {
+      LIBRDF_FREE(char*, query);
+      librdf_storage_mysql_find_statements_in_context_finished((void*)sos);
+      return NULL;
+    }
+  } else if(mysql_real_query(sos->handle, query, strlen(query)) ||
      !(sos->results=mysql_use_result(sos->handle))) {
     librdf_log(sos->storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
                "MySQL query failed: %s",
                mysql_error(sos->handle));
+    LIBRDF_FREE(char*, query);
     librdf_storage_mysql_find_statements_in_context_finished((void*)sos);
     return NULL;
   }
@@ -2295,6 +2653,125 @@ librdf_storage_mysql_find_statements_with_options(librdf_storage* storage,
 }
 
 
+/*
+ * librdf_storage_mysql_find_statements_open_cursor - Run a find query with a server-side cursor
+ * @sos: find statements context
+ * @query: query string
+ * @fetch_size: rows to fetch from the server at a time
+ *
+ * The result is kept on the server and fetched @fetch_size rows at a
+ * time, so the client holds at most that many rows whatever the
+ * result size.
+ *
+ * Return value: non-0 on failure
+ **/
+static int
+librdf_storage_mysql_find_statements_open_cursor(librdf_storage_mysql_sos_context* sos,
+                                                 const char *query,
+                                                 int fetch_size)
+{
+  unsigned long cursor_type=(unsigned long)CURSOR_TYPE_READ_ONLY;
+  unsigned long prefetch_rows=(unsigned long)fetch_size;
+  unsigned int i;
+
+  sos->stmt=mysql_stmt_init(sos->handle);
+  if(!sos->stmt) {
+    librdf_log(sos->storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "MySQL statement init failed: %s", mysql_error(sos->handle));
+    return 1;
+  }
+
+  if(mysql_stmt_prepare(sos->stmt, query, strlen(query)) ||
+     mysql_stmt_attr_set(sos->stmt, STMT_ATTR_CURSOR_TYPE, &cursor_type) ||
+     mysql_stmt_attr_set(sos->stmt, STMT_ATTR_PREFETCH_ROWS, &prefetch_rows) ||
+     mysql_stmt_execute(sos->stmt))
+    goto failed;
+
+  sos->fields=mysql_stmt_field_count(sos->stmt);
+  sos->binds = LIBRDF_CALLOC(MYSQL_BIND*, sos->fields + 1, sizeof(MYSQL_BIND));
+  sos->row = LIBRDF_CALLOC(char**, sos->fields + 1, sizeof(char*));
+  if(!sos->binds || !sos->row)
+    return 1;
+
+  /* all columns are read as NUL-terminated strings like a MYSQL_ROW */
+  for(i=0; i < sos->fields; i++) {
+    sos->binds[i].buffer_type=MYSQL_TYPE_STRING;
+    sos->binds[i].buffer = LIBRDF_MALLOC(char*, 256);
+    if(!sos->binds[i].buffer)
+      return 1;
+    sos->binds[i].buffer_length=255;
+  }
+
+  if(mysql_stmt_bind_result(sos->stmt, sos->binds))
+    goto failed;
+
+  return 0;
+
+  failed:
+  librdf_log(sos->storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+             "MySQL cursor query failed: %s", mysql_stmt_error(sos->stmt));
+  return 1;
+}
+
+
+/*
+ * librdf_storage_mysql_find_statements_fetch_cursor_row - Fetch the next row from a cursor
+ * @sos: find statements context
+ *
+ * Return value: the row, valid until the next fetch, or NULL at the end or on failure
+ **/
+static char**
+librdf_storage_mysql_find_statements_fetch_cursor_row(librdf_storage_mysql_sos_context* sos)
+{
+  int rc;
+  int rebind=0;
+  unsigned int i;
+
+  rc=mysql_stmt_fetch(sos->stmt);
+  if(rc == MYSQL_NO_DATA)
+    return NULL;
+  if(rc && rc != MYSQL_DATA_TRUNCATED) {
+    librdf_log(sos->storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "MySQL cursor fetch failed: %s", mysql_stmt_error(sos->stmt));
+    return NULL;
+  }
+
+  for(i=0; i < sos->fields; i++) {
+    MYSQL_BIND* bind=&sos->binds[i];
+    unsigned long length=*bind->length;
+
+    if(*bind->is_null) {
+      sos->row[i]=NULL;
+      continue;
+    }
+
+    /* grow buffers of truncated values and fetch them again */
+    if(length > bind->buffer_length) {
+      char *buffer = LIBRDF_MALLOC(char*, length + 1);
+      if(!buffer)
+        return NULL;
+      LIBRDF_FREE(char*, bind->buffer);
+      bind->buffer=buffer;
+      bind->buffer_length=length;
+      if(mysql_stmt_fetch_column(sos->stmt, bind, i, 0)) {
+        librdf_log(sos->storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                   "MySQL cursor fetch failed: %s", mysql_stmt_error(sos->stmt));
+        return NULL;
+      }
+      rebind=1;
+    }
+
+    ((char*)bind->buffer)[length]='\0';
+    sos->row[i]=(char*)bind->buffer;
+  }
+
+  if(rebind && mysql_stmt_bind_result(sos->stmt, sos->binds))
+    return NULL;
+
+  return sos->row;
+}
+
+
 static int
 librdf_storage_mysql_find_statements_in_context_augment_query(char **query, 
                                                               const char *addition)
@@ -2332,7 +2809,10 @@ librdf_storage_mysql_find_statements_in_context_next_statement(void* context)
   librdf_node *node;
 
   /* Get next statement */
-  row=mysql_fetch_row(sos->results);
+  if(sos->stmt)
+    row=librdf_storage_mysql_find_statements_fetch_cursor_row(sos);
+  else
+    row=mysql_fetch_row(sos->results);
   if(row) {
     /* Get ready for context */
     if(sos->current_context)
@@ -2495,7 +2975,25 @@ librdf_storage_mysql_find_statements_in_context_finished(void* context)
   if(sos->results)
     mysql_free_result(sos->results);
 
-  if(sos->handle) {
+  if(sos->stmt)
+    mysql_stmt_close(sos->stmt);
+
+  if(sos->binds) {
+    unsigned int i;
+
+    for(i=0; i < sos->fields; i++) {
+      if(sos->binds[i].buffer)
+        LIBRDF_FREE(char*, sos->binds[i].buffer);
+    }
+    LIBRDF_FREE(MYSQL_BIND*, sos->binds);
+  }
+
+  if(sos->row)
+    LIBRDF_FREE(char**, sos->row);
+
+  /* the transaction connection is released when the transaction ends
+   * and may already be back in the pool */
+  if(sos->handle && !sos->is_transaction) {
     librdf_storage_mysql_release_handle(sos->storage, sos->handle);
   }
 
@@ -2735,7 +3233,6 @@ static int
 librdf_storage_mysql_transaction_start(librdf_storage* storage) 
 {
   librdf_storage_mysql_instance* context=(librdf_storage_mysql_instance* )storage->instance;
-  int i;
   
   if(context->transaction_handle) {
     librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
@@ -2747,19 +3244,7 @@ librdf_storage_mysql_transaction_start(librdf_storage* storage)
   if(!context->transaction_handle) 
     return 1;
 
-  for(i=0; i<= TABLE_STATEMENTS; i++)
-    context->pending_inserts[i] = raptor_new_sequence((raptor_data_free_handler)free_pending_row, NULL);
-
-  context->pending_insert_hash_nodes=librdf_new_hash(storage->world, NULL);
-  if(!context->pending_insert_hash_nodes)
-    LIBRDF_FATAL1(storage->world, LIBRDF_FROM_STORAGE, 
-                  "Failed to create MySQL seen nodes hash from factory");
-  
-  if(librdf_hash_open(context->pending_insert_hash_nodes, NULL, 0, 1, 1, NULL))
-    LIBRDF_FATAL1(storage->world, LIBRDF_FROM_STORAGE,
-                  "Failed to open MySQL seen nodes hash");
-
-  context->pending_statements = raptor_new_sequence((raptor_data_free_handler)free_pending_row, NULL);
+  librdf_storage_mysql_pending_init(storage);
 
   return 0;
 }
@@ -2793,7 +3278,6 @@ void librdf_storage_mysql_transaction_terminate(librdf_storage *storage)
 {
   librdf_storage_mysql_instance* context=(librdf_storage_mysql_instance* )storage->instance;
   MYSQL* handle=context->transaction_handle;
-  int i;
   
   if(!handle)
     return;
@@ -2801,25 +3285,8 @@ void librdf_storage_mysql_transaction_terminate(librdf_storage *storage)
   context->transaction_handle=NULL;
 
   librdf_storage_mysql_release_handle(storage, handle);
-  
-  for(i=0; i<= TABLE_STATEMENTS; i++) {
-    raptor_sequence* seq;
-    seq=context->pending_inserts[i];
-    if(seq)
-      raptor_free_sequence(seq);
-    context->pending_inserts[i]=NULL;
-  }
-  
-  if(context->pending_insert_hash_nodes) {
-    librdf_free_hash(context->pending_insert_hash_nodes);
-    context->pending_insert_hash_nodes=NULL;
-  }
 
-  if(context->pending_statements) {
-    raptor_free_sequence(context->pending_statements);
-    context->pending_statements=NULL;
-  }
-  
+  librdf_storage_mysql_pending_free(storage);
 }
 
 
@@ -2841,8 +3308,6 @@ librdf_storage_mysql_transaction_commit(librdf_storage* storage)
   int i;
   size_t query_len;
   const char start_query[]="START TRANSACTION";
-  const table_info *table;
-  raptor_stringbuffer* sb=NULL;
   int count=0;
 
   handle=context->transaction_handle;
@@ -2883,102 +3348,10 @@ librdf_storage_mysql_transaction_commit(librdf_storage* storage)
     return 1;
   }
 
-  /* INSERT node values */
-  for(i=0; i< TABLE_STATEMENTS; i++) {
-    raptor_sequence* seq;
-    raptor_stringbuffer* tsb;
-
-    seq=context->pending_inserts[i];
-    table=&mysql_tables[i];
-
-    /* sort pending nodes to always be inserted in same order */
-    raptor_sequence_sort(seq, compare_pending_rows);
-
-    tsb=format_pending_row_sequence(table, seq);
-    if(!tsb)
-      continue;
-
-    query_len=raptor_stringbuffer_length(tsb);
-    query=(char*)raptor_stringbuffer_as_string(tsb);
-    
-#ifdef LIBRDF_DEBUG_SQL
-    LIBRDF_DEBUG2("SQL: >>%s<<\n", query);
-#endif
-    if(mysql_real_query(context->transaction_handle, query, query_len)) {
-      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                 "MySQL query to table %s failed: %s", table->name,
-                 mysql_error(context->transaction_handle));
-      raptor_free_stringbuffer(tsb);
-      librdf_storage_mysql_transaction_rollback(storage);    
-      return 1;
-    }
-    
-    raptor_free_stringbuffer(tsb);
-  }
-
-
-  /* INSERT STATEMENT* */
-  if(raptor_sequence_size(context->pending_statements)) {
-    char uint64_buffer[64];
-    raptor_sequence* seq;
-    
-    table=&mysql_tables[TABLE_STATEMENTS];
-
-    /* sort pending statements to always be inserted in same order */
-    raptor_sequence_sort(context->pending_statements, 
-                         compare_pending_rows);
-    
-    sb=raptor_new_stringbuffer();
-    
-    raptor_stringbuffer_append_string(sb, (const unsigned char*)"REPLACE INTO Statements", 1);
-    sprintf(uint64_buffer, UINT64_T_FMT, context->model);
-    raptor_stringbuffer_append_string(sb, (const unsigned char*)uint64_buffer, 1);
-    raptor_stringbuffer_append_counted_string(sb, (const unsigned char*)" (", 2, 1);
-    raptor_stringbuffer_append_string(sb, (const unsigned char*)table->columns, 1);
-    raptor_stringbuffer_append_counted_string(sb, (const unsigned char*)") VALUES ", 9, 1);
-
-    seq=context->pending_statements;
-    for(i=0; i< raptor_sequence_size(seq); i++) {
-      pending_row* prow=(pending_row*)raptor_sequence_get_at(seq, i);
-      int j;
-
-      if(i > 0)
-        raptor_stringbuffer_append_counted_string(sb,
-                                             (const unsigned char*)", ", 2, 1);
-      
-      raptor_stringbuffer_append_counted_string(sb,
-                                             (const unsigned char*)"(", 1, 1);
-
-      for(j=0; j < 4; j++) {
-        if(j > 0)
-          raptor_stringbuffer_append_counted_string(sb,
-                                             (const unsigned char*)", ", 2, 1);
-        sprintf(uint64_buffer, UINT64_T_FMT, prow->uints[j]);
-        raptor_stringbuffer_append_string(sb,
-                                       (const unsigned char*)uint64_buffer, 1);
-      }
-
-      raptor_stringbuffer_append_counted_string(sb,
-                                             (const unsigned char*)")", 1, 1);
-    }
-    
-    query=(char*)raptor_stringbuffer_as_string(sb);
-    if(query) {
-#ifdef LIBRDF_DEBUG_SQL
-      LIBRDF_DEBUG2("SQL: >>%s<<\n", query);
-#endif
-      if(mysql_real_query(handle, query, strlen(query)) &&
-         mysql_errno(handle) != ER_DUP_ENTRY) {
-        librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                   "MySQL insert into %s failed with error %s",
-                   table->name, mysql_error(handle));
-        raptor_free_stringbuffer(sb);
-        librdf_storage_mysql_transaction_rollback(storage);    
-        return 1;
-      }
-    }
+  if(librdf_storage_mysql_pending_flush(storage, handle, "REPLACE INTO ")) {
+    librdf_storage_mysql_transaction_rollback(storage);
+    return 1;
   }
-  
 
   /* COMMIT */
 #ifdef LIBRDF_DEBUG_SQL
@@ -2988,9 +3361,6 @@ librdf_storage_mysql_transaction_commit(librdf_storage* storage)
 
   librdf_storage_mysql_transaction_terminate(storage);
 
-  if(sb)
-    raptor_free_stringbuffer(sb);
-
   return (status != 0);
 }
 
@@ -56,8 +56,61 @@ typedef struct {
   /* A postgresql connection */
   librdf_storage_postgresql_connection_status status;
   PGconn *handle;
+  /* bit set of prepared statements (librdf_storage_postgresql_prepared_id)
+   * and of prepared find query shapes on this connection */
+  unsigned int prepared;
+  unsigned int find_prepared;
 } librdf_storage_postgresql_connection;
 
+typedef enum {
+  /* Statements prepared on first use on each connection */
+  LIBRDF_STORAGE_POSTGRESQL_INSERT_RESOURCE,
+  LIBRDF_STORAGE_POSTGRESQL_INSERT_LITERAL,
+  LIBRDF_STORAGE_POSTGRESQL_INSERT_BNODE,
+  LIBRDF_STORAGE_POSTGRESQL_INSERT_STATEMENT,
+  LIBRDF_STORAGE_POSTGRESQL_ADD_STATEMENT,
+  LIBRDF_STORAGE_POSTGRESQL_CONTAINS_STATEMENT,
+  LIBRDF_STORAGE_POSTGRESQL_DELETE_STATEMENT,
+  LIBRDF_STORAGE_POSTGRESQL_DELETE_CONTEXT_STATEMENT,
+  LIBRDF_STORAGE_POSTGRESQL_PREPARED_COUNT
+} librdf_storage_postgresql_prepared_id;
+
+/* Node IDs are passed as text and cast; node strings as binary text.
+ * The model ID is substituted in for every UINT64_T_FMT. */
+static const struct {
+  const char *name;
+  const char *sql;
+  int params;
+} librdf_storage_postgresql_prepared[LIBRDF_STORAGE_POSTGRESQL_PREPARED_COUNT]={
+  { "redland_insert_resource",
+    "INSERT INTO Resources (ID,URI) SELECT $1::numeric,$2::text WHERE NOT EXISTS (SELECT 1 FROM Resources WHERE ID=$1::numeric)",
+    2 },
+  { "redland_insert_literal",
+    "INSERT INTO Literals (ID,Value,Language,Datatype) SELECT $1::numeric,$2::text,$3::text,$4::text WHERE NOT EXISTS (SELECT 1 FROM Literals WHERE ID=$1::numeric)",
+    4 },
+  { "redland_insert_bnode",
+    "INSERT INTO Bnodes (ID,Name) SELECT $1::numeric,$2::text WHERE NOT EXISTS (SELECT 1 FROM Bnodes WHERE ID=$1::numeric)",
+    2 },
+  { "redland_insert_statement",
+    "INSERT INTO Statements" UINT64_T_FMT " (Subject,Predicate,Object,Context) VALUES ($1,$2,$3,$4)",
+    4 },
+  { "redland_add_statement",
+    "INSERT INTO Statements" UINT64_T_FMT " (Subject,Predicate,Object,Context) SELECT $1::numeric,$2::numeric,$3::numeric,$4::numeric WHERE NOT EXISTS (SELECT 1 FROM Statements" UINT64_T_FMT " WHERE Subject=$1::numeric AND Predicate=$2::numeric AND Object=$3::numeric)",
+    4 },
+  { "redland_contains_statement",
+    "SELECT 1 FROM Statements" UINT64_T_FMT " WHERE Subject=$1 AND Predicate=$2 AND Object=$3 LIMIT 1",
+    3 },
+  { "redland_delete_statement",
+    "DELETE FROM Statements" UINT64_T_FMT " WHERE Subject=$1 AND Predicate=$2 AND Object=$3",
+    3 },
+  { "redland_delete_context_statement",
+    "DELETE FROM Statements" UINT64_T_FMT " WHERE Subject=$1 AND Predicate=$2 AND Object=$3 AND Context=$4",
+    4 }
+};
+
+/* statements per pipeline sync when adding streams of statements */
+#define LIBRDF_STORAGE_POSTGRESQL_PIPELINE_BATCH 256
+
 typedef struct {
   /* postgresql connection parameters */
   char *host;
@@ -73,9 +126,12 @@ typedef struct {
   /* hash of model name in the database (table Models, column ID) */
   u64 model;
 
-  /* if inserts should be optimized by locking and index optimizations */
+  /* if stream inserts should be loaded with COPY via staging tables */
   int bulk;
 
+  /* statements per COPY batch in bulk mode */
+  int bulk_batch;
+
   /* if a table with merged models should be maintained */
   int merge;
 
@@ -86,6 +142,24 @@ typedef struct {
 
 } librdf_storage_postgresql_instance;
 
+/* growing buffer of rows in COPY text format */
+typedef struct {
+  char *data;
+  size_t length;
+  size_t size;
+} librdf_storage_postgresql_copy_buffer;
+
+/* pending rows for the staging tables in bulk mode */
+typedef struct {
+  librdf_storage_postgresql_copy_buffer resources;
+  librdf_storage_postgresql_copy_buffer literals;
+  librdf_storage_postgresql_copy_buffer bnodes;
+  librdf_storage_postgresql_copy_buffer statements;
+  int rows;
+} librdf_storage_postgresql_bulk_rows;
+
+#define LIBRDF_STORAGE_POSTGRESQL_DEFAULT_BULK_BATCH 50000
+
 /* prototypes for local functions */
 static int librdf_storage_postgresql_init(librdf_storage* storage, const char *name,
                                           librdf_hash* options);
@@ -168,8 +242,19 @@ static u64 librdf_storage_postgresql_hash(librdf_storage* storage,
                                           const char *string, size_t length);
 static u64 librdf_storage_postgresql_node_hash(librdf_storage* storage,
                                                librdf_node* node, int add);
-static int librdf_storage_postgresql_start_bulk(librdf_storage* storage);
+static u64 librdf_storage_postgresql_node_hash_value(librdf_storage* storage,
+                                                     librdf_node* node);
+static int librdf_storage_postgresql_start_bulk(librdf_storage* storage, PGconn *handle);
 static int librdf_storage_postgresql_stop_bulk(librdf_storage* storage);
+static int librdf_storage_postgresql_bulk_add_statements(librdf_storage* storage,
+                                                         u64 ctxt,
+                                                         librdf_stream* statement_stream);
+#ifdef LIBPQ_HAS_PIPELINING
+static int librdf_storage_postgresql_pipeline_add_statements(librdf_storage* storage,
+                                                             PGconn *handle,
+                                                             u64 ctxt,
+                                                             librdf_stream* statement_stream);
+#endif
 static int librdf_storage_postgresql_context_add_statement_helper(librdf_storage* storage,
                                                                   u64 ctxt,
                                                                   librdf_statement* statement);
@@ -374,6 +459,8 @@ librdf_storage_postgresql_get_handle(librdf_storage* storage)
   if(conninfo) {
     sprintf(conninfo,coninfo_template,context->host,context->port,context->dbname,context->user,context->password);
     connection->handle=PQconnectdb(conninfo);
+    connection->prepared=0;
+    connection->find_prepared=0;
     if(connection->handle) {
     	if( PQstatus(connection->handle) == CONNECTION_OK ) {
         connection->status=LIBRDF_STORAGE_POSTGRESQL_CONNECTION_BUSY;
@@ -425,6 +512,152 @@ librdf_storage_postgresql_release_handle(librdf_storage* storage, PGconn *handle
 }
 
 
+/*
+ * librdf_storage_postgresql_get_connection:
+ * @storage: the storage
+ * @handle: postgresql connection handle
+ *
+ * INTERNAL - Find the pooled connection for a handle
+ *
+ * Return value: connection or NULL if the handle is not pooled
+ **/
+static librdf_storage_postgresql_connection*
+librdf_storage_postgresql_get_connection(librdf_storage* storage,
+                                         PGconn *handle)
+{
+  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
+  int i;
+
+  for(i=0; i < context->connections_count; i++) {
+    if(LIBRDF_STORAGE_POSTGRESQL_CONNECTION_CLOSED != context->connections[i].status &&
+       context->connections[i].handle == handle)
+      return &context->connections[i];
+  }
+
+  return NULL;
+}
+
+
+/*
+ * librdf_storage_postgresql_prepare:
+ * @storage: the storage
+ * @handle: postgresql connection handle
+ * @prepared: bit set of statements already prepared on the connection or NULL
+ * @bit: bit for this statement in @prepared
+ * @name: statement name
+ * @sql: statement SQL
+ * @params: number of parameters
+ *
+ * INTERNAL - Prepare a statement on a connection unless already done
+ *
+ * Return value: Non-zero on failure.
+ **/
+static int
+librdf_storage_postgresql_prepare(librdf_storage* storage, PGconn *handle,
+                                  unsigned int *prepared, unsigned int bit,
+                                  const char *name, const char *sql,
+                                  int params)
+{
+  PGresult *res;
+  int status=1;
+
+  if(prepared && (*prepared & bit))
+    return 0;
+
+  if((res=PQprepare(handle, name, sql, params, NULL))) {
+    if(PQresultStatus(res) == PGRES_COMMAND_OK) {
+      status=0;
+      if(prepared)
+        *prepared |= bit;
+    } else
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "postgresql prepare %s failed: %s", name,
+                 PQresultErrorMessage(res));
+    PQclear(res);
+  } else {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "postgresql prepare %s failed: %s", name,
+               PQerrorMessage(handle));
+  }
+
+  return status;
+}
+
+
+/*
+ * librdf_storage_postgresql_prepare_statement:
+ * @storage: the storage
+ * @handle: postgresql connection handle
+ * @id: statement to prepare
+ *
+ * INTERNAL - Prepare one of the fixed statements on a connection
+ *
+ * Statements are cached per pooled connection so each is parsed and
+ * planned once per connection.
+ *
+ * Return value: Non-zero on failure.
+ **/
+static int
+librdf_storage_postgresql_prepare_statement(librdf_storage* storage,
+                                            PGconn *handle,
+                                            librdf_storage_postgresql_prepared_id id)
+{
+  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
+  librdf_storage_postgresql_connection* connection;
+  const char *sql=librdf_storage_postgresql_prepared[id].sql;
+  char *query;
+  int status;
+
+  connection=librdf_storage_postgresql_get_connection(storage, handle);
+  if(connection && (connection->prepared & (1U << id)))
+    return 0;
+
+  query = LIBRDF_MALLOC(char*, strlen(sql) + (20 * 2) + 1);
+  if(!query)
+    return 1;
+  /* extra arguments are ignored by statements naming the model once */
+  sprintf(query, sql, context->model, context->model);
+
+  status=librdf_storage_postgresql_prepare(storage, handle,
+                                           connection ? &connection->prepared : NULL,
+                                           1U << id,
+                                           librdf_storage_postgresql_prepared[id].name,
+                                           query,
+                                           librdf_storage_postgresql_prepared[id].params);
+  LIBRDF_FREE(char*, query);
+
+  return status;
+}
+
+
+/*
+ * librdf_storage_postgresql_exec_prepared:
+ * @storage: the storage
+ * @handle: postgresql connection handle
+ * @id: statement to run
+ * @values: parameter values
+ * @lengths: parameter lengths for binary parameters or NULL
+ * @formats: parameter formats (0 text, 1 binary) or NULL for all text
+ *
+ * INTERNAL - Run one of the fixed statements, preparing it if needed
+ *
+ * Return value: result (to free with PQclear()) or NULL on failure
+ **/
+static PGresult*
+librdf_storage_postgresql_exec_prepared(librdf_storage* storage, PGconn *handle,
+                                        librdf_storage_postgresql_prepared_id id,
+                                        const char * const *values,
+                                        const int *lengths, const int *formats)
+{
+  if(librdf_storage_postgresql_prepare_statement(storage, handle, id))
+    return NULL;
+
+  return PQexecPrepared(handle, librdf_storage_postgresql_prepared[id].name,
+                        librdf_storage_postgresql_prepared[id].params,
+                        values, lengths, formats, 0);
+}
+
+
 /*
  * librdf_storage_postgresql_init:
  * @storage: the storage
@@ -433,9 +666,11 @@ librdf_storage_postgresql_release_handle(librdf_storage* storage, PGconn *handle
  *
  * INTERNAL - Create connection to database.  Defaults to port 5432 if not given.
  *
- * The boolean bulk option can be set to true if optimized inserts (table
- * locks and temporary key disabling) is wanted. Note that this will block
- * all other access, and requires table locking and alter table privileges.
+ * The boolean bulk option can be set to true if streams of statements
+ * should be loaded with COPY into temporary staging tables and merged in
+ * batches of bulk-batch statements (default 50000).  Duplicate statements
+ * are not checked for against the existing ones and PostgreSQL 9.5 or
+ * later is needed for INSERT ... ON CONFLICT.
  *
  * The boolean merge option can be set to true if a merged "view" of all
  * models should be maintained. This "view" will be a table with TYPE=MERGE.
@@ -692,6 +927,9 @@ librdf_storage_postgresql_init(librdf_storage* storage, const char *name,
 
   /* Optimize loads? */
   context->bulk=(librdf_hash_get_as_boolean(options, "bulk")>0);
+  context->bulk_batch=(int)librdf_hash_get_as_long(options, "bulk-batch");
+  if(context->bulk_batch <= 0)
+    context->bulk_batch=LIBRDF_STORAGE_POSTGRESQL_DEFAULT_BULK_BATCH;
 
   /* Truncate model? */
    if(!status && (librdf_hash_get_as_boolean(options, "new")>0))
@@ -976,88 +1214,28 @@ librdf_storage_postgresql_add_statements(librdf_storage* storage,
 }
 
 /*
- * librdf_storage_postgresql_node_hash - Create hash value for node
+ * librdf_storage_postgresql_node_hash_value - Find hash value for node
  * @storage: the storage
- * @node: a node to get hash for (and possibly create in database)
- * @add: whether to add the node to the database
+ * @node: a node to get hash for
+ *
+ * Computes the ID of the node used in the Resources, Literals and
+ * Bnodes tables without touching the database.
  *
  * Return value: Non-zero on succes.
  **/
 static u64
-librdf_storage_postgresql_node_hash(librdf_storage* storage,
-                               librdf_node* node,
-                               int add)
+librdf_storage_postgresql_node_hash_value(librdf_storage* storage,
+                                          librdf_node* node)
 {
   librdf_node_type type=librdf_node_get_type(node);
-  u64 hash;
+  u64 hash=0;
   size_t nodelen;
-  char *query;
-  PGconn *handle;
-  PGresult *res;
-
-  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 0);
-  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(node, librdf_node, 0);
-
-  /* Get postgresql connection handle */
-  handle=librdf_storage_postgresql_get_handle(storage);
-  if(!handle)
-    return 0;
 
   if(type==LIBRDF_NODE_TYPE_RESOURCE) {
-    /* Get hash */
     unsigned char *uri=librdf_uri_as_counted_string(librdf_node_get_uri(node), &nodelen);
     hash = librdf_storage_postgresql_hash(storage, "R", (char*)uri, nodelen);
 
-    if(add) {
-      char create_resource[]="INSERT INTO Resources (ID,URI) VALUES (" UINT64_T_FMT ",'%s')";
-      int add_status = 0;
-      char *escaped_uri;
-
-      escaped_uri = LIBRDF_MALLOC(char*, nodelen * 2 + 1);
-      if(escaped_uri) {
-        int error = 0;
-        PQescapeStringConn(handle, escaped_uri,
-                           (const char*)uri, nodelen,
-                           &error);
-        if(error) {
-          librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                     "postgresql escapeStringConn() failed: %s",
-                     PQerrorMessage(handle));
-        }
-
-        query = LIBRDF_MALLOC(char*, strlen(create_resource) + 20 + nodelen + 1);
-        if(query) {
-          sprintf(query, create_resource, hash, escaped_uri);
-          if((res=PQexec(handle, query))) {
-            if(PQresultStatus(res) == PGRES_COMMAND_OK) {
-              add_status = 1;
-            } else {
-              if (0 == strncmp("23505", PQresultErrorField(res, PG_DIAG_SQLSTATE), strlen("23505"))) {
-                /* Don't care about unique key viloations */
-                add_status = 1;
-              } else {
-                librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                           "postgresql insert into Resources failed: %s",
-                           PQresultErrorMessage(res));
-              }
-            }
-            PQclear(res);
-          } else {
-            librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                       "postgresql insert into Resources failed");
-          }
-          LIBRDF_FREE(char*, query);
-        }
-        LIBRDF_FREE(char*, escaped_uri);
-      }
-      if(!add_status) {
-        librdf_storage_postgresql_release_handle(storage, handle);
-        return 0;
-      }
-    }
-
   } else if(type==LIBRDF_NODE_TYPE_LITERAL) {
-    /* Get hash */
     unsigned char *value, *datatype=0;
     char *lang, *nodestring;
     librdf_uri *dt;
@@ -1075,10 +1253,8 @@ librdf_storage_postgresql_node_hash(librdf_storage* storage,
 
     /* Create composite node string for hash generation */
     nodestring = LIBRDF_MALLOC(char*, valuelen + langlen + datatypelen + 3);
-    if(!nodestring) {
-      librdf_storage_postgresql_release_handle(storage, handle);
+    if(!nodestring)
       return 0;
-    }
     strcpy(nodestring, (const char*)value);
     strcat(nodestring, "<");
     if(lang)
@@ -1090,168 +1266,215 @@ librdf_storage_postgresql_node_hash(librdf_storage* storage,
     hash = librdf_storage_postgresql_hash(storage, "L", nodestring, nodelen);
     LIBRDF_FREE(char*, nodestring);
 
-    if(add) {
-      char create_literal[]="INSERT INTO Literals (ID,Value,Language,Datatype) VALUES (" UINT64_T_FMT ",'%s','%s','%s')";
-      int add_status = 0;
-      char *escaped_value, *escaped_lang, *escaped_datatype;
-
-      escaped_value = LIBRDF_MALLOC(char*, valuelen * 2 + 1);
-      if(escaped_value) {
-        int error = 0;
-        PQescapeStringConn(handle, escaped_value,
-                           (const char*)value, valuelen,
-                           &error);
-        if(error) {
-          librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                     "postgresql escapeStringConn() failed: %s",
-                     PQerrorMessage(handle));
-        }
-
-        escaped_lang = LIBRDF_MALLOC(char*, langlen * 2 + 1);
-        if(escaped_lang) {
-          if(lang) {
-            PQescapeStringConn(handle, escaped_lang,
-                               (const char*)lang, langlen,
-                               &error);
-            if(error) {
-              librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                         "postgresql escapeStringConn() failed: %s",
-                         PQerrorMessage(handle));
-            }
-          } else
-            strcpy(escaped_lang,"");
-
-          escaped_datatype = LIBRDF_MALLOC(char*, datatypelen * 2 + 1);
-          if(escaped_datatype) {
-            if(datatype) {
-              PQescapeStringConn(handle, escaped_datatype,
-                                 (const char*)datatype, datatypelen,
-                                 &error);
-              if(error) {
-                librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                           "postgresql escapeStringConn() failed: %s",
-                           PQerrorMessage(handle));
-              }
-            } else
-              strcpy(escaped_datatype,"");
-
-            query = LIBRDF_MALLOC(char*,
-                                  strlen(create_literal) +
-                                  strlen(escaped_value) +
-                                  strlen(escaped_lang) +
-                                  strlen(escaped_datatype) + 21);
-            if(query) {
-              sprintf(query, create_literal, hash, escaped_value, escaped_lang, escaped_datatype);
-              if((res=PQexec(handle, query))) {
-                if(PQresultStatus(res) == PGRES_COMMAND_OK) {
-                  add_status = 1;
-                } else {
-                  if (0 == strncmp("23505", PQresultErrorField(res, PG_DIAG_SQLSTATE), strlen("23505"))) {
-                    /* Don't care about unique key viloations */
-                    add_status = 1;
-                  } else {
-                    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                               "postgresql insert into Resources failed: %s",
-                               PQresultErrorMessage(res));
-                  }
-                }
-                PQclear(res);
-              } else {
-                librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                           "postgresql insert into Resources failed");
-              }
-              LIBRDF_FREE(char*, query);
-            }
-            LIBRDF_FREE(char*, escaped_datatype);
-          }
-          LIBRDF_FREE(char*, escaped_lang);
-        }
-        LIBRDF_FREE(char*, escaped_value);
-      }
-      if(!add_status) {
-        librdf_storage_postgresql_release_handle(storage, handle);
-        return 0;
-      }
-    }
-
   } else if(type==LIBRDF_NODE_TYPE_BLANK) {
-    /* Get hash */
     unsigned char *name = librdf_node_get_blank_identifier(node);
     nodelen = strlen((const char*)name);
     hash = librdf_storage_postgresql_hash(storage, "B", (char*)name, nodelen);
+  }
 
-    if(add) {
-      char create_bnode[]="INSERT INTO Bnodes (ID,Name) VALUES (" UINT64_T_FMT ",'%s')";
-      int add_status = 0;
-      char *escaped_name;
-
-      escaped_name = LIBRDF_MALLOC(char*, nodelen * 2 + 1);
-      if(escaped_name) {
-        int error = 0;
-        PQescapeStringConn(handle, escaped_name,
-                           (const char*)name, nodelen,
-                           &error);
-        if(error) {
-          librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                     "postgresql escapeStringConn() failed: %s",
-                     PQerrorMessage(handle));
-        }
+  return hash;
+}
 
-        query = LIBRDF_MALLOC(char*, strlen(create_bnode) + 20 + nodelen + 1);
-        if(query) {
-          sprintf(query, create_bnode, hash, escaped_name);
-          if((res=PQexec(handle, query))) {
-            if(PQresultStatus(res) == PGRES_COMMAND_OK) {
-              add_status = 1;
-            } else {
-              if (0 == strncmp("23505", PQresultErrorField(res, PG_DIAG_SQLSTATE), strlen("23505"))) {
-                /* Don't care about unique key viloations */
-                add_status = 1;
-              } else {
-                librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                           "postgresql insert into Resources failed: %s",
-                           PQresultErrorMessage(res));
-              }
-            }
-            PQclear(res);
-          } else {
-            librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                       "postgresql insert into Bnodes failed");
-          }
-          LIBRDF_FREE(char*, query);
-        }
-        LIBRDF_FREE(char*, escaped_name);
-      }
-      if(!add_status) {
-        librdf_storage_postgresql_release_handle(storage, handle);
-        return 0;
+
+/*
+ * librdf_storage_postgresql_node_params:
+ * @node: the node
+ * @id: the node hash as a decimal string
+ * @values: parameter values (4)
+ * @lengths: parameter lengths (4)
+ * @formats: parameter formats (4)
+ *
+ * INTERNAL - Set the parameters of the statement adding a node
+ *
+ * Return value: statement to run or LIBRDF_STORAGE_POSTGRESQL_PREPARED_COUNT for an unknown node type
+ **/
+static librdf_storage_postgresql_prepared_id
+librdf_storage_postgresql_node_params(librdf_node* node, const char *id,
+                                      const char **values, int *lengths,
+                                      int *formats)
+{
+  librdf_node_type type=librdf_node_get_type(node);
+  size_t len;
+  int i;
+
+  values[0]=id;
+  lengths[0]=0;
+  formats[0]=0;
+  for(i=1; i < 4; i++) {
+    values[i]="";
+    lengths[i]=0;
+    formats[i]=1;
+  }
+
+  if(type==LIBRDF_NODE_TYPE_RESOURCE) {
+    values[1]=(const char*)librdf_uri_as_counted_string(librdf_node_get_uri(node), &len);
+    lengths[1]=LIBRDF_BAD_CAST(int, len);
+    return LIBRDF_STORAGE_POSTGRESQL_INSERT_RESOURCE;
+  } else if(type==LIBRDF_NODE_TYPE_LITERAL) {
+    char *lang;
+    librdf_uri *dt;
+
+    values[1]=(const char*)librdf_node_get_literal_value_as_counted_string(node, &len);
+    lengths[1]=LIBRDF_BAD_CAST(int, len);
+    lang=librdf_node_get_literal_value_language(node);
+    if(lang) {
+      values[2]=lang;
+      lengths[2]=LIBRDF_BAD_CAST(int, strlen(lang));
+    }
+    dt=librdf_node_get_literal_value_datatype_uri(node);
+    if(dt) {
+      values[3]=(const char*)librdf_uri_as_counted_string(dt, &len);
+      lengths[3]=LIBRDF_BAD_CAST(int, len);
+    }
+    return LIBRDF_STORAGE_POSTGRESQL_INSERT_LITERAL;
+  } else if(type==LIBRDF_NODE_TYPE_BLANK) {
+    values[1]=(const char*)librdf_node_get_blank_identifier(node);
+    lengths[1]=LIBRDF_BAD_CAST(int, strlen(values[1]));
+    return LIBRDF_STORAGE_POSTGRESQL_INSERT_BNODE;
+  }
+
+  /* Some node type we don't know about? */
+  return LIBRDF_STORAGE_POSTGRESQL_PREPARED_COUNT;
+}
+
+
+/*
+ * librdf_storage_postgresql_node_hash - Create hash value for node
+ * @storage: the storage
+ * @node: a node to get hash for (and possibly create in database)
+ * @add: whether to add the node to the database
+ *
+ * Return value: Non-zero on succes.
+ **/
+static u64
+librdf_storage_postgresql_node_hash(librdf_storage* storage,
+                               librdf_node* node,
+                               int add)
+{
+  librdf_storage_postgresql_prepared_id id;
+  const char *values[4];
+  int lengths[4];
+  int formats[4];
+  char hash_string[21];
+  u64 hash;
+  PGconn *handle;
+  PGresult *res;
+  int add_status = 0;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 0);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(node, librdf_node, 0);
+
+  hash=librdf_storage_postgresql_node_hash_value(storage, node);
+  if(!hash || !add)
+    return hash;
+
+  sprintf(hash_string, UINT64_T_FMT, hash);
+  id=librdf_storage_postgresql_node_params(node, hash_string,
+                                           values, lengths, formats);
+  if(id == LIBRDF_STORAGE_POSTGRESQL_PREPARED_COUNT)
+    return 0;
+
+  /* Get postgresql connection handle */
+  handle=librdf_storage_postgresql_get_handle(storage);
+  if(!handle)
+    return 0;
+
+  if((res=librdf_storage_postgresql_exec_prepared(storage, handle, id, values,
+                                                  lengths, formats))) {
+    if(PQresultStatus(res) == PGRES_COMMAND_OK) {
+      add_status = 1;
+    } else {
+      const char *state=PQresultErrorField(res, PG_DIAG_SQLSTATE);
+      if (state && 0 == strncmp("23505", state, strlen("23505"))) {
+        /* Don't care about unique key viloations from concurrent adds */
+        add_status = 1;
+      } else {
+        librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                   "postgresql %s failed: %s",
+                   librdf_storage_postgresql_prepared[id].name,
+                   PQresultErrorMessage(res));
       }
     }
+    PQclear(res);
   } else {
-    /* Some node type we don't know about? */
-    librdf_storage_postgresql_release_handle(storage, handle);
-    return 0;
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "postgresql %s failed: %s",
+               librdf_storage_postgresql_prepared[id].name,
+               PQerrorMessage(handle));
   }
 
   librdf_storage_postgresql_release_handle(storage, handle);
 
-  return hash;
+  return add_status ? hash : 0;
+}
+
+
+/*
+ * librdf_storage_postgresql_exec_command:
+ * @storage: the storage
+ * @handle: postgresql connection handle
+ * @query: SQL command(s) returning no rows
+ *
+ * INTERNAL - Run SQL commands, logging any failure
+ *
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_postgresql_exec_command(librdf_storage* storage,
+                                       PGconn *handle, const char *query)
+{
+  PGresult *res;
+  int status=1;
+
+  if((res=PQexec(handle, query))) {
+    if(PQresultStatus(res) == PGRES_COMMAND_OK)
+      status=0;
+    else
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "postgresql command failed: %s",
+                 PQresultErrorMessage(res));
+    PQclear(res);
+  } else {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "postgresql command failed: %s",
+               PQerrorMessage(handle));
+  }
+
+  return status;
 }
 
 
 /*
  * librdf_storage_postgresql_start_bulk:
  * @storage: the storage
+ * @handle: postgresql connection handle
  *
  * INTERNAL - Prepare for bulk insert operation
  *
+ * Creates empty temporary staging tables on the connection that
+ * are filled with COPY and merged into the real tables.
+ *
  * Return value: Non-zero on failure.
  */
 static int
-librdf_storage_postgresql_start_bulk(librdf_storage* storage)
+librdf_storage_postgresql_start_bulk(librdf_storage* storage, PGconn *handle)
 {
-
-  return 1;
+  const char create_staging_tables[]="\
+CREATE TEMPORARY TABLE IF NOT EXISTS redland_bulk_resources (\
+  ID numeric(20) NOT NULL, URI text NOT NULL);\
+CREATE TEMPORARY TABLE IF NOT EXISTS redland_bulk_literals (\
+  ID numeric(20) NOT NULL, Value text NOT NULL,\
+  Language text NOT NULL, Datatype text NOT NULL);\
+CREATE TEMPORARY TABLE IF NOT EXISTS redland_bulk_bnodes (\
+  ID numeric(20) NOT NULL, Name text NOT NULL);\
+CREATE TEMPORARY TABLE IF NOT EXISTS redland_bulk_statements (\
+  Subject numeric(20) NOT NULL, Predicate numeric(20) NOT NULL,\
+  Object numeric(20) NOT NULL, Context numeric(20) NOT NULL);\
+TRUNCATE redland_bulk_resources, redland_bulk_literals,\
+  redland_bulk_bnodes, redland_bulk_statements";
+
+  return librdf_storage_postgresql_exec_command(storage, handle,
+                                                create_staging_tables);
 }
 
 
@@ -1261,68 +1484,658 @@ librdf_storage_postgresql_start_bulk(librdf_storage* storage)
  *
  * INTERNAL - End bulk insert operation
  *
+ * Nothing to do since every batch is merged before
+ * librdf_storage_postgresql_bulk_add_statements() returns and the
+ * staging tables go away with the connection.
+ *
  * Return value: Non-zero on failure.
  */
 static int
 librdf_storage_postgresql_stop_bulk(librdf_storage* storage)
 {
-  return 1;
+  return 0;
 }
 
 
 /*
- * librdf_storage_postgresql_context_add_statements:
- * @storage: the storage
- * @context_node: #librdf_node object
- * @statement_stream: the stream of statements
+ * librdf_storage_postgresql_copy_buffer_append:
+ * @buffer: COPY buffer
+ * @string: string to append
+ * @length: length of string
+ * @escape: non-0 to escape as a COPY text format field
  *
- * INTERNAL - Add statements in stream to storage, with context.
+ * INTERNAL - Append to a COPY buffer
  *
  * Return value: Non-zero on failure.
- **/
+ */
 static int
-librdf_storage_postgresql_context_add_statements(librdf_storage* storage,
-                                            librdf_node* context_node,
-                                            librdf_stream* statement_stream)
+librdf_storage_postgresql_copy_buffer_append(librdf_storage_postgresql_copy_buffer* buffer,
+                                             const char *string, size_t length,
+                                             int escape)
 {
-  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
-  u64 ctxt=0;
-  int helper=0;
+  size_t i;
 
-  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 1);
-  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(statement_stream, librdf_stream, 1);
+  /* worst case every character is escaped */
+  if(buffer->length + length * 2 + 1 > buffer->size) {
+    size_t size=buffer->size ? buffer->size : 1024;
+    char *data;
 
-  /* Optimize for bulk loads? */
-  if(context->bulk) {
-    if(librdf_storage_postgresql_start_bulk(storage))
+    while(size < buffer->length + length * 2 + 1)
+      size <<= 1;
+    data = LIBRDF_MALLOC(char*, size);
+    if(!data)
       return 1;
+    if(buffer->data) {
+      memcpy(data, buffer->data, buffer->length);
+      LIBRDF_FREE(char*, buffer->data);
+    }
+    buffer->data=data;
+    buffer->size=size;
   }
 
-  /* Find hash for context, creating if necessary */
-  if(context_node) {
-    ctxt=librdf_storage_postgresql_node_hash(storage,context_node,1);
-    if(!ctxt)
-      return 1;
+  if(!escape) {
+    memcpy(buffer->data + buffer->length, string, length);
+    buffer->length += length;
+    return 0;
   }
 
-  while(!helper && !librdf_stream_end(statement_stream)) {
-    librdf_statement* statement=librdf_stream_get_object(statement_stream);
-    if(!context->bulk) {
-      /* Do not add duplicate statements
-       * but do not check for this when in bulk mode.
-       */
-      if(librdf_storage_postgresql_contains_statement(storage, statement)) {
-        librdf_stream_next(statement_stream);
-        continue;
+  for(i=0; i < length; i++) {
+    char c=string[i];
+    switch(c) {
+      case '\\':
+        buffer->data[buffer->length++]='\\';
+        buffer->data[buffer->length++]='\\';
+        break;
+      case '\t':
+        buffer->data[buffer->length++]='\\';
+        buffer->data[buffer->length++]='t';
+        break;
+      case '\n':
+        buffer->data[buffer->length++]='\\';
+        buffer->data[buffer->length++]='n';
+        break;
+      case '\r':
+        buffer->data[buffer->length++]='\\';
+        buffer->data[buffer->length++]='r';
+        break;
+      default:
+        buffer->data[buffer->length++]=c;
+    }
+  }
+
+  return 0;
+}
+
+
+/*
+ * librdf_storage_postgresql_bulk_add_node:
+ * @storage: the storage
+ * @rows: pending bulk rows
+ * @node: node to add
+ *
+ * INTERNAL - Add a row for a node to the right staging table buffer
+ *
+ * Return value: the node hash or 0 on failure
+ */
+static u64
+librdf_storage_postgresql_bulk_add_node(librdf_storage* storage,
+                                        librdf_storage_postgresql_bulk_rows* rows,
+                                        librdf_node* node)
+{
+  librdf_node_type type;
+  librdf_storage_postgresql_copy_buffer* buffer;
+  const char *string;
+  size_t length;
+  char id[21];
+  u64 hash;
+  int status;
+
+  hash=librdf_storage_postgresql_node_hash_value(storage, node);
+  if(!hash)
+    return 0;
+  sprintf(id, UINT64_T_FMT, hash);
+
+  type=librdf_node_get_type(node);
+  if(type == LIBRDF_NODE_TYPE_RESOURCE) {
+    buffer=&rows->resources;
+    string=(const char*)librdf_uri_as_counted_string(librdf_node_get_uri(node),
+                                                     &length);
+  } else if(type == LIBRDF_NODE_TYPE_LITERAL) {
+    buffer=&rows->literals;
+    string=(const char*)librdf_node_get_literal_value_as_counted_string(node,
+                                                                        &length);
+  } else {
+    buffer=&rows->bnodes;
+    string=(const char*)librdf_node_get_blank_identifier(node);
+    length=strlen(string);
+  }
+
+  status=librdf_storage_postgresql_copy_buffer_append(buffer, id, strlen(id), 0) ||
+         librdf_storage_postgresql_copy_buffer_append(buffer, "\t", 1, 0) ||
+         librdf_storage_postgresql_copy_buffer_append(buffer, string, length, 1);
+
+  if(!status && type == LIBRDF_NODE_TYPE_LITERAL) {
+    const char *lang=librdf_node_get_literal_value_language(node);
+    librdf_uri *dt=librdf_node_get_literal_value_datatype_uri(node);
+
+    status=librdf_storage_postgresql_copy_buffer_append(buffer, "\t", 1, 0);
+    if(!status && lang)
+      status=librdf_storage_postgresql_copy_buffer_append(buffer, lang,
+                                                          strlen(lang), 1);
+    if(!status)
+      status=librdf_storage_postgresql_copy_buffer_append(buffer, "\t", 1, 0);
+    if(!status && dt) {
+      string=(const char*)librdf_uri_as_counted_string(dt, &length);
+      status=librdf_storage_postgresql_copy_buffer_append(buffer, string,
+                                                          length, 1);
+    }
+  }
+
+  if(!status)
+    status=librdf_storage_postgresql_copy_buffer_append(buffer, "\n", 1, 0);
+
+  return status ? 0 : hash;
+}
+
+
+/*
+ * librdf_storage_postgresql_copy_in:
+ * @storage: the storage
+ * @handle: postgresql connection handle
+ * @table: staging table name
+ * @buffer: rows in COPY text format
+ *
+ * INTERNAL - Send a buffer of rows to a table with COPY FROM STDIN
+ *
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_postgresql_copy_in(librdf_storage* storage, PGconn *handle,
+                                  const char *table,
+                                  librdf_storage_postgresql_copy_buffer* buffer)
+{
+  char copy_from_stdin[]="COPY %s FROM STDIN";
+  char *query;
+  PGresult *res;
+  int status=1;
+
+  if(!buffer->length)
+    return 0;
+
+  query = LIBRDF_MALLOC(char*, strlen(copy_from_stdin) + strlen(table) + 1);
+  if(!query)
+    return 1;
+  sprintf(query, copy_from_stdin, table);
+
+  res=PQexec(handle, query);
+  LIBRDF_FREE(char*, query);
+  if(!res || PQresultStatus(res) != PGRES_COPY_IN) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "postgresql COPY into %s failed: %s", table,
+               res ? PQresultErrorMessage(res) : PQerrorMessage(handle));
+    if(res)
+      PQclear(res);
+    return 1;
+  }
+  PQclear(res);
+
+  if(PQputCopyData(handle, buffer->data, LIBRDF_BAD_CAST(int, buffer->length)) == 1 &&
+     PQputCopyEnd(handle, NULL) == 1)
+    status=0;
+  else
+    PQputCopyEnd(handle, "redland bulk load failed");
+
+  /* collect the COPY result */
+  while((res=PQgetResult(handle))) {
+    if(PQresultStatus(res) != PGRES_COMMAND_OK) {
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "postgresql COPY into %s failed: %s", table,
+                 PQresultErrorMessage(res));
+      status=1;
+    }
+    PQclear(res);
+  }
+
+  buffer->length=0;
+
+  return status;
+}
+
+
+/*
+ * librdf_storage_postgresql_bulk_flush:
+ * @storage: the storage
+ * @handle: postgresql connection handle
+ * @rows: pending bulk rows
+ *
+ * INTERNAL - COPY pending rows to the staging tables and merge them
+ *
+ * Return value: Non-zero on failure.
+ */
+static int
+librdf_storage_postgresql_bulk_flush(librdf_storage* storage, PGconn *handle,
+                                     librdf_storage_postgresql_bulk_rows* rows)
+{
+  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
+  const char merge_nodes[]="\
+INSERT INTO Resources (ID,URI)\
+  SELECT DISTINCT ON (ID) ID,URI FROM redland_bulk_resources\
+  ON CONFLICT DO NOTHING;\
+INSERT INTO Literals (ID,Value,Language,Datatype)\
+  SELECT DISTINCT ON (ID) ID,Value,Language,Datatype FROM redland_bulk_literals\
+  ON CONFLICT DO NOTHING;\
+INSERT INTO Bnodes (ID,Name)\
+  SELECT DISTINCT ON (ID) ID,Name FROM redland_bulk_bnodes\
+  ON CONFLICT DO NOTHING";
+  const char merge_statements[]="\
+INSERT INTO Statements" UINT64_T_FMT " (Subject,Predicate,Object,Context)\
+  SELECT DISTINCT Subject,Predicate,Object,Context FROM redland_bulk_statements;\
+TRUNCATE redland_bulk_resources, redland_bulk_literals,\
+  redland_bulk_bnodes, redland_bulk_statements";
+  char *query;
+  int status;
+
+  if(!rows->rows)
+    return 0;
+
+  status=librdf_storage_postgresql_copy_in(storage, handle,
+                                           "redland_bulk_resources",
+                                           &rows->resources) ||
+         librdf_storage_postgresql_copy_in(storage, handle,
+                                           "redland_bulk_literals",
+                                           &rows->literals) ||
+         librdf_storage_postgresql_copy_in(storage, handle,
+                                           "redland_bulk_bnodes",
+                                           &rows->bnodes) ||
+         librdf_storage_postgresql_copy_in(storage, handle,
+                                           "redland_bulk_statements",
+                                           &rows->statements);
+
+  if(!status)
+    status=librdf_storage_postgresql_exec_command(storage, handle,
+                                                  merge_nodes);
+
+  if(!status) {
+    query = LIBRDF_MALLOC(char*, strlen(merge_statements) + 20 + 1);
+    if(!query)
+      return 1;
+    sprintf(query, merge_statements, context->model);
+    status=librdf_storage_postgresql_exec_command(storage, handle, query);
+    LIBRDF_FREE(char*, query);
+  }
+
+  rows->resources.length=0;
+  rows->literals.length=0;
+  rows->bnodes.length=0;
+  rows->statements.length=0;
+  rows->rows=0;
+
+  return status;
+}
+
+
+/*
+ * librdf_storage_postgresql_bulk_add_statements:
+ * @storage: the storage
+ * @ctxt: u64 context hash
+ * @statement_stream: the stream of statements
+ *
+ * INTERNAL - Add statements in stream to storage using COPY
+ *
+ * The rows for the nodes and statements are streamed into temporary
+ * staging tables with COPY FROM STDIN in batches and merged into the
+ * real tables with INSERT ... SELECT, ignoring nodes already present.
+ * Unless a transaction is active, the whole stream is added in one
+ * transaction.
+ *
+ * Return value: Non-zero on failure.
+ **/
+static int
+librdf_storage_postgresql_bulk_add_statements(librdf_storage* storage,
+                                              u64 ctxt,
+                                              librdf_stream* statement_stream)
+{
+  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
+  librdf_storage_postgresql_bulk_rows rows;
+  PGconn *handle;
+  int own_transaction;
+  int status=0;
+
+  handle=librdf_storage_postgresql_get_handle(storage);
+  if(!handle)
+    return 1;
+
+  own_transaction=(context->transaction_handle == NULL);
+  if(own_transaction &&
+     librdf_storage_postgresql_exec_command(storage, handle, "BEGIN")) {
+    librdf_storage_postgresql_release_handle(storage, handle);
+    return 1;
+  }
+
+  memset(&rows, '\0', sizeof(rows));
+
+  status=librdf_storage_postgresql_start_bulk(storage, handle);
+
+  while(!status && !librdf_stream_end(statement_stream)) {
+    librdf_statement* statement=librdf_stream_get_object(statement_stream);
+    u64 subject, predicate, object;
+    char row[(20 + 1) * 4 + 1];
+
+    subject=librdf_storage_postgresql_bulk_add_node(storage, &rows,
+                                                    librdf_statement_get_subject(statement));
+    predicate=librdf_storage_postgresql_bulk_add_node(storage, &rows,
+                                                      librdf_statement_get_predicate(statement));
+    object=librdf_storage_postgresql_bulk_add_node(storage, &rows,
+                                                   librdf_statement_get_object(statement));
+    if(!subject || !predicate || !object) {
+      status=1;
+      break;
+    }
+
+    sprintf(row, UINT64_T_FMT "\t" UINT64_T_FMT "\t" UINT64_T_FMT "\t" UINT64_T_FMT "\n",
+            subject, predicate, object, ctxt);
+    status=librdf_storage_postgresql_copy_buffer_append(&rows.statements, row,
+                                                        strlen(row), 0);
+
+    if(!status && ++rows.rows >= context->bulk_batch)
+      status=librdf_storage_postgresql_bulk_flush(storage, handle, &rows);
+
+    librdf_stream_next(statement_stream);
+  }
+
+  if(!status)
+    status=librdf_storage_postgresql_bulk_flush(storage, handle, &rows);
+
+  if(!status)
+    status=librdf_storage_postgresql_stop_bulk(storage);
+
+  if(own_transaction)
+    librdf_storage_postgresql_exec_command(storage, handle,
+                                           status ? "ROLLBACK" : "COMMIT");
+
+  if(rows.resources.data)
+    LIBRDF_FREE(char*, rows.resources.data);
+  if(rows.literals.data)
+    LIBRDF_FREE(char*, rows.literals.data);
+  if(rows.bnodes.data)
+    LIBRDF_FREE(char*, rows.bnodes.data);
+  if(rows.statements.data)
+    LIBRDF_FREE(char*, rows.statements.data);
+
+  librdf_storage_postgresql_release_handle(storage, handle);
+
+  return status;
+}
+
+
+#ifdef LIBPQ_HAS_PIPELINING
+/*
+ * librdf_storage_postgresql_pipeline_sync:
+ * @storage: the storage
+ * @handle: postgresql connection handle in pipeline mode
+ *
+ * INTERNAL - Sync the pipeline and collect the queued results
+ *
+ * Return value: Non-zero if any queued command failed.
+ **/
+static int
+librdf_storage_postgresql_pipeline_sync(librdf_storage* storage,
+                                        PGconn *handle)
+{
+  PGresult *res;
+  int empty=0;
+  int status=0;
+
+  if(PQpipelineSync(handle) != 1) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "postgresql pipeline sync failed: %s",
+               PQerrorMessage(handle));
+    return 1;
+  }
+
+  /* Each command result is followed by a NULL; the sync result ends
+   * the batch.  Two NULLs in a row means the connection went away. */
+  for(;;) {
+    ExecStatusType result_status;
+
+    res=PQgetResult(handle);
+    if(!res) {
+      if(++empty > 1) {
+        librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                   "postgresql pipeline failed: %s",
+                   PQerrorMessage(handle));
+        return 1;
+      }
+      continue;
+    }
+    empty=0;
+
+    result_status=PQresultStatus(res);
+    if(result_status == PGRES_PIPELINE_SYNC) {
+      PQclear(res);
+      break;
+    }
+    /* commands after a failed one are aborted; only log the failure */
+    if(result_status != PGRES_COMMAND_OK) {
+      if(!status && result_status != PGRES_PIPELINE_ABORTED)
+        librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                   "postgresql pipelined insert failed: %s",
+                   PQresultErrorMessage(res));
+      status=1;
+    }
+    PQclear(res);
+  }
+
+  return status;
+}
+
+
+/*
+ * librdf_storage_postgresql_pipeline_add_statements:
+ * @storage: the storage
+ * @handle: postgresql connection handle
+ * @ctxt: u64 context hash
+ * @statement_stream: the stream of statements
+ *
+ * INTERNAL - Add statements in a stream using pipelined prepared inserts
+ *
+ * The node and statement inserts are sent without waiting for their
+ * results and synced every LIBRDF_STORAGE_POSTGRESQL_PIPELINE_BATCH
+ * statements, which keeps the unread results small enough not to
+ * stall the blocking connection.  Statements already present in any
+ * context are not added again.
+ *
+ * Return value: Non-zero on failure.
+ **/
+static int
+librdf_storage_postgresql_pipeline_add_statements(librdf_storage* storage,
+                                                  PGconn *handle,
+                                                  u64 ctxt,
+                                                  librdf_stream* statement_stream)
+{
+  librdf_storage_postgresql_prepared_id id;
+  char context_string[21];
+  int queued=0;
+  int status=0;
+
+  /* statements cannot be prepared synchronously in pipeline mode */
+  for(id=LIBRDF_STORAGE_POSTGRESQL_INSERT_RESOURCE;
+      id <= LIBRDF_STORAGE_POSTGRESQL_ADD_STATEMENT; id++) {
+    if(id == LIBRDF_STORAGE_POSTGRESQL_INSERT_STATEMENT)
+      continue;
+    if(librdf_storage_postgresql_prepare_statement(storage, handle, id))
+      return 1;
+  }
+
+  if(PQenterPipelineMode(handle) != 1) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "postgresql pipeline mode failed: %s",
+               PQerrorMessage(handle));
+    return 1;
+  }
+
+  sprintf(context_string, UINT64_T_FMT, ctxt);
+
+  while(!status && !librdf_stream_end(statement_stream)) {
+    librdf_statement* statement=librdf_stream_get_object(statement_stream);
+    librdf_node* nodes[3];
+    char ids[3][21];
+    const char *values[4];
+    int lengths[4];
+    int formats[4];
+    int i;
+
+    nodes[0]=librdf_statement_get_subject(statement);
+    nodes[1]=librdf_statement_get_predicate(statement);
+    nodes[2]=librdf_statement_get_object(statement);
+    for(i=0; i < 3 && !status; i++) {
+      u64 hash=librdf_storage_postgresql_node_hash_value(storage, nodes[i]);
+
+      if(!hash) {
+        status=1;
+        break;
       }
+      sprintf(ids[i], UINT64_T_FMT, hash);
+      id=librdf_storage_postgresql_node_params(nodes[i], ids[i],
+                                               values, lengths, formats);
+      if(id == LIBRDF_STORAGE_POSTGRESQL_PREPARED_COUNT ||
+         PQsendQueryPrepared(handle, librdf_storage_postgresql_prepared[id].name,
+                             librdf_storage_postgresql_prepared[id].params,
+                             values, lengths, formats, 0) != 1)
+        status=1;
+    }
+
+    if(!status) {
+      values[0]=ids[0];
+      values[1]=ids[1];
+      values[2]=ids[2];
+      values[3]=context_string;
+      id=LIBRDF_STORAGE_POSTGRESQL_ADD_STATEMENT;
+      if(PQsendQueryPrepared(handle, librdf_storage_postgresql_prepared[id].name,
+                             librdf_storage_postgresql_prepared[id].params,
+                             values, NULL, NULL, 0) != 1)
+        status=1;
+    }
+
+    if(status) {
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "postgresql pipelined insert failed: %s",
+                 PQerrorMessage(handle));
+      break;
+    }
+
+    if(++queued == LIBRDF_STORAGE_POSTGRESQL_PIPELINE_BATCH) {
+      status=librdf_storage_postgresql_pipeline_sync(storage, handle);
+      queued=0;
     }
 
-    helper=librdf_storage_postgresql_context_add_statement_helper(storage, ctxt,
-                                                             statement);
     librdf_stream_next(statement_stream);
   }
 
-  return helper;
+  /* always sync so the pipeline can be left */
+  if(queued || status) {
+    if(librdf_storage_postgresql_pipeline_sync(storage, handle))
+      status=1;
+  }
+
+  PQexitPipelineMode(handle);
+
+  return status;
+}
+#endif
+
+
+/*
+ * librdf_storage_postgresql_context_add_statements:
+ * @storage: the storage
+ * @context_node: #librdf_node object
+ * @statement_stream: the stream of statements
+ *
+ * INTERNAL - Add statements in stream to storage, with context.
+ *
+ * Return value: Non-zero on failure.
+ **/
+static int
+librdf_storage_postgresql_context_add_statements(librdf_storage* storage,
+                                            librdf_node* context_node,
+                                            librdf_stream* statement_stream)
+{
+  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
+  u64 ctxt=0;
+  PGconn *handle;
+  int status=0;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, 1);
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(statement_stream, librdf_stream, 1);
+
+  /* Find hash for context, creating if necessary */
+  if(context_node) {
+    ctxt=librdf_storage_postgresql_node_hash(storage,context_node,1);
+    if(!ctxt)
+      return 1;
+  }
+
+  /* Optimize for bulk loads? */
+  if(context->bulk)
+    return librdf_storage_postgresql_bulk_add_statements(storage, ctxt,
+                                                         statement_stream);
+
+  handle=librdf_storage_postgresql_get_handle(storage);
+  if(!handle)
+    return 1;
+
+#ifdef LIBPQ_HAS_PIPELINING
+  status=librdf_storage_postgresql_pipeline_add_statements(storage, handle,
+                                                           ctxt,
+                                                           statement_stream);
+#else
+  while(!status && !librdf_stream_end(statement_stream)) {
+    librdf_statement* statement=librdf_stream_get_object(statement_stream);
+    librdf_node* nodes[3];
+    char ids[4][21];
+    const char *values[4];
+    PGresult *res;
+    int i;
+
+    nodes[0]=librdf_statement_get_subject(statement);
+    nodes[1]=librdf_statement_get_predicate(statement);
+    nodes[2]=librdf_statement_get_object(statement);
+    for(i=0; i < 3; i++) {
+      u64 hash;
+
+      hash=librdf_storage_postgresql_node_hash(storage, nodes[i], 1);
+      if(!hash)
+        break;
+      sprintf(ids[i], UINT64_T_FMT, hash);
+      values[i]=ids[i];
+    }
+    if(i < 3) {
+      status=1;
+      break;
+    }
+    sprintf(ids[3], UINT64_T_FMT, ctxt);
+    values[3]=ids[3];
+
+    /* Adds the statement unless already present in any context */
+    res=librdf_storage_postgresql_exec_prepared(storage, handle,
+                                                LIBRDF_STORAGE_POSTGRESQL_ADD_STATEMENT,
+                                                values, NULL, NULL);
+    if(!res || PQresultStatus(res) != PGRES_COMMAND_OK) {
+      librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "postgresql insert into Statements failed: %s",
+                 res ? PQresultErrorMessage(res) : PQerrorMessage(handle));
+      status=1;
+    }
+    if(res)
+      PQclear(res);
+
+    librdf_stream_next(statement_stream);
+  }
+#endif
+
+  librdf_storage_postgresql_release_handle(storage, handle);
+
+  return status;
 }
 
 
@@ -1372,8 +2185,6 @@ static int
 librdf_storage_postgresql_context_add_statement_helper(librdf_storage* storage,
                                           u64 ctxt, librdf_statement* statement)
 {
-  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
-  char insert_statement[]="INSERT INTO Statements" UINT64_T_FMT " (Subject,Predicate,Object,Context) VALUES (" UINT64_T_FMT "," UINT64_T_FMT "," UINT64_T_FMT "," UINT64_T_FMT ")";
   u64 subject, predicate, object;
   PGconn *handle;
   int status = 1;
@@ -1392,27 +2203,34 @@ librdf_storage_postgresql_context_add_statement_helper(librdf_storage* storage,
     object=librdf_storage_postgresql_node_hash(storage,
                                           librdf_statement_get_object(statement),1);
     if(subject && predicate && object) {
-      char *query;
+      char ids[4][21];
+      const char *values[4];
       PGresult *res;
 
-      query = LIBRDF_MALLOC(char*, strlen(insert_statement) + (20 * 5) + 1);
-      if(query) {
-        sprintf(query, insert_statement, context->model, subject, predicate, object, ctxt);
-        if((res=PQexec(handle, query))) {
-          if(PQresultStatus(res) == PGRES_COMMAND_OK) {
-            status = 0;
-          } else {
-            librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                       "postgresql insert into Statements failed: %s",
-                       PQresultErrorMessage(res));
-          }
-          PQclear(res);
+      sprintf(ids[0], UINT64_T_FMT, subject);
+      sprintf(ids[1], UINT64_T_FMT, predicate);
+      sprintf(ids[2], UINT64_T_FMT, object);
+      sprintf(ids[3], UINT64_T_FMT, ctxt);
+      values[0]=ids[0];
+      values[1]=ids[1];
+      values[2]=ids[2];
+      values[3]=ids[3];
+
+      if((res=librdf_storage_postgresql_exec_prepared(storage, handle,
+                                                      LIBRDF_STORAGE_POSTGRESQL_INSERT_STATEMENT,
+                                                      values, NULL, NULL))) {
+        if(PQresultStatus(res) == PGRES_COMMAND_OK) {
+          status = 0;
         } else {
           librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
                      "postgresql insert into Statements failed: %s",
-                     PQerrorMessage(handle));
+                     PQresultErrorMessage(res));
         }
-        LIBRDF_FREE(char*, query);
+        PQclear(res);
+      } else {
+        librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                   "postgresql insert into Statements failed: %s",
+                   PQerrorMessage(handle));
       }
     }
     librdf_storage_postgresql_release_handle(storage, handle);
@@ -1435,8 +2253,6 @@ static int
 librdf_storage_postgresql_contains_statement(librdf_storage* storage,
                                              librdf_statement* statement)
 {
-  librdf_storage_postgresql_instance* context = (librdf_storage_postgresql_instance*)storage->instance;
-  char find_statement[]="SELECT 1 FROM Statements" UINT64_T_FMT " WHERE Subject=" UINT64_T_FMT " AND Predicate=" UINT64_T_FMT " AND Object=" UINT64_T_FMT " limit 1";
   u64 subject, predicate, object;
   PGconn *handle;
   int status = 0;
@@ -1456,26 +2272,30 @@ librdf_storage_postgresql_contains_statement(librdf_storage* storage,
                                           librdf_statement_get_object(statement),0);
 
     if(subject && predicate && object) {
-      char *query;
-      size_t len = strlen(find_statement)+(20*4)+1;
-      query = LIBRDF_MALLOC(char*, len);
-      if(query) {
-        PGresult *res;
-        snprintf(query, len, find_statement, context->model,
-                 subject, predicate, object);
-        if((res=PQexec(handle, query))) {
-          if(PQresultStatus(res) == PGRES_TUPLES_OK) {
-            if(PQntuples(res)) {
-              status = 1;
-            }
-          } else {
-            librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                       "postgresql insert into Statements failed: %s",
-                       PQresultErrorMessage(res));
+      char ids[3][21];
+      const char *values[3];
+      PGresult *res;
+
+      sprintf(ids[0], UINT64_T_FMT, subject);
+      sprintf(ids[1], UINT64_T_FMT, predicate);
+      sprintf(ids[2], UINT64_T_FMT, object);
+      values[0]=ids[0];
+      values[1]=ids[1];
+      values[2]=ids[2];
+
+      if((res=librdf_storage_postgresql_exec_prepared(storage, handle,
+                                                      LIBRDF_STORAGE_POSTGRESQL_CONTAINS_STATEMENT,
+                                                      values, NULL, NULL))) {
+        if(PQresultStatus(res) == PGRES_TUPLES_OK) {
+          if(PQntuples(res)) {
+            status = 1;
           }
-          PQclear(res);
+        } else {
+          librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                     "postgresql select from Statements failed: %s",
+                     PQresultErrorMessage(res));
         }
-        LIBRDF_FREE(char*, query);
+        PQclear(res);
       }
     }
     librdf_storage_postgresql_release_handle(storage, handle);
@@ -1516,9 +2336,6 @@ librdf_storage_postgresql_context_remove_statement(librdf_storage* storage,
                                              librdf_node* context_node,
                                              librdf_statement* statement)
 {
-  librdf_storage_postgresql_instance* context=(librdf_storage_postgresql_instance*)storage->instance;
-  char delete_statement[]="DELETE FROM Statements" UINT64_T_FMT " WHERE Subject=" UINT64_T_FMT " AND Predicate=" UINT64_T_FMT " AND Object=" UINT64_T_FMT;
-  char delete_statement_with_context[]="DELETE FROM Statements" UINT64_T_FMT " WHERE Subject=" UINT64_T_FMT " AND Predicate=" UINT64_T_FMT " AND Object=" UINT64_T_FMT " AND Context=" UINT64_T_FMT;
   u64 subject, predicate, object, ctxt=0;
   PGconn *handle=NULL;
   int status = 1;
@@ -1535,41 +2352,41 @@ librdf_storage_postgresql_context_remove_statement(librdf_storage* storage,
                                              librdf_statement_get_predicate(statement),0);
     object=librdf_storage_postgresql_node_hash(storage,
                                           librdf_statement_get_object(statement),0);
+    if(context_node)
+      ctxt=librdf_storage_postgresql_node_hash(storage,context_node,0);
 
-    if (subject && predicate && object) {
-      char *query=NULL;
-      if(context_node) {
-        ctxt=librdf_storage_postgresql_node_hash(storage,context_node,0);
-        if(ctxt) {
-          query = LIBRDF_MALLOC(char*,
-                                strlen(delete_statement_with_context) + (20 * 5) + 1);
-  if(query) {
-            sprintf(query, delete_statement_with_context, context->model, subject, predicate, object, ctxt);
-          }
-        }
-      } else {
-        query = LIBRDF_MALLOC(char*, strlen(delete_statement) + (20 * 4) + 1);
-        if(query) {
-          sprintf(query, delete_statement, context->model, subject, predicate, object);
-        }
-      }
-      if(query) {
-        PGresult *res=NULL;
-        if((res=PQexec(handle, query))) {
-          if(PQresultStatus(res) == PGRES_COMMAND_OK) {
-            status = 0;
-          } else {
-            librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                       "postgresql delete from Statements failed: %s",
-                       PQresultErrorMessage(res));
-          }
-          PQclear(res);
+    if (subject && predicate && object && (!context_node || ctxt)) {
+      librdf_storage_postgresql_prepared_id id;
+      char ids[4][21];
+      const char *values[4];
+      PGresult *res=NULL;
+
+      sprintf(ids[0], UINT64_T_FMT, subject);
+      sprintf(ids[1], UINT64_T_FMT, predicate);
+      sprintf(ids[2], UINT64_T_FMT, object);
+      sprintf(ids[3], UINT64_T_FMT, ctxt);
+      values[0]=ids[0];
+      values[1]=ids[1];
+      values[2]=ids[2];
+      values[3]=ids[3];
+      if(context_node)
+        id=LIBRDF_STORAGE_POSTGRESQL_DELETE_CONTEXT_STATEMENT;
+      else
+        id=LIBRDF_STORAGE_POSTGRESQL_DELETE_STATEMENT;
+
+      if((res=librdf_storage_postgresql_exec_prepared(storage, handle, id,
+                                                      values, NULL, NULL))) {
+        if(PQresultStatus(res) == PGRES_COMMAND_OK) {
+          status = 0;
         } else {
           librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
-                   "postgresql delete from Statements failed");
+                     "postgresql delete from Statements failed: %s",
+                     PQresultErrorMessage(res));
         }
-
-        LIBRDF_FREE(char*, query);
+        PQclear(res);
+      } else {
+        librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+                 "postgresql delete from Statements failed");
       }
     }
 
@@ -1745,6 +2562,11 @@ librdf_storage_postgresql_find_statements_with_options(librdf_storage* storage,
   char tmp[64];
   char where[256];
   char joins[640];
+  char ids[4][21];
+  const char *values[4];
+  int params=0;
+  /* bit set of bound parts selecting the prepared query */
+  unsigned int shape=0;
   librdf_stream *stream;
 
   LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(storage, librdf_storage, NULL);
@@ -1798,8 +2620,12 @@ librdf_storage_postgresql_find_statements_with_options(librdf_storage* storage,
 
   /* Subject */
   if(statement && subject) {
-    sprintf(tmp, "S.Subject=" UINT64_T_FMT "",
+    sprintf(ids[params], UINT64_T_FMT,
             librdf_storage_postgresql_node_hash(storage,subject,0));
+    values[params]=ids[params];
+    params++;
+    sprintf(tmp, "S.Subject=$%d", params);
+    shape |= 1;
     if(!strlen(where))
       strcat(where, " WHERE ");
     else
@@ -1816,8 +2642,12 @@ librdf_storage_postgresql_find_statements_with_options(librdf_storage* storage,
 
   /* Predicate */
   if(statement && predicate) {
-    sprintf(tmp, "S.Predicate=" UINT64_T_FMT "",
+    sprintf(ids[params], UINT64_T_FMT,
             librdf_storage_postgresql_node_hash(storage, predicate, 0));
+    values[params]=ids[params];
+    params++;
+    sprintf(tmp, "S.Predicate=$%d", params);
+    shape |= 2;
     if(!strlen(where))
       strcat(where, " WHERE ");
     else
@@ -1840,8 +2670,12 @@ librdf_storage_postgresql_find_statements_with_options(librdf_storage* storage,
   /* Object */
   if(statement && object) {
     if(!sos->is_literal_match) {
-      sprintf(tmp,"S.Object=" UINT64_T_FMT "",
+      sprintf(ids[params], UINT64_T_FMT,
               librdf_storage_postgresql_node_hash(storage, object, 0));
+      values[params]=ids[params];
+      params++;
+      sprintf(tmp, "S.Object=$%d", params);
+      shape |= 4;
       if(!strlen(where))
         strcat(where, " WHERE ");
       else
@@ -1895,8 +2729,12 @@ librdf_storage_postgresql_find_statements_with_options(librdf_storage* storage,
 
   /* Context */
   if(context_node) {
-    sprintf(tmp,"S.Context=" UINT64_T_FMT "",
+    sprintf(ids[params], UINT64_T_FMT,
             librdf_storage_postgresql_node_hash(storage,context_node,0));
+    values[params]=ids[params];
+    params++;
+    sprintf(tmp, "S.Context=$%d", params);
+    shape |= 8;
     if(!strlen(where))
       strcat(where, " WHERE ");
     else
@@ -1935,8 +2773,27 @@ librdf_storage_postgresql_find_statements_with_options(librdf_storage* storage,
   }
 
 
-  /* Start query... */
-  sos->results=PQexec(sos->handle, query);
+  /* Start query, preparing it once per connection for each shape
+   * unless matching literal text */
+  if(sos->is_literal_match)
+    sos->results=PQexecParams(sos->handle, query, params, NULL, values,
+                              NULL, NULL, 0);
+  else {
+    librdf_storage_postgresql_connection* connection;
+    char name[32];
+
+    sprintf(name, "redland_find_%u", shape);
+    connection=librdf_storage_postgresql_get_connection(storage, sos->handle);
+    if(librdf_storage_postgresql_prepare(storage, sos->handle,
+                                         connection ? &connection->find_prepared : NULL,
+                                         1U << shape, name, query, params)) {
+      LIBRDF_FREE(char*, query);
+      librdf_storage_postgresql_find_statements_in_context_finished((void*)sos);
+      return NULL;
+    }
+    sos->results=PQexecPrepared(sos->handle, name, params, values,
+                                NULL, NULL, 0);
+  }
   LIBRDF_FREE(char*, query);
   if (sos->results) {
     if (PQresultStatus(sos->results) != PGRES_TUPLES_OK) {
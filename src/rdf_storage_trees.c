@@ -41,8 +41,25 @@
 #include <stddef.h>
 #endif
 #include <sys/types.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <sys/mman.h>
+#define LIBRDF_STORAGE_TREES_USE_MMAP 1
+#endif
 
 #include <redland.h>
+#include <rdf_types.h>
 
 /* Not yet fully implemented (namely iteration) */
 /*#define RDF_STORAGE_TREES_WITH_CONTEXTS 1*/
@@ -56,6 +73,7 @@ typedef struct
   raptor_avltree* sop_tree; /* Optional */
   raptor_avltree* ops_tree; /* Optional */
   raptor_avltree* pso_tree; /* Optional */
+  raptor_avltree* value_tree; /* Optional, of librdf_storage_trees_value */
 } librdf_storage_trees_graph;
 
 typedef struct
@@ -67,8 +85,49 @@ typedef struct
   int index_sop;
   int index_ops;
   int index_pso;
+  int index_values;
+  /* name".snapshot" if option 'snapshot' was given, else NULL */
+  char* snapshot_name;
+  /* statements changed since the snapshot was read or written */
+  int dirty;
 } librdf_storage_trees_instance;
 
+
+/*
+ * Snapshot file layout, in the byte order of the writer:
+ *   librdf_storage_trees_snapshot_header
+ *   for each statement in (s, p, o) order: u32 length then the
+ *     librdf_statement_encode2() bytes, padded to 4 bytes
+ */
+typedef struct
+{
+  char magic[8];
+  u32 version;
+  /* LIBRDF_STORAGE_TREES_SNAPSHOT_BYTE_ORDER as written */
+  u32 byte_order;
+  u32 statements;
+  u32 reserved;
+} librdf_storage_trees_snapshot_header;
+
+/*
+ * Entry in the value index: a statement whose object is a literal
+ * with an ordered value, sorted by (predicate, kind, key, subject,
+ * object).  A search key has a NULL statement and a range instead.
+ */
+typedef struct
+{
+  librdf_statement* statement;
+  librdf_node* predicate;
+  librdf_node_value_kind kind;
+  double key;
+  librdf_node_value_range* range;
+} librdf_storage_trees_value;
+
+
+#define LIBRDF_STORAGE_TREES_SNAPSHOT_MAGIC "RDFTSNAP"
+#define LIBRDF_STORAGE_TREES_SNAPSHOT_VERSION 1
+#define LIBRDF_STORAGE_TREES_SNAPSHOT_BYTE_ORDER 0x01020304
+
 /* prototypes for local functions */
 static int librdf_storage_trees_init(librdf_storage* storage, const char *name, librdf_hash* options);
 static int librdf_storage_trees_open(librdf_storage* storage, librdf_model* model);
@@ -107,9 +166,15 @@ static int librdf_statement_compare_spo(const void* data1, const void* data2);
 static int librdf_statement_compare_sop(const void* data1, const void* data2);
 static int librdf_statement_compare_ops(const void* data1, const void* data2);
 static int librdf_statement_compare_pso(const void* data1, const void* data2);
+static int librdf_storage_trees_value_compare(const void* data1, const void* data2);
 static void librdf_storage_trees_avl_free(void* data);
+static void librdf_storage_trees_value_free(void* data);
 
 
+static int librdf_storage_trees_sync(librdf_storage* storage);
+static int librdf_storage_trees_snapshot_read(librdf_storage* storage);
+static int librdf_storage_trees_snapshot_write(librdf_storage* storage);
+
 static void librdf_storage_trees_register_factory(librdf_storage_factory *factory);
 
 
@@ -122,6 +187,7 @@ librdf_storage_trees_init(librdf_storage* storage, const char *name,
   const int index_sop_option = librdf_hash_get_as_boolean(options, "index-sop") > 0;
   const int index_ops_option = librdf_hash_get_as_boolean(options, "index-ops") > 0;
   const int index_pso_option = librdf_hash_get_as_boolean(options, "index-pso") > 0;
+  const int index_values_option = librdf_hash_get_as_boolean(options, "index-values") > 0;
 
   librdf_storage_trees_instance* context;
 
@@ -156,9 +222,30 @@ librdf_storage_trees_init(librdf_storage* storage, const char *name,
     context->index_ops=index_ops_option;
     context->index_pso=index_pso_option;
   }
+
+  /* value index is only made when asked for */
+  context->index_values=index_values_option;
   
   context->graph = librdf_storage_trees_graph_new(storage, NULL);
   
+  if(name && librdf_hash_get_as_boolean(options, "snapshot") > 0) {
+    size_t len = strlen(name);
+
+    /* name".snapshot\0" */
+    context->snapshot_name = LIBRDF_MALLOC(char*, len + 10);
+    if(context->snapshot_name) {
+      strcpy(context->snapshot_name, name);
+      strcpy(context->snapshot_name + len, ".snapshot");
+    }
+
+    if(!context->snapshot_name ||
+       librdf_storage_trees_snapshot_read(storage)) {
+      if(options)
+        librdf_free_hash(options);
+      return 1;
+    }
+  }
+
   /* no more options, might as well free them now */
   if(options)
     librdf_free_hash(options);
@@ -170,8 +257,15 @@ librdf_storage_trees_init(librdf_storage* storage, const char *name,
 static void
 librdf_storage_trees_terminate(librdf_storage* storage)
 {
-  if (storage->instance != NULL)
-    LIBRDF_FREE(librdf_storage_trees_instance, storage->instance);
+  librdf_storage_trees_instance* context=(librdf_storage_trees_instance*)storage->instance;
+
+  if (context == NULL)
+    return;
+
+  if(context->snapshot_name)
+    LIBRDF_FREE(char*, context->snapshot_name);
+
+  LIBRDF_FREE(librdf_storage_trees_instance, context);
 }
 
 
@@ -198,6 +292,9 @@ librdf_storage_trees_close(librdf_storage* storage)
 {
   librdf_storage_trees_instance* context=(librdf_storage_trees_instance*)storage->instance;
   
+  if(context->graph)
+    librdf_storage_trees_sync(storage);
+
   librdf_storage_trees_graph_free(context->graph);
   context->graph=NULL;
   
@@ -249,6 +346,26 @@ librdf_storage_trees_add_statement_internal(librdf_storage* storage,
   if (context->index_pso)
     raptor_avltree_add(graph->pso_tree, statement);
     
+  if (graph->value_tree) {
+    librdf_storage_trees_value value;
+
+    value.kind = librdf_node_get_literal_value_key(statement->object,
+                                                   &value.key);
+    if(value.kind != LIBRDF_NODE_VALUE_NONE) {
+      librdf_storage_trees_value* entry;
+
+      entry = LIBRDF_MALLOC(librdf_storage_trees_value*, sizeof(*entry));
+      if(entry) {
+        entry->statement = statement;
+        entry->predicate = statement->predicate;
+        entry->kind = value.kind;
+        entry->key = value.key;
+        entry->range = NULL;
+        raptor_avltree_add(graph->value_tree, entry);
+      }
+    }
+  }
+
   return status;
 }
 
@@ -269,6 +386,7 @@ librdf_storage_trees_add_statement(librdf_storage* storage,
                                    librdf_statement* statement) 
 {
   librdf_storage_trees_instance* context=(librdf_storage_trees_instance*)storage->instance;
+  context->dirty = 1;
   return librdf_storage_trees_add_statement_internal(storage, context->graph, statement);
 }
 
@@ -308,6 +426,19 @@ librdf_storage_trees_remove_statement_internal(librdf_storage_trees_graph* graph
   if (graph->pso_tree)
     raptor_avltree_delete(graph->pso_tree, statement);
   
+  if (graph->value_tree) {
+    librdf_storage_trees_value value;
+
+    value.kind = librdf_node_get_literal_value_key(statement->object,
+                                                   &value.key);
+    if(value.kind != LIBRDF_NODE_VALUE_NONE) {
+      value.statement = statement;
+      value.predicate = statement->predicate;
+      value.range = NULL;
+      raptor_avltree_delete(graph->value_tree, &value);
+    }
+  }
+
   raptor_avltree_delete(graph->spo_tree, statement);
   
   return 0;
@@ -330,6 +461,7 @@ librdf_storage_trees_remove_statement(librdf_storage* storage,
 {
   librdf_storage_trees_instance* context=(librdf_storage_trees_instance*)storage->instance;
 
+  context->dirty = 1;
   return librdf_storage_trees_remove_statement_internal(context->graph, statement);
 }
 
@@ -345,6 +477,8 @@ librdf_storage_trees_contains_statement(librdf_storage* storage, librdf_statemen
 typedef struct {
   librdf_storage *storage;
   raptor_avltree_iterator *avltree_iterator;
+  /* non 0 when iterating the value index */
+  int values;
 #ifdef RDF_STORAGE_TREES_WITH_CONTEXTS
   librdf_node *context_node;
 #endif
@@ -491,6 +625,12 @@ librdf_storage_trees_serialise_get_statement(void* context, int flags)
 
   switch(flags) {
     case LIBRDF_ITERATOR_GET_METHOD_GET_OBJECT:
+      if(scontext->values) {
+        librdf_storage_trees_value* value;
+
+        value = (librdf_storage_trees_value*)raptor_avltree_iterator_get(scontext->avltree_iterator);
+        return value ? value->statement : NULL;
+      }
       return (librdf_statement*)raptor_avltree_iterator_get(scontext->avltree_iterator);
 
 #ifdef RDF_STORAGE_TREES_WITH_CONTEXTS
@@ -641,6 +781,125 @@ librdf_storage_trees_find_statements(librdf_storage* storage, librdf_statement*
   return stream;
 }
 
+
+static void
+librdf_storage_trees_value_range_free(void* data)
+{
+  librdf_storage_trees_value* value=(librdf_storage_trees_value*)data;
+
+  librdf_free_node(value->predicate);
+  librdf_free_node_value_range(value->range);
+  LIBRDF_FREE(librdf_storage_trees_value, value);
+}
+
+
+/**
+ * librdf_storage_trees_find_statements_in_range:
+ * @storage: the storage
+ * @predicate: the predicate
+ * @min: lowest literal value or NULL
+ * @max: highest literal value or NULL
+ *
+ * .
+ * 
+ * Return a stream of statements with the predicate and a literal
+ * object with a value in the range, scanning the value index if
+ * the storage has one, otherwise filtering the statements with the
+ * predicate.
+ * 
+ * Return value: a #librdf_stream or NULL on failure
+ **/
+static librdf_stream*
+librdf_storage_trees_find_statements_in_range(librdf_storage* storage,
+                                              librdf_node* predicate,
+                                              librdf_node* min,
+                                              librdf_node* max)
+{
+  librdf_storage_trees_instance* context=(librdf_storage_trees_instance*)storage->instance;
+  librdf_storage_trees_serialise_stream_context* scontext;
+  librdf_storage_trees_value* key;
+  librdf_node_value_range* range;
+  librdf_stream* stream;
+
+  range=librdf_new_node_value_range(min, max);
+  if(!range) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "Range bounds are not comparable literal values");
+    return NULL;
+  }
+
+  if(!context->graph->value_tree) {
+    librdf_statement* statement;
+
+    statement=librdf_new_statement(storage->world);
+    if(!statement) {
+      librdf_free_node_value_range(range);
+      return NULL;
+    }
+    librdf_statement_set_predicate(statement,
+                                   librdf_new_node_from_node(predicate));
+
+    /* range takes ownership of statement */
+    stream=librdf_storage_trees_serialise_range(storage, statement);
+    if(!stream) {
+      librdf_free_node_value_range(range);
+      return NULL;
+    }
+
+    if(librdf_stream_add_map(stream, &librdf_stream_value_range_map,
+                             (librdf_stream_map_free_context_handler)&librdf_free_node_value_range,
+                             (void*)range)) {
+      /* error - stream_add_map failed and freed the range */
+      librdf_free_stream(stream);
+      stream=NULL;
+    }
+    return stream;
+  }
+
+  key = LIBRDF_CALLOC(librdf_storage_trees_value*, 1, sizeof(*key));
+  if(!key) {
+    librdf_free_node_value_range(range);
+    return NULL;
+  }
+  key->predicate = librdf_new_node_from_node(predicate);
+  key->kind = range->kind;
+  key->range = range;
+
+  scontext = LIBRDF_CALLOC(librdf_storage_trees_serialise_stream_context*, 1,
+                           sizeof(*scontext));
+  if(!scontext) {
+    librdf_storage_trees_value_range_free(key);
+    return NULL;
+  }
+
+  scontext->values = 1;
+  /* iterator takes ownership of key */
+  scontext->avltree_iterator = raptor_new_avltree_iterator(context->graph->value_tree,
+                                                           key,
+                                                           librdf_storage_trees_value_range_free,
+                                                           1);
+  if(!scontext->avltree_iterator) {
+    LIBRDF_FREE(librdf_storage_trees_serialise_stream_context, scontext);
+    return librdf_new_empty_stream(storage->world);
+  }
+
+  scontext->storage=storage;
+  librdf_storage_add_reference(scontext->storage);
+
+  stream=librdf_new_stream(storage->world,
+                           (void*)scontext,
+                           &librdf_storage_trees_serialise_end_of_stream,
+                           &librdf_storage_trees_serialise_next_statement,
+                           &librdf_storage_trees_serialise_get_statement,
+                           &librdf_storage_trees_serialise_finished);
+  if(!stream) {
+    librdf_storage_trees_serialise_finished((void*)scontext);
+    return NULL;
+  }
+
+  return stream;
+}
+
 /* statement tree functions */
 
 static int
@@ -848,6 +1107,39 @@ librdf_statement_compare_pso(const void* data1, const void* data2)
 }
 
 
+/* Compare two value index entries in (p, kind, key, s, o) order.
+ * A search key with a range matches every entry in the range. */
+static int
+librdf_storage_trees_value_compare(const void* data1, const void* data2)
+{
+  librdf_storage_trees_value* a = (librdf_storage_trees_value*)data1;
+  librdf_storage_trees_value* b = (librdf_storage_trees_value*)data2;
+  int cmp;
+
+  cmp = librdf_storage_trees_node_compare(a->predicate, b->predicate);
+  if (cmp != 0)
+    return cmp;
+
+  if (a->range)
+    return -librdf_node_value_range_compare(a->range, b->kind, b->key);
+  if (b->range)
+    return librdf_node_value_range_compare(b->range, a->kind, a->key);
+
+  if (a->kind != b->kind)
+    return (a->kind < b->kind) ? -1 : 1;
+  if (a->key != b->key)
+    return (a->key < b->key) ? -1 : 1;
+
+  cmp = librdf_storage_trees_node_compare(a->statement->subject,
+                                          b->statement->subject);
+  if (cmp != 0)
+    return cmp;
+
+  return librdf_storage_trees_node_compare(a->statement->object,
+                                           b->statement->object);
+}
+
+
 static void
 librdf_storage_trees_avl_free(void* data)
 {
@@ -856,6 +1148,13 @@ librdf_storage_trees_avl_free(void* data)
 }
 
 
+static void
+librdf_storage_trees_value_free(void* data)
+{
+  LIBRDF_FREE(librdf_storage_trees_value, data);
+}
+
+
 /* graph functions */
 
 static librdf_storage_trees_graph*
@@ -897,6 +1196,14 @@ librdf_storage_trees_graph_new(librdf_storage* storage, librdf_node* context_nod
   else
     graph->pso_tree=NULL;
 
+  /* value index entries point to the statements in the spo tree */
+  if(context->index_values)
+    graph->value_tree = raptor_new_avltree(librdf_storage_trees_value_compare,
+                                           librdf_storage_trees_value_free,
+                                           /* flags */ 0);
+  else
+    graph->value_tree=NULL;
+
   return graph;
 }
 
@@ -928,6 +1235,8 @@ librdf_storage_trees_graph_free(void* data)
     raptor_free_avltree(graph->ops_tree);
   if (graph->pso_tree)
     raptor_free_avltree(graph->pso_tree);
+  if (graph->value_tree)
+    raptor_free_avltree(graph->value_tree);
 
   /* Free spo tree and statements */
   raptor_free_avltree(graph->spo_tree);
@@ -936,11 +1245,265 @@ librdf_storage_trees_graph_free(void* data)
   graph->sop_tree = NULL;
   graph->ops_tree = NULL;
   graph->pso_tree = NULL;
+  graph->value_tree = NULL;
 
   LIBRDF_FREE(librdf_storage_trees_graph, graph);
 }
 
 
+/*
+ * librdf_storage_trees_snapshot_read - Add the statements in the snapshot
+ * @storage: the storage
+ *
+ * The file is mapped read-only (or read where mmap is not available)
+ * and the encoded statements decoded straight into the trees, which
+ * avoids parsing RDF syntax.  A missing file is not an error.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_storage_trees_snapshot_read(librdf_storage* storage)
+{
+  librdf_storage_trees_instance* context=(librdf_storage_trees_instance*)storage->instance;
+  const librdf_storage_trees_snapshot_header* header;
+  unsigned char* image = NULL;
+  size_t size;
+  size_t offset;
+  struct stat sb;
+  u32 i;
+  int fd;
+  int status = 1;
+
+  fd = open(context->snapshot_name, O_RDONLY);
+  if(fd < 0) {
+    if(errno == ENOENT)
+      return 0;
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "failed to open trees snapshot '%s' - %s",
+               context->snapshot_name, strerror(errno));
+    return 1;
+  }
+
+  if(fstat(fd, &sb) < 0 || (size_t)sb.st_size < sizeof(*header)) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "trees snapshot '%s' is too short", context->snapshot_name);
+    close(fd);
+    return 1;
+  }
+  size = (size_t)sb.st_size;
+
+#ifdef LIBRDF_STORAGE_TREES_USE_MMAP
+  image = (unsigned char*)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  if(image == (unsigned char*)MAP_FAILED)
+    image = NULL;
+#else
+  image = LIBRDF_MALLOC(unsigned char*, size);
+  if(image && read(fd, image, size) != (ssize_t)size) {
+    LIBRDF_FREE(char*, image);
+    image = NULL;
+  }
+#endif
+  close(fd);
+
+  if(!image) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "failed to read trees snapshot '%s' - %s",
+               context->snapshot_name, strerror(errno));
+    return 1;
+  }
+
+  header = (const librdf_storage_trees_snapshot_header*)image;
+  if(memcmp(header->magic, LIBRDF_STORAGE_TREES_SNAPSHOT_MAGIC, 8) ||
+     header->version != LIBRDF_STORAGE_TREES_SNAPSHOT_VERSION ||
+     header->byte_order != LIBRDF_STORAGE_TREES_SNAPSHOT_BYTE_ORDER) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "trees snapshot '%s' is not a valid snapshot for this system",
+               context->snapshot_name);
+    goto tidy;
+  }
+
+  offset = sizeof(*header);
+  for(i = 0; i < header->statements; i++) {
+    librdf_statement* statement;
+    u32 length;
+
+    if(offset + sizeof(u32) > size)
+      break;
+    length = *(const u32*)(image + offset);
+    offset += sizeof(u32);
+    if(offset + length > size)
+      break;
+
+    statement = librdf_new_statement(storage->world);
+    if(!statement)
+      break;
+    if(!librdf_statement_decode2(storage->world, statement, NULL,
+                                 image + offset, length) ||
+       librdf_storage_trees_add_statement_internal(storage, context->graph,
+                                                   statement) < 0) {
+      librdf_free_statement(statement);
+      break;
+    }
+    librdf_free_statement(statement);
+
+    offset += (length + 3) & ~3U;
+  }
+
+  if(i < header->statements)
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "trees snapshot '%s' is truncated or corrupt at statement %u",
+               context->snapshot_name, i);
+  else
+    status = 0;
+
+  tidy:
+#ifdef LIBRDF_STORAGE_TREES_USE_MMAP
+  munmap(image, size);
+#else
+  LIBRDF_FREE(char*, image);
+#endif
+
+  return status;
+}
+
+
+/*
+ * librdf_storage_trees_snapshot_write - Write all statements to the snapshot
+ * @storage: the storage
+ *
+ * Writes to the snapshot name with ".new" appended then renames it
+ * into place.
+ *
+ * Return value: non 0 on failure
+ */
+static int
+librdf_storage_trees_snapshot_write(librdf_storage* storage)
+{
+  librdf_storage_trees_instance* context=(librdf_storage_trees_instance*)storage->instance;
+  librdf_storage_trees_snapshot_header header;
+  raptor_avltree_iterator* iterator;
+  unsigned char* buffer = NULL;
+  size_t buffer_size = 0;
+  size_t len;
+  char* new_name;
+  FILE* fh;
+  int status = 1;
+
+  len = strlen(context->snapshot_name);
+  new_name = LIBRDF_MALLOC(char*, len + 5);
+  if(!new_name)
+    return 1;
+  strcpy(new_name, context->snapshot_name);
+  strcpy(new_name + len, ".new");
+
+  fh = fopen(new_name, "wb");
+  if(!fh) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "failed to open trees snapshot '%s' for writing - %s",
+               new_name, strerror(errno));
+    LIBRDF_FREE(char*, new_name);
+    return 1;
+  }
+
+  memset(&header, '\0', sizeof(header));
+  memcpy(header.magic, LIBRDF_STORAGE_TREES_SNAPSHOT_MAGIC, 8);
+  header.version = LIBRDF_STORAGE_TREES_SNAPSHOT_VERSION;
+  header.byte_order = LIBRDF_STORAGE_TREES_SNAPSHOT_BYTE_ORDER;
+  header.statements = (u32)raptor_avltree_size(context->graph->spo_tree);
+  if(fwrite(&header, sizeof(header), 1, fh) != 1)
+    goto tidy;
+
+  if(!header.statements) {
+    status = 0;
+    goto tidy;
+  }
+
+  iterator = raptor_new_avltree_iterator(context->graph->spo_tree,
+                                         NULL, NULL, 1);
+  while(iterator) {
+    librdf_statement* statement;
+    u32 length;
+    size_t padded;
+
+    statement = (librdf_statement*)raptor_avltree_iterator_get(iterator);
+    if(!statement)
+      break;
+
+    len = librdf_statement_encode2(storage->world, statement, NULL, 0);
+    padded = sizeof(u32) + ((len + 3) & ~(size_t)3);
+    if(padded > buffer_size) {
+      if(buffer)
+        LIBRDF_FREE(char*, buffer);
+      buffer_size = padded * 2;
+      buffer = LIBRDF_MALLOC(unsigned char*, buffer_size);
+      if(!buffer)
+        break;
+    }
+    memset(buffer, '\0', padded);
+
+    length = (u32)librdf_statement_encode2(storage->world, statement,
+                                           buffer + sizeof(u32), len);
+    memcpy(buffer, &length, sizeof(u32));
+    if(!length || fwrite(buffer, 1, padded, fh) != padded)
+      break;
+
+    if(raptor_avltree_iterator_next(iterator)) {
+      status = 0;
+      break;
+    }
+  }
+  if(iterator)
+    raptor_free_avltree_iterator(iterator);
+
+  tidy:
+  if(fclose(fh))
+    status = 1;
+
+  if(!status && rename(new_name, context->snapshot_name) < 0) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "rename of '%s' to '%s' failed - %s",
+               new_name, context->snapshot_name, strerror(errno));
+    status = 1;
+  }
+
+  if(status) {
+    librdf_log(storage->world, 0, LIBRDF_LOG_ERROR, LIBRDF_FROM_STORAGE, NULL,
+               "failed to write trees snapshot '%s'", new_name);
+    remove(new_name);
+  }
+
+  if(buffer)
+    LIBRDF_FREE(char*, buffer);
+  LIBRDF_FREE(char*, new_name);
+
+  return status;
+}
+
+
+/**
+ * librdf_storage_trees_sync:
+ * @storage: #librdf_storage object
+ *
+ * Write the snapshot file if there is one and the statements changed.
+ * 
+ * Return value: non 0 on failure
+ **/
+static int
+librdf_storage_trees_sync(librdf_storage* storage)
+{
+  librdf_storage_trees_instance* context=(librdf_storage_trees_instance*)storage->instance;
+
+  if(!context->snapshot_name || !context->dirty)
+    return 0;
+
+  if(librdf_storage_trees_snapshot_write(storage))
+    return 1;
+
+  context->dirty = 0;
+  return 0;
+}
+
+
 /**
  * librdf_storage_trees_get_feature:
  * @storage: #librdf_storage object
@@ -1004,6 +1567,7 @@ librdf_storage_trees_register_factory(librdf_storage_factory *factory)
    * Since these are exposed by model methods, the storage interface
    * needs to be fixed so these can be exposed but find_statements
    * still work */
+  factory->find_statements_in_range = librdf_storage_trees_find_statements_in_range;
   factory->find_sources             = NULL;
   factory->find_arcs                = NULL;
   factory->find_targets             = NULL;
@@ -1020,7 +1584,7 @@ librdf_storage_trees_register_factory(librdf_storage_factory *factory)
   factory->get_contexts             = NULL;
 #endif
 
-  factory->sync                     = NULL;
+  factory->sync                     = librdf_storage_trees_sync;
   factory->get_feature              = librdf_storage_trees_get_feature;
 }
 
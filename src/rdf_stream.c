@@ -32,6 +32,7 @@
 #endif
 
 #include <stdio.h>
+#include <string.h>
 #include <sys/types.h>
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
@@ -102,17 +103,6 @@ librdf_new_stream(librdf_world *world,
 }
 
 
-/* helper function for deleting list map */
-static void
-librdf_stream_free_stream_map(void *list_data, void *user_data) 
-{
-  librdf_stream_map* map=(librdf_stream_map*)list_data;
-  if(map->free_context)
-    map->free_context(map->context);
-  LIBRDF_FREE(librdf_stream_map, map);
-}
-
-  
 
 /**
  * librdf_free_stream:
@@ -130,10 +120,16 @@ librdf_free_stream(librdf_stream* stream)
   if(stream->finished_method)
     stream->finished_method(stream->context);
 
-  if(stream->map_list) {
-    librdf_list_foreach(stream->map_list,
-                        librdf_stream_free_stream_map, NULL);
-    librdf_free_list(stream->map_list);
+  if(stream->maps) {
+    int i;
+
+    for(i=0; i < stream->maps_count; i++) {
+      librdf_stream_map *map=&stream->maps[i];
+      if(map->free_context)
+        map->free_context(map->context);
+    }
+    if(stream->maps != stream->inline_maps)
+      LIBRDF_FREE(librdf_stream_map, stream->maps);
   }
   
   LIBRDF_FREE(librdf_stream, stream);
@@ -161,34 +157,18 @@ librdf_stream_update_current_statement(librdf_stream* stream)
 
   /* find next statement subject to map */
   while(!stream->is_end_method(stream->context)) {
-    librdf_iterator* map_iterator; /* Iterator over stream->map_list librdf_list */
+    int i;
+
     statement=(librdf_statement*)stream->get_method(stream->context,
                                  LIBRDF_STREAM_GET_METHOD_GET_OBJECT);
     if(!statement)
       break;
 
-    if(!stream->map_list || !librdf_list_size(stream->map_list))
-      break;
-    
-    map_iterator=librdf_list_get_iterator(stream->map_list);
-    if(!map_iterator) {
-      statement=NULL;
-      break;
-    }
-    
-    while(!librdf_iterator_end(map_iterator)) {
-      librdf_stream_map *map=(librdf_stream_map*)librdf_iterator_get_object(map_iterator);
-      if(!map)
-        break;
-      
-      /* apply the map to the element  */
+    /* apply the maps to the element in order */
+    for(i=0; statement && i < stream->maps_count; i++) {
+      librdf_stream_map *map=&stream->maps[i];
       statement=map->fn(stream, map->context, statement);
-      if(!statement)
-        break;
-
-      librdf_iterator_next(map_iterator);
     }
-    librdf_free_iterator(map_iterator);
     
 
     /* found something, return it */
@@ -361,32 +341,30 @@ librdf_stream_add_map(librdf_stream* stream,
 {
   librdf_stream_map *map;
   
-  if(!stream->map_list) {
-    stream->map_list=librdf_new_list(stream->world);
-    if(!stream->map_list) {
+  if(!stream->maps) {
+    stream->maps=stream->inline_maps;
+    stream->maps_size=LIBRDF_STREAM_INLINE_MAPS;
+  } else if(stream->maps_count == stream->maps_size) {
+    librdf_stream_map *maps;
+
+    maps = LIBRDF_MALLOC(librdf_stream_map*,
+                         2 * stream->maps_size * sizeof(*maps));
+    if(!maps) {
       if(free_context && map_context)
         (*free_context)(map_context);
       return 1;
     }
+    memcpy(maps, stream->maps, stream->maps_count * sizeof(*maps));
+    if(stream->maps != stream->inline_maps)
+      LIBRDF_FREE(librdf_stream_map, stream->maps);
+    stream->maps=maps;
+    stream->maps_size *= 2;
   }
 
-  map = LIBRDF_CALLOC(librdf_stream_map*, 1, sizeof(*map));
-  if(!map) {
-    if(free_context && map_context)
-      (*free_context)(map_context);
-    return 1;
-  }
-
+  map=&stream->maps[stream->maps_count++];
   map->fn=map_function;
   map->free_context=free_context;
   map->context=map_context;
-
-  if(librdf_list_add(stream->map_list, map)) {
-    LIBRDF_FREE(librdf_stream_map, map);
-    if(free_context && map_context)
-      (*free_context)(map_context);
-    return 1;
-  }
   
   return 0;
 }
@@ -691,6 +669,20 @@ librdf_stream_statement_find_map(librdf_stream *stream,
 }
 
 
+librdf_statement*
+librdf_stream_value_range_map(librdf_stream *stream,
+                              void* context, librdf_statement* statement) 
+{
+  librdf_node_value_range* range=(librdf_node_value_range*)context;
+
+  if(librdf_node_value_range_contains(range, statement->object))
+    return statement;
+
+  /* not suitable */
+  return NULL;
+}
+
+
 /**
  * librdf_new_empty_stream:
  * @world: redland world object
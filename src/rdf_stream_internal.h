@@ -30,7 +30,10 @@
 extern "C" {
 #endif
 
-/* used in map_list below */
+/* Maps held in the object itself before an array is allocated */
+#define LIBRDF_STREAM_INLINE_MAPS 2
+
+/* used in maps below */
 typedef struct {
   void *context; /* context to pass on to map */
   librdf_stream_map_handler fn;
@@ -47,7 +50,12 @@ struct librdf_stream_s {
   
   /* Used when mapping */
   librdf_statement *current;
-  librdf_list *map_list; /* non-empty means there is a list of maps */
+  /* maps_count maps to apply in order, in inline_maps until more
+   * than fit there are added */
+  librdf_stream_map *maps;
+  int maps_count;
+  int maps_size;
+  librdf_stream_map inline_maps[LIBRDF_STREAM_INLINE_MAPS];
   
   int (*is_end_method)(void*);
   int (*next_method)(void*);
@@ -56,6 +64,7 @@ struct librdf_stream_s {
 };
 
 librdf_statement* librdf_stream_statement_find_map(librdf_stream *stream, void* context, librdf_statement* statement);
+librdf_statement* librdf_stream_value_range_map(librdf_stream *stream, void* context, librdf_statement* statement);
 
 #ifdef __cplusplus
 }
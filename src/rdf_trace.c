@@ -0,0 +1,560 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rdf_trace.c - RDF operation tracing spans and Chrome trace writer
+ *
+ * Copyright (C) 2004-2008, David Beckett http://www.dajobe.org/
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <rdf_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rdf_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef WITH_THREADS
+#include <pthread.h>
+#endif
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h> /* for getpid() */
+#endif
+
+#include <redland.h>
+
+
+#ifndef STANDALONE
+
+static void librdf_trace_chrome_finish(librdf_world* world);
+
+
+/**
+ * librdf_world_set_trace_handlers:
+ * @world: redland world object
+ * @user_data: user data to pass to the handlers
+ * @begin_handler: handler called as an operation begins or NULL
+ * @end_handler: handler called as an operation ends or NULL
+ *
+ * Set the handlers called around traced operations.
+ *
+ * Parses, storage operations, query prepare and execute phases and
+ * the query triple pattern matches are traced.  With no handlers set
+ * (the default) the cost of tracing is a test of a flag per operation.
+ *
+ * Any Chrome trace writer set with librdf_world_set_trace_chrome()
+ * is finished first.  The handlers should be set while no operations
+ * are running in the world.
+ **/
+void
+librdf_world_set_trace_handlers(librdf_world* world, void* user_data,
+                                librdf_trace_handler begin_handler,
+                                librdf_trace_handler end_handler)
+{
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN(world, librdf_world);
+
+  librdf_trace_chrome_finish(world);
+
+  world->trace_user_data = user_data;
+  world->trace_begin_handler = begin_handler;
+  world->trace_end_handler = end_handler;
+  world->trace_enabled = (begin_handler || end_handler);
+}
+
+
+/**
+ * librdf_finish_trace:
+ * @world: redland world object
+ *
+ * INTERNAL - Finish any Chrome trace and remove the trace handlers.
+ *
+ **/
+void
+librdf_finish_trace(librdf_world* world)
+{
+  librdf_trace_chrome_finish(world);
+
+  world->trace_user_data = NULL;
+  world->trace_begin_handler = NULL;
+  world->trace_end_handler = NULL;
+  world->trace_enabled = 0;
+}
+
+
+/**
+ * librdf_trace_drop:
+ * @world: redland world object
+ *
+ * Remove the trace handlers without ending any Chrome trace.
+ *
+ * For use in a forked child process so that only the parent writes
+ * to and ends the trace output.  The Chrome trace iostream is left
+ * untouched.
+ **/
+void
+librdf_trace_drop(librdf_world* world)
+{
+  librdf_trace_chrome* chrome;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN(world, librdf_world);
+
+  chrome = world->trace_chrome;
+
+  if(chrome) {
+#ifdef WITH_THREADS
+    pthread_mutex_destroy(chrome->mutex);
+    SYSTEM_FREE(chrome->mutex);
+#endif
+    LIBRDF_FREE(librdf_trace_chrome, chrome);
+    world->trace_chrome = NULL;
+  }
+
+  world->trace_user_data = NULL;
+  world->trace_begin_handler = NULL;
+  world->trace_end_handler = NULL;
+  world->trace_enabled = 0;
+}
+
+
+/**
+ * librdf_trace_span_init:
+ * @world: redland world object
+ * @span: span to initialise
+ * @category: span category
+ * @name: span operation name
+ *
+ * INTERNAL - Start timing a span.
+ *
+ * Called via LIBRDF_TRACE_SPAN_INIT() only when tracing is on.
+ * Attributes known at the start may be added before calling
+ * librdf_trace_span_begin().
+ *
+ * Return value: non-0 (the span was started)
+ **/
+int
+librdf_trace_span_init(librdf_world* world, librdf_trace_span* span,
+                       const char* category, const char* name)
+{
+  span->world = world;
+  span->category = category;
+  span->name = name;
+  span->attributes_count = 0;
+  span->user_data = NULL;
+  span->start = librdf_metrics_now();
+
+  return 1;
+}
+
+
+/**
+ * librdf_trace_span_add_string:
+ * @span: span
+ * @key: attribute name
+ * @value: string value
+ *
+ * INTERNAL - Add a string attribute to a span.
+ *
+ * Attributes past LIBRDF_TRACE_MAX_ATTRIBUTES are ignored.
+ **/
+void
+librdf_trace_span_add_string(librdf_trace_span* span, const char* key,
+                             const char* value)
+{
+  librdf_trace_attribute* attribute;
+
+  if(!span->world || !value ||
+     span->attributes_count == LIBRDF_TRACE_MAX_ATTRIBUTES)
+    return;
+
+  attribute = &span->attributes[span->attributes_count++];
+  attribute->key = key;
+  attribute->string = value;
+  attribute->number = 0;
+}
+
+
+/**
+ * librdf_trace_span_add_number:
+ * @span: span
+ * @key: attribute name
+ * @value: integer value
+ *
+ * INTERNAL - Add an integer attribute to a span.
+ *
+ * Attributes past LIBRDF_TRACE_MAX_ATTRIBUTES are ignored.
+ **/
+void
+librdf_trace_span_add_number(librdf_trace_span* span, const char* key,
+                             long value)
+{
+  librdf_trace_attribute* attribute;
+
+  if(!span->world || span->attributes_count == LIBRDF_TRACE_MAX_ATTRIBUTES)
+    return;
+
+  attribute = &span->attributes[span->attributes_count++];
+  attribute->key = key;
+  attribute->string = NULL;
+  attribute->number = value;
+}
+
+
+/**
+ * librdf_trace_span_begin:
+ * @span: span
+ *
+ * INTERNAL - Call the trace begin handler for a started span.
+ *
+ **/
+void
+librdf_trace_span_begin(librdf_trace_span* span)
+{
+  librdf_world* world = span->world;
+
+  if(world && world->trace_begin_handler)
+    world->trace_begin_handler(world->trace_user_data, span);
+}
+
+
+/**
+ * librdf_trace_span_end:
+ * @span: span
+ *
+ * INTERNAL - Call the trace end handler for a started span.
+ *
+ * Called via LIBRDF_TRACE_SPAN_END().
+ **/
+void
+librdf_trace_span_end(librdf_trace_span* span)
+{
+  librdf_world* world = span->world;
+
+  if(world && world->trace_end_handler)
+    world->trace_end_handler(world->trace_user_data, span);
+
+  span->world = NULL;
+}
+
+
+/*
+ * librdf_trace_chrome_write_string - Write a JSON string
+ * @iostr: iostream to write to
+ * @string: string
+ */
+static void
+librdf_trace_chrome_write_string(raptor_iostream* iostr, const char* string)
+{
+  raptor_iostream_write_byte('"', iostr);
+  raptor_string_escaped_write((const unsigned char*)string, strlen(string),
+                              '"', RAPTOR_ESCAPED_WRITE_JSON_LITERAL, iostr);
+  raptor_iostream_write_byte('"', iostr);
+}
+
+
+/*
+ * librdf_trace_chrome_end_handler - Write a span as a Chrome complete event
+ * @user_data: #librdf_trace_chrome
+ * @span: span that ended
+ *
+ * Complete ("X") events carry their own duration, so spans from
+ * several threads or interleaved streams need not nest.
+ */
+static void
+librdf_trace_chrome_end_handler(void* user_data, librdf_trace_span* span)
+{
+  librdf_trace_chrome* chrome = (librdf_trace_chrome*)user_data;
+  raptor_iostream* iostr = chrome->iostr;
+  double end = librdf_metrics_now();
+  unsigned long tid = 1;
+  char number[128];
+  int i;
+
+#ifdef WITH_THREADS
+  tid = (unsigned long)pthread_self();
+  pthread_mutex_lock(chrome->mutex);
+#endif
+
+  raptor_iostream_string_write(chrome->count++ ? ",\n" : "\n", iostr);
+
+  raptor_iostream_string_write("{\"name\":", iostr);
+  librdf_trace_chrome_write_string(iostr, span->name);
+  raptor_iostream_string_write(",\"cat\":", iostr);
+  librdf_trace_chrome_write_string(iostr, span->category);
+
+  /* times in microseconds */
+  sprintf(number, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%lu",
+          (span->start - chrome->origin) * 1000000.0,
+          (end - span->start) * 1000000.0, chrome->pid, tid);
+  raptor_iostream_string_write(number, iostr);
+
+  raptor_iostream_string_write(",\"args\":{", iostr);
+  for(i = 0; i < span->attributes_count; i++) {
+    librdf_trace_attribute* attribute = &span->attributes[i];
+
+    if(i)
+      raptor_iostream_write_byte(',', iostr);
+    librdf_trace_chrome_write_string(iostr, attribute->key);
+    raptor_iostream_write_byte(':', iostr);
+    if(attribute->string)
+      librdf_trace_chrome_write_string(iostr, attribute->string);
+    else {
+      sprintf(number, "%ld", attribute->number);
+      raptor_iostream_string_write(number, iostr);
+    }
+  }
+  raptor_iostream_string_write("}}", iostr);
+
+#ifdef WITH_THREADS
+  pthread_mutex_unlock(chrome->mutex);
+#endif
+}
+
+
+/*
+ * librdf_trace_chrome_finish - End the Chrome trace of a world, if any
+ * @world: redland world object
+ */
+static void
+librdf_trace_chrome_finish(librdf_world* world)
+{
+  librdf_trace_chrome* chrome = world->trace_chrome;
+
+  if(!chrome)
+    return;
+
+  raptor_iostream_string_write("\n]\n", chrome->iostr);
+
+  if(world->trace_user_data == chrome) {
+    world->trace_user_data = NULL;
+    world->trace_begin_handler = NULL;
+    world->trace_end_handler = NULL;
+    world->trace_enabled = 0;
+  }
+
+#ifdef WITH_THREADS
+  pthread_mutex_destroy(chrome->mutex);
+  SYSTEM_FREE(chrome->mutex);
+#endif
+
+  LIBRDF_FREE(librdf_trace_chrome, chrome);
+  world->trace_chrome = NULL;
+}
+
+
+/**
+ * librdf_world_set_trace_chrome:
+ * @world: redland world object
+ * @iostr: iostream to write to or NULL to end the trace
+ *
+ * Write the traced operations as Chrome trace event JSON.
+ *
+ * Each span is written as a complete event with its attributes as
+ * the event arguments, for loading into chrome://tracing, Perfetto or
+ * other flame graph tools.  This replaces any trace handlers.
+ *
+ * The trace is ended with the JSON array closed when this is called
+ * with a NULL @iostr, when other trace handlers are set or when the
+ * world is freed.  The @iostr is owned by the caller and must stay
+ * open until then.
+ *
+ * Return value: non 0 on failure
+ **/
+int
+librdf_world_set_trace_chrome(librdf_world* world, raptor_iostream* iostr)
+{
+  librdf_trace_chrome* chrome;
+
+  LIBRDF_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, librdf_world, 1);
+
+  librdf_finish_trace(world);
+
+  if(!iostr)
+    return 0;
+
+  chrome = LIBRDF_CALLOC(librdf_trace_chrome*, 1, sizeof(*chrome));
+  if(!chrome)
+    return 1;
+
+#ifdef WITH_THREADS
+  chrome->mutex = (pthread_mutex_t *) SYSTEM_MALLOC(sizeof(pthread_mutex_t));
+  pthread_mutex_init(chrome->mutex, NULL);
+#endif
+
+  chrome->iostr = iostr;
+  chrome->origin = librdf_metrics_now();
+#ifdef HAVE_UNISTD_H
+  chrome->pid = (long)getpid();
+#else
+  chrome->pid = 1;
+#endif
+
+  raptor_iostream_write_byte('[', iostr);
+
+  world->trace_chrome = chrome;
+  world->trace_user_data = chrome;
+  world->trace_begin_handler = NULL;
+  world->trace_end_handler = librdf_trace_chrome_end_handler;
+  world->trace_enabled = 1;
+
+  return 0;
+}
+
+#endif
+
+
+
+/* TEST CODE */
+
+
+#ifdef STANDALONE
+
+/* one more prototype */
+int main(int argc, char *argv[]);
+
+
+typedef struct {
+  int begins;
+  int ends;
+  int finds;
+} trace_test_counts;
+
+
+static void
+trace_test_begin_handler(void* user_data, librdf_trace_span* span)
+{
+  ((trace_test_counts*)user_data)->begins++;
+}
+
+
+static void
+trace_test_end_handler(void* user_data, librdf_trace_span* span)
+{
+  trace_test_counts* counts = (trace_test_counts*)user_data;
+  int i;
+
+  counts->ends++;
+
+  if(strcmp(span->category, "storage") || strcmp(span->name, "find"))
+    return;
+
+  for(i = 0; i < span->attributes_count; i++) {
+    if(!strcmp(span->attributes[i].key, "pattern") &&
+       span->attributes[i].string &&
+       !strcmp(span->attributes[i].string, "s??"))
+      counts->finds++;
+  }
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  librdf_world *world;
+  librdf_storage *storage;
+  librdf_model *model;
+  librdf_statement *statement;
+  librdf_stream *stream;
+  raptor_iostream *iostr;
+  trace_test_counts counts;
+  unsigned char *string = NULL;
+  size_t string_len = 0;
+  const char *program = librdf_basename((const char*)argv[0]);
+  const char *expected = "{\"name\":\"add\",\"cat\":\"storage\",\"ph\":\"X\"";
+  int rc = 0;
+
+  world = librdf_new_world();
+  librdf_world_open(world);
+
+  memset(&counts, 0, sizeof(counts));
+  librdf_world_set_trace_handlers(world, &counts,
+                                  trace_test_begin_handler,
+                                  trace_test_end_handler);
+
+  storage = librdf_new_storage(world, "hashes", NULL, "hash-type='memory'");
+  model = librdf_new_model(world, storage, NULL);
+  if(!storage || !model) {
+    fprintf(stderr, "%s: Failed to create model\n", program);
+    return 1;
+  }
+
+  fprintf(stdout, "%s: Tracing an add and a find\n", program);
+  statement = librdf_new_statement_from_nodes(world,
+    librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/s"),
+    librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/p"),
+    librdf_new_node_from_literal(world, (const unsigned char*)"o", NULL, 0));
+  librdf_model_add_statement(model, statement);
+  librdf_free_statement(statement);
+
+  statement = librdf_new_statement_from_nodes(world,
+    librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/s"),
+    NULL, NULL);
+  stream = librdf_model_find_statements(model, statement);
+  librdf_free_stream(stream);
+  librdf_free_statement(statement);
+
+  if(counts.begins < 2 || counts.begins != counts.ends) {
+    fprintf(stderr, "%s: Expected matching begins and ends, got %d and %d\n",
+            program, counts.begins, counts.ends);
+    rc = 1;
+  }
+  if(counts.finds != 1) {
+    fprintf(stderr, "%s: Expected 1 (S, ?, ?) find span, got %d\n", program,
+            counts.finds);
+    rc = 1;
+  }
+
+  fprintf(stdout, "%s: Writing a Chrome trace\n", program);
+  iostr = raptor_new_iostream_to_string(world->raptor_world_ptr,
+                                        (void**)&string, &string_len, malloc);
+  librdf_world_set_trace_chrome(world, iostr);
+
+  statement = librdf_new_statement_from_nodes(world,
+    librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/s"),
+    librdf_new_node_from_uri_string(world, (const unsigned char*)"http://example.org/p"),
+    librdf_new_node_from_literal(world, (const unsigned char*)"o2", NULL, 0));
+  librdf_model_add_statement(model, statement);
+  librdf_free_statement(statement);
+
+  librdf_world_set_trace_chrome(world, NULL);
+  raptor_free_iostream(iostr);
+
+  if(!string || string[0] != '[' ||
+     strcmp((const char*)string + string_len - 3, "\n]\n") ||
+     !strstr((const char*)string, expected)) {
+    fprintf(stderr, "%s: Unexpected Chrome trace %s\n", program,
+            string ? (const char*)string : "(none)");
+    rc = 1;
+  }
+  if(string)
+    free(string);
+
+  librdf_free_model(model);
+  librdf_free_storage(storage);
+
+  librdf_free_world(world);
+
+  return rc;
+}
+
+#endif
@@ -0,0 +1,108 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rdf_trace.h - RDF operation tracing interfaces
+ *
+ * Copyright (C) 2004-2008, David Beckett http://www.dajobe.org/
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+
+#ifndef LIBRDF_TRACE_H
+#define LIBRDF_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <raptor2.h>
+
+/**
+ * LIBRDF_TRACE_MAX_ATTRIBUTES:
+ *
+ * Maximum number of attributes on a #librdf_trace_span.
+ */
+#define LIBRDF_TRACE_MAX_ATTRIBUTES 4
+
+/**
+ * librdf_trace_attribute:
+ * @key: attribute name
+ * @string: string value or NULL if the value is @number
+ * @number: integer value when @string is NULL
+ *
+ * One attribute of a #librdf_trace_span.
+ */
+typedef struct {
+  const char* key;
+  const char* string;
+  long number;
+} librdf_trace_attribute;
+
+/**
+ * librdf_trace_span:
+ * @world: redland world object
+ * @category: span category: "parser", "storage" or "query"
+ * @name: operation such as "parse", "add", "find" or "execute"
+ * @start: start time in seconds from a monotonic clock where there is one
+ * @attributes_count: number of @attributes set
+ * @attributes: attributes such as the storage name, pattern or result count
+ * @user_data: free for the trace handlers to use between begin and end
+ *
+ * A traced operation, passed to the same begin and end handlers.
+ *
+ * Spans made in one thread nest.  Attributes known only at the end
+ * such as "statements" or "matches" counts are added before the end
+ * handler is called.  The strings are only valid during the calls.
+ */
+typedef struct {
+  librdf_world* world;
+  const char* category;
+  const char* name;
+  double start;
+  int attributes_count;
+  librdf_trace_attribute attributes[LIBRDF_TRACE_MAX_ATTRIBUTES];
+  void* user_data;
+} librdf_trace_span;
+
+/**
+ * librdf_trace_handler:
+ * @user_data: user data given to librdf_world_set_trace_handlers()
+ * @span: span beginning or ending
+ *
+ * Handler for the beginning or end of a traced operation.
+ */
+typedef void (*librdf_trace_handler)(void* user_data, librdf_trace_span* span);
+
+
+#ifdef LIBRDF_INTERNAL
+#include <rdf_trace_internal.h>
+#endif
+
+
+/* class methods */
+REDLAND_API
+void librdf_world_set_trace_handlers(librdf_world* world, void* user_data, librdf_trace_handler begin_handler, librdf_trace_handler end_handler);
+REDLAND_API
+int librdf_world_set_trace_chrome(librdf_world* world, raptor_iostream* iostr);
+REDLAND_API
+void librdf_trace_drop(librdf_world* world);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,67 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rdf_trace_internal.h - Internal RDF operation tracing definitions
+ *
+ * Copyright (C) 2004-2008, David Beckett http://www.dajobe.org/
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+
+#ifndef LIBRDF_TRACE_INTERNAL_H
+#define LIBRDF_TRACE_INTERNAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Chrome trace event writer state */
+typedef struct {
+#ifdef WITH_THREADS
+  pthread_mutex_t* mutex;
+#endif
+  raptor_iostream* iostr;
+  /* time of the first event and events written */
+  double origin;
+  int count;
+  long pid;
+} librdf_trace_chrome;
+
+
+/* Start a span if tracing is on, returning non-0 if it was started.
+ * When tracing is off this is only a branch, and the span is marked
+ * so LIBRDF_TRACE_SPAN_END() does nothing.
+ */
+#define LIBRDF_TRACE_SPAN_INIT(w, span, category, name) \
+  ((w)->trace_enabled ? librdf_trace_span_init(w, span, category, name) : ((span)->world = NULL, 0))
+
+#define LIBRDF_TRACE_SPAN_END(span) \
+  do { if((span)->world) librdf_trace_span_end(span); } while(0)
+
+void librdf_finish_trace(librdf_world* world);
+
+int librdf_trace_span_init(librdf_world* world, librdf_trace_span* span, const char* category, const char* name);
+void librdf_trace_span_add_string(librdf_trace_span* span, const char* key, const char* value);
+void librdf_trace_span_add_number(librdf_trace_span* span, const char* key, long value);
+void librdf_trace_span_begin(librdf_trace_span* span);
+void librdf_trace_span_end(librdf_trace_span* span);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
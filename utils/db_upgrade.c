@@ -23,10 +23,25 @@
  */
 
 
+
+#ifdef HAVE_CONFIG_H
+#include <rdf_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rdf_config.h>
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
 
 #include <redland.h>
 
@@ -35,100 +50,1047 @@
 int main(int argc, char *argv[]);
 
 
+/*
+ * The upgrade works on the hashes of a 'hashes' storage directly.
+ * The old sp2o hash is read once in key order, copied to the new sp2o
+ * hash and every other index record is written to sorted run files
+ * of at most run_size records.  Each index is then rebuilt by merging
+ * its runs so that keys are inserted in order, several indexes at once
+ * when jobs > 1.  Progress is recorded in a state file so an
+ * interrupted upgrade can be resumed with -r.
+ *
+ * The index layouts must match librdf_storage_hashes_descriptions
+ * in src/rdf_storage_hashes.c
+ */
+typedef struct
+{
+  const char *name;
+  int key_fields;
+  int value_fields;
+} upgrade_index;
+
+static const upgrade_index upgrade_indexes[]= {
+  {"sp2o",
+   LIBRDF_STATEMENT_SUBJECT|LIBRDF_STATEMENT_PREDICATE,
+   LIBRDF_STATEMENT_OBJECT},
+  {"po2s",
+   LIBRDF_STATEMENT_PREDICATE|LIBRDF_STATEMENT_OBJECT,
+   LIBRDF_STATEMENT_SUBJECT},
+  {"so2p", 
+   LIBRDF_STATEMENT_SUBJECT|LIBRDF_STATEMENT_OBJECT,
+   LIBRDF_STATEMENT_PREDICATE},
+  {"p2so", 
+   LIBRDF_STATEMENT_PREDICATE,
+   LIBRDF_STATEMENT_SUBJECT|LIBRDF_STATEMENT_OBJECT},
+  /* key is the context node, value the whole statement */
+  {"contexts", 0, 0},
+  {NULL, 0, 0}
+};
+
+#define UPGRADE_SP2O_INDEX 0
+#define UPGRADE_P2SO_INDEX 3
+#define UPGRADE_CONTEXTS_INDEX 4
+#define UPGRADE_INDEXES_COUNT 5
+
+#define UPGRADE_DEFAULT_RUN_SIZE 1000000
+
+
+/* one key/value record held in memory or in a run file */
+typedef struct
+{
+  size_t key_len;
+  size_t value_len;
+  unsigned char data[1]; /* key then value */
+} upgrade_record;
+
+
+typedef struct
+{
+  librdf_world* world;
+  const char* program;
+
+  const char* dir;
+  const char* old_name;
+  const char* new_name;
+  const char* old_hash_type;
+  const char* new_hash_type;
+  librdf_hash* options;
+
+  /* which indexes to build */
+  int wanted[UPGRADE_INDEXES_COUNT];
+  /* which indexes are finished (from the state file when resuming) */
+  int done[UPGRADE_INDEXES_COUNT];
+
+  int run_size;
+  int jobs;
+
+  /* set when the scan of the old store completed */
+  int scanned;
+  unsigned long statements;
+  unsigned long context_statements;
+  int runs_count;
+
+  /* records for the current run of each index */
+  upgrade_record** records[UPGRADE_INDEXES_COUNT];
+  int records_count[UPGRADE_INDEXES_COUNT];
+  /* statements in the current run */
+  int run_count;
+
+  /* encoding buffers */
+  unsigned char* key_buffer;
+  size_t key_buffer_len;
+  unsigned char* value_buffer;
+  size_t value_buffer_len;
+} upgrade_state;
+
+
+static char*
+upgrade_file_name(upgrade_state* state, const char* name, const char* index,
+                  const char* suffix, int number)
+{
+  size_t len;
+  char* file_name;
+
+  len = strlen(state->dir) + strlen(name) + strlen(index) + strlen(suffix) + 20;
+  file_name = (char*)malloc(len);
+  if(!file_name)
+    return NULL;
+
+  if(number >= 0)
+    sprintf(file_name, "%s/%s-%s%s%d", state->dir, name, index, suffix,
+            number);
+  else if(*index)
+    sprintf(file_name, "%s/%s-%s%s", state->dir, name, index, suffix);
+  else
+    sprintf(file_name, "%s/%s%s", state->dir, name, suffix);
+
+  return file_name;
+}
+
+
+static librdf_hash*
+upgrade_open_hash(upgrade_state* state, const char* hash_type,
+                  const char* name, const char* index, int is_new)
+{
+  librdf_hash* hash;
+  char* identifier;
+  int rc;
+
+  identifier = upgrade_file_name(state, name, index, "", -1);
+  if(!identifier)
+    return NULL;
+
+  hash = librdf_new_hash(state->world, hash_type);
+  if(!hash) {
+    fprintf(stderr, "%s: Failed to create %s hash\n", state->program,
+            hash_type);
+    free(identifier);
+    return NULL;
+  }
+
+  rc = librdf_hash_open(hash, identifier, 0644, is_new, is_new,
+                        state->options);
+  if(rc) {
+    fprintf(stderr, "%s: Failed to open %s hash '%s'\n", state->program,
+            hash_type, identifier);
+    librdf_free_hash(hash);
+    hash = NULL;
+  }
+
+  free(identifier);
+  return hash;
+}
+
+
+/* Count values in a hash, iterating if the hash cannot say */
+static long
+upgrade_count_values(upgrade_state* state, librdf_hash* hash)
+{
+  librdf_hash_datum *key, *value;
+  librdf_iterator* iterator;
+  long count;
+
+  count = librdf_hash_values_count(hash);
+  if(count >= 0)
+    return count;
+
+  key = librdf_new_hash_datum(state->world, NULL, 0);
+  value = librdf_new_hash_datum(state->world, NULL, 0);
+  if(!key || !value)
+    return -1;
+
+  count = 0;
+  iterator = librdf_hash_get_all(hash, key, value);
+  if(iterator) {
+    while(!librdf_iterator_end(iterator)) {
+      count++;
+      librdf_iterator_next(iterator);
+    }
+    librdf_free_iterator(iterator);
+  } else
+    count = -1;
+
+  key->data = NULL;
+  librdf_free_hash_datum(key);
+  value->data = NULL;
+  librdf_free_hash_datum(value);
+
+  return count;
+}
+
+
+/* state file */
+
+static int
+upgrade_write_state(upgrade_state* state)
+{
+  char* file_name;
+  FILE* fh;
+  int i;
+
+  file_name = upgrade_file_name(state, state->new_name, "", "-upgrade.state",
+                                -1);
+  if(!file_name)
+    return 1;
+
+  fh = fopen(file_name, "w");
+  free(file_name);
+  if(!fh)
+    return 1;
+
+  if(state->scanned)
+    fprintf(fh, "scan %lu %lu %d\n", state->statements,
+            state->context_statements, state->runs_count);
+  for(i = 0; i < UPGRADE_INDEXES_COUNT; i++) {
+    if(state->done[i])
+      fprintf(fh, "index %s\n", upgrade_indexes[i].name);
+  }
+
+  return fclose(fh) != 0;
+}
+
+
+static void
+upgrade_read_state(upgrade_state* state)
+{
+  char* file_name;
+  FILE* fh;
+  char line[100];
+
+  file_name = upgrade_file_name(state, state->new_name, "", "-upgrade.state",
+                                -1);
+  if(!file_name)
+    return;
+
+  fh = fopen(file_name, "r");
+  free(file_name);
+  if(!fh)
+    return;
+
+  while(fgets(line, sizeof(line), fh)) {
+    char name[20];
+    int i;
+
+    if(sscanf(line, "scan %lu %lu %d", &state->statements,
+              &state->context_statements, &state->runs_count) == 3)
+      state->scanned = 1;
+    else if(sscanf(line, "index %19s", name) == 1) {
+      for(i = 0; i < UPGRADE_INDEXES_COUNT; i++) {
+        if(!strcmp(name, upgrade_indexes[i].name))
+          state->done[i] = 1;
+      }
+    }
+  }
+  fclose(fh);
+
+  /* indexes are only usable if the scan they came from completed */
+  if(!state->scanned)
+    memset(state->done, '\0', sizeof(state->done));
+}
+
+
+/* sorted runs */
+
+static int
+upgrade_compare_records(const void* a, const void* b)
+{
+  const upgrade_record* ra = *(const upgrade_record* const*)a;
+  const upgrade_record* rb = *(const upgrade_record* const*)b;
+  size_t len;
+  int rc;
+
+  /* byte order, shorter first; the same order as a BDB btree */
+  len = (ra->key_len < rb->key_len) ? ra->key_len : rb->key_len;
+  rc = memcmp(ra->data, rb->data, len);
+  if(rc)
+    return rc;
+  if(ra->key_len != rb->key_len)
+    return (ra->key_len < rb->key_len) ? -1 : 1;
+
+  len = (ra->value_len < rb->value_len) ? ra->value_len : rb->value_len;
+  rc = memcmp(ra->data + ra->key_len, rb->data + rb->key_len, len);
+  if(rc)
+    return rc;
+  if(ra->value_len != rb->value_len)
+    return (ra->value_len < rb->value_len) ? -1 : 1;
+  return 0;
+}
+
+
+static upgrade_record*
+upgrade_new_record(const unsigned char* key, size_t key_len,
+                   const unsigned char* value, size_t value_len)
+{
+  upgrade_record* record;
+
+  record = (upgrade_record*)malloc(sizeof(*record) + key_len + value_len);
+  if(!record)
+    return NULL;
+
+  record->key_len = key_len;
+  record->value_len = value_len;
+  memcpy(record->data, key, key_len);
+  memcpy(record->data + key_len, value, value_len);
+
+  return record;
+}
+
+
+static upgrade_record*
+upgrade_read_record(FILE* fh)
+{
+  size_t lens[2];
+  upgrade_record* record;
+
+  if(fread(lens, sizeof(size_t), 2, fh) != 2)
+    return NULL;
+
+  record = (upgrade_record*)malloc(sizeof(*record) + lens[0] + lens[1]);
+  if(!record)
+    return NULL;
+
+  record->key_len = lens[0];
+  record->value_len = lens[1];
+  if(fread(record->data, 1, lens[0] + lens[1], fh) != lens[0] + lens[1]) {
+    free(record);
+    return NULL;
+  }
+
+  return record;
+}
+
+
+/* Sort the buffered records of every index and write them as a run */
+static int
+upgrade_flush_runs(upgrade_state* state)
+{
+  int i;
+  int rc = 0;
+
+  for(i = 0; i < UPGRADE_INDEXES_COUNT; i++) {
+    upgrade_record** records = state->records[i];
+    char* file_name;
+    FILE* fh;
+    int j;
+
+    if(!records)
+      continue;
+
+    file_name = upgrade_file_name(state, state->new_name,
+                                  upgrade_indexes[i].name, ".run",
+                                  state->runs_count);
+    fh = file_name ? fopen(file_name, "wb") : NULL;
+    if(!fh) {
+      fprintf(stderr, "%s: Failed to create run file %s\n", state->program,
+              file_name ? file_name : "");
+      rc = 1;
+    }
+    free(file_name);
+
+    qsort(records, state->records_count[i], sizeof(upgrade_record*),
+          upgrade_compare_records);
+
+    for(j = 0; j < state->records_count[i]; j++) {
+      upgrade_record* record = records[j];
+      size_t lens[2];
+
+      lens[0] = record->key_len;
+      lens[1] = record->value_len;
+      if(fh && (fwrite(lens, sizeof(size_t), 2, fh) != 2 ||
+                fwrite(record->data, 1, lens[0] + lens[1], fh) !=
+                lens[0] + lens[1]))
+        rc = 1;
+
+      free(record);
+      records[j] = NULL;
+    }
+
+    state->records_count[i] = 0;
+
+    if(fh && fclose(fh))
+      rc = 1;
+  }
+
+  state->run_count = 0;
+  state->runs_count++;
+
+  return rc;
+}
+
+
+static int
+upgrade_grow_buffer(unsigned char** buffer, size_t* len, size_t required_len)
+{
+  if(required_len <= *len)
+    return 0;
+
+  if(*buffer)
+    free(*buffer);
+  *len = required_len + 8;
+  *buffer = (unsigned char*)malloc(*len);
+  if(!*buffer)
+    *len = 0;
+  return (*len < required_len);
+}
+
+
+/* Encode statement with fields into buffer, returning the length or 0 */
+static size_t
+upgrade_encode(upgrade_state* state, librdf_statement* statement,
+               librdf_node* context_node, int fields,
+               unsigned char** buffer, size_t* buffer_len)
+{
+  size_t len;
+
+  len = librdf_statement_encode_parts2(state->world, statement, context_node,
+                                       NULL, 0,
+                                       (librdf_statement_part)fields);
+  if(!len || upgrade_grow_buffer(buffer, buffer_len, len))
+    return 0;
+
+  return librdf_statement_encode_parts2(state->world, statement, context_node,
+                                        *buffer, *buffer_len,
+                                        (librdf_statement_part)fields);
+}
+
+
+/* Add the index records for one statement to the current run */
+static int
+upgrade_add_records(upgrade_state* state, librdf_statement* statement,
+                    librdf_node* context_node)
+{
+  int i;
+
+  for(i = 0; i < UPGRADE_INDEXES_COUNT; i++) {
+    size_t key_len, value_len;
+    upgrade_record* record;
+
+    if(!state->records[i])
+      continue;
+
+    if(i == UPGRADE_CONTEXTS_INDEX) {
+      if(!context_node)
+        continue;
+
+      key_len = librdf_node_encode(context_node, NULL, 0);
+      if(upgrade_grow_buffer(&state->key_buffer, &state->key_buffer_len,
+                             key_len))
+        return 1;
+      key_len = librdf_node_encode(context_node, state->key_buffer,
+                                   state->key_buffer_len);
+
+      value_len = librdf_statement_encode2(state->world, statement, NULL, 0);
+      if(upgrade_grow_buffer(&state->value_buffer, &state->value_buffer_len,
+                             value_len))
+        return 1;
+      value_len = librdf_statement_encode2(state->world, statement,
+                                           state->value_buffer,
+                                           state->value_buffer_len);
+    } else {
+      key_len = upgrade_encode(state, statement, NULL,
+                               upgrade_indexes[i].key_fields,
+                               &state->key_buffer, &state->key_buffer_len);
+      value_len = upgrade_encode(state, statement, context_node,
+                                 upgrade_indexes[i].value_fields,
+                                 &state->value_buffer,
+                                 &state->value_buffer_len);
+    }
+    if(!key_len || !value_len)
+      return 1;
+
+    record = upgrade_new_record(state->key_buffer, key_len,
+                                state->value_buffer, value_len);
+    if(!record)
+      return 1;
+
+    state->records[i][state->records_count[i]++] = record;
+  }
+
+  /* the contexts index may have fewer records so count statements */
+  if(++state->run_count == state->run_size)
+    return upgrade_flush_runs(state);
+
+  return 0;
+}
+
+
+/*
+ * Read the old sp2o hash in order, copying it to the new sp2o hash
+ * and writing sorted runs for the other indexes.
+ */
+static int
+upgrade_scan(upgrade_state* state)
+{
+  librdf_hash *old_hash, *new_hash;
+  librdf_hash_datum *key, *value;
+  librdf_hash_datum hd_key, hd_value; /* on stack */
+  librdf_iterator* iterator;
+  librdf_statement* statement;
+  int i;
+  int rc = 0;
+
+  old_hash = upgrade_open_hash(state, state->old_hash_type, state->old_name,
+                               upgrade_indexes[UPGRADE_SP2O_INDEX].name, 0);
+  if(!old_hash)
+    return 1;
+
+  new_hash = upgrade_open_hash(state, state->new_hash_type, state->new_name,
+                               upgrade_indexes[UPGRADE_SP2O_INDEX].name, 1);
+  if(!new_hash) {
+    librdf_free_hash(old_hash);
+    return 1;
+  }
+
+  for(i = 0; i < UPGRADE_INDEXES_COUNT; i++) {
+    if(i == UPGRADE_SP2O_INDEX || !state->wanted[i])
+      continue;
+    state->records[i] = (upgrade_record**)calloc(state->run_size,
+                                                 sizeof(upgrade_record*));
+    if(!state->records[i])
+      rc = 1;
+  }
+
+  key = librdf_new_hash_datum(state->world, NULL, 0);
+  value = librdf_new_hash_datum(state->world, NULL, 0);
+  statement = librdf_new_statement(state->world);
+  if(rc || !key || !value || !statement) {
+    rc = 1;
+    goto tidy;
+  }
+
+  state->statements = 0;
+  state->context_statements = 0;
+  state->runs_count = 0;
+
+  iterator = librdf_hash_get_all(old_hash, key, value);
+  if(!iterator) {
+    rc = 1;
+    goto tidy;
+  }
+
+  while(!librdf_iterator_end(iterator)) {
+    librdf_hash_datum* hd;
+    librdf_node* context_node = NULL;
+
+    librdf_statement_clear(statement);
+
+    hd = (librdf_hash_datum*)librdf_iterator_get_key(iterator);
+    if(!librdf_statement_decode2(state->world, statement, NULL,
+                                 (unsigned char*)hd->data, hd->size)) {
+      rc = 1;
+      break;
+    }
+
+    hd = (librdf_hash_datum*)librdf_iterator_get_value(iterator);
+    if(!librdf_statement_decode2(state->world, statement, &context_node,
+                                 (unsigned char*)hd->data, hd->size)) {
+      rc = 1;
+      break;
+    }
+
+    /* write sp2o back re-encoded in the current format */
+    hd_key.size = upgrade_encode(state, statement, NULL,
+                                 upgrade_indexes[UPGRADE_SP2O_INDEX].key_fields,
+                                 &state->key_buffer, &state->key_buffer_len);
+    hd_key.data = state->key_buffer;
+    hd_value.size = upgrade_encode(state, statement, context_node,
+                                   upgrade_indexes[UPGRADE_SP2O_INDEX].value_fields,
+                                   &state->value_buffer,
+                                   &state->value_buffer_len);
+    hd_value.data = state->value_buffer;
+    if(!hd_key.size || !hd_value.size ||
+       librdf_hash_put(new_hash, &hd_key, &hd_value)) {
+      if(context_node)
+        librdf_free_node(context_node);
+      rc = 1;
+      break;
+    }
+
+    if(upgrade_add_records(state, statement, context_node))
+      rc = 1;
+
+    state->statements++;
+    if(context_node) {
+      state->context_statements++;
+      librdf_free_node(context_node);
+    }
+    if(rc)
+      break;
+
+    if(!(state->statements % 1000000))
+      fprintf(stderr, "%s: Read %lu statements\n", state->program,
+              state->statements);
+
+    librdf_iterator_next(iterator);
+  }
+  librdf_free_iterator(iterator);
+
+  if(!rc && state->run_count)
+    rc = upgrade_flush_runs(state);
+
+  if(rc)
+    fprintf(stderr, "%s: Failed reading statement %lu from '%s'\n",
+            state->program, state->statements + 1, state->old_name);
+  else if(upgrade_count_values(state, new_hash) != (long)state->statements) {
+    fprintf(stderr, "%s: New sp2o index does not have %lu statements\n",
+            state->program, state->statements);
+    rc = 1;
+  }
+
+  tidy:
+  for(i = 0; i < UPGRADE_INDEXES_COUNT; i++) {
+    if(state->records[i]) {
+      int j;
+      for(j = 0; j < state->records_count[i]; j++)
+        free(state->records[i][j]);
+      free(state->records[i]);
+      state->records[i] = NULL;
+    }
+  }
+  if(statement)
+    librdf_free_statement(statement);
+  if(key) {
+    key->data = NULL;
+    librdf_free_hash_datum(key);
+  }
+  if(value) {
+    value->data = NULL;
+    librdf_free_hash_datum(value);
+  }
+  librdf_free_hash(new_hash);
+  librdf_free_hash(old_hash);
+
+  if(!rc) {
+    state->scanned = 1;
+    state->done[UPGRADE_SP2O_INDEX] = 1;
+  }
+
+  return rc;
+}
+
+
+/* k-way merge of runs using a binary heap on the current records */
+typedef struct
+{
+  FILE* fh;
+  upgrade_record* record;
+} upgrade_run;
+
+
+static void
+upgrade_heap_down(upgrade_run* heap, int count, int i)
+{
+  while(1) {
+    int smallest = i;
+    int child = 2 * i + 1;
+    upgrade_run tmp;
+
+    if(child < count &&
+       upgrade_compare_records(&heap[child].record,
+                               &heap[smallest].record) < 0)
+      smallest = child;
+    child++;
+    if(child < count &&
+       upgrade_compare_records(&heap[child].record,
+                               &heap[smallest].record) < 0)
+      smallest = child;
+    if(smallest == i)
+      break;
+
+    tmp = heap[i];
+    heap[i] = heap[smallest];
+    heap[smallest] = tmp;
+    i = smallest;
+  }
+}
+
+
+/* Build one index of the new store from its runs */
+static int
+upgrade_build_index(upgrade_state* state, int index)
+{
+  const char* name = upgrade_indexes[index].name;
+  librdf_hash* hash;
+  upgrade_run* heap;
+  int count = 0;
+  unsigned long expected;
+  long values;
+  int i;
+  int rc = 0;
+
+  heap = (upgrade_run*)calloc(state->runs_count ? state->runs_count : 1,
+                              sizeof(upgrade_run));
+  if(!heap)
+    return 1;
+
+  hash = upgrade_open_hash(state, state->new_hash_type, state->new_name,
+                           name, 1);
+  if(!hash) {
+    free(heap);
+    return 1;
+  }
+
+  for(i = 0; i < state->runs_count; i++) {
+    char* file_name;
+
+    file_name = upgrade_file_name(state, state->new_name, name, ".run", i);
+    heap[count].fh = file_name ? fopen(file_name, "rb") : NULL;
+    if(!heap[count].fh) {
+      fprintf(stderr, "%s: Failed to open run file %s\n", state->program,
+              file_name ? file_name : "");
+      free(file_name);
+      rc = 1;
+      goto tidy;
+    }
+    free(file_name);
+
+    heap[count].record = upgrade_read_record(heap[count].fh);
+    if(heap[count].record)
+      count++;
+    else
+      fclose(heap[count].fh);
+  }
+
+  for(i = count / 2 - 1; i >= 0; i--)
+    upgrade_heap_down(heap, count, i);
+
+  while(count) {
+    upgrade_record* record = heap[0].record;
+    librdf_hash_datum hd_key, hd_value; /* on stack */
+
+    hd_key.data = record->data;
+    hd_key.size = record->key_len;
+    hd_value.data = record->data + record->key_len;
+    hd_value.size = record->value_len;
+    if(librdf_hash_put(hash, &hd_key, &hd_value))
+      rc = 1;
+    free(record);
+    if(rc)
+      break;
+
+    heap[0].record = upgrade_read_record(heap[0].fh);
+    if(!heap[0].record) {
+      fclose(heap[0].fh);
+      heap[0] = heap[--count];
+    }
+    upgrade_heap_down(heap, count, 0);
+  }
+
+  if(!rc) {
+    expected = (index == UPGRADE_CONTEXTS_INDEX) ? state->context_statements :
+               state->statements;
+    values = upgrade_count_values(state, hash);
+    if(values != (long)expected) {
+      fprintf(stderr, "%s: Index %s has %ld values, expected %lu\n",
+              state->program, name, values, expected);
+      rc = 1;
+    }
+  }
+
+  tidy:
+  for(i = 0; i < count; i++) {
+    free(heap[i].record);
+    fclose(heap[i].fh);
+  }
+  free(heap);
+  librdf_free_hash(hash);
+
+  return rc;
+}
+
+
+/* Build all wanted indexes that are not done, jobs at a time */
+static int
+upgrade_build_indexes(upgrade_state* state)
+{
+  int i;
+  int rc = 0;
+#ifdef HAVE_FORK
+  pid_t pids[UPGRADE_INDEXES_COUNT];
+  int running = 0;
+
+  memset(pids, '\0', sizeof(pids));
+#endif
+
+  for(i = 0; i < UPGRADE_INDEXES_COUNT; i++) {
+    if(!state->wanted[i] || state->done[i])
+      continue;
+
+    fprintf(stderr, "%s: Building index %s\n", state->program,
+            upgrade_indexes[i].name);
+
+#ifdef HAVE_FORK
+    if(state->jobs > 1) {
+      pid_t pid;
+
+      /* wait for a job to finish if all are busy */
+      while(running >= state->jobs) {
+        int status;
+        int j;
+
+        pid = wait(&status);
+        if(pid < 0)
+          break;
+        for(j = 0; j < UPGRADE_INDEXES_COUNT; j++) {
+          if(pids[j] == pid) {
+            pids[j] = 0;
+            running--;
+            if(WIFEXITED(status) && !WEXITSTATUS(status)) {
+              state->done[j] = 1;
+              upgrade_write_state(state);
+            } else
+              rc = 1;
+          }
+        }
+      }
+
+      fflush(stderr);
+      pid = fork();
+      if(!pid)
+        _exit(upgrade_build_index(state, i));
+      if(pid > 0) {
+        pids[i] = pid;
+        running++;
+        continue;
+      }
+      /* fork failed so build it here */
+    }
+#endif
+
+    if(upgrade_build_index(state, i))
+      rc = 1;
+    else {
+      state->done[i] = 1;
+      upgrade_write_state(state);
+    }
+  }
+
+#ifdef HAVE_FORK
+  for(i = 0; i < UPGRADE_INDEXES_COUNT; i++) {
+    int status;
+
+    if(!pids[i])
+      continue;
+
+    if(waitpid(pids[i], &status, 0) == pids[i] &&
+       WIFEXITED(status) && !WEXITSTATUS(status)) {
+      state->done[i] = 1;
+      upgrade_write_state(state);
+    } else
+      rc = 1;
+  }
+#endif
+
+  for(i = 0; i < UPGRADE_INDEXES_COUNT; i++) {
+    if(state->wanted[i] && !state->done[i]) {
+      fprintf(stderr, "%s: Failed to build index %s\n", state->program,
+              upgrade_indexes[i].name);
+      rc = 1;
+    }
+  }
+
+  return rc;
+}
+
+
+static void
+upgrade_remove_runs(upgrade_state* state)
+{
+  int i;
+  int r;
+
+  for(i = 0; i < UPGRADE_INDEXES_COUNT; i++) {
+    for(r = 0; r < state->runs_count; r++) {
+      char* file_name;
+
+      file_name = upgrade_file_name(state, state->new_name,
+                                    upgrade_indexes[i].name, ".run", r);
+      if(file_name) {
+        remove(file_name);
+        free(file_name);
+      }
+    }
+  }
+}
+
+
+static void
+upgrade_usage(const char* program)
+{
+  fprintf(stderr, "USAGE: %s [OPTIONS] <Redland store name> [new store name]\n", program);
+  fputs("  -c          Store has contexts\n", stderr);
+  fputs("  -d DIR      Directory of the stores (default '.')\n", stderr);
+  fputs("  -f TYPE     Hash type of the old store (default 'bdb')\n", stderr);
+  fputs("  -t TYPE     Hash type of the new store (default old type)\n", stderr);
+  fputs("  -j JOBS     Build up to JOBS indexes in parallel (default 1)\n", stderr);
+  fputs("  -m RECORDS  Records per sorted run (default 1000000)\n", stderr);
+  fputs("  -p          Store has a predicate index (p2so)\n", stderr);
+  fputs("  -r          Resume an interrupted upgrade\n", stderr);
+}
+
 
 int
 main(int argc, char *argv[]) 
 {
-  librdf_world* world;
-  librdf_storage *storage, *new_storage;
-  librdf_model *model, *new_model;
-  librdf_stream *stream;
+  upgrade_state state;
   char *program=argv[0];
-  char *name;
-  char *new_name;
-  int count;
+  char *new_name=NULL;
+  char *state_file;
+  int resume=0;
+  int i;
+  int rc=0;
+
+  memset(&state, '\0', sizeof(state));
+  state.program=program;
+  state.dir=".";
+  state.old_hash_type="bdb";
+  state.run_size=UPGRADE_DEFAULT_RUN_SIZE;
+  state.jobs=1;
+  for(i=0; i < UPGRADE_INDEXES_COUNT; i++)
+    state.wanted[i]=(i != UPGRADE_P2SO_INDEX && i != UPGRADE_CONTEXTS_INDEX);
+
+  for(i=1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+    const char* arg=NULL;
+    char opt=argv[i][1];
+
+    if(strchr("dftjm", opt)) {
+      if(i+1 == argc) {
+        upgrade_usage(program);
+        return(1);
+      }
+      arg=argv[++i];
+    }
+
+    switch(opt) {
+      case 'c':
+        state.wanted[UPGRADE_CONTEXTS_INDEX]=1;
+        break;
+      case 'd':
+        state.dir=arg;
+        break;
+      case 'f':
+        state.old_hash_type=arg;
+        break;
+      case 't':
+        state.new_hash_type=arg;
+        break;
+      case 'j':
+        state.jobs=atoi(arg);
+        break;
+      case 'm':
+        state.run_size=atoi(arg);
+        break;
+      case 'p':
+        state.wanted[UPGRADE_P2SO_INDEX]=1;
+        break;
+      case 'r':
+        resume=1;
+        break;
+      default:
+        upgrade_usage(program);
+        return(1);
+    }
+  }
 
-  if(argc < 2 || argc >3) {
-    fprintf(stderr, "USAGE: %s: <Redland BDB name> [new DB name]\n", program);
+  if(argc - i < 1 || argc - i > 2 || state.jobs < 1 || state.run_size < 1) {
+    upgrade_usage(program);
     return(1);
   }
 
-  name=argv[1];
+  state.old_name=argv[i];
+  if(!state.new_hash_type)
+    state.new_hash_type=state.old_hash_type;
 
-  if(argc < 3) {
-    new_name=librdf_heuristic_gen_name(name);
+  if(argc - i < 2) {
+    new_name=librdf_heuristic_gen_name(state.old_name);
     if(!new_name) {
       fprintf(stderr, "%s: Failed to create new name from '%s'\n", program,
-              name);
+              state.old_name);
       return(1);
     }
-  } else {
-    new_name=argv[2];
-  }
+    state.new_name=new_name;
+  } else
+    state.new_name=argv[i+1];
   
-  fprintf(stderr, "%s: Upgrading DB '%s' to '%s'\n", program, name, new_name);
+  fprintf(stderr, "%s: Upgrading %s store '%s' to %s store '%s'\n", program,
+          state.old_hash_type, state.old_name, state.new_hash_type,
+          state.new_name);
 
-  world=librdf_new_world();
-  librdf_world_open(world);
+  state.world=librdf_new_world();
+  librdf_world_open(state.world);
 
-  storage=librdf_new_storage(world, "hashes", name, 
-                             "hash-type='bdb',dir='.',write='no',new='no'");
-  if(!storage) {
-    fprintf(stderr, "%s: Failed to open old storage '%s'\n", program, name);
-    return(1);
+  state.options=librdf_new_hash(state.world, NULL);
+  if(!state.options) {
+    rc=1;
+    goto tidy;
   }
 
-  new_storage=librdf_new_storage(world, "hashes", new_name,
-                                 "hash-type='bdb',dir='.',write='yes',new='yes'");
-  if(!storage) {
-    fprintf(stderr, "%s: Failed to create new storage '%s'\n", program, new_name);
-    return(1);
+  if(resume) {
+    upgrade_read_state(&state);
+    if(state.scanned)
+      fprintf(stderr, "%s: Resuming after reading %lu statements\n", program,
+              state.statements);
   }
 
-  model=librdf_new_model(world, storage, NULL);
-  if(!model) {
-    fprintf(stderr, "%s: Failed to create model for '%s'\n", program, name);
-    return(1);
+  if(!state.scanned) {
+    if(upgrade_scan(&state)) {
+      rc=1;
+      goto tidy;
+    }
+    upgrade_write_state(&state);
+    fprintf(stderr, "%s: Read %lu statements into %d runs\n", program,
+            state.statements, state.runs_count);
   }
 
-  new_model=librdf_new_model(world, new_storage, NULL);
-  if(!new_model) {
-    fprintf(stderr, "%s: Failed to create new model for '%s'\n", program, new_name);
-    return(1);
-  }
-  
-  stream=librdf_model_as_stream(model);
-  if(!stream) {
-    fprintf(stderr, "%s: librdf_model_as_stream returned NULL stream\n", 
+  if(upgrade_build_indexes(&state)) {
+    fprintf(stderr, "%s: Upgrade incomplete, run again with -r to resume\n",
             program);
-    return(1);
-  } else {
-    count=0;
-    while(!librdf_stream_end(stream)) {
-      librdf_statement *statement=librdf_stream_get_object(stream);
-      if(!statement) {
-        fprintf(stderr, "%s: librdf_stream_next returned NULL\n", program);
-        break;
-      }
-      
-      librdf_model_add_statement(new_model, statement);
+    rc=1;
+    goto tidy;
+  }
 
-      librdf_stream_next(stream);
-      count++;
-    }
-    librdf_free_stream(stream);  
+  /* all indexes built and counted so tidy up */
+  upgrade_remove_runs(&state);
+  state_file=upgrade_file_name(&state, state.new_name, "", "-upgrade.state",
+                               -1);
+  if(state_file) {
+    remove(state_file);
+    free(state_file);
   }
 
-      
-  librdf_free_model(model);
-  librdf_free_model(new_model);
+  fprintf(stderr, "%s: Upgraded %lu statements\n", program, state.statements);
 
-  librdf_free_storage(storage);
-  librdf_free_storage(new_storage);
+  tidy:
+  if(state.key_buffer)
+    free(state.key_buffer);
+  if(state.value_buffer)
+    free(state.value_buffer);
+  if(state.options)
+    librdf_free_hash(state.options);
 
-  librdf_free_world(world);
+  librdf_free_world(state.world);
 
-  if(argc < 3)
+  if(new_name)
     free(new_name);
 
 
@@ -136,6 +1098,5 @@ main(int argc, char *argv[])
   librdf_memory_report(stderr);
 #endif
 	
-  /* keep gcc -Wall happy */
-  return(0);
+  return(rc);
 }
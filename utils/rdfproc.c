@@ -46,6 +46,22 @@
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#ifdef TIME_WITH_SYS_TIME
+#include <sys/time.h>
+#include <time.h>
+#else
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#else
+#include <time.h>
+#endif
+#endif
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+#ifdef HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
 
 #include <redland.h>
 #include <raptor.h>
@@ -87,7 +103,8 @@ enum command_type {
   CMD_REMOVE_CONTEXT,
   CMD_CONTEXTS,
   CMD_MATCH,
-  CMD_SIZE
+  CMD_SIZE,
+  CMD_BULK_LOAD
 };
 
 typedef struct
@@ -95,7 +112,7 @@ typedef struct
   enum command_type type;
   const char *name;
   int min_args; /* min args needed? */
-  int max_args; /* max args needed? */
+  int max_args; /* max args needed? or -1 for no limit */
   int write; /* write to db? */
 } command;
 
@@ -127,6 +144,7 @@ static command commands[]={
   {CMD_CONTEXTS, "contexts", 0, 0, 0},
   {CMD_MATCH, "match", 3, 4, 0},
   {CMD_SIZE, "size", 0, 0, 0},
+  {CMD_BULK_LOAD, "bulk-load", 1, -1, 1},
   {(enum command_type)-1, NULL, 0, 0, 0}  
 };
  
@@ -140,14 +158,18 @@ static command commands[]={
 #endif
 
 
-#define GETOPT_STRING "chno:pqr:s:t:TvV"
+#define GETOPT_STRING "B:cC:hj:mno:pqr:s:t:TvV"
 
 #ifdef HAVE_GETOPT_LONG
 static struct option long_options[] =
 {
   /* name, has_arg, flag, val */
+  {"batch", 1, 0, 'B'},
   {"contexts", 0, 0, 'c'},
+  {"trace", 1, 0, 'C'},
   {"help", 0, 0, 'h'},
+  {"jobs", 1, 0, 'j'},
+  {"metrics", 0, 0, 'm'},
   {"new", 0, 0, 'n'},
   {"output", 1, 0, 'o'},
   {"password", 0, 0, 'p'},
@@ -246,6 +268,433 @@ print_node(FILE* fh, librdf_node* node)
 }
 
 
+/* bulk-load command */
+
+typedef struct
+{
+  librdf_world* world;
+  librdf_model* model;
+
+  /* statements per storage transaction or 0 for none */
+  int batch_size;
+  int in_transaction;
+  int batch_count;
+
+  /* total input size and size of input files finished with */
+  long total_bytes;
+  long done_bytes;
+
+  unsigned long statements;
+  int errors;
+
+  double start_time;
+  double last_report_time;
+
+  int verbosity;
+  /* prefix for progress messages such as the job number, or NULL */
+  const char* label;
+} bulk_load_state;
+
+
+static double
+bulk_load_now(void)
+{
+#ifdef HAVE_GETTIMEOFDAY
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+#else
+  return (double)time(NULL);
+#endif
+}
+
+
+/* Resident set size in kilobytes or -1 if unknown */
+static long
+bulk_load_rss_kb(void)
+{
+  long rss = -1;
+#ifdef _SC_PAGESIZE
+  FILE* fh;
+#endif
+
+#ifdef _SC_PAGESIZE
+  fh = fopen("/proc/self/statm", "r");
+  if(fh) {
+    long size, resident;
+    if(fscanf(fh, "%ld %ld", &size, &resident) == 2)
+      rss = resident * (sysconf(_SC_PAGESIZE) / 1024);
+    fclose(fh);
+  }
+#endif
+
+#ifdef HAVE_GETRUSAGE
+  if(rss < 0) {
+    struct rusage usage;
+    if(!getrusage(RUSAGE_SELF, &usage))
+      rss = usage.ru_maxrss;
+  }
+#endif
+
+  return rss;
+}
+
+
+/* Peak resident set size in kilobytes of this process and any
+ * finished children or -1 if unknown
+ */
+static long
+bulk_load_peak_rss_kb(void)
+{
+#ifdef HAVE_GETRUSAGE
+  struct rusage usage;
+  long peak = -1;
+
+  if(!getrusage(RUSAGE_SELF, &usage))
+    peak = usage.ru_maxrss;
+  if(!getrusage(RUSAGE_CHILDREN, &usage) && usage.ru_maxrss > peak)
+    peak = usage.ru_maxrss;
+  return peak;
+#else
+  return bulk_load_rss_kb();
+#endif
+}
+
+
+static void
+bulk_load_report(bulk_load_state* state, long current_bytes)
+{
+  double now = bulk_load_now();
+  double elapsed = now - state->start_time;
+  long bytes = state->done_bytes + current_bytes;
+  double rate = 0.0;
+  double eta = -1.0;
+
+  if(elapsed > 0.0) {
+    rate = (double)state->statements / elapsed;
+    if(bytes > 0 && state->total_bytes > bytes)
+      eta = (double)(state->total_bytes - bytes) * elapsed / (double)bytes;
+  }
+
+  fprintf(stderr, "%s: %s%s%lu statements, %.0f statements/s, RSS %ld kB",
+          program,
+          (state->label ? state->label : ""), (state->label ? ": " : ""),
+          state->statements, rate, bulk_load_rss_kb());
+  if(eta >= 0.0)
+    fprintf(stderr, ", ETA %.0fs", eta);
+  fputc('\n', stderr);
+
+  state->last_report_time = now;
+}
+
+
+static void
+bulk_load_transaction_start(bulk_load_state* state)
+{
+  if(!state->batch_size)
+    return;
+
+  if(librdf_model_transaction_start(state->model)) {
+    /* storage has no transactions so just add statements */
+    if(state->verbosity > 1)
+      fprintf(stderr, "%s: Storage does not support transactions\n", program);
+    state->batch_size = 0;
+    return;
+  }
+
+  state->in_transaction = 1;
+  state->batch_count = 0;
+}
+
+
+static int
+bulk_load_transaction_commit(bulk_load_state* state)
+{
+  if(!state->in_transaction)
+    return 0;
+
+  state->in_transaction = 0;
+  if(librdf_model_transaction_commit(state->model)) {
+    fprintf(stderr, "%s: Failed to commit transaction after %lu statements\n",
+            program, state->statements);
+    state->errors++;
+    return 1;
+  }
+
+  return 0;
+}
+
+
+static int
+bulk_load_parser_error_count(librdf_world* world, librdf_parser* parser)
+{
+  librdf_uri* error_count_uri;
+  librdf_node* error_count_node;
+  int error_count = 0;
+
+  error_count_uri = librdf_new_uri(world, (const unsigned char*)LIBRDF_PARSER_FEATURE_ERROR_COUNT);
+  error_count_node = librdf_parser_get_feature(parser, error_count_uri);
+  if(error_count_node) {
+    error_count = atoi((const char*)librdf_node_get_literal_value(error_count_node));
+    librdf_free_node(error_count_node);
+  }
+  librdf_free_uri(error_count_uri);
+
+  return error_count;
+}
+
+
+/* Parse one file into the model, committing every batch_size statements */
+static int
+bulk_load_file(bulk_load_state* state, const char* filename,
+               const char* syntax)
+{
+  librdf_world* world = state->world;
+  librdf_parser* parser;
+  librdf_stream* stream;
+  librdf_uri* base_uri;
+  unsigned char* uri_string;
+  FILE* fh;
+  long file_bytes = 0;
+  int rc = 0;
+
+  fh = fopen(filename, "rb");
+  if(!fh) {
+    fprintf(stderr, "%s: Failed to open file %s\n", program, filename);
+    state->errors++;
+    return 1;
+  }
+
+  uri_string = raptor_uri_filename_to_uri_string(filename);
+  base_uri = librdf_new_uri(world, uri_string);
+  raptor_free_memory(uri_string);
+  if(!base_uri) {
+    fprintf(stderr, "%s: Failed to create URI for %s\n", program, filename);
+    fclose(fh);
+    state->errors++;
+    return 1;
+  }
+
+  if(!syntax)
+    syntax = librdf_parser_guess_name2(world, NULL, NULL,
+                                       librdf_uri_as_string(base_uri));
+
+  parser = librdf_new_parser(world, syntax, NULL, NULL);
+  if(!parser) {
+    fprintf(stderr, "%s: Failed to create new parser %s\n", program,
+            syntax ? syntax : "(default)");
+    librdf_free_uri(base_uri);
+    fclose(fh);
+    state->errors++;
+    return 1;
+  }
+
+  if(state->verbosity > 1)
+    fprintf(stderr, "%s: Parsing %s with %s parser\n", program, filename,
+            syntax ? syntax : "default");
+
+  /* the file handle is read here so its position gives the progress */
+  stream = librdf_parser_parse_file_handle_as_stream(parser, fh, 0, base_uri);
+  if(!stream) {
+    fprintf(stderr, "%s: Failed to parse %s as stream\n", program, filename);
+    rc = 1;
+  } else {
+    while(!librdf_stream_end(stream)) {
+      librdf_statement *statement = librdf_stream_get_object(stream);
+      if(!statement) {
+        fprintf(stderr, "%s: librdf_stream_next returned NULL\n", program);
+        rc = 1;
+        break;
+      }
+
+      if(librdf_model_add_statement(state->model, statement)) {
+        rc = 1;
+        break;
+      }
+      state->statements++;
+
+      if(state->in_transaction && ++state->batch_count >= state->batch_size) {
+        if(bulk_load_transaction_commit(state)) {
+          rc = 1;
+          break;
+        }
+        bulk_load_transaction_start(state);
+      }
+
+      /* checking the time is cheap enough every 1024 statements */
+      if(state->verbosity && !(state->statements & 1023) &&
+         bulk_load_now() - state->last_report_time >= 1.0)
+        bulk_load_report(state, ftell(fh));
+
+      librdf_stream_next(stream);
+    }
+    librdf_free_stream(stream);
+  }
+
+  if(!rc && bulk_load_parser_error_count(world, parser) > 0)
+    rc = 1;
+
+  if(rc) {
+    fprintf(stderr, "%s: Loading %s failed\n", program, filename);
+    state->errors++;
+  }
+
+  if(!fseek(fh, 0L, SEEK_END))
+    file_bytes = ftell(fh);
+  state->done_bytes += file_bytes;
+
+  librdf_free_parser(parser);
+  librdf_free_uri(base_uri);
+  fclose(fh);
+
+  return rc;
+}
+
+
+/* Load files (or every jobs'th file from offset) into a model */
+static void
+bulk_load_files(bulk_load_state* state, char** files, int files_count,
+                int offset, int jobs, const char* syntax)
+{
+  int i;
+
+  bulk_load_transaction_start(state);
+
+  for(i = offset; i < files_count; i += jobs)
+    bulk_load_file(state, files[i], syntax);
+
+  bulk_load_transaction_commit(state);
+}
+
+
+#ifdef HAVE_FORK
+/*
+ * Load the files in jobs child processes, each with its own storage
+ * object opened on the same store.  Only useful for storages that
+ * allow several writers at once such as mysql or postgresql.
+ */
+static int
+bulk_load_parallel(bulk_load_state* state, int jobs,
+                   const char* storage_name, const char* identifier,
+                   librdf_hash* options,
+                   char** files, int files_count, const char* syntax)
+{
+  pid_t* pids;
+  int* fds;
+  char* new_value;
+  int j;
+  int rc = 0;
+
+  pids = (pid_t*)calloc(jobs, sizeof(pid_t));
+  fds = (int*)calloc(jobs, sizeof(int));
+  if(!pids || !fds) {
+    fprintf(stderr, "%s: Out of memory\n", program);
+    return 1;
+  }
+
+  /* the store already exists so never recreate it in a child */
+  new_value = librdf_hash_get_del(options, "new");
+  if(new_value)
+    librdf_free_memory(new_value);
+
+  /* children inherit stdio buffers so empty them all, including any
+   * trace file, before forking
+   */
+  fflush(NULL);
+
+  for(j = 0; j < jobs; j++) {
+    int pipe_fds[2];
+
+    if(pipe(pipe_fds)) {
+      fprintf(stderr, "%s: Failed to create pipe\n", program);
+      jobs = j;
+      rc = 1;
+      break;
+    }
+
+    pids[j] = fork();
+    if(pids[j] < 0) {
+      fprintf(stderr, "%s: Failed to start job %d\n", program, j + 1);
+      close(pipe_fds[0]);
+      close(pipe_fds[1]);
+      jobs = j;
+      rc = 1;
+      break;
+    }
+
+    if(!pids[j]) {
+      /* child: never touch the parent's storage or model objects */
+      librdf_storage* storage;
+      char label[20];
+      char result[64];
+      size_t len;
+
+      close(pipe_fds[0]);
+
+      /* only the parent writes to and ends any trace file */
+      librdf_trace_drop(state->world);
+
+      sprintf(label, "job %d", j + 1);
+      state->label = label;
+      state->statements = 0;
+      state->errors = 0;
+      state->done_bytes = 0;
+      state->total_bytes = 0;
+
+      storage = librdf_new_storage_with_options(state->world, storage_name,
+                                                identifier, options);
+      state->model = storage ? librdf_new_model(state->world, storage, NULL) : NULL;
+      if(!state->model) {
+        fprintf(stderr, "%s: %s: Failed to open %s storage '%s'\n", program,
+                label, storage_name, identifier);
+        state->errors++;
+      } else {
+        bulk_load_files(state, files, files_count, j, jobs, syntax);
+        librdf_free_model(state->model);
+      }
+      if(storage)
+        librdf_free_storage(storage);
+
+      sprintf(result, "%lu %d\n", state->statements, state->errors);
+      len = strlen(result);
+      if(write(pipe_fds[1], result, len) != (ssize_t)len)
+        _exit(1);
+      close(pipe_fds[1]);
+      _exit(state->errors ? 1 : 0);
+    }
+
+    close(pipe_fds[1]);
+    fds[j] = pipe_fds[0];
+  }
+
+  for(j = 0; j < jobs; j++) {
+    char result[64];
+    ssize_t len;
+    unsigned long statements = 0;
+    int errors = 1;
+    int status;
+
+    len = read(fds[j], result, sizeof(result) - 1);
+    if(len > 0) {
+      result[len] = '\0';
+      sscanf(result, "%lu %d", &statements, &errors);
+    }
+    close(fds[j]);
+    waitpid(pids[j], &status, 0);
+
+    state->statements += statements;
+    state->errors += errors;
+  }
+
+  free(pids);
+  free(fds);
+
+  return rc;
+}
+#endif
+
+
 int
 main(int argc, char *argv[]) 
 {
@@ -292,6 +741,11 @@ main(int argc, char *argv[])
   size_t size;
   const char *query_graph_serializer_syntax_name="rdfxml";
   char* results_format=NULL;
+  int batch_size=0;
+  int jobs=1;
+  librdf_metrics* metrics=NULL;
+  FILE* trace_fh=NULL;
+  raptor_iostream* trace_iostr=NULL;
 
   program=argv[0];
   if((p=strrchr(program, '/')))
@@ -337,14 +791,53 @@ main(int argc, char *argv[])
         usage=1;
         break;
         
+      case 'B':
+        if(optarg) {
+          batch_size=atoi(optarg);
+          if(batch_size < 0) {
+            fprintf(stderr, "%s: invalid argument `%s' for `" HELP_ARG(B, batch) "'\n", program, optarg);
+            usage=1;
+          }
+        }
+        break;
+
       case 'c':
         librdf_hash_put_strings(options, "contexts", "yes");
         break;
 
+      case 'C':
+        if(optarg && !trace_fh) {
+          trace_fh=fopen(optarg, "w");
+          if(trace_fh)
+            trace_iostr=raptor_new_iostream_to_file_handle(librdf_world_get_raptor(world),
+                                                           trace_fh);
+          if(!trace_iostr ||
+             librdf_world_set_trace_chrome(world, trace_iostr)) {
+            fprintf(stderr, "%s: Failed to write trace file `%s'\n",
+                    program, optarg);
+            usage=1;
+          }
+        }
+        break;
+
       case 'h':
         help=1;
         break;
 
+      case 'j':
+        if(optarg) {
+          jobs=atoi(optarg);
+          if(jobs < 1) {
+            fprintf(stderr, "%s: invalid argument `%s' for `" HELP_ARG(j, jobs) "'\n", program, optarg);
+            usage=1;
+          }
+        }
+        break;
+
+      case 'm':
+        metrics=librdf_world_get_metrics(world);
+        break;
+
       case 'n':
         is_new=1;
         break;
@@ -548,7 +1041,8 @@ main(int argc, char *argv[])
     fprintf(stderr, "%s: Command %s needs %d arguments\n", program, 
             cmd, commands[cmd_index].min_args);
     usage=1;
-  } else if(argc > commands[cmd_index].max_args) {
+  } else if(commands[cmd_index].max_args >= 0 &&
+            argc > commands[cmd_index].max_args) {
     fprintf(stderr, "%s: Command %s given more than %d arguments\n",
             program, cmd, commands[cmd_index].max_args);
     usage=1;
@@ -578,8 +1072,12 @@ main(int argc, char *argv[])
     puts(librdf_short_copyright_string);
     puts("Utility for processing RDF using the Redland library.");
     puts("\nOptions:");
+    puts(HELP_TEXT(B, "batch N         ", "bulk-load: commit a transaction every N triples"));
     puts(HELP_TEXT(c, "contexts        ", "Use Redland contexts"));
+    puts(HELP_TEXT(C, "trace FILE      ", "Write a Chrome trace of operations to FILE"));
     puts(HELP_TEXT(h, "help            ", "Print this help, then exit"));
+    puts(HELP_TEXT(j, "jobs N          ", "bulk-load: load files in N parallel processes"));
+    puts(HELP_TEXT(m, "metrics         ", "Print operation metrics to stderr at exit"));
     puts(HELP_TEXT(n, "new             ", "Create a new store (default no)"));
     puts(HELP_TEXT(o, "output FORMAT   ", "Set the triple output format"));
     for(i = 0; 1; i++) {
@@ -628,6 +1126,9 @@ main(int argc, char *argv[])
     puts("  parse-stream FILE|URI [SYNTAX [BASEURI [CONTEXT]]]");
     puts("      Parse RDF syntax (default RDF/XML) in FILE or URI into the graph");
     puts("      with optional BASEURI, into the optional CONTEXT.");
+    puts("  bulk-load FILE... [SYNTAX]");
+    puts("      Load RDF syntax (default guessed) from FILEs into the graph");
+    puts("      reporting progress and a JSON summary of the throughput.");
     puts("  print                                     Print the graph triples.");
     puts("  serialize [SYNTAX [URI [MIME-TYPE]]]      Serializes to a syntax (RDF/XML).");
     puts("  query NAME|- URI|- QUERY-STRING           Run QUERY-STRING query in language NAME for bindings");
@@ -1059,13 +1560,10 @@ main(int argc, char *argv[])
        if(verbosity)
          fprintf(stderr, "%s: Query returned graph result:\n", program);
        
-       stream=librdf_query_results_as_stream(results);
-       if(!stream) {
+       if(librdf_query_results_add_to_model(results, tmp_model)) {
          fprintf(stderr, "%s: Failed to get query results graph\n", program);
          return(1);
        }
-       librdf_model_add_statements(tmp_model, stream);
-       librdf_free_stream(stream);
 
        if(verbosity)
          fprintf(stderr, "%s: Total %d triples\n", program,
@@ -1565,6 +2063,98 @@ main(int argc, char *argv[])
         fprintf(stdout, "%s: graph has unknown number of triples\n", program);
       break;
 
+    case CMD_BULK_LOAD:
+      {
+        bulk_load_state state;
+        const char* syntax=NULL;
+        char** files=argv;
+        int files_count=argc;
+        double elapsed;
+        int j;
+
+        /* a final argument that is not a file may name the syntax */
+        if(argc > 1 && access(argv[argc-1], R_OK) &&
+           librdf_parser_check_name(world, argv[argc-1])) {
+          syntax=argv[argc-1];
+          files_count--;
+        }
+
+        memset(&state, '\0', sizeof(state));
+        state.world=world;
+        state.model=model;
+        state.batch_size=batch_size;
+        state.verbosity=verbosity;
+
+        for(j=0; j < files_count; j++) {
+          FILE* fh=fopen(files[j], "rb");
+          if(fh) {
+            if(!fseek(fh, 0L, SEEK_END))
+              state.total_bytes += ftell(fh);
+            fclose(fh);
+          }
+        }
+
+        if(jobs > files_count)
+          jobs=files_count;
+
+        /* only stores that allow several writers at once can be loaded
+         * by parallel jobs
+         */
+        if(jobs > 1 && strcmp(storage_name, "mysql") &&
+           strcmp(storage_name, "postgresql")) {
+          fprintf(stderr, "%s: Warning - %s storage does not allow parallel jobs, using 1\n",
+                  program, storage_name);
+          jobs=1;
+        }
+
+        if(verbosity)
+          fprintf(stderr, "%s: Loading %d files (%ld bytes) with %d job%s\n",
+                  program, files_count, state.total_bytes, jobs,
+                  (jobs == 1) ? "" : "s");
+
+        state.start_time=bulk_load_now();
+        state.last_report_time=state.start_time;
+
+        if(jobs > 1) {
+#ifdef HAVE_FORK
+          /* end any -T transaction so the jobs can see the store */
+          if(transactions) {
+            librdf_model_transaction_commit(model);
+            transactions=0;
+          }
+          if(bulk_load_parallel(&state, jobs, storage_name, identifier,
+                                options, files, files_count, syntax))
+            state.errors++;
+#else
+          fprintf(stderr, "%s: Parallel jobs are not supported, using 1\n",
+                  program);
+          jobs=1;
+#endif
+        }
+
+        if(jobs == 1)
+          bulk_load_files(&state, files, files_count, 0, 1, syntax);
+
+        elapsed=bulk_load_now() - state.start_time;
+
+        if(verbosity)
+          bulk_load_report(&state, 0);
+
+        /* one line machine readable summary */
+        fprintf(stdout,
+                "{\"command\": \"bulk-load\", \"files\": %d, \"jobs\": %d, "
+                "\"statements\": %lu, \"seconds\": %.3f, "
+                "\"statements_per_second\": %.1f, \"peak_rss_kb\": %ld, "
+                "\"errors\": %d}\n",
+                files_count, jobs, state.statements, elapsed,
+                (elapsed > 0.0) ? (double)state.statements / elapsed : 0.0,
+                bulk_load_peak_rss_kb(), state.errors);
+
+        if(state.errors)
+          rc=1;
+      }
+      break;
+
     default:
       fprintf(stderr, "%s: Unknown command %d\n", program, type);
       return(1);
@@ -1596,6 +2186,23 @@ main(int argc, char *argv[])
   librdf_free_model(model);
   librdf_free_storage(storage);
 
+  if(trace_iostr) {
+    librdf_world_set_trace_chrome(world, NULL);
+    raptor_free_iostream(trace_iostr);
+  }
+  if(trace_fh)
+    fclose(trace_fh);
+
+  if(metrics) {
+    raptor_iostream* iostr;
+    iostr=raptor_new_iostream_to_file_handle(librdf_world_get_raptor(world),
+                                             stderr);
+    if(iostr) {
+      librdf_metrics_write_prometheus(metrics, iostr);
+      raptor_free_iostream(iostr);
+    }
+  }
+
   librdf_free_world(world);
 
 #ifdef LIBRDF_MEMORY_DEBUG
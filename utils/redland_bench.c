@@ -0,0 +1,1386 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * redland_bench.c - Redland storage benchmark
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <rdf_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rdf_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#include <sys/time.h>
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+
+#include <redland.h>
+
+
+/* one prototype needed */
+int main(int argc, char *argv[]);
+
+
+/*
+ * The generated graph has one subject per BENCH_SUBJECT_TRIPLES
+ * triples, BENCH_PREDICATES predicates, and each (subject, predicate)
+ * pair has several objects.  The first BENCH_LINK_PREDICATES
+ * predicates point at other subjects, the rest have one of
+ * BENCH_LITERALS shared literal values so that sources fan out.
+ */
+#define BENCH_SUBJECT_TRIPLES 20
+#define BENCH_PREDICATES 5
+#define BENCH_LINK_PREDICATES 2
+#define BENCH_LITERALS 1000
+#define BENCH_CONTEXTS 10
+
+/*
+ * The remove-skewed workload adds BENCH_SKEW_TRIPLES triples per
+ * lookup whose predicate is rank r of BENCH_SKEW_PREDICATES with
+ * probability 1/2^(r+1) (like rdf:type dominating a real graph) and
+ * whose object is one of BENCH_SKEW_CLASSES, then removes them.
+ */
+#define BENCH_SKEW_TRIPLES 10
+#define BENCH_SKEW_PREDICATES 8
+#define BENCH_SKEW_CLASSES 4
+
+/* overlay-create and copy-create remove every BENCH_CHANGE_STRIDE'th
+ * loaded triple (wrapping round)
+ */
+#define BENCH_CHANGE_STRIDE 7919
+
+#define BENCH_NS "http://example.org/bench/"
+
+#define BENCH_DEFAULT_TRIPLES 100000
+#define BENCH_DEFAULT_LOOKUPS 1000
+
+
+typedef struct
+{
+  librdf_world* world;
+  librdf_storage* storage;
+  librdf_model* model;
+
+  int triples;
+  int subjects;
+  int lookups;
+  int contexts;
+
+  /* load with statement streams rather than one at a time */
+  int stream_load;
+
+  /* the same changes over the loaded model, layered or copied */
+  librdf_model* overlay;
+  librdf_model* copy;
+
+  /* state of the pseudo-random number generator */
+  unsigned long seed;
+} bench_state;
+
+
+typedef struct
+{
+  const char* name;
+
+  /* operations done and the time taken for each in seconds */
+  double* latencies;
+  int count;
+  int size;
+
+  /* total time and number of items (triples, rows) handled */
+  double seconds;
+  unsigned long items;
+} bench_result;
+
+
+typedef int (*bench_workload_fn)(bench_state* state, bench_result* result);
+
+typedef struct
+{
+  const char* name;
+  const char* label;
+  bench_workload_fn fn;
+  /* workload needs a storage with contexts */
+  int needs_contexts;
+} bench_workload;
+
+
+static const char *program;
+
+
+static double
+bench_now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+}
+
+
+static long
+bench_peak_rss_kb(void)
+{
+#ifdef HAVE_GETRUSAGE
+  struct rusage usage;
+
+  if(!getrusage(RUSAGE_SELF, &usage))
+    return usage.ru_maxrss;
+#endif
+  return -1;
+}
+
+
+/* Repeatable pseudo-random numbers so runs can be compared */
+static int
+bench_random(bench_state* state, int range)
+{
+  state->seed = state->seed * 1103515245UL + 12345UL;
+  return (int)((state->seed >> 16) % (unsigned long)range);
+}
+
+
+static int
+bench_result_add(bench_result* result, double latency)
+{
+  if(result->count == result->size) {
+    int size = result->size ? result->size * 2 : 1024;
+    double* latencies;
+
+    latencies = (double*)realloc(result->latencies, size * sizeof(double));
+    if(!latencies)
+      return 1;
+    result->latencies = latencies;
+    result->size = size;
+  }
+
+  result->latencies[result->count++] = latency;
+  result->seconds += latency;
+  return 0;
+}
+
+
+static librdf_node*
+bench_new_subject(bench_state* state, int subject)
+{
+  char buffer[64];
+
+  sprintf(buffer, BENCH_NS "s%d", subject);
+  return librdf_new_node_from_uri_string(state->world,
+                                         (const unsigned char*)buffer);
+}
+
+
+static librdf_node*
+bench_new_predicate(bench_state* state, int predicate)
+{
+  char buffer[64];
+
+  sprintf(buffer, BENCH_NS "p%d", predicate);
+  return librdf_new_node_from_uri_string(state->world,
+                                         (const unsigned char*)buffer);
+}
+
+
+static librdf_node*
+bench_new_literal(bench_state* state, int value)
+{
+  char buffer[32];
+
+  sprintf(buffer, "v%d", value);
+  return librdf_new_node_from_literal(state->world,
+                                      (const unsigned char*)buffer, NULL, 0);
+}
+
+
+static librdf_node*
+bench_new_context(bench_state* state, int context)
+{
+  char buffer[64];
+
+  sprintf(buffer, BENCH_NS "c%d", context);
+  return librdf_new_node_from_uri_string(state->world,
+                                         (const unsigned char*)buffer);
+}
+
+
+/* Object of generated triple i */
+static librdf_node*
+bench_new_object(bench_state* state, int i)
+{
+  int subject = i / BENCH_SUBJECT_TRIPLES;
+  int predicate = i % BENCH_PREDICATES;
+
+  if(predicate < BENCH_LINK_PREDICATES)
+    return bench_new_subject(state, (subject * 31 + i) % state->subjects);
+
+  return bench_new_literal(state, i % BENCH_LITERALS);
+}
+
+
+static librdf_statement*
+bench_new_statement(bench_state* state, int i)
+{
+  return librdf_new_statement_from_nodes(state->world,
+                                         bench_new_subject(state, i / BENCH_SUBJECT_TRIPLES),
+                                         bench_new_predicate(state, i % BENCH_PREDICATES),
+                                         bench_new_object(state, i));
+}
+
+
+/* Stream of generated triples start, start+step, ... below end */
+typedef struct
+{
+  bench_state* state;
+  int i;
+  int step;
+  librdf_statement* statement;
+} bench_stream_context;
+
+
+static int
+bench_stream_end_of_stream(void* context)
+{
+  bench_stream_context* scontext = (bench_stream_context*)context;
+
+  return !scontext->statement;
+}
+
+
+static int
+bench_stream_next_statement(void* context)
+{
+  bench_stream_context* scontext = (bench_stream_context*)context;
+
+  librdf_free_statement(scontext->statement);
+  scontext->statement = NULL;
+
+  scontext->i += scontext->step;
+  if(scontext->i < scontext->state->triples)
+    scontext->statement = bench_new_statement(scontext->state, scontext->i);
+
+  return !scontext->statement;
+}
+
+
+static void*
+bench_stream_get_statement(void* context, int flags)
+{
+  bench_stream_context* scontext = (bench_stream_context*)context;
+
+  if(flags == LIBRDF_ITERATOR_GET_METHOD_GET_OBJECT)
+    return scontext->statement;
+  return NULL;
+}
+
+
+static void
+bench_stream_finished(void* context)
+{
+  bench_stream_context* scontext = (bench_stream_context*)context;
+
+  if(scontext->statement)
+    librdf_free_statement(scontext->statement);
+  free(scontext);
+}
+
+
+static librdf_stream*
+bench_new_stream(bench_state* state, int start, int step)
+{
+  bench_stream_context* scontext;
+  librdf_stream* stream;
+
+  scontext = (bench_stream_context*)calloc(1, sizeof(*scontext));
+  if(!scontext)
+    return NULL;
+  scontext->state = state;
+  scontext->i = start;
+  scontext->step = step;
+  if(start < state->triples) {
+    scontext->statement = bench_new_statement(state, start);
+    if(!scontext->statement) {
+      free(scontext);
+      return NULL;
+    }
+  }
+
+  stream = librdf_new_stream(state->world, scontext,
+                             &bench_stream_end_of_stream,
+                             &bench_stream_next_statement,
+                             &bench_stream_get_statement,
+                             &bench_stream_finished);
+  if(!stream)
+    bench_stream_finished(scontext);
+  return stream;
+}
+
+
+/* Add the triples as one stream per context */
+static int
+bench_load_streams(bench_state* state, bench_result* result)
+{
+  int streams = state->contexts ? BENCH_CONTEXTS : 1;
+  int c;
+
+  for(c = 0; c < streams; c++) {
+    librdf_stream* stream;
+    librdf_node* context = NULL;
+    double start;
+    int rc;
+
+    stream = bench_new_stream(state, c, streams);
+    if(!stream)
+      return 1;
+    if(state->contexts)
+      context = bench_new_context(state, c);
+
+    start = bench_now();
+    if(context)
+      rc = librdf_model_context_add_statements(state->model, context, stream);
+    else
+      rc = librdf_model_add_statements(state->model, stream);
+    bench_result_add(result, bench_now() - start);
+
+    if(context)
+      librdf_free_node(context);
+    librdf_free_stream(stream);
+
+    if(rc) {
+      fprintf(stderr, "%s: Failed to add stream %d\n", program, c);
+      return 1;
+    }
+    result->items += (state->triples - c + streams - 1) / streams;
+  }
+
+  return 0;
+}
+
+
+static int
+bench_load(bench_state* state, bench_result* result)
+{
+  int i;
+
+  if(state->stream_load)
+    return bench_load_streams(state, result);
+
+  for(i = 0; i < state->triples; i++) {
+    librdf_statement* statement;
+    librdf_node* context = NULL;
+    double start;
+    int rc;
+
+    statement = bench_new_statement(state, i);
+    if(!statement)
+      return 1;
+    if(state->contexts)
+      context = bench_new_context(state, i % BENCH_CONTEXTS);
+
+    start = bench_now();
+    if(context)
+      rc = librdf_model_context_add_statement(state->model, context, statement);
+    else
+      rc = librdf_model_add_statement(state->model, statement);
+    bench_result_add(result, bench_now() - start);
+
+    if(context)
+      librdf_free_node(context);
+    librdf_free_statement(statement);
+
+    if(rc) {
+      fprintf(stderr, "%s: Failed to add triple %d\n", program, i);
+      return 1;
+    }
+    result->items++;
+  }
+
+  return 0;
+}
+
+
+/* Find statements in model matching triple i with the parts not in
+ * mask blank
+ */
+static int
+bench_find_pattern_in_model(bench_state* state, bench_result* result,
+                            librdf_model* model, int mask)
+{
+  int n;
+
+  for(n = 0; n < state->lookups; n++) {
+    int i = bench_random(state, state->triples);
+    librdf_statement* statement;
+    librdf_stream* stream;
+    double start;
+
+    statement = librdf_new_statement_from_nodes(state->world,
+      (mask & 4) ? bench_new_subject(state, i / BENCH_SUBJECT_TRIPLES) : NULL,
+      (mask & 2) ? bench_new_predicate(state, i % BENCH_PREDICATES) : NULL,
+      (mask & 1) ? bench_new_object(state, i) : NULL);
+    if(!statement)
+      return 1;
+
+    start = bench_now();
+    stream = librdf_model_find_statements(model, statement);
+    if(stream) {
+      while(!librdf_stream_end(stream)) {
+        result->items++;
+        librdf_stream_next(stream);
+      }
+      librdf_free_stream(stream);
+    }
+    bench_result_add(result, bench_now() - start);
+
+    librdf_free_statement(statement);
+    if(!stream)
+      return 1;
+  }
+
+  return 0;
+}
+
+
+static int
+bench_find_pattern(bench_state* state, bench_result* result, int mask)
+{
+  return bench_find_pattern_in_model(state, result, state->model, mask);
+}
+
+
+static int
+bench_find_spo(bench_state* state, bench_result* result)
+{
+  return bench_find_pattern(state, result, 7);
+}
+
+static int
+bench_find_sp(bench_state* state, bench_result* result)
+{
+  return bench_find_pattern(state, result, 6);
+}
+
+static int
+bench_find_so(bench_state* state, bench_result* result)
+{
+  return bench_find_pattern(state, result, 5);
+}
+
+static int
+bench_find_s(bench_state* state, bench_result* result)
+{
+  return bench_find_pattern(state, result, 4);
+}
+
+static int
+bench_find_po(bench_state* state, bench_result* result)
+{
+  return bench_find_pattern(state, result, 3);
+}
+
+static int
+bench_find_p(bench_state* state, bench_result* result)
+{
+  return bench_find_pattern(state, result, 2);
+}
+
+static int
+bench_find_o(bench_state* state, bench_result* result)
+{
+  return bench_find_pattern(state, result, 1);
+}
+
+
+static int
+bench_count_iterator(bench_result* result, librdf_iterator* iterator)
+{
+  if(!iterator)
+    return 1;
+
+  while(!librdf_iterator_end(iterator)) {
+    result->items++;
+    librdf_iterator_next(iterator);
+  }
+  librdf_free_iterator(iterator);
+
+  return 0;
+}
+
+
+static int
+bench_targets(bench_state* state, bench_result* result)
+{
+  int n;
+
+  for(n = 0; n < state->lookups; n++) {
+    int i = bench_random(state, state->triples);
+    librdf_node* subject;
+    librdf_node* predicate;
+    double start;
+    int rc;
+
+    subject = bench_new_subject(state, i / BENCH_SUBJECT_TRIPLES);
+    predicate = bench_new_predicate(state, i % BENCH_PREDICATES);
+
+    start = bench_now();
+    rc = bench_count_iterator(result, librdf_model_get_targets(state->model,
+                                                               subject,
+                                                               predicate));
+    bench_result_add(result, bench_now() - start);
+
+    librdf_free_node(subject);
+    librdf_free_node(predicate);
+    if(rc)
+      return 1;
+  }
+
+  return 0;
+}
+
+
+static int
+bench_sources(bench_state* state, bench_result* result)
+{
+  int n;
+
+  for(n = 0; n < state->lookups; n++) {
+    int i = bench_random(state, state->triples);
+    librdf_node* predicate;
+    librdf_node* object;
+    double start;
+    int rc;
+
+    predicate = bench_new_predicate(state, i % BENCH_PREDICATES);
+    object = bench_new_object(state, i);
+
+    start = bench_now();
+    rc = bench_count_iterator(result, librdf_model_get_sources(state->model,
+                                                               predicate,
+                                                               object));
+    bench_result_add(result, bench_now() - start);
+
+    librdf_free_node(predicate);
+    librdf_free_node(object);
+    if(rc)
+      return 1;
+  }
+
+  return 0;
+}
+
+
+static int
+bench_serialize(bench_state* state, bench_result* result)
+{
+  librdf_serializer* serializer;
+  raptor_iostream* iostr;
+  double start;
+  int rc;
+
+  serializer = librdf_new_serializer(state->world, "ntriples", NULL, NULL);
+  if(!serializer)
+    return 1;
+
+  /* throw the output away so only the serializing is measured */
+  iostr = raptor_new_iostream_to_sink(librdf_world_get_raptor(state->world));
+  if(!iostr) {
+    librdf_free_serializer(serializer);
+    return 1;
+  }
+
+  start = bench_now();
+  rc = librdf_serializer_serialize_model_to_iostream(serializer, NULL,
+                                                     state->model, iostr);
+  bench_result_add(result, bench_now() - start);
+  result->items = state->triples;
+
+  raptor_free_iostream(iostr);
+  librdf_free_serializer(serializer);
+
+  return rc;
+}
+
+
+/* Stream map keeping statements with the given predicate */
+static librdf_statement*
+bench_filter_predicate(librdf_stream* stream, void* map_context,
+                       librdf_statement* statement)
+{
+  librdf_node* predicate = (librdf_node*)map_context;
+
+  if(!librdf_node_equals(librdf_statement_get_predicate(statement), predicate))
+    return NULL;
+
+  return statement;
+}
+
+
+/* Stream map passing every statement on, standing in for a second
+ * stage of a map pipeline */
+static librdf_statement*
+bench_filter_pass(librdf_stream* stream, void* map_context,
+                  librdf_statement* statement)
+{
+  return statement;
+}
+
+
+/* Time streaming the whole store through a two stage map pipeline */
+static int
+bench_filter(bench_state* state, bench_result* result)
+{
+  librdf_node* predicate;
+  librdf_stream* stream;
+  double start;
+  int rc = 0;
+
+  predicate = bench_new_predicate(state, 0);
+  if(!predicate)
+    return 1;
+
+  start = bench_now();
+  stream = librdf_model_as_stream(state->model);
+  if(!stream ||
+     librdf_stream_add_map(stream, bench_filter_predicate, NULL, predicate) ||
+     librdf_stream_add_map(stream, bench_filter_pass, NULL, NULL))
+    rc = 1;
+  else {
+    while(!librdf_stream_end(stream)) {
+      result->items++;
+      librdf_stream_next(stream);
+    }
+  }
+  if(stream)
+    librdf_free_stream(stream);
+  bench_result_add(result, bench_now() - start);
+
+  librdf_free_node(predicate);
+
+  return rc;
+}
+
+
+/* Fixed SPARQL query mix; %d is replaced by a random subject number */
+static const char* const bench_queries[] = {
+  "SELECT ?p ?o WHERE { <" BENCH_NS "s%d> ?p ?o }",
+  "SELECT ?s WHERE { ?s <" BENCH_NS "p0> <" BENCH_NS "s%d> }",
+  "SELECT ?s ?o WHERE { <" BENCH_NS "s%d> <" BENCH_NS "p0> ?s . ?s <" BENCH_NS "p1> ?o }",
+  "SELECT ?s WHERE { ?s <" BENCH_NS "p2> ?v . FILTER(STR(?v) = \"v%d\") } LIMIT 10",
+  "SELECT DISTINCT ?o WHERE { <" BENCH_NS "s%d> ?p ?o } ORDER BY ?o"
+};
+
+#define BENCH_QUERIES_COUNT (int)(sizeof(bench_queries) / sizeof(bench_queries[0]))
+
+
+static int
+bench_sparql(bench_state* state, bench_result* result)
+{
+  int n;
+
+  for(n = 0; n < state->lookups; n++) {
+    int q = n % BENCH_QUERIES_COUNT;
+    char query_string[256];
+    librdf_query* query;
+    librdf_query_results* results;
+    double start;
+
+    sprintf(query_string, bench_queries[q],
+            bench_random(state, state->subjects));
+
+    start = bench_now();
+    query = librdf_new_query(state->world, "sparql", NULL,
+                             (const unsigned char*)query_string, NULL);
+    if(!query) {
+      fprintf(stderr, "%s: Failed to create query %s\n", program,
+              query_string);
+      return 1;
+    }
+
+    results = librdf_model_query_execute(state->model, query);
+    if(!results) {
+      fprintf(stderr, "%s: Failed to execute query %s\n", program,
+              query_string);
+      librdf_free_query(query);
+      return 1;
+    }
+
+    while(!librdf_query_results_finished(results)) {
+      result->items++;
+      librdf_query_results_next(results);
+    }
+    librdf_free_query_results(results);
+    librdf_free_query(query);
+
+    bench_result_add(result, bench_now() - start);
+  }
+
+  return 0;
+}
+
+
+/* Apply LOOKUPS removals of loaded triples and additions of new ones
+ * to model, timing each
+ */
+static int
+bench_change(bench_state* state, bench_result* result, librdf_model* model)
+{
+  int n;
+
+  for(n = 0; n < state->lookups; n++) {
+    librdf_statement* removed;
+    librdf_statement* added;
+    double start;
+    int rc;
+
+    removed = bench_new_statement(state,
+                                  (int)(((long)n * BENCH_CHANGE_STRIDE) % state->triples));
+    added = bench_new_statement(state, state->triples + n);
+    if(!removed || !added) {
+      if(removed)
+        librdf_free_statement(removed);
+      if(added)
+        librdf_free_statement(added);
+      return 1;
+    }
+
+    start = bench_now();
+    rc = librdf_model_remove_statement(model, removed) ||
+         librdf_model_add_statement(model, added);
+    bench_result_add(result, bench_now() - start);
+
+    librdf_free_statement(removed);
+    librdf_free_statement(added);
+    if(rc)
+      return 1;
+    result->items++;
+  }
+
+  return 0;
+}
+
+
+static librdf_model*
+bench_new_memory_model(bench_state* state)
+{
+  librdf_storage* storage;
+  librdf_model* model;
+
+  storage = librdf_new_storage(state->world, "hashes", NULL,
+                               "hash-type='memory'");
+  if(!storage)
+    return NULL;
+
+  model = librdf_new_model(state->world, storage, NULL);
+  /* the model holds a reference if it was made */
+  librdf_free_storage(storage);
+
+  return model;
+}
+
+
+/* Time a CONSTRUCT query copying the whole store into a new model */
+static int
+bench_construct(bench_state* state, bench_result* result)
+{
+  librdf_query* query;
+  librdf_query_results* results;
+  librdf_model* model;
+  double start;
+  int rc;
+
+  model = bench_new_memory_model(state);
+  if(!model)
+    return 1;
+
+  start = bench_now();
+  query = librdf_new_query(state->world, "sparql", NULL,
+                           (const unsigned char*)"CONSTRUCT { ?s ?p ?o } WHERE { ?s ?p ?o }",
+                           NULL);
+  if(!query) {
+    fprintf(stderr, "%s: Failed to create CONSTRUCT query\n", program);
+    librdf_free_model(model);
+    return 1;
+  }
+
+  results = librdf_model_query_execute(state->model, query);
+  rc = !results || librdf_query_results_add_to_model(results, model);
+  if(results)
+    librdf_free_query_results(results);
+  librdf_free_query(query);
+  bench_result_add(result, bench_now() - start);
+
+  if(rc)
+    fprintf(stderr, "%s: Failed to run CONSTRUCT query\n", program);
+  else
+    result->items = librdf_model_size(model);
+
+  librdf_free_model(model);
+
+  return rc;
+}
+
+
+/* Time layering an overlay model with in-memory changes over the
+ * loaded model (first operation) and then making the changes
+ */
+static int
+bench_overlay_create(bench_state* state, bench_result* result)
+{
+  librdf_storage* storage;
+  double start;
+
+  if(state->overlay) {
+    librdf_free_model(state->overlay);
+    state->overlay = NULL;
+  }
+
+  start = bench_now();
+  storage = librdf_new_storage(state->world, "hashes", NULL,
+                               "hash-type='memory'");
+  if(storage) {
+    state->overlay = librdf_new_model_overlay(state->world, state->model,
+                                              storage, NULL);
+    librdf_free_storage(storage);
+  }
+  bench_result_add(result, bench_now() - start);
+
+  if(!state->overlay) {
+    fprintf(stderr, "%s: Failed to create overlay model\n", program);
+    return 1;
+  }
+
+  return bench_change(state, result, state->overlay);
+}
+
+
+/* Time copying the loaded model into memory (first operation) and then
+ * making the same changes as overlay-create
+ */
+static int
+bench_copy_create(bench_state* state, bench_result* result)
+{
+  librdf_stream* stream;
+  double start;
+  int rc = 1;
+
+  if(state->copy) {
+    librdf_free_model(state->copy);
+    state->copy = NULL;
+  }
+
+  start = bench_now();
+  state->copy = bench_new_memory_model(state);
+  if(state->copy) {
+    stream = librdf_model_as_stream(state->model);
+    if(stream) {
+      rc = librdf_model_add_statements(state->copy, stream);
+      librdf_free_stream(stream);
+    }
+  }
+  bench_result_add(result, bench_now() - start);
+
+  if(rc) {
+    fprintf(stderr, "%s: Failed to copy model\n", program);
+    return 1;
+  }
+  result->items = state->triples;
+
+  return bench_change(state, result, state->copy);
+}
+
+
+static int
+bench_overlay_find(bench_state* state, bench_result* result)
+{
+  if(!state->overlay) {
+    bench_result unused;
+    int rc;
+
+    memset(&unused, '\0', sizeof(unused));
+    rc = bench_overlay_create(state, &unused);
+    free(unused.latencies);
+    if(rc)
+      return 1;
+  }
+
+  return bench_find_pattern_in_model(state, result, state->overlay, 4);
+}
+
+
+static int
+bench_copy_find(bench_state* state, bench_result* result)
+{
+  if(!state->copy) {
+    bench_result unused;
+    int rc;
+
+    memset(&unused, '\0', sizeof(unused));
+    rc = bench_copy_create(state, &unused);
+    free(unused.latencies);
+    if(rc)
+      return 1;
+  }
+
+  return bench_find_pattern_in_model(state, result, state->copy, 4);
+}
+
+
+static librdf_statement*
+bench_new_skewed_statement(bench_state* state, int i, int predicate)
+{
+  char buffer[64];
+  librdf_node* subject;
+  librdf_node* object;
+
+  sprintf(buffer, BENCH_NS "k%d", i);
+  subject = librdf_new_node_from_uri_string(state->world,
+                                            (const unsigned char*)buffer);
+  sprintf(buffer, BENCH_NS "class%d", i % BENCH_SKEW_CLASSES);
+  object = librdf_new_node_from_uri_string(state->world,
+                                           (const unsigned char*)buffer);
+
+  return librdf_new_statement_from_nodes(state->world, subject,
+                                         bench_new_predicate(state, BENCH_PREDICATES + predicate),
+                                         object);
+}
+
+
+/* Time adding LOOKUPS new triples one at a time to the loaded store,
+ * encoding each into every index.  Removes them afterwards (untimed)
+ * so leaves the store as loaded.
+ */
+static int
+bench_add(bench_state* state, bench_result* result)
+{
+  int n;
+  int rc = 0;
+
+  for(n = 0; n < state->lookups; n++) {
+    librdf_statement* statement;
+    double start;
+
+    statement = bench_new_statement(state, state->triples + n);
+    if(!statement)
+      return 1;
+
+    start = bench_now();
+    rc = librdf_model_add_statement(state->model, statement);
+    bench_result_add(result, bench_now() - start);
+
+    librdf_free_statement(statement);
+    if(rc) {
+      fprintf(stderr, "%s: Failed to add triple %d\n", program,
+              state->triples + n);
+      return 1;
+    }
+    result->items++;
+  }
+
+  for(n = 0; n < state->lookups; n++) {
+    librdf_statement* statement;
+
+    statement = bench_new_statement(state, state->triples + n);
+    if(!statement)
+      return 1;
+    rc = librdf_model_remove_statement(state->model, statement);
+    librdf_free_statement(statement);
+    if(rc)
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/* Time removing triples whose predicates (and objects) have a very
+ * uneven number of triples, so a few (P, O) and P keys fan out to
+ * most of them.  Removes oldest first.  Leaves the store as loaded.
+ */
+static int
+bench_remove_skewed(bench_state* state, bench_result* result)
+{
+  int count = state->lookups * BENCH_SKEW_TRIPLES;
+  int* predicates;
+  int i;
+  int rc = 0;
+
+  predicates = (int*)malloc(count * sizeof(int));
+  if(!predicates)
+    return 1;
+
+  for(i = 0; i < count; i++) {
+    librdf_statement* statement;
+    int predicate = 0;
+
+    while(predicate < BENCH_SKEW_PREDICATES - 1 && bench_random(state, 2))
+      predicate++;
+    predicates[i] = predicate;
+
+    statement = bench_new_skewed_statement(state, i, predicate);
+    if(!statement || librdf_model_add_statement(state->model, statement)) {
+      fprintf(stderr, "%s: Failed to add skewed triple %d\n", program, i);
+      if(statement)
+        librdf_free_statement(statement);
+      free(predicates);
+      return 1;
+    }
+    librdf_free_statement(statement);
+  }
+
+  for(i = 0; i < count; i++) {
+    librdf_statement* statement;
+    double start;
+
+    statement = bench_new_skewed_statement(state, i, predicates[i]);
+    if(!statement) {
+      rc = 1;
+      break;
+    }
+
+    start = bench_now();
+    rc = librdf_model_remove_statement(state->model, statement);
+    bench_result_add(result, bench_now() - start);
+
+    librdf_free_statement(statement);
+    if(rc) {
+      fprintf(stderr, "%s: Failed to remove skewed triple %d\n", program, i);
+      break;
+    }
+    result->items++;
+  }
+
+  free(predicates);
+
+  return rc;
+}
+
+
+static int
+bench_drop_contexts(bench_state* state, bench_result* result)
+{
+  int i;
+
+  for(i = 0; i < BENCH_CONTEXTS; i++) {
+    librdf_node* context;
+    double start;
+    int rc;
+
+    context = bench_new_context(state, i);
+    if(!context)
+      return 1;
+
+    start = bench_now();
+    rc = librdf_model_context_remove_statements(state->model, context);
+    bench_result_add(result, bench_now() - start);
+
+    librdf_free_node(context);
+    if(rc)
+      return 1;
+  }
+  result->items = state->triples;
+
+  return 0;
+}
+
+
+/* in order; load must be first and drop-contexts empties the store */
+static const bench_workload bench_workloads[] = {
+  { "load",           "Add triples (-s: as streams)", bench_load, 0 },
+  { "find-spo",       "Find (S, P, O)",               bench_find_spo, 0 },
+  { "find-sp",        "Find (S, P, ?)",               bench_find_sp, 0 },
+  { "find-so",        "Find (S, ?, O)",               bench_find_so, 0 },
+  { "find-s",         "Find (S, ?, ?)",               bench_find_s, 0 },
+  { "find-po",        "Find (?, P, O)",               bench_find_po, 0 },
+  { "find-p",         "Find (?, P, ?)",               bench_find_p, 0 },
+  { "find-o",         "Find (?, ?, O)",               bench_find_o, 0 },
+  { "targets",        "Get targets of (S, P)",        bench_targets, 0 },
+  { "sources",        "Get sources of (P, O)",        bench_sources, 0 },
+  { "serialize",      "Serialize graph as N-Triples", bench_serialize, 0 },
+  { "filter",         "Stream the store via 2 maps",  bench_filter, 0 },
+  { "sparql",         "Fixed SPARQL query mix",       bench_sparql, 0 },
+  { "construct",      "CONSTRUCT copy of the store",  bench_construct, 0 },
+  { "overlay-create", "Layer changes over the store", bench_overlay_create, 0 },
+  { "overlay-find",   "Find (S, ?, ?) in overlay",    bench_overlay_find, 0 },
+  { "copy-create",    "Copy the store and change it", bench_copy_create, 0 },
+  { "copy-find",      "Find (S, ?, ?) in the copy",   bench_copy_find, 0 },
+  { "add",            "Add new triples one by one",   bench_add, 0 },
+  { "remove-skewed",  "Remove skewed triples",        bench_remove_skewed, 0 },
+  { "drop-contexts",  "Remove each context",          bench_drop_contexts, 1 },
+  { NULL, NULL, NULL, 0 }
+};
+
+
+static int
+bench_compare_double(const void* a, const void* b)
+{
+  double da = *(const double*)a;
+  double db = *(const double*)b;
+
+  return (da < db) ? -1 : ((da > db) ? 1 : 0);
+}
+
+
+/* Latency percentile in microseconds; latencies must be sorted */
+static double
+bench_percentile(bench_result* result, int percent)
+{
+  int i;
+
+  if(!result->count)
+    return 0.0;
+
+  i = (result->count * percent + 99) / 100 - 1;
+  if(i < 0)
+    i = 0;
+  return result->latencies[i] * 1000000.0;
+}
+
+
+static void
+bench_print_json_string(FILE* fh, const char* string)
+{
+  fputc('"', fh);
+  for(; string && *string; string++) {
+    if(*string == '"' || *string == '\\')
+      fputc('\\', fh);
+    fputc(*string, fh);
+  }
+  fputc('"', fh);
+}
+
+
+static void
+bench_print_result(FILE* fh, bench_result* result)
+{
+  double ops_per_second = 0.0;
+  double items_per_second = 0.0;
+
+  qsort(result->latencies, result->count, sizeof(double),
+        bench_compare_double);
+
+  if(result->seconds > 0.0) {
+    ops_per_second = (double)result->count / result->seconds;
+    items_per_second = (double)result->items / result->seconds;
+  }
+
+  fputs("    {\"name\": ", fh);
+  bench_print_json_string(fh, result->name);
+  fprintf(fh, ", \"operations\": %d, \"items\": %lu, \"seconds\": %.6f,\n",
+          result->count, result->items, result->seconds);
+  fprintf(fh, "     \"operations_per_second\": %.1f, \"items_per_second\": %.1f,\n",
+          ops_per_second, items_per_second);
+  fprintf(fh, "     \"latency_us\": {\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f}}",
+          bench_percentile(result, 50), bench_percentile(result, 90),
+          bench_percentile(result, 99), bench_percentile(result, 100));
+}
+
+
+static int
+bench_workload_selected(const char* workloads, const char* name)
+{
+  size_t len = strlen(name);
+  const char* p;
+
+  if(!workloads)
+    return 1;
+
+  for(p = workloads; (p = strstr(p, name)); p++) {
+    if((p == workloads || p[-1] == ',') && (!p[len] || p[len] == ','))
+      return 1;
+  }
+
+  return 0;
+}
+
+
+static void
+bench_usage(void)
+{
+  int i;
+
+  fprintf(stderr, "USAGE: %s [-n TRIPLES] [-l LOOKUPS] [-s] [-w WORKLOAD,...] STORAGE-NAME [STORAGE-OPTIONS [IDENTIFIER]]\n", program);
+  fprintf(stderr, "Workloads:\n");
+  for(i = 0; bench_workloads[i].name; i++)
+    fprintf(stderr, "  %-14s  %s%s\n", bench_workloads[i].name,
+            bench_workloads[i].label,
+            bench_workloads[i].needs_contexts ? " (needs contexts)" : "");
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  bench_state state;
+  bench_result* results = NULL;
+  int results_count = 0;
+  const char* storage_name;
+  const char* storage_options = NULL;
+  const char* identifier = "redland-bench";
+  const char* workloads = NULL;
+  librdf_hash* options = NULL;
+  int i;
+  int rc = 0;
+
+  program = argv[0];
+
+  memset(&state, '\0', sizeof(state));
+  state.triples = BENCH_DEFAULT_TRIPLES;
+  state.lookups = BENCH_DEFAULT_LOOKUPS;
+  state.seed = 1;
+
+  for(i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+    if(!strcmp(argv[i], "-s")) {
+      state.stream_load = 1;
+      continue;
+    }
+
+    if(i + 1 == argc) {
+      bench_usage();
+      return(1);
+    }
+
+    if(!strcmp(argv[i], "-n"))
+      state.triples = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "-l"))
+      state.lookups = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "-w"))
+      workloads = argv[++i];
+    else {
+      bench_usage();
+      return(1);
+    }
+  }
+
+  if(i == argc || argc - i > 3 || state.triples < BENCH_SUBJECT_TRIPLES ||
+     state.lookups < 1) {
+    bench_usage();
+    return(1);
+  }
+
+  storage_name = argv[i++];
+  if(i < argc)
+    storage_options = argv[i++];
+  if(i < argc)
+    identifier = argv[i++];
+
+  state.subjects = state.triples / BENCH_SUBJECT_TRIPLES;
+
+  state.world = librdf_new_world();
+  librdf_world_open(state.world);
+
+  options = librdf_new_hash_from_string(state.world, NULL, storage_options);
+  if(!options) {
+    fprintf(stderr, "%s: Bad storage options '%s'\n", program,
+            storage_options);
+    rc = 1;
+    goto tidy;
+  }
+  /* always start from an empty store */
+  librdf_hash_put_strings(options, "new", "yes");
+  librdf_hash_put_strings(options, "write", "yes");
+
+  state.storage = librdf_new_storage_with_options(state.world, storage_name,
+                                                  identifier, options);
+  if(!state.storage) {
+    fprintf(stderr, "%s: Failed to open %s storage '%s'\n", program,
+            storage_name, identifier);
+    rc = 1;
+    goto tidy;
+  }
+
+  state.model = librdf_new_model(state.world, state.storage, NULL);
+  if(!state.model) {
+    fprintf(stderr, "%s: Failed to create model\n", program);
+    rc = 1;
+    goto tidy;
+  }
+  state.contexts = librdf_model_supports_contexts(state.model);
+
+  results = (bench_result*)calloc(sizeof(bench_workloads) /
+                                  sizeof(bench_workloads[0]),
+                                  sizeof(bench_result));
+  if(!results) {
+    rc = 1;
+    goto tidy;
+  }
+
+  for(i = 0; bench_workloads[i].name; i++) {
+    const bench_workload* workload = &bench_workloads[i];
+    bench_result* result;
+
+    /* everything else needs the triples so always load */
+    if(i && !bench_workload_selected(workloads, workload->name))
+      continue;
+    if(workload->needs_contexts && !state.contexts)
+      continue;
+
+    result = &results[results_count++];
+    result->name = workload->name;
+
+    fprintf(stderr, "%s: Running %s\n", program, workload->name);
+    if(workload->fn(&state, result)) {
+      fprintf(stderr, "%s: Workload %s failed\n", program, workload->name);
+      rc = 1;
+      break;
+    }
+  }
+
+  fputs("{\"storage\": ", stdout);
+  bench_print_json_string(stdout, storage_name);
+  fputs(", \"options\": ", stdout);
+  bench_print_json_string(stdout, storage_options);
+  fprintf(stdout, ", \"version\": \"%s\",\n", librdf_version_string);
+  fprintf(stdout, " \"triples\": %d, \"lookups\": %d, \"contexts\": %s,\n",
+          state.triples, state.lookups, state.contexts ? "true" : "false");
+  fputs(" \"workloads\": [\n", stdout);
+  for(i = 0; i < results_count; i++) {
+    bench_print_result(stdout, &results[i]);
+    fputs((i + 1 < results_count) ? ",\n" : "\n", stdout);
+  }
+  fputs(" ],\n", stdout);
+  fprintf(stdout, " \"peak_rss_kb\": %ld}\n", bench_peak_rss_kb());
+
+  tidy:
+  if(state.overlay)
+    librdf_free_model(state.overlay);
+  if(state.copy)
+    librdf_free_model(state.copy);
+  if(results) {
+    for(i = 0; i < results_count; i++)
+      free(results[i].latencies);
+    free(results);
+  }
+  if(state.model)
+    librdf_free_model(state.model);
+  if(state.storage)
+    librdf_free_storage(state.storage);
+  if(options)
+    librdf_free_hash(options);
+  librdf_free_world(state.world);
+
+  return(rc);
+}
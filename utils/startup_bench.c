@@ -0,0 +1,134 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * startup_bench.c - Time Redland world creation and opening
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ * 
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ * 
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ * 
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ * 
+ * 
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <rdf_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rdf_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#include <sys/time.h>
+
+#include <redland.h>
+
+
+/* one prototype needed */
+int main(int argc, char *argv[]);
+
+
+static double
+startup_bench_now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+}
+
+
+int
+main(int argc, char *argv[]) 
+{
+  const char *program = argv[0];
+  const char *storage_name = NULL;
+  int iterations = 100;
+  int i;
+  double start_time;
+  double world_time = 0.0;
+  double open_time = 0.0;
+  double storage_time = 0.0;
+
+  if(argc > 3) {
+    fprintf(stderr, "USAGE: %s [ITERATIONS [STORAGE-NAME]]\n", program);
+    return(1);
+  }
+
+  if(argc > 1) {
+    iterations = atoi(argv[1]);
+    if(iterations < 1) {
+      fprintf(stderr, "%s: Bad iterations count '%s'\n", program, argv[1]);
+      return(1);
+    }
+  }
+
+  /* Optionally also time the first use of a storage, which is where
+   * a modular build loads that storage's module.
+   */
+  if(argc > 2)
+    storage_name = argv[2];
+
+  for(i = 0; i < iterations; i++) {
+    librdf_world *world;
+
+    start_time = startup_bench_now();
+    world = librdf_new_world();
+    if(!world) {
+      fprintf(stderr, "%s: Failed to create world\n", program);
+      return(1);
+    }
+    world_time += startup_bench_now() - start_time;
+
+    start_time = startup_bench_now();
+    librdf_world_open(world);
+    open_time += startup_bench_now() - start_time;
+
+    if(storage_name) {
+      librdf_storage *storage;
+
+      start_time = startup_bench_now();
+      storage = librdf_new_storage(world, storage_name, NULL, NULL);
+      storage_time += startup_bench_now() - start_time;
+      if(!storage) {
+        fprintf(stderr, "%s: Failed to create storage '%s'\n", program,
+                storage_name);
+        librdf_free_world(world);
+        return(1);
+      }
+      librdf_free_storage(storage);
+    }
+
+    librdf_free_world(world);
+  }
+
+  fprintf(stdout, "%s: %d iterations\n", program, iterations);
+  fprintf(stdout, "%s: librdf_new_world   %10.1f usec\n", program,
+          world_time * 1000000.0 / iterations);
+  fprintf(stdout, "%s: librdf_world_open  %10.1f usec\n", program,
+          open_time * 1000000.0 / iterations);
+  if(storage_name)
+    fprintf(stdout, "%s: new storage %-7s %10.1f usec\n", program,
+            storage_name, storage_time * 1000000.0 / iterations);
+
+#ifdef LIBRDF_MEMORY_DEBUG
+  librdf_memory_report(stderr);
+#endif
+	
+  /* keep gcc -Wall happy */
+  return(0);
+}